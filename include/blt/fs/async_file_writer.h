@@ -0,0 +1,147 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_FS_ASYNC_FILE_WRITER_H
+#define BLT_FS_ASYNC_FILE_WRITER_H
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <blt/fs/file_writers.h>
+
+namespace blt::fs
+{
+	namespace detail
+	{
+		class async_backend_t;
+	}
+
+	enum class async_backend_type_t
+	{
+		// io_uring when the kernel supports it, otherwise the thread pool
+		AUTO,
+		IO_URING,
+		THREAD_POOL
+	};
+
+	/**
+	* fwriter_t which does not block the caller on the disk. Writes are collected into one of two page aligned buffers; once a buffer fills
+	* it is handed to the kernel through io_uring (or to a small pool of I/O threads shared by all writers) while the other buffer keeps
+	* accepting writes. The caller only waits if it gets a whole buffer ahead of the disk.
+	*
+	* Only one buffer is in flight at a time so the file always sees the writes in order. Like the other writers this is not thread safe,
+	* wrap it in a concurrent_file_writer when several threads write to it.
+	*/
+	class async_file_writer_t final : public fwriter_t
+	{
+	public:
+		static constexpr size_t DEFAULT_BUFFER_SIZE = 1024 * 1024;
+
+		/**
+		* @param name file to append to
+		* @param buffer_size size of each of the two buffers, rounded up to a whole number of pages
+		* @throws std::runtime_error if the file cannot be opened or the requested backend is not available
+		*/
+		explicit async_file_writer_t(const std::string& name, size_t buffer_size = DEFAULT_BUFFER_SIZE,
+									async_backend_type_t backend = async_backend_type_t::AUTO);
+
+		// create a writer without opening a file, for use with bounded_writer and rotating_writer. Writing without calling newfile is UB
+		explicit async_file_writer_t(size_t buffer_size = DEFAULT_BUFFER_SIZE, async_backend_type_t backend = async_backend_type_t::AUTO);
+
+		~async_file_writer_t() override;
+
+		i64 write(const char* buffer, size_t bytes) override;
+
+		/**
+		* Submits everything buffered and waits until it has been written to the file
+		*/
+		void flush() override;
+
+		void newfile(const std::string& new_name) override;
+
+		/**
+		* Submits everything written so far without waiting for it
+		* @return ticket which completes once all of those bytes have been written to the file
+		*/
+		u64 fence();
+
+		/**
+		* Checks on the write in flight without blocking, submitting the fenced bytes if they were waiting on it
+		*/
+		[[nodiscard]] bool is_complete(u64 ticket);
+
+		void wait(u64 ticket);
+
+		/**
+		* @return errno of the last failed write to the current file, or 0. The bytes of a failed write are dropped.
+		*/
+		[[nodiscard]] int error() const
+		{
+			return m_error;
+		}
+
+		[[nodiscard]] bool uses_io_uring() const
+		{
+			return m_uses_io_uring;
+		}
+
+	private:
+		struct free_deleter_t
+		{
+			void operator()(char* ptr) const
+			{
+				std::free(ptr);
+			}
+		};
+
+		/**
+		* Collects the result of the write in flight and resubmits the rest after a short write
+		* @return true if nothing is in flight anymore
+		*/
+		bool reap(bool block);
+
+		void submit_active();
+
+		void progress(bool block);
+
+		std::unique_ptr<detail::async_backend_t> m_backend;
+		bool m_uses_io_uring = false;
+		std::unique_ptr<char, free_deleter_t> m_storage;
+		char* m_buffers[2]{};
+		size_t m_buffer_size;
+		size_t m_active = 0;
+		size_t m_active_size = 0;
+
+		int m_fd = -1;
+		u64 m_offset = 0;
+		int m_error = 0;
+
+		bool m_in_flight = false;
+		const char* m_flight_data = nullptr;
+		size_t m_flight_remaining = 0;
+		u64 m_flight_offset = 0;
+
+		// byte counts since construction, tickets are values of m_accepted
+		u64 m_accepted = 0;
+		u64 m_submitted = 0;
+		u64 m_completed = 0;
+		u64 m_fenced = 0;
+	};
+}
+
+#endif //BLT_FS_ASYNC_FILE_WRITER_H
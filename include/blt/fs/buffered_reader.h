@@ -0,0 +1,105 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_FS_BUFFERED_READER_H
+#define BLT_FS_BUFFERED_READER_H
+
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <blt/fs/fwddecl.h>
+
+namespace blt::fs
+{
+	/**
+	* reader_t which reads ahead from another reader in large blocks, so many small reads cost a memcpy instead of a virtual call into the
+	* backend each. Fixed size values can be read through the inline read_value(), which only leaves the header when the buffer runs dry.
+	* reader_serializer_t uses it automatically when handed a buffered_reader_t.
+	*
+	* The wrapped reader must outlive this one, and should not be read from directly while this one is in use.
+	*/
+	class buffered_reader_t final : public reader_t
+	{
+	public:
+		// matches buffered_writer
+		static constexpr size_t DEFAULT_BUFFER_SIZE = 128 * 1024;
+
+		explicit buffered_reader_t(reader_t& reader, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+		i64 read(char* buffer, size_t bytes) override;
+
+		/**
+		* Reads one trivially copyable value
+		* @return false if the reader ended before the whole value was read
+		*/
+		template <typename T>
+		bool read_value(T& out)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable types can be read directly!");
+			if (m_end - m_pos >= sizeof(T))
+			{
+				std::memcpy(&out, m_buffer.data() + m_pos, sizeof(T));
+				m_pos += sizeof(T);
+				return true;
+			}
+			return read_slow(reinterpret_cast<char*>(&out), sizeof(T)) == sizeof(T);
+		}
+
+		/**
+		* Looks at the next bytes without consuming them, refilling the buffer if needed.
+		* @param bytes number of bytes wanted, at most the buffer size
+		* @return view valid until the next read, peek or skip. Shorter than asked for if the reader ends first.
+		*/
+		std::string_view peek(size_t bytes);
+
+		/**
+		* Discards the next bytes
+		* @return number of bytes skipped, less than asked for if the reader ended
+		*/
+		size_t skip(size_t bytes);
+
+		// bytes which can be read without touching the wrapped reader
+		[[nodiscard]] size_t available() const
+		{
+			return m_end - m_pos;
+		}
+
+		[[nodiscard]] size_t buffer_size() const
+		{
+			return m_buffer.size();
+		}
+
+	private:
+		size_t read_slow(char* buffer, size_t bytes);
+
+		/**
+		* Moves the unread bytes to the front of the buffer and reads after them until at least `wanted` bytes are buffered or the
+		* wrapped reader ends
+		*/
+		void fill(size_t wanted);
+
+		reader_t* m_reader;
+		std::vector<char> m_buffer;
+		size_t m_pos = 0;
+		size_t m_end = 0;
+		bool m_eof = false;
+	};
+}
+
+#endif //BLT_FS_BUFFERED_READER_H
@@ -21,6 +21,8 @@
 
 #include <blt/std/types.h>
 #include <cstdio>
+#include <optional>
+#include <string_view>
 
 namespace blt::fs
 {
@@ -49,6 +51,25 @@ namespace blt::fs
 		{
 			return this->read(static_cast<char*>(buffer), bytes);
 		}
+
+		/**
+		* Zero copy read for readers backed by memory. Hands out a view of the next bytes and advances past them.
+		* The view stays valid for the lifetime of the reader.
+		* @param bytes number of bytes wanted, the view is shorter if the end of the data is reached first
+		* @return view of the bytes, or an empty optional if this reader only supports copying reads
+		*/
+		virtual std::optional<std::string_view> read_view(size_t)
+		{
+			return {};
+		}
+
+		/**
+		* @return true if read_view() can be used in place of read()
+		*/
+		[[nodiscard]] virtual bool supports_views() const
+		{
+			return false;
+		}
 	};
 
 	/**
@@ -0,0 +1,100 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_FS_MMAP_READER_H
+#define BLT_FS_MMAP_READER_H
+
+#include <string>
+#include <blt/fs/fwddecl.h>
+
+namespace blt::fs
+{
+	/**
+	* reader_t over a read only memory mapping of a file. Besides copying reads it hands out views directly into the mapping.
+	* The whole file is mapped up front but only the pages which are touched get loaded, so files larger than RAM work (on 64-bit platforms).
+	* Pages ahead of the read position are requested from the kernel as reading progresses.
+	*/
+	class mmap_reader_t final : public reader_t
+	{
+	public:
+		// how far ahead of the read position pages are requested
+		static constexpr size_t DEFAULT_READ_AHEAD = 4 * 1024 * 1024;
+
+		/**
+		* @throws std::runtime_error if the file cannot be opened or mapped
+		*/
+		explicit mmap_reader_t(const std::string& path, size_t read_ahead = DEFAULT_READ_AHEAD);
+
+		mmap_reader_t(mmap_reader_t&& move) noexcept;
+
+		mmap_reader_t& operator=(mmap_reader_t&& move) noexcept;
+
+		~mmap_reader_t() override;
+
+		i64 read(char* buffer, size_t bytes) override;
+
+		std::optional<std::string_view> read_view(size_t bytes) override;
+
+		[[nodiscard]] bool supports_views() const override
+		{
+			return true;
+		}
+
+		/**
+		* @return view of the entire file, independent of the read position
+		*/
+		[[nodiscard]] std::string_view data() const
+		{
+			return {m_data, m_size};
+		}
+
+		[[nodiscard]] size_t size() const
+		{
+			return m_size;
+		}
+
+		[[nodiscard]] size_t position() const
+		{
+			return m_pos;
+		}
+
+		[[nodiscard]] size_t remaining() const
+		{
+			return m_size - m_pos;
+		}
+
+		/**
+		* Moves the read position, clamped to the end of the file
+		*/
+		void seek(size_t position);
+
+	private:
+		void advance(size_t bytes);
+
+		void release();
+
+		const char* m_data = nullptr;
+		size_t m_size = 0;
+		size_t m_pos = 0;
+		// everything before this has already been requested from the kernel
+		size_t m_advised = 0;
+		size_t m_read_ahead;
+	};
+}
+
+#endif //BLT_FS_MMAP_READER_H
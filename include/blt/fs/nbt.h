@@ -9,6 +9,8 @@
 
 #include <utility>
 #include <cstring>
+#include <stdexcept>
+#include <vector>
 #include <type_traits>
 #include <unordered_map>
 #include <algorithm>
@@ -40,6 +42,48 @@ namespace blt::nbt {
         mem::fromBytes(data, &d);
     }
     
+    /**
+     * Writes the length prefixed payload of an array tag, converting to big endian in chunks instead of one write per element
+     */
+    template<typename T>
+    inline static void writeArray(blt::fs::writer_t& out, const std::vector<T>& values) {
+        constexpr size_t chunk = 16384 / sizeof(T);
+        auto length = (int32_t) values.size();
+        writeData(out, length);
+        T buffer[chunk];
+        for (size_t i = 0; i < values.size(); i += chunk) {
+            const auto amount = std::min(chunk, values.size() - i);
+            mem::toBytesArray(values.data() + i, buffer, amount);
+            out.write(reinterpret_cast<char*>(buffer), amount * sizeof(T));
+        }
+    }
+    
+    /**
+     * Reads the payload of an array tag in bulk and swaps it to native order in place. The vector grows as the data arrives, so a corrupt
+     * length throws once the data runs out instead of allocating what it claims.
+     */
+    template<typename T>
+    inline static void readArray(blt::fs::reader_t& in, std::vector<T>& values) {
+        int32_t length;
+        readData(in, length);
+        if (length < 0)
+            throw std::runtime_error("Negative array length in NBT data!");
+        constexpr size_t chunk = 64 * 1024 / sizeof(T);
+        const auto count = static_cast<size_t>(length);
+        values.clear();
+        size_t read = 0;
+        // readers may hand back less than asked for, only running out of data is an error
+        while (read < count * sizeof(T)) {
+            if (read == values.size() * sizeof(T))
+                values.resize(std::min(count, std::max(values.size() * 2, values.size() + chunk)));
+            const auto amount = in.read(reinterpret_cast<char*>(values.data()) + read, values.size() * sizeof(T) - read);
+            if (amount <= 0)
+                throw std::runtime_error("NBT data ended in the middle of an array!");
+            read += static_cast<size_t>(amount);
+        }
+        mem::fromBytesArray(values.data(), values.data(), values.size());
+    }
+    
     enum class nbt_tag : char {
         END = 0,
         BYTE = 1,
@@ -156,7 +200,7 @@ namespace blt::nbt {
             void readPayload(blt::fs::reader_t& in) final {
                 int32_t length;
                 readData(in, length);
-                t.reserve(length);
+                t.resize(length);
                 in.read(reinterpret_cast<char*>(t.data()), length);
             }
     };
@@ -178,17 +222,10 @@ namespace blt::nbt {
             tag_int_array(): tag(nbt_tag::INT_ARRAY) {}
             tag_int_array(const std::string& name, const std::vector<int32_t>& v): tag(nbt_tag::INT_ARRAY, name, v) {}
             void writePayload(blt::fs::writer_t& out) final {
-                auto length = (int32_t) t.size();
-                writeData(out, length);
-                for (int i = 0; i < length; i++)
-                    writeData(out, t[i]);
+                writeArray(out, t);
             }
             void readPayload(blt::fs::reader_t& in) final {
-                int32_t length;
-                readData(in, length);
-                t.reserve(length);
-                for (int i = 0; i < length; i++)
-                    readData(in, t[i]);
+                readArray(in, t);
             }
     };
     
@@ -197,17 +234,10 @@ namespace blt::nbt {
             tag_long_array(): tag(nbt_tag::LONG_ARRAY) {}
             tag_long_array(const std::string& name, const std::vector<int64_t>& v): tag(nbt_tag::LONG_ARRAY, name, v) {}
             void writePayload(blt::fs::writer_t& out) final {
-                auto length = (int32_t) t.size();
-                writeData(out, length);
-                for (int i = 0; i < length; i++)
-                    writeData(out, t[i]);
+                writeArray(out, t);
             }
             void readPayload(blt::fs::reader_t& in) final {
-                int32_t length;
-                readData(in, length);
-                t.reserve(length);
-                for (int i = 0; i < length; i++)
-                    readData(in, t[i]);
+                readArray(in, t);
             }
     };
     
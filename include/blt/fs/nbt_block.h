@@ -7,4 +7,119 @@
 #ifndef BLT_TESTS_NBT_BLOCK_H
 #define BLT_TESTS_NBT_BLOCK_H
 
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <blt/fs/nbt.h>
+#include <blt/fs/nbt_document.h>
+#include <blt/std/types.h>
+
+namespace blt::nbt
+{
+	enum class region_compression_t : u8
+	{
+		NONE = 0,
+		// only available when BLT was built with zlib
+		ZLIB = 1
+	};
+
+	/**
+	* Container holding many NBT documents in a single file, so large collections do not need one file (and one open / sync) per document.
+	*
+	* The file starts with a fixed header: a magic number, the format version, the number of entries and a table of (first sector,
+	* sector count) pairs, one per entry. Every entry is stored in a contiguous run of SECTOR_SIZE sectors which starts with its stored
+	* length, compression and uncompressed length. An entry is read with a single table lookup and read of its sectors, nothing else in the
+	* file is touched. All numbers are big endian like the rest of NBT.
+	*
+	* Rewriting an entry which still fits in its sectors happens in place and releases the sectors it no longer needs, otherwise the entry
+	* moves to the first run of free sectors large enough for it, and only if there is none does the file grow. Sectors which are freed
+	* are reused by later writes.
+	*
+	* Any number of threads may read at the same time, writes are exclusive. Entries are not journaled, a crash during a write can lose
+	* the entry being written.
+	*/
+	class region_file_t
+	{
+	public:
+		static constexpr size_t SECTOR_SIZE = 4096;
+		static constexpr u32 DEFAULT_ENTRY_COUNT = 1024;
+		// "BLTR"
+		static constexpr u32 MAGIC = 0x424C5452;
+		static constexpr u32 VERSION = 1;
+
+		/**
+		* Opens a region file, creating it if it does not exist.
+		* @param entry_count number of entries of a newly created file, existing files keep the count they were created with
+		* @throws std::runtime_error if the file cannot be opened or is not a valid region file
+		*/
+		explicit region_file_t(const std::string& path, u32 entry_count = DEFAULT_ENTRY_COUNT);
+
+		region_file_t(const region_file_t&) = delete;
+		region_file_t& operator=(const region_file_t&) = delete;
+
+		~region_file_t();
+
+		[[nodiscard]] u32 capacity() const
+		{
+			return static_cast<u32>(m_entries.size());
+		}
+
+		[[nodiscard]] bool contains(u32 index) const;
+
+		/**
+		* @return the uncompressed NBT data of the entry, or nothing if the entry is empty
+		* @throws std::out_of_range if index is not below capacity()
+		*/
+		[[nodiscard]] std::optional<std::string> read(u32 index) const;
+
+		[[nodiscard]] std::optional<nbt_document_t> read_document(u32 index) const;
+
+		/**
+		* Stores NBT data (as written by NBTWriter) in an entry, replacing whatever was there
+		* @throws std::runtime_error if the compression is not available or the file cannot be written
+		*/
+		void write(u32 index, std::string_view data, region_compression_t compression = region_compression_t::NONE);
+
+		void write(u32 index, tag_compound& root, region_compression_t compression = region_compression_t::NONE);
+
+		/**
+		* Empties an entry and frees its sectors
+		* @return false if the entry was already empty
+		*/
+		bool erase(u32 index);
+
+		// flushes written entries to the disk
+		void sync();
+
+		// size of the file in sectors, including the header and free sectors
+		[[nodiscard]] size_t sector_count() const;
+
+		[[nodiscard]] static bool supports(region_compression_t compression);
+
+	private:
+		struct entry_t
+		{
+			u32 first_sector = 0;
+			u32 sector_count = 0;
+		};
+
+		u32 allocate_sectors(u32 count);
+
+		void free_sectors(u32 first, u32 count);
+
+		void mark_sectors(u32 first, u32 count, bool used);
+
+		void write_entry(u32 index);
+
+		int m_fd = -1;
+		u32 m_header_sectors = 0;
+		std::vector<entry_t> m_entries;
+		// one flag per sector of the file
+		std::vector<bool> m_used;
+		mutable std::shared_mutex m_mutex;
+	};
+}
+
 #endif //BLT_TESTS_NBT_BLOCK_H
@@ -0,0 +1,254 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_FS_NBT_DOCUMENT_H
+#define BLT_FS_NBT_DOCUMENT_H
+
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include <blt/fs/fwddecl.h>
+#include <blt/fs/nbt.h>
+#include <blt/std/allocator.h>
+#include <blt/std/hashmap.h>
+#include <blt/std/ranges.h>
+#include <blt/std/types.h>
+
+namespace blt::nbt
+{
+	class nbt_document_t;
+
+	namespace detail
+	{
+		/**
+		* One tag of a document. Records are stored depth first, so the children of a compound or list start right after it and each
+		* record knows where its subtree ends, which is also where its next sibling starts.
+		*/
+		struct nbt_record_t
+		{
+			nbt_tag type;
+			// type of the elements of a list
+			nbt_tag element_type;
+			// interned name, NO_NAME for list elements
+			u32 name;
+			// one past the last record of this tag's subtree
+			u32 end;
+			// children of compounds and lists, elements of arrays, bytes of strings
+			u32 count;
+
+			union
+			{
+				i8 byte;
+				i16 short_value;
+				i32 int_value;
+				i64 long_value;
+				f32 float_value;
+				f64 double_value;
+				// strings and arrays, stored in the document's arena
+				const void* data;
+			} value;
+		};
+	}
+
+	/**
+	* Read only handle to one tag of an nbt_document_t, valid as long as the document is
+	*/
+	class nbt_node_t
+	{
+	public:
+		class iterator
+		{
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = nbt_node_t;
+			using difference_type = std::ptrdiff_t;
+			using pointer = void;
+			using reference = nbt_node_t;
+
+			iterator(const nbt_document_t* document, const u32 index): m_document(document), m_index(index)
+			{}
+
+			nbt_node_t operator*() const
+			{
+				return {m_document, m_index};
+			}
+
+			iterator& operator++();
+
+			iterator operator++(int)
+			{
+				auto copy = *this;
+				++*this;
+				return copy;
+			}
+
+			friend bool operator==(const iterator& a, const iterator& b)
+			{
+				return a.m_index == b.m_index;
+			}
+
+			friend bool operator!=(const iterator& a, const iterator& b)
+			{
+				return a.m_index != b.m_index;
+			}
+
+		private:
+			const nbt_document_t* m_document;
+			u32 m_index;
+		};
+
+		nbt_node_t(const nbt_document_t* document, const u32 index): m_document(document), m_index(index)
+		{}
+
+		[[nodiscard]] nbt_tag type() const;
+
+		// type of the elements if this is a list
+		[[nodiscard]] nbt_tag element_type() const;
+
+		// empty for list elements
+		[[nodiscard]] std::string_view name() const;
+
+		/**
+		* @return children of a compound or list, elements of an array, bytes of a string, 0 otherwise
+		*/
+		[[nodiscard]] size_t size() const;
+
+		// the value accessors throw std::runtime_error if the tag is of another type
+		[[nodiscard]] i8 as_byte() const;
+		[[nodiscard]] i16 as_short() const;
+		[[nodiscard]] i32 as_int() const;
+		[[nodiscard]] i64 as_long() const;
+		[[nodiscard]] f32 as_float() const;
+		[[nodiscard]] f64 as_double() const;
+		[[nodiscard]] std::string_view as_string() const;
+		[[nodiscard]] span<const i8> as_byte_array() const;
+		[[nodiscard]] span<const i32> as_int_array() const;
+		[[nodiscard]] span<const i64> as_long_array() const;
+
+		/**
+		* Looks up a child of a compound by name, interned names make this an integer compare per child
+		*/
+		[[nodiscard]] std::optional<nbt_node_t> find(std::string_view name) const;
+
+		/**
+		* Child of a compound or list by position. Constant time for lists of non container tags, otherwise walks the earlier siblings.
+		*/
+		[[nodiscard]] nbt_node_t at(size_t index) const;
+
+		// iterates the children of a compound or list
+		[[nodiscard]] iterator begin() const;
+		[[nodiscard]] iterator end() const;
+
+		[[nodiscard]] u32 index() const
+		{
+			return m_index;
+		}
+
+	private:
+		[[nodiscard]] const detail::nbt_record_t& record() const;
+
+		[[nodiscard]] const detail::nbt_record_t& record(nbt_tag expected) const;
+
+		const nbt_document_t* m_document;
+		u32 m_index;
+	};
+
+	/**
+	* NBT document stored flat instead of as a tree of heap allocated tags. Tag records sit in a single contiguous array, names are
+	* interned once per document and strings and arrays are placed in a bump allocated arena. Destroying or clearing a document frees
+	* a handful of arena blocks instead of walking and deleting every tag.
+	*
+	* Documents are built by reading NBT data (through the streaming visitor) or by converting a tag_compound, and are read only after.
+	*/
+	class nbt_document_t
+	{
+		friend class nbt_node_t;
+
+	public:
+		static constexpr u32 NO_NAME = std::numeric_limits<u32>::max();
+
+		nbt_document_t();
+
+		nbt_document_t(nbt_document_t&&) noexcept;
+		nbt_document_t& operator=(nbt_document_t&&) noexcept;
+
+		~nbt_document_t();
+
+		/**
+		* @throws std::runtime_error if the data is not a valid NBT document
+		*/
+		static nbt_document_t read(fs::reader_t& reader);
+
+		static nbt_document_t read(std::string_view data);
+
+		static nbt_document_t from_compound(tag_compound& root);
+
+		/**
+		* Builds the equivalent tag tree
+		* @return root compound, owned by the caller
+		*/
+		[[nodiscard]] tag_compound* to_compound() const;
+
+		/**
+		* The root compound. Only valid on a document which has been read or converted.
+		*/
+		[[nodiscard]] nbt_node_t root() const
+		{
+			return {this, 0};
+		}
+
+		[[nodiscard]] bool empty() const
+		{
+			return m_records.empty();
+		}
+
+		[[nodiscard]] size_t tag_count() const
+		{
+			return m_records.size();
+		}
+
+		/**
+		* Releases every tag at once, the document can be refilled afterward
+		*/
+		void clear();
+
+	private:
+		class builder_t;
+
+		static constexpr size_t ARENA_BLOCK_SIZE = 256 * 1024;
+		// payloads above this get their own allocation instead of wasting the tail of an arena block
+		static constexpr size_t LARGE_PAYLOAD = ARENA_BLOCK_SIZE / 4;
+
+		u32 intern(std::string_view name);
+
+		[[nodiscard]] u32 find_name(std::string_view name) const;
+
+		void* allocate(size_t bytes, size_t alignment);
+
+		std::vector<detail::nbt_record_t> m_records;
+		std::vector<std::string_view> m_names;
+		hashmap_t<std::string_view, u32> m_name_ids;
+		std::unique_ptr<bump_allocator<ARENA_BLOCK_SIZE>> m_arena;
+		std::vector<std::unique_ptr<char[]>> m_large;
+	};
+}
+
+#endif //BLT_FS_NBT_DOCUMENT_H
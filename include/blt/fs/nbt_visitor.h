@@ -0,0 +1,192 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_FS_NBT_VISITOR_H
+#define BLT_FS_NBT_VISITOR_H
+
+#include <string>
+#include <string_view>
+#include <blt/fs/fwddecl.h>
+#include <blt/fs/nbt.h>
+#include <blt/std/memory_util.h>
+#include <blt/std/types.h>
+
+namespace blt::nbt
+{
+	enum class visit_t
+	{
+		CONTINUE,
+		// skip the tag (from key) or the rest of the compound / list (from begin_compound / begin_list), nothing inside it is reported
+		SKIP,
+		// stop the walk, visit() returns false
+		STOP
+	};
+
+	/**
+	* Array payload as stored in the document (big endian), elements are converted as they are accessed
+	*/
+	template <typename T>
+	class nbt_array_view_t
+	{
+	public:
+		explicit nbt_array_view_t(const std::string_view bytes): m_bytes(bytes)
+		{}
+
+		[[nodiscard]] size_t size() const
+		{
+			return m_bytes.size() / sizeof(T);
+		}
+
+		[[nodiscard]] bool empty() const
+		{
+			return m_bytes.empty();
+		}
+
+		T operator[](const size_t index) const
+		{
+			T value;
+			mem::fromBytes(m_bytes.data() + index * sizeof(T), value);
+			return value;
+		}
+
+		// converts every element at once, out must have room for size() elements
+		void copy_to(T* out) const
+		{
+			mem::fromBytesArray(m_bytes.data(), out, size());
+		}
+
+		[[nodiscard]] std::string_view bytes() const
+		{
+			return m_bytes;
+		}
+
+	private:
+		std::string_view m_bytes;
+	};
+
+	/**
+	* Receives the events of an NBT document as it is walked, without any tag objects being built. Override only the events you need,
+	* the rest default to CONTINUE. Returning SKIP from a value or end event is the same as CONTINUE.
+	*
+	* A tag inside a compound (and the root tag) is reported as key() followed by its value: either a single value_* call or a
+	* begin_compound / begin_list ... end_compound / end_list pair. List elements have no key.
+	*
+	* Strings and arrays are views into the data (or into the walker's scratch buffer when reading from a reader without views) and are
+	* only valid until the callback returns. Strings are the modified UTF-8 bytes as stored, decode_string converts them.
+	*/
+	class nbt_visitor_t
+	{
+	public:
+		virtual ~nbt_visitor_t() = default;
+
+		virtual visit_t key(nbt_tag, std::string_view)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t begin_compound()
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t end_compound()
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t begin_list(nbt_tag, i32)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t end_list()
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_byte(i8)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_short(i16)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_int(i32)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_long(i64)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_float(f32)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_double(f64)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_string(std::string_view)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_byte_array(nbt_array_view_t<i8>)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_int_array(nbt_array_view_t<i32>)
+		{
+			return visit_t::CONTINUE;
+		}
+
+		virtual visit_t value_long_array(nbt_array_view_t<i64>)
+		{
+			return visit_t::CONTINUE;
+		}
+	};
+
+	/**
+	* Walks the NBT document read from the reader. Skipped subtrees are passed over using their lengths where the format stores them,
+	* readers with zero copy views (like fs::mmap_reader_t) are read without copying.
+	* @return false if the visitor stopped the walk
+	* @throws std::runtime_error if the data is malformed or ends early
+	*/
+	bool visit(fs::reader_t& reader, nbt_visitor_t& visitor);
+
+	/**
+	* Walks an NBT document held in memory
+	*/
+	bool visit(std::string_view data, nbt_visitor_t& visitor);
+
+	/**
+	* Converts a string reported to a visitor from the modified UTF-8 NBT stores
+	*/
+	std::string decode_string(std::string_view str);
+}
+
+#endif //BLT_FS_NBT_VISITOR_H
@@ -0,0 +1,308 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_FS_SERIALIZABLE_H
+#define BLT_FS_SERIALIZABLE_H
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <blt/fs/fwddecl.h>
+#include <blt/std/types.h>
+
+namespace blt::fs::detail
+{
+	// integers which the VARINT encoding shortens, single byte values cannot get any smaller
+	template <typename T>
+	inline constexpr bool is_varint_v = std::is_integral_v<T> && !std::is_same_v<T, bool> && (sizeof(T) > 1);
+
+	template <typename, typename = void>
+	struct has_save : std::false_type
+	{};
+
+	template <typename T>
+	struct has_save<T, std::void_t<decltype(std::declval<T>().save(std::declval<writer_t&>()))>> : std::true_type
+	{};
+
+	template <typename T>
+	inline constexpr bool has_save_v = has_save<T>::value;
+
+	template <typename, typename = void>
+	struct has_load : std::false_type
+	{};
+
+	template <typename T>
+	struct has_load<T, std::void_t<decltype(std::declval<T>().load(std::declval<reader_t&>()))>> : std::true_type
+	{};
+
+	template <typename T>
+	inline constexpr bool has_load_v = has_load<T>::value;
+
+	// BLT_SERIALIZABLE defines blt_reflect for this tag in the namespace of the type, where argument dependent lookup finds it
+	template <typename T>
+	struct reflect_tag_t
+	{};
+
+	template <typename T, auto... Members>
+	struct reflection_t
+	{
+		static constexpr size_t size = sizeof...(Members);
+		static constexpr auto members = std::make_tuple(Members...);
+
+		std::string_view name;
+		std::string_view fields;
+	};
+
+	template <typename, typename = void>
+	struct is_serializable : std::false_type
+	{};
+
+	template <typename T>
+	struct is_serializable<T, std::void_t<decltype(blt_reflect(reflect_tag_t<T>{}))>> : std::true_type
+	{};
+
+	template <typename T>
+	inline constexpr bool is_serializable_v = is_serializable<T>::value;
+
+	template <typename T>
+	using reflection_of_t = decltype(blt_reflect(reflect_tag_t<T>{}));
+
+	template <typename>
+	struct member_type;
+
+	template <typename Class, typename Member>
+	struct member_type<Member Class::*>
+	{
+		using type = Member;
+	};
+
+	template <typename T, size_t I>
+	using field_type_t = typename member_type<std::tuple_element_t<I, std::remove_cv_t<decltype(reflection_of_t<T>::members)>>>::type;
+
+	template <size_t I, typename T>
+	decltype(auto) field(T& object)
+	{
+		return (object.*std::get<I>(reflection_of_t<std::remove_const_t<T>>::members));
+	}
+
+	// FNV-1a, applied to the bytes of the value
+	constexpr u64 hash_value(u64 hash, const u64 value)
+	{
+		for (size_t i = 0; i < sizeof(u64); i++)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// whitespace is skipped so the formatting of the macro arguments does not matter
+	constexpr u64 hash_text(u64 hash, const std::string_view text)
+	{
+		for (const char c : text)
+		{
+			if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+				continue;
+			hash ^= static_cast<u8>(c);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	template <typename, typename = void>
+	struct has_value_type : std::false_type
+	{};
+
+	template <typename T>
+	struct has_value_type<T, std::void_t<typename T::value_type>> : std::true_type
+	{};
+
+	template <typename T, size_t... I>
+	constexpr u64 schema_hash(std::index_sequence<I...>);
+
+	/**
+	* Describes how a type is laid out when serialized, so a change to any field type changes the hash of the structs containing it
+	*/
+	template <typename T>
+	constexpr u64 type_signature()
+	{
+		if constexpr (is_serializable_v<T>)
+			return schema_hash<T>(std::make_index_sequence<reflection_of_t<T>::size>{});
+		else if constexpr (std::is_same_v<T, bool>)
+			return hash_value(1, 1);
+		else if constexpr (std::is_integral_v<T>)
+			return hash_value(std::is_signed_v<T> ? 2 : 3, sizeof(T));
+		else if constexpr (std::is_floating_point_v<T>)
+			return hash_value(4, sizeof(T));
+		else if constexpr (std::is_enum_v<T>)
+			return hash_value(5, type_signature<std::underlying_type_t<T>>());
+		else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+			return 6;
+		else if constexpr (std::is_array_v<T>)
+			return hash_value(hash_value(7, std::extent_v<T>), type_signature<std::remove_extent_t<T>>());
+		else if constexpr (has_value_type<T>::value)
+			return hash_value(8, type_signature<typename T::value_type>());
+		else
+			return hash_value(9, sizeof(T));
+	}
+
+	template <typename T, size_t... I>
+	constexpr u64 schema_hash(std::index_sequence<I...>)
+	{
+		constexpr auto reflection = blt_reflect(reflect_tag_t<T>{});
+		u64 hash = hash_text(hash_text(14695981039346656037ull, reflection.name), reflection.fields);
+		((hash = hash_value(hash, type_signature<field_type_t<T, I>>())), ...);
+		return hash;
+	}
+
+	template <typename T>
+	inline constexpr u64 schema_hash_v = schema_hash<T>(std::make_index_sequence<reflection_of_t<T>::size>{});
+
+	/**
+	* Fields which are stored as their raw bytes. Runs of them are written and read as one block. Reflected types, types with their own
+	* save() or load(), string views and (when encoding varints) integers are serialized on their own, exactly as they would be outside
+	* of a run.
+	*/
+	template <typename T, bool Varint>
+	inline constexpr bool is_packable_v = std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && !std::is_same_v<T, std::string_view> &&
+		!is_serializable_v<T> && !has_save_v<T> && !has_load_v<T> && !(Varint && is_varint_v<T>);
+
+	// one past the last field of the packable run starting at I, I itself if that field is not packable
+	template <typename T, bool Varint, size_t I>
+	constexpr size_t run_end()
+	{
+		if constexpr (I >= reflection_of_t<T>::size)
+			return I;
+		else if constexpr (std::is_pointer_v<field_type_t<T, I>>)
+		{
+			static_assert(!std::is_pointer_v<field_type_t<T, I>>, "We cannot serialize pointer members, only the address would be stored.");
+			return I;
+		} else if constexpr (!is_packable_v<field_type_t<T, I>, Varint>)
+			return I;
+		else
+			return run_end<T, Varint, I + 1>();
+	}
+
+	template <typename T, size_t Begin, size_t End>
+	constexpr size_t run_bytes()
+	{
+		if constexpr (Begin >= End)
+			return 0;
+		else
+			return sizeof(field_type_t<T, Begin>) + run_bytes<T, Begin + 1, End>();
+	}
+
+	/**
+	* True if the fields of the run follow each other in memory without padding, then the run can be copied straight to or from the
+	* object. Member pointers are constants, so this folds away.
+	*/
+	template <typename T, size_t Begin, size_t End>
+	bool run_contiguous(const T& object)
+	{
+		if constexpr (Begin + 1 >= End)
+			return true;
+		else
+		{
+			const auto* first = reinterpret_cast<const char*>(&field<Begin>(object));
+			const auto* next = reinterpret_cast<const char*>(&field<Begin + 1>(object));
+			return first + sizeof(field_type_t<T, Begin>) == next && run_contiguous<T, Begin + 1, End>(object);
+		}
+	}
+
+	template <typename T, size_t I, size_t End>
+	void pack_run(const T& object, char* out)
+	{
+		if constexpr (I < End)
+		{
+			std::memcpy(out, &field<I>(object), sizeof(field_type_t<T, I>));
+			pack_run<T, I + 1, End>(object, out + sizeof(field_type_t<T, I>));
+		}
+	}
+
+	template <typename T, size_t I, size_t End>
+	void unpack_run(T& object, const char* in)
+	{
+		if constexpr (I < End)
+		{
+			std::memcpy(&field<I>(object), in, sizeof(field_type_t<T, I>));
+			unpack_run<T, I + 1, End>(object, in + sizeof(field_type_t<T, I>));
+		}
+	}
+}
+
+#define BLT_SERIALIZABLE_EXPAND(x) x
+#define BLT_SERIALIZABLE_CONCAT_IMPL(a, b) a##b
+#define BLT_SERIALIZABLE_CONCAT(a, b) BLT_SERIALIZABLE_CONCAT_IMPL(a, b)
+#define BLT_SERIALIZABLE_COUNT_IMPL(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ...) N
+#define BLT_SERIALIZABLE_COUNT(...) BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_COUNT_IMPL(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1))
+#define BLT_SERIALIZABLE_MEMBER_1(TYPE, field) &TYPE::field
+#define BLT_SERIALIZABLE_MEMBER_2(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_1(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_3(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_2(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_4(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_3(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_5(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_4(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_6(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_5(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_7(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_6(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_8(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_7(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_9(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_8(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_10(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_9(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_11(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_10(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_12(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_11(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_13(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_12(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_14(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_13(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_15(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_14(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_16(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_15(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_17(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_16(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_18(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_17(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_19(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_18(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_20(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_19(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_21(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_20(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_22(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_21(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_23(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_22(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_24(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_23(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_25(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_24(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_26(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_25(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_27(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_26(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_28(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_27(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_29(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_28(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_30(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_29(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_31(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_30(TYPE, __VA_ARGS__))
+#define BLT_SERIALIZABLE_MEMBER_32(TYPE, field, ...) &TYPE::field, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_MEMBER_31(TYPE, __VA_ARGS__))
+
+/**
+* Makes a struct readable and writable by reader_serializer_t / writer_serializer_t without hand written save / load members. Use it at
+* namespace scope, in the namespace of the type, listing the public fields to serialize in order (up to 32):
+*
+*     struct point_t { i32 x, y; std::string label; };
+*     BLT_SERIALIZABLE(point_t, x, y, label)
+*
+* Fields are serialized one after another with the serializer's usual rules, except that runs of neighbouring trivially copyable fields
+* are copied as a single block. A hash of the type name, the field names and the field types is written in front of the outermost
+* reflected value (or container of them), reading data written with a different layout throws std::runtime_error instead of producing
+* garbage. The type must not be a template with commas in its name, use an alias for those.
+*/
+#define BLT_SERIALIZABLE(TYPE, ...)                                                                                                     \
+	[[maybe_unused]] constexpr auto blt_reflect(::blt::fs::detail::reflect_tag_t<TYPE>)                                                \
+	{                                                                                                                                   \
+		return ::blt::fs::detail::reflection_t<TYPE, BLT_SERIALIZABLE_EXPAND(BLT_SERIALIZABLE_CONCAT(BLT_SERIALIZABLE_MEMBER_,         \
+			BLT_SERIALIZABLE_COUNT(__VA_ARGS__))(TYPE, __VA_ARGS__))>{#TYPE, #__VA_ARGS__};                                            \
+	}
+
+#endif //BLT_FS_SERIALIZABLE_H
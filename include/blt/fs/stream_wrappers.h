@@ -19,44 +19,21 @@
 #ifndef BLT_FS_STREAM_WRAPPERS_H
 #define BLT_FS_STREAM_WRAPPERS_H
 
+#include <cstring>
 #include <iosfwd>
+#include <limits>
 #include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <blt/fs/buffered_reader.h>
 #include <blt/fs/fwddecl.h>
+#include <blt/fs/serializable.h>
 #include <blt/meta/serialization.h>
 #include <blt/meta/type_traits.h>
 
 namespace blt::fs
 {
-	namespace detail
-	{
-		template <typename, typename = void>
-		struct has_save : std::false_type
-		{};
-
-
-		template <typename T>
-		struct has_save<T, std::void_t<decltype(std::declval<T>().save(std::declval<writer_t&>()))>> : std::true_type
-		{};
-
-
-		template <typename T>
-		inline constexpr bool has_save_v = has_save<T>::value;
-
-
-		template <typename, typename = void>
-		struct has_load : std::false_type
-		{};
-
-
-		template <typename T>
-		struct has_load<T, std::void_t<decltype(std::declval<T>().load(std::declval<reader_t&>()))>> : std::true_type
-		{};
-
-
-		template <typename T>
-		inline constexpr bool has_load_v = has_load<T>::value;
-	}
-
 	/**
 		* reader_t wrapper for fstream
 		*/
@@ -95,39 +72,176 @@ namespace blt::fs
 	};
 
 
+	/**
+	* How the serializers store integers and the length prefixes of strings and containers. Both sides have to agree on it.
+	*/
+	enum class serializer_encoding_t
+	{
+		// every integer at its full width and lengths as size_t, in native byte order. The original format.
+		FIXED,
+		// LEB128 varints for lengths and integers wider than a byte, signed values zigzag encoded first so small negatives stay small
+		VARINT
+	};
+
+	namespace detail
+	{
+		// longest encoding of a 64 bit value
+		inline constexpr size_t MAX_VARINT_BYTES = 10;
+
+		template <typename T>
+		std::make_unsigned_t<T> zigzag_encode(const T value)
+		{
+			using unsigned_t = std::make_unsigned_t<T>;
+			return static_cast<unsigned_t>(static_cast<unsigned_t>(value) << 1) ^ static_cast<unsigned_t>(value >> (sizeof(T) * 8 - 1));
+		}
+
+		template <typename T>
+		T zigzag_decode(const std::make_unsigned_t<T> value)
+		{
+			using unsigned_t = std::make_unsigned_t<T>;
+			return static_cast<T>(static_cast<unsigned_t>(value >> 1) ^ static_cast<unsigned_t>(-static_cast<unsigned_t>(value & 1)));
+		}
+
+		/**
+		* @return number of bytes written to out, which needs room for MAX_VARINT_BYTES
+		*/
+		inline size_t encode_varint(u64 value, char* out)
+		{
+			size_t size = 0;
+			while (value >= 0x80)
+			{
+				out[size++] = static_cast<char>(static_cast<u8>(value) | 0x80);
+				value >>= 7;
+			}
+			out[size++] = static_cast<char>(value);
+			return size;
+		}
+	}
+
 	class reader_serializer_t
 	{
 	public:
-		explicit reader_serializer_t(reader_t& reader): m_reader(&reader)
+		explicit reader_serializer_t(reader_t& reader, const serializer_encoding_t encoding = serializer_encoding_t::FIXED):
+			m_reader(&reader), m_buffered(dynamic_cast<buffered_reader_t*>(&reader)), m_views(reader.supports_views()), m_encoding(encoding)
 		{}
 
 		std::string read_string()
 		{
 			std::string str;
-			size_t      size;
-			read_mem(size);
+			const auto  size = read_size();
+			if (m_views)
+				return std::string(read_view(size));
 			str.resize(size);
-			m_reader->read(str.data(), size);
+			read_bytes(str.data(), size);
 			return str;
 		}
 
+		/**
+		* Reads a string without copying it, the view points into the reader's memory.
+		* @throws std::runtime_error if the reader does not support views
+		*/
+		std::string_view read_string_view()
+		{
+			if (!m_views)
+				throw std::runtime_error("Reading a std::string_view requires a reader which supports views");
+			return read_view(read_size());
+		}
+
 		template <typename T>
 		void read_mem(T& out)
 		{
-			if (!m_reader->read(reinterpret_cast<char*>(&out), sizeof(T)))
-				throw std::runtime_error("Failed to read from reader");
+			// buffered readers are read inline, everything else costs a virtual call per value
+			if (m_buffered)
+			{
+				if (!m_buffered->read_value(out))
+					throw std::runtime_error("Failed to read from reader");
+				return;
+			}
+			read_bytes(reinterpret_cast<char*>(&out), sizeof(T));
 		}
 
-		template <typename T>
-		void read_container(T& t)
+		// length prefix of a string or container
+		size_t read_size()
 		{
-			using result_t = decltype(*t.data());
+			if (m_encoding == serializer_encoding_t::VARINT)
+				return static_cast<size_t>(read_varint());
 			size_t size;
 			read_mem(size);
+			return size;
+		}
+
+		template <typename T>
+		void read_integer(T& out)
+		{
+			static_assert(std::is_integral_v<T>);
+			if constexpr (detail::is_varint_v<T>)
+			{
+				if (m_encoding == serializer_encoding_t::VARINT)
+				{
+					using unsigned_t = std::make_unsigned_t<T>;
+					const auto value = read_varint();
+					if (value > std::numeric_limits<unsigned_t>::max())
+						throw std::runtime_error("Varint is too large for the type being read");
+					if constexpr (std::is_signed_v<T>)
+						out = detail::zigzag_decode<T>(static_cast<unsigned_t>(value));
+					else
+						out = static_cast<T>(value);
+					return;
+				}
+			}
+			read_mem(out);
+		}
+
+		/**
+		* @throws std::runtime_error if the varint is longer than a 64 bit value can be
+		*/
+		u64 read_varint()
+		{
+			u64 value = 0;
+			for (size_t i = 0; i < detail::MAX_VARINT_BYTES; i++)
+			{
+				u8 byte;
+				read_mem(byte);
+				value |= static_cast<u64>(byte & 0x7F) << (7 * i);
+				if (!(byte & 0x80))
+					return value;
+			}
+			throw std::runtime_error("Malformed varint, it does not end within 10 bytes");
+		}
+
+		template <typename T>
+		void read_container(T& t)
+		{
+			using result_t = std::remove_cv_t<std::remove_reference_t<decltype(*t.data())>>;
+			const auto size = read_size();
 			t.resize(size);
+			if constexpr (detail::is_serializable_v<result_t>)
+			{
+				read_schema<result_t>();
+				++m_reflect_depth;
+				for (size_t i = 0; i < size; i++)
+					read(t.data()[i]);
+				--m_reflect_depth;
+				return;
+			}
+			if constexpr (detail::is_varint_v<result_t>)
+			{
+				if (m_encoding == serializer_encoding_t::VARINT)
+				{
+					for (size_t i = 0; i < size; i++)
+						read_integer(t.data()[i]);
+					return;
+				}
+			}
 			if constexpr (std::is_trivially_copyable_v<result_t>)
 			{
-				m_reader->read(reinterpret_cast<char*>(t.data()), sizeof(result_t) * size);
+				// straight out of the reader's memory, no intermediate read() call
+				if (m_views)
+				{
+					const auto view = read_view(sizeof(result_t) * size);
+					std::memcpy(static_cast<void*>(t.data()), view.data(), view.size());
+				} else
+					read_bytes(reinterpret_cast<char*>(t.data()), sizeof(result_t) * size);
 			} else
 			{
 				for (size_t i = 0; i < size; i++)
@@ -138,9 +252,13 @@ namespace blt::fs
 		template <typename T>
 		void read_iterator(T& t)
 		{
-			using result_t = decltype(*t.begin());
-			size_t size;
-			read_mem(size);
+			using result_t = std::remove_cv_t<std::remove_reference_t<decltype(*t.begin())>>;
+			const auto size = read_size();
+			if constexpr (detail::is_serializable_v<result_t>)
+			{
+				read_schema<result_t>();
+				++m_reflect_depth;
+			}
 			for (size_t i = 0; i < size; i++)
 			{
 				result_t v;
@@ -153,6 +271,8 @@ namespace blt::fs
 					meta::insert_helper_t{t, std::move(v)};
 				}
 			}
+			if constexpr (detail::is_serializable_v<result_t>)
+				--m_reflect_depth;
 		}
 
 		template <typename T>
@@ -161,12 +281,24 @@ namespace blt::fs
 			static_assert(!std::is_pointer_v<std::decay_t<T>>,
 						  "We cannot serialize pointers due to a lack of size information. "
 						  "If you intended to read the data behind the pointer please pass a blt::span.");
-			if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+			if constexpr (std::is_same_v<T, std::string>)
 			{
 				t = read_string();
+			} else if constexpr (std::is_same_v<T, std::string_view>)
+			{
+				t = read_string_view();
 			} else if constexpr (detail::has_load_v<T>)
 			{
 				t.load(*this);
+			} else if constexpr (detail::is_serializable_v<T>)
+			{
+				read_schema<T>();
+				++m_reflect_depth;
+				if (m_encoding == serializer_encoding_t::VARINT)
+					read_fields<T, true, 0>(t);
+				else
+					read_fields<T, false, 0>(t);
+				--m_reflect_depth;
 			} else if constexpr (meta::is_tuple_like_v<T>)
 			{
 				std::apply([this](auto&... elems) {
@@ -179,6 +311,9 @@ namespace blt::fs
 			} else if constexpr (meta::is_iterable_v<T>)
 			{
 				read_iterator(t);
+			} else if constexpr (std::is_integral_v<T>)
+			{
+				read_integer(t);
 			} else if constexpr (std::is_trivially_copyable_v<T>)
 			{
 				read_mem(t);
@@ -195,20 +330,100 @@ namespace blt::fs
 			return reader;
 		}
 
+		[[nodiscard]] serializer_encoding_t encoding() const
+		{
+			return m_encoding;
+		}
+
 	private:
+		// readers may hand back less than asked for, only running out of data is an error
+		void read_bytes(char* buffer, const size_t bytes)
+		{
+			size_t read = 0;
+			while (read < bytes)
+			{
+				const auto amount = m_buffered ? m_buffered->read(buffer + read, bytes - read) : m_reader->read(buffer + read, bytes - read);
+				if (amount <= 0)
+					throw std::runtime_error("Failed to read from reader");
+				read += static_cast<size_t>(amount);
+			}
+		}
+
+		void read_exact(char* buffer, const size_t bytes)
+		{
+			if (m_views)
+			{
+				std::memcpy(buffer, read_view(bytes).data(), bytes);
+				return;
+			}
+			read_bytes(buffer, bytes);
+		}
+
+		// the schema hash is only stored in front of the outermost reflected value
+		template <typename T>
+		void read_schema()
+		{
+			if (m_reflect_depth != 0)
+				return;
+			u64 hash;
+			read_mem(hash);
+			if (hash != detail::schema_hash_v<T>)
+				throw std::runtime_error("Serialized layout of '" + std::string(blt_reflect(detail::reflect_tag_t<T>{}).name) +
+										 "' does not match the type being read");
+		}
+
+		template <typename T, bool Varint, size_t I>
+		void read_fields(T& t)
+		{
+			if constexpr (I < detail::reflection_of_t<T>::size)
+			{
+				constexpr auto end = detail::run_end<T, Varint, I>();
+				if constexpr (end == I)
+				{
+					read(detail::field<I>(t));
+					read_fields<T, Varint, I + 1>(t);
+				} else
+				{
+					constexpr auto bytes = detail::run_bytes<T, I, end>();
+					if (detail::run_contiguous<T, I, end>(t))
+						read_exact(reinterpret_cast<char*>(&detail::field<I>(t)), bytes);
+					else
+					{
+						char buffer[bytes];
+						read_exact(buffer, bytes);
+						detail::unpack_run<T, I, end>(t, buffer);
+					}
+					read_fields<T, Varint, end>(t);
+				}
+			}
+		}
+
+		std::string_view read_view(const size_t bytes)
+		{
+			const auto view = *m_reader->read_view(bytes);
+			if (view.size() != bytes)
+				throw std::runtime_error("Failed to read from reader");
+			return view;
+		}
+
 		reader_t* m_reader;
+		buffered_reader_t* m_buffered;
+		bool m_views;
+		serializer_encoding_t m_encoding;
+		size_t m_reflect_depth = 0;
 	};
 
 
 	class writer_serializer_t
 	{
 	public:
-		explicit writer_serializer_t(writer_t& writer): m_writer(&writer)
+		explicit writer_serializer_t(writer_t& writer, const serializer_encoding_t encoding = serializer_encoding_t::FIXED):
+			m_writer(&writer), m_encoding(encoding)
 		{}
 
 		void write_string(const std::string_view str)
 		{
-			write_mem(str.size());
+			write_size(str.size());
 			m_writer->write(str.data(), str.size());
 		}
 
@@ -219,11 +434,71 @@ namespace blt::fs
 			m_writer->write(reinterpret_cast<const char*>(&t), sizeof(T));
 		}
 
+		// length prefix of a string or container
+		void write_size(const size_t size)
+		{
+			if (m_encoding == serializer_encoding_t::VARINT)
+				write_varint(size);
+			else
+				write_mem(size);
+		}
+
+		template <typename T>
+		void write_integer(const T& t)
+		{
+			static_assert(std::is_integral_v<T>);
+			if constexpr (detail::is_varint_v<T>)
+			{
+				if (m_encoding == serializer_encoding_t::VARINT)
+				{
+					if constexpr (std::is_signed_v<T>)
+						write_varint(detail::zigzag_encode(t));
+					else
+						write_varint(t);
+					return;
+				}
+			}
+			write_mem(t);
+		}
+
+		void write_varint(const u64 value)
+		{
+			char buffer[detail::MAX_VARINT_BYTES];
+			m_writer->write(buffer, detail::encode_varint(value, buffer));
+		}
+
 		template <typename T>
 		void write_container(const T& t)
 		{
-			using result_t = decltype(*t.data());
-			write_mem(t.size());
+			using result_t = std::remove_cv_t<std::remove_reference_t<decltype(*t.data())>>;
+			write_size(t.size());
+			if constexpr (detail::is_serializable_v<result_t>)
+			{
+				write_schema<result_t>();
+				++m_reflect_depth;
+				for (size_t i = 0; i < t.size(); i++)
+					write(t.data()[i]);
+				--m_reflect_depth;
+				return;
+			}
+			if constexpr (detail::is_varint_v<result_t>)
+			{
+				if (m_encoding == serializer_encoding_t::VARINT)
+				{
+					// encoded into one buffer so the writer sees a single write
+					std::string buffer(t.size() * detail::MAX_VARINT_BYTES, '\0');
+					size_t size = 0;
+					for (size_t i = 0; i < t.size(); i++)
+					{
+						if constexpr (std::is_signed_v<result_t>)
+							size += detail::encode_varint(detail::zigzag_encode(t.data()[i]), buffer.data() + size);
+						else
+							size += detail::encode_varint(t.data()[i], buffer.data() + size);
+					}
+					m_writer->write(buffer.data(), size);
+					return;
+				}
+			}
 			if constexpr (std::is_trivially_copyable_v<result_t>)
 			{
 				m_writer->write(reinterpret_cast<const char*>(t.data()), sizeof(result_t) * t.size());
@@ -237,11 +512,19 @@ namespace blt::fs
 		template <typename T>
 		void write_iterator(const T& t)
 		{
+			using result_t = std::remove_cv_t<std::remove_reference_t<decltype(*t.begin())>>;
 			auto begin = t.begin();
 			auto end   = t.end();
-			write_mem(static_cast<size_t>(std::distance(begin, end)));
+			write_size(static_cast<size_t>(std::distance(begin, end)));
+			if constexpr (detail::is_serializable_v<result_t>)
+			{
+				write_schema<result_t>();
+				++m_reflect_depth;
+			}
 			for (; begin != end; ++begin)
 				write(*begin);
+			if constexpr (detail::is_serializable_v<result_t>)
+				--m_reflect_depth;
 		}
 
 		template <typename T>
@@ -256,6 +539,15 @@ namespace blt::fs
 			} else if constexpr (detail::has_save_v<T>)
 			{
 				t.save(*this);
+			} else if constexpr (detail::is_serializable_v<T>)
+			{
+				write_schema<T>();
+				++m_reflect_depth;
+				if (m_encoding == serializer_encoding_t::VARINT)
+					write_fields<T, true, 0>(t);
+				else
+					write_fields<T, false, 0>(t);
+				--m_reflect_depth;
 			} else if constexpr (meta::is_tuple_like_v<T>)
 			{
 				std::apply([this](const auto&... elems) {
@@ -268,6 +560,9 @@ namespace blt::fs
 			} else if constexpr (meta::is_iterable_v<T>)
 			{
 				write_iterator(t);
+			} else if constexpr (std::is_integral_v<T>)
+			{
+				write_integer(t);
 			} else if constexpr (std::is_trivially_copyable_v<T>)
 			{
 				write_mem(t);
@@ -284,8 +579,49 @@ namespace blt::fs
 			return writer;
 		}
 
+		[[nodiscard]] serializer_encoding_t encoding() const
+		{
+			return m_encoding;
+		}
+
 	private:
+		// the schema hash is only stored in front of the outermost reflected value
+		template <typename T>
+		void write_schema()
+		{
+			if (m_reflect_depth == 0)
+				write_mem(detail::schema_hash_v<T>);
+		}
+
+		template <typename T, bool Varint, size_t I>
+		void write_fields(const T& t)
+		{
+			if constexpr (I < detail::reflection_of_t<T>::size)
+			{
+				constexpr auto end = detail::run_end<T, Varint, I>();
+				if constexpr (end == I)
+				{
+					write(detail::field<I>(t));
+					write_fields<T, Varint, I + 1>(t);
+				} else
+				{
+					constexpr auto bytes = detail::run_bytes<T, I, end>();
+					if (detail::run_contiguous<T, I, end>(t))
+						m_writer->write(reinterpret_cast<const char*>(&detail::field<I>(t)), bytes);
+					else
+					{
+						char buffer[bytes];
+						detail::pack_run<T, I, end>(t, buffer);
+						m_writer->write(buffer, bytes);
+					}
+					write_fields<T, Varint, end>(t);
+				}
+			}
+		}
+
 		writer_t* m_writer;
+		serializer_encoding_t m_encoding;
+		size_t m_reflect_depth = 0;
 	};
 
 
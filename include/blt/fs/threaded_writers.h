@@ -19,22 +19,67 @@
 #ifndef BLT_FS_THREADED_WRITERS_H
 #define BLT_FS_THREADED_WRITERS_H
 
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <blt/fs/fwddecl.h>
 
 namespace blt::fs
 {
+	/**
+	* Lets several threads write to one writer without their records interleaving.
+	*
+	* By default every write goes straight through to the wrapped writer under a lock, so nothing is held back if the program dies.
+	* Passing a buffer_size (DEFAULT_BUFFER_SIZE is a good start) opts into buffering instead: threads reserve space in a shared buffer with
+	* a single fetch_add and copy their bytes in without taking a lock. The thread whose reservation no longer fits closes the buffer,
+	* switches everyone over to the second one and hands the closed buffer to the wrapped writer as one contiguous write.
+	*
+	* Buffered writes only reach the wrapped writer once a buffer fills, flush() is called or this is destroyed, so records written just
+	* before a crash are lost. Writes larger than a quarter of the buffer skip it and go straight to the wrapped writer.
+	*/
 	// ReSharper disable once CppClassCanBeFinal
 	class concurrent_file_writer : public writer_t
 	{
 	public:
-		explicit concurrent_file_writer(writer_t* writer);
+		// no buffering, every write reaches the wrapped writer before write() returns
+		static constexpr size_t WRITE_THROUGH = 0;
+		static constexpr size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+		explicit concurrent_file_writer(writer_t* writer, size_t buffer_size = WRITE_THROUGH);
 
 		i64 write(const char* buffer, size_t bytes) override;
 
 		void flush() override;
+
+		~concurrent_file_writer() override;
+
 	private:
+		struct slab_t
+		{
+			std::unique_ptr<char[]> data;
+			std::atomic<u64> committed = 0;
+		};
+
+		/**
+		* Called by the one thread whose reservation was the first not to fit in the generation's buffer
+		* @param used bytes reserved in the buffer before that reservation
+		*/
+		void seal(u64 generation, u64 used);
+
+		void wait_for_next(u64 generation) const;
+
+		/**
+		* Closes the current buffer and waits until everything written before this call has reached the wrapped writer
+		* @return the lock guarding the wrapped writer
+		*/
+		std::unique_lock<std::mutex> drain();
+
 		writer_t* m_writer;
+		size_t m_buffer_size;
+		slab_t m_slabs[2];
+		// generation of the current buffer in the high bits, bytes reserved in it in the low bits
+		std::atomic<u64> m_state = 0;
+		// held by whichever thread is writing to m_writer
 		std::mutex m_mutex;
 	};
 }
@@ -176,18 +176,20 @@ namespace blt::iterator
             return *this;
         }
 
-        deref_only_wrapper& operator+(blt::ptrdiff_t n)
+        Derived operator+(blt::ptrdiff_t n) const
         {
             static_assert(meta::is_random_access_iterator_v<Iter>, "Iterator must allow random access");
-            this->iter = this->iter + n;
-            return *this;
+            auto copy = static_cast<const Derived&>(*this);
+            copy.iter = copy.iter + n;
+            return copy;
         }
 
-        deref_only_wrapper& operator-(ptrdiff_t n)
+        Derived operator-(ptrdiff_t n) const
         {
             static_assert(meta::is_random_access_iterator_v<Iter>, "Iterator must allow random access");
-            this->iter = this->iter - n;
-            return *this;
+            auto copy = static_cast<const Derived&>(*this);
+            copy.iter = copy.iter - n;
+            return copy;
         }
     };
 
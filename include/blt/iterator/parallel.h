@@ -0,0 +1,149 @@
+#pragma once
+/*
+ *  Parallel algorithms over iterator containers
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_ITERATOR_PARALLEL_H
+#define BLT_ITERATOR_PARALLEL_H
+
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <blt/meta/iterator.h>
+#include <blt/std/executor.h>
+#include <blt/std/types.h>
+
+namespace blt
+{
+    namespace iterator::detail
+    {
+        // number of chunks per worker when the grain size is picked automatically, gives stealing some slack for uneven work
+        inline constexpr size_t AUTO_CHUNKS_PER_THREAD = 8;
+
+        /**
+         * Waits on a forked task when the current scope unwinds, the task references state owned by this scope.
+         */
+        template<typename T>
+        struct join_guard_t
+        {
+            const task_handle<T>& handle;
+
+            ~join_guard_t()
+            {
+                handle.wait();
+            }
+        };
+
+        inline size_t pick_grain(const work_stealing_executor& executor, const size_t count, const size_t grain_size)
+        {
+            if (grain_size != 0)
+                return grain_size;
+            return std::max<size_t>(1, count / (executor.thread_count() * AUTO_CHUNKS_PER_THREAD));
+        }
+
+        /**
+         * Splits [begin, begin + count) in half until it fits the grain size. The right half is handed to the executor where it can be
+         * stolen, the left half keeps running on the current thread.
+         */
+        template<typename Iter, typename Func>
+        void parallel_for(work_stealing_executor& executor, Iter begin, const size_t count, Func& func, const size_t grain)
+        {
+            if (count <= grain)
+            {
+                for (size_t i = 0; i < count; ++i, ++begin)
+                    func(*begin);
+                return;
+            }
+            const auto half = count / 2;
+            auto right = executor.submit([&executor, &func, grain, mid = begin + static_cast<ptrdiff_t>(half), rest = count - half]() {
+                detail::parallel_for(executor, mid, rest, func, grain);
+            });
+            join_guard_t<void> guard{right};
+            detail::parallel_for(executor, std::move(begin), half, func, grain);
+            right.get();
+        }
+
+        template<typename Iter, typename T, typename Reduce>
+        T parallel_reduce(work_stealing_executor& executor, Iter begin, const size_t count, const T& identity, Reduce& reduce, const size_t grain)
+        {
+            if (count <= grain)
+            {
+                T accumulator = identity;
+                for (size_t i = 0; i < count; ++i, ++begin)
+                    accumulator = reduce(std::move(accumulator), *begin);
+                return accumulator;
+            }
+            const auto half = count / 2;
+            auto right = executor.submit([&executor, &identity, &reduce, grain, mid = begin + static_cast<ptrdiff_t>(half),
+                    rest = count - half]() {
+                return detail::parallel_reduce(executor, mid, rest, identity, reduce, grain);
+            });
+            join_guard_t<T> guard{right};
+            auto left = detail::parallel_reduce(executor, std::move(begin), half, identity, reduce, grain);
+            return reduce(std::move(left), std::move(right.get()));
+        }
+    }
+
+    /**
+     * Calls func on every element of range using the executor. The range must have random access iterators, this includes
+     * iterator_containers built from random access containers with enumerate(), zip(), map() and friends.
+     * @param grain_size number of elements processed serially per task, 0 picks a size based on the executor thread count
+     */
+    template<typename Range, typename Func>
+    void parallel_for(work_stealing_executor& executor, Range&& range, Func&& func, const size_t grain_size = 0)
+    {
+        using iter_t = std::decay_t<decltype(range.begin())>;
+        static_assert(meta::is_random_access_iterator_v<iter_t>, "parallel_for requires random access iterators!");
+        const auto count = static_cast<size_t>(std::distance(range.begin(), range.end()));
+        if (count == 0)
+            return;
+        iterator::detail::parallel_for(executor, range.begin(), count, func, iterator::detail::pick_grain(executor, count, grain_size));
+    }
+
+    template<typename Range, typename Func>
+    void parallel_for(Range&& range, Func&& func, const size_t grain_size = 0)
+    {
+        parallel_for(global_executor(), std::forward<Range>(range), std::forward<Func>(func), grain_size);
+    }
+
+    /**
+     * Folds every element of range into a single value using the executor. Chunks are reduced independently starting from identity, then
+     * combined pairwise, so reduce must be associative and identity must not change the result when combined.
+     * @param reduce callable (T, element) -> T which must also accept (T, T)
+     * @param grain_size number of elements processed serially per task, 0 picks a size based on the executor thread count
+     */
+    template<typename Range, typename T, typename Reduce>
+    T parallel_reduce(work_stealing_executor& executor, Range&& range, T identity, Reduce&& reduce, const size_t grain_size = 0)
+    {
+        using iter_t = std::decay_t<decltype(range.begin())>;
+        static_assert(meta::is_random_access_iterator_v<iter_t>, "parallel_reduce requires random access iterators!");
+        const auto count = static_cast<size_t>(std::distance(range.begin(), range.end()));
+        if (count == 0)
+            return identity;
+        return iterator::detail::parallel_reduce(executor, range.begin(), count, identity, reduce,
+                                                 iterator::detail::pick_grain(executor, count, grain_size));
+    }
+
+    template<typename Range, typename T, typename Reduce>
+    T parallel_reduce(Range&& range, T identity, Reduce&& reduce, const size_t grain_size = 0)
+    {
+        return parallel_reduce(global_executor(), std::forward<Range>(range), std::move(identity), std::forward<Reduce>(reduce), grain_size);
+    }
+}
+
+#endif //BLT_ITERATOR_PARALLEL_H
@@ -0,0 +1,160 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_LOGGING_FMT_BUFFER_H
+#define BLT_LOGGING_FMT_BUFFER_H
+
+#include <iosfwd>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <blt/logging/fmt_tokenizer.h>
+#include <blt/std/types.h>
+
+namespace blt::logging
+{
+	class fmt_buffer_stream_t;
+
+	/**
+	 * Growable character buffer used as the formatting target. Clearing keeps the allocation, so a buffer which is reused
+	 * (like the thread local ones used by the logger) stops allocating once it has grown to fit the longest line.
+	 */
+	class fmt_buffer_t
+	{
+	public:
+		fmt_buffer_t();
+
+		fmt_buffer_t(const fmt_buffer_t&) = delete;
+		fmt_buffer_t& operator=(const fmt_buffer_t&) = delete;
+
+		~fmt_buffer_t();
+
+		void append(const char c)
+		{
+			*extend(1) = c;
+		}
+
+		void append(std::string_view str);
+
+		void append(size_t count, char c);
+
+		/**
+		 * Grows the buffer by count characters.
+		 * @return pointer to the start of the new characters, valid until the buffer is next modified
+		 */
+		char* extend(const size_t count)
+		{
+			if (m_size + count > m_capacity)
+				grow(m_size + count);
+			auto* ptr = m_data.get() + m_size;
+			m_size += count;
+			return ptr;
+		}
+
+		void shrink(const size_t count)
+		{
+			m_size -= count;
+		}
+
+		void clear()
+		{
+			m_size = 0;
+		}
+
+		[[nodiscard]] char* data()
+		{
+			return m_data.get();
+		}
+
+		[[nodiscard]] std::string_view view() const
+		{
+			return {m_data.get(), m_size};
+		}
+
+		[[nodiscard]] size_t size() const
+		{
+			return m_size;
+		}
+
+		[[nodiscard]] bool empty() const
+		{
+			return m_size == 0;
+		}
+
+		/**
+		 * Stream which appends to this buffer, used for types without a direct formatter (anything with a user provided operator<<)
+		 */
+		std::ostream& stream();
+
+	private:
+		void grow(size_t min_capacity);
+
+		std::unique_ptr<char[]> m_data;
+		size_t m_size = 0;
+		size_t m_capacity = 0;
+		std::unique_ptr<fmt_buffer_stream_t> m_stream;
+	};
+
+	/**
+	 * Writes str padded to the spec's width with the spec's fill and alignment
+	 */
+	void write_string(fmt_buffer_t& out, const fmt_spec_t& spec, std::string_view str);
+
+	/**
+	 * Writes an integer given as its magnitude and sign. The base, prefix, sign and padding come from the spec.
+	 */
+	void write_integer(fmt_buffer_t& out, const fmt_spec_t& spec, u64 magnitude, bool negative);
+
+	void write_float(fmt_buffer_t& out, const fmt_spec_t& spec, double value);
+
+	void write_float(fmt_buffer_t& out, const fmt_spec_t& spec, long double value);
+
+	/**
+	 * Writes the raw bits of an object, byte by byte starting from the least significant bit of each byte.
+	 * A space sign separates the bytes and the alternate form adds a 0b prefix.
+	 */
+	void write_binary(fmt_buffer_t& out, const fmt_spec_t& spec, const void* data, size_t bytes);
+
+	/**
+	 * Prepares the buffer's stream for a spec (fill, width, base, float format) and returns it
+	 */
+	std::ostream& setup_stream(fmt_buffer_t& out, const fmt_spec_t& spec);
+
+	template <typename T>
+	void write_integral(fmt_buffer_t& out, const fmt_spec_t& spec, const T value)
+	{
+		if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char>)
+			write_integral(out, spec, static_cast<int>(value));
+		else if constexpr (std::is_same_v<T, unsigned char>)
+			write_integral(out, spec, static_cast<unsigned int>(value));
+		else if constexpr (std::is_signed_v<T>)
+		{
+			// like iostreams, hex and octal print the two's complement bits of negative values
+			if (spec.type == fmt_type_t::HEX || spec.type == fmt_type_t::OCTAL)
+				write_integer(out, spec, static_cast<u64>(static_cast<std::make_unsigned_t<T>>(value)), false);
+			else
+			{
+				const auto bits = static_cast<u64>(value);
+				write_integer(out, spec, value < 0 ? 0 - bits : bits, value < 0);
+			}
+		} else
+			write_integer(out, spec, static_cast<u64>(value), false);
+	}
+}
+
+#endif //BLT_LOGGING_FMT_BUFFER_H
@@ -19,10 +19,10 @@
 #ifndef BLT_LOGGING_FMT_TOKENIZER_H
 #define BLT_LOGGING_FMT_TOKENIZER_H
 
-#include <functional>
 #include <optional>
 #include <string_view>
 #include <vector>
+#include <blt/logging/fwddecl.h>
 #include <blt/std/types.h>
 
 namespace blt::logging
@@ -86,6 +86,22 @@ namespace blt::logging
         bool alternate_form = false;
     };
 
+    /**
+     * Type erased reference to a format argument. Printing goes through a plain function pointer, so building the argument list does not allocate.
+     */
+    struct fmt_arg_t
+    {
+        using print_func_t = void (*)(fmt_buffer_t&, const fmt_spec_t&, const void*);
+
+        const void* value = nullptr;
+        print_func_t print = nullptr;
+
+        void operator()(fmt_buffer_t& out, const fmt_spec_t& spec) const
+        {
+            print(out, spec, value);
+        }
+    };
+
     struct fmt_token_t
     {
         fmt_token_type type;
@@ -112,7 +128,7 @@ namespace blt::logging
     class fmt_parser_t
     {
     public:
-        explicit fmt_parser_t(std::vector<std::function<void(std::ostream&, const fmt_spec_t&)>>& handlers): m_handlers(handlers)
+        explicit fmt_parser_t(std::vector<fmt_arg_t>& handlers): m_handlers(handlers)
         {
         }
 
@@ -181,7 +197,7 @@ namespace blt::logging
         fmt_tokenizer_t m_tokenizer;
         fmt_spec_t m_spec;
 
-        std::vector<std::function<void(std::ostream&, const fmt_spec_t&)>>& m_handlers;
+        std::vector<fmt_arg_t>& m_handlers;
     };
 }
 
@@ -19,6 +19,8 @@
 #ifndef BLT_LOGGING_FWDDECL_H
 #define BLT_LOGGING_FWDDECL_H
 
+#include <blt/std/types.h>
+
 namespace blt::logging
 {
 	struct logger_t;
@@ -30,6 +32,7 @@ namespace blt::logging
 	struct fmt_token_t;
 	class fmt_tokenizer_t;
 	class fmt_parser_t;
+	class fmt_buffer_t;
 
 	class injector_t;
 }
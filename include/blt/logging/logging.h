@@ -19,11 +19,14 @@
 #ifndef BLT_LOGGING_LOGGING_H
 #define BLT_LOGGING_LOGGING_H
 
+#include <array>
 #include <cstring>
-#include <functional>
+#include <optional>
+#include <ostream>
 #include <string>
 #include <string_view>
 #include <vector>
+#include <blt/logging/fmt_buffer.h>
 #include <blt/logging/fmt_tokenizer.h>
 #include <blt/logging/logging_config.h>
 #include <blt/meta/serialization.h>
@@ -31,23 +34,90 @@
 
 namespace blt::logging
 {
+	namespace detail
+	{
+		/**
+		 * A format string split into its literal sections and parsed replacement fields. Automatic argument positions are already resolved,
+		 * so every spec has a valid arg_id.
+		 */
+		struct compiled_fmt_t
+		{
+			// escapes already removed, always one more section than specs
+			std::vector<std::string> sections;
+			std::vector<fmt_spec_t> specs;
+		};
+
+		/**
+		 * Parses a format string ahead of time.
+		 * @return empty if the format cannot be parsed without the arguments, which is the case for nested arg references like {0:{1}}
+		 */
+		std::optional<compiled_fmt_t> compile_fmt(std::string_view fmt);
+
+		/**
+		 * True if the spelling of a macro argument is a plain or raw string literal (possibly several concatenated ones). Only those have
+		 * contents fixed for the call site, a named char array may be rewritten between calls.
+		 */
+		constexpr bool is_literal_spelling(const std::string_view spelling)
+		{
+			if (spelling.substr(0, 2) == "u8")
+				return is_literal_spelling(spelling.substr(2));
+			return !spelling.empty() && (spelling.front() == '"' || spelling.substr(0, 2) == "R\"");
+		}
+
+		template <typename T>
+		inline constexpr bool is_fmt_array_v = std::is_array_v<std::remove_reference_t<T>>;
+	}
+
 	struct logger_t
 	{
-		explicit logger_t(std::ostream& stream): m_stream(stream)
+		logger_t() = default;
+
+		/**
+		 * Every formatted string is also appended to the stream, for code which formatted into a stream of its own before the logger kept
+		 * a buffer
+		 */
+		explicit logger_t(std::ostream& stream): m_stream(&stream)
 		{}
 
 		template <typename... Args>
 		std::string format(std::string fmt, Args&&... args)
 		{
+			return std::string(format_view(std::move(fmt), std::forward<Args>(args)...));
+		}
+
+		/**
+		 * Formats using a format string parsed ahead of time. Unlike the std::string overload the spec and section tables are only read.
+		 */
+		template <typename... Args>
+		std::string format(const detail::compiled_fmt_t& fmt, Args&&... args)
+		{
+			return std::string(format_view(fmt, std::forward<Args>(args)...));
+		}
+
+		/**
+		 * Same as format() but returns a view of the logger's buffer instead of a copy. The view is valid until this logger formats again.
+		 */
+		template <typename... Args>
+		std::string_view format_view(std::string fmt, Args&&... args)
+		{
+			m_buffer.clear();
 			if (fmt.empty())
-				return fmt;
+				return {};
 			auto sequence = std::make_integer_sequence<size_t, sizeof...(Args)>{};
 			m_arg_print_funcs.clear();
 			m_arg_print_funcs.resize(sizeof...(Args));
 			create_conv_funcs(sequence, std::forward<Args>(args)...);
 			compile(std::move(fmt));
 			process_strings();
-			return to_string();
+			return formatted();
+		}
+
+		template <typename... Args>
+		std::string_view format_view(const detail::compiled_fmt_t& fmt, Args&&... args)
+		{
+			const std::array<fmt_arg_t, sizeof...(Args)> arg_funcs{make_arg(args)...};
+			process_compiled(fmt, arg_funcs.data(), arg_funcs.size());
+			return formatted();
 		}
 
 		[[nodiscard]] std::string to_string() const;
@@ -62,103 +132,102 @@ namespace blt::logging
 		template <size_t index, typename T>
 		void handle_func(const T& t)
 		{
-			m_arg_print_funcs[index] = [&t](std::ostream& stream, const fmt_spec_t& type) {
-				switch (type.sign)
-				{
-					case fmt_sign_t::SPACE:
-						if constexpr (std::is_arithmetic_v<T>)
-						{
-							if (type.type != fmt_type_t::BINARY && static_cast<i64>(t) >= 0l)
-								stream << ' ';
-						}
-						break;
-					case fmt_sign_t::PLUS:
-					case fmt_sign_t::MINUS:
-						break;
-				}
-				switch (type.type)
-				{
-					case fmt_type_t::BINARY:
+			m_arg_print_funcs[index] = make_arg(t);
+		}
+
+		template <typename T>
+		static fmt_arg_t make_arg(const T& t)
+		{
+			return fmt_arg_t{&t, &print_arg<T>};
+		}
+
+		template <typename T>
+		static void print_arg(fmt_buffer_t& out, const fmt_spec_t& type, const void* ptr)
+		{
+			const T& t = *static_cast<const T*>(ptr);
+			switch (type.type)
+			{
+				case fmt_type_t::BINARY:
+					if constexpr (std::is_trivially_copyable_v<T>)
+						write_binary(out, type, &t, sizeof(T));
+					else
+						print_streamed(out, type, t);
+					break;
+				case fmt_type_t::CHAR:
+					if constexpr (std::is_arithmetic_v<T> || std::is_convertible_v<T, char>)
 					{
-						if constexpr (std::is_trivially_copyable_v<T>)
-						{
-							// copy bytes of type
-							char buffer[sizeof(T)];
-							std::memcpy(buffer, &t, sizeof(T));
-							// display prefix
-							if (type.alternate_form)
-								stream << '0' << (type.uppercase ? 'B' : 'b');
-							// print bytes
-							for (size_t i = 0; i < sizeof(T); ++i)
-							{
-								// print bits
-								for (size_t j = 0; j < 8; ++j)
-									stream << ((buffer[i] & (1 << j)) ? '1' : '0');
-								// special seperator defined via sign (weird hack, change?)
-								if (type.sign == fmt_sign_t::SPACE && i != sizeof(T) - 1)
-									stream << ' ';
-							}
-						} else
-						{
-							if constexpr (blt::meta::is_streamable_v<T>)
-								stream << t;
-							else
-								stream << "{INVALID TYPE}";
-						}
-						break;
-					}
-					case fmt_type_t::CHAR:
-						if constexpr (std::is_arithmetic_v<T> || std::is_convertible_v<T, char>)
-						{
-							stream << static_cast<char>(t);
-						} else
-						{
-							if constexpr (blt::meta::is_streamable_v<T>)
-								stream << t;
-							else
-								stream << "{INVALID TYPE}";
-						}
-						break;
-					case fmt_type_t::TYPE:
-						stream << blt::type_string<T>();
-						break;
-					default:
-						handle_type(stream, type);
-						if constexpr (blt::meta::is_streamable_v<T>)
-						{
-							if constexpr (std::is_same_v<T, char> || std::is_same_v<T, signed char>)
-								stream << static_cast<int>(t);
-							else if constexpr (std::is_same_v<T, unsigned char>)
-								stream << static_cast<unsigned int>(t);
-							else
-								stream << t;
-						} else
-							stream << "{INVALID TYPE}";
-				}
-			};
+						const auto c = static_cast<char>(t);
+						write_string(out, type, std::string_view{&c, 1});
+					} else
+						print_streamed(out, type, t);
+					break;
+				case fmt_type_t::TYPE:
+					write_string(out, type, blt::type_string<T>());
+					break;
+				default:
+					print_value(out, type, t);
+			}
+		}
+
+		template <typename T>
+		static void print_value(fmt_buffer_t& out, const fmt_spec_t& type, const T& t)
+		{
+			if constexpr (std::is_same_v<T, bool>)
+			{
+				if (type.type == fmt_type_t::UNSPECIFIED)
+					write_string(out, type, t ? "true" : "false");
+				else
+					write_integral(out, type, static_cast<int>(t));
+			} else if constexpr (std::is_integral_v<T>)
+				write_integral(out, type, t);
+			else if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>)
+				write_float(out, type, static_cast<double>(t));
+			else if constexpr (std::is_same_v<T, long double>)
+				write_float(out, type, t);
+			else if constexpr (std::is_convertible_v<const T&, const char*>)
+			{
+				const char* str = t;
+				write_string(out, type, str == nullptr ? std::string_view{"(null)"} : std::string_view{str});
+			} else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+				write_string(out, type, t);
+			else
+				print_streamed(out, type, t);
+		}
+
+		template <typename T>
+		static void print_streamed(fmt_buffer_t& out, const fmt_spec_t& type, const T& t)
+		{
+			if constexpr (blt::meta::is_streamable_v<T>)
+				setup_stream(out, type) << t;
+			else
+				write_string(out, type, "{INVALID TYPE}");
 		}
 
 		[[nodiscard]] size_t find_ending_brace(size_t begin) const;
-		void setup_stream(const fmt_spec_t& spec) const;
-		std::string process_string(std::string_view str);
 		void process_strings();
-		static void handle_type(std::ostream& stream, const fmt_spec_t& spec);
-
-		static void exponential(std::ostream& stream);
-		static void fixed(std::ostream& stream);
+		void process_compiled(const detail::compiled_fmt_t& fmt, const fmt_arg_t* args, size_t arg_count);
 
 		void compile(std::string fmt);
 
+		std::string_view formatted()
+		{
+			const auto view = m_buffer.view();
+			if (m_stream)
+				m_stream->write(view.data(), static_cast<std::streamsize>(view.size()));
+			return view;
+		}
+
 		std::optional<std::pair<size_t, size_t>> consume_to_next_fmt();
 
 		std::string m_fmt;
-		std::ostream& m_stream;
+		fmt_buffer_t m_buffer;
+		std::ostream* m_stream = nullptr;
 		fmt_parser_t m_parser{m_arg_print_funcs};
 		// normal sections of string
 		std::vector<std::string_view> m_string_sections;
 		// processed format specs
 		std::vector<fmt_spec_t> m_fmt_specs;
-		std::vector<std::function<void(std::ostream&, const fmt_spec_t&)>> m_arg_print_funcs;
+		std::vector<fmt_arg_t> m_arg_print_funcs;
 		size_t m_last_fmt_pos = 0;
 		size_t m_arg_pos = 0;
 	};
@@ -177,6 +246,18 @@ namespace blt::logging
 
 	const std::string& get_thread_name();
 
+	/**
+	 * Blocks until every record logged before the call has been written and the outputs flushed.
+	 * In async mode the wait is bounded by the configured flush timeout.
+	 * @return false if the timeout expired before everything was written
+	 */
+	bool flush();
+
+	/**
+	 * @return number of records discarded by async logging under log_overflow_policy_t::COUNT
+	 */
+	u64 get_dropped_records();
+
 	template <typename... Args>
 	void print(std::string fmt, Args&&... args)
 	{
@@ -188,7 +269,7 @@ namespace blt::logging
 	void print(std::ostream& stream, std::string fmt, Args&&... args)
 	{
 		auto& logger = get_global_logger();
-		stream << logger.format(std::move(fmt), std::forward<Args>(args)...);
+		stream << logger.format_view(std::move(fmt), std::forward<Args>(args)...);
 	}
 
 	template <typename... Args>
@@ -205,28 +286,52 @@ namespace blt::logging
 		stream << std::endl;
 	}
 
+	namespace detail
+	{
+		void log_formatted(log_level_t level, const char* file, i32 line, std::string_view user_str);
+	}
+
 	template <typename... Args>
 	void log(const log_level_t level, const char* file, const i32 line, std::string fmt, Args&&... args)
 	{
 		auto& logger = get_global_logger();
-		const auto& config = get_global_config();
-		std::string user_str = logger.format(std::move(fmt), std::forward<Args>(args)...);
-		if (!user_str.empty() && user_str.back() == '\n')
-			user_str.pop_back();
-		if (level == log_level_t::NONE)
+		detail::log_formatted(level, file, line, logger.format_view(std::move(fmt), std::forward<Args>(args)...));
+	}
+
+	/**
+	 * Used by the BLT_* macros, compiled is the call site's pre-parsed format or null if fmt could not be parsed ahead of time.
+	 */
+	template <typename... Args>
+	void log(const log_level_t level, const char* file, const i32 line, const detail::compiled_fmt_t* compiled, const std::string_view fmt,
+			Args&&... args)
+	{
+		if (compiled == nullptr)
 		{
-			print(user_str);
-			newline();
+			log(level, file, line, std::string(fmt), std::forward<Args>(args)...);
 			return;
 		}
-		auto log_fmt_str = config.generate(user_str, get_thread_name(), level, file, line);
-		if (log_fmt_str)
-			print(std::move(*log_fmt_str));
+		auto& logger = get_global_logger();
+		detail::log_formatted(level, file, line, logger.format_view(*compiled, std::forward<Args>(args)...));
+	}
+
+	/**
+	 * Used by the BLT_* macros, cache is the call site's BLT_LOGGING_COMPILE_FMT. Taking fmt once here keeps it evaluated exactly once.
+	 */
+	template <typename Cache, typename Fmt, typename... Args>
+	void log_cached(const log_level_t level, const char* file, const i32 line, Cache&& cache, const Fmt& fmt, Args&&... args)
+	{
+		log(level, file, line, cache(fmt), fmt, std::forward<Args>(args)...);
 	}
 
 	namespace detail
 	{
+		/**
+		 * Runs the configured injectors over the string.
+		 * @return true if the resulting string should be printed
+		 */
+		bool apply_injectors(std::string& str);
 
+		void submit_async(std::string str);
 	}
 }
 
@@ -245,11 +350,23 @@ namespace blt::string
 #pragma clang diagnostic ignored "-Wgnu-zero-variadic-macro-arguments"
 #endif
 
+// Parses a literal format string once per call site. The lambda type is unique to each expansion, so its static holds that call site's format.
+// fmt is only stringized here, never evaluated, the lambda is called with the value log_cached() received.
+#define BLT_LOGGING_COMPILE_FMT(fmt) [](const auto& blt_fmt_str) -> const ::blt::logging::detail::compiled_fmt_t* {                  \
+        if constexpr (::blt::logging::detail::is_fmt_array_v<decltype(blt_fmt_str)> &&                                             \
+                      ::blt::logging::detail::is_literal_spelling(#fmt))                                                           \
+        {                                                                                                                          \
+            static const auto blt_compiled_fmt = ::blt::logging::detail::compile_fmt(blt_fmt_str);                                 \
+            return blt_compiled_fmt ? &*blt_compiled_fmt : nullptr;                                                                \
+        } else                                                                                                                     \
+            return nullptr;                                                                                                        \
+    }
+
 #ifdef BLT_DISABLE_LOGGING
 #define BLT_LOG(level, fmt, ...)
 
 #else
-#define BLT_LOG(level, fmt, ...) blt::logging::log(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+#define BLT_LOG(level, fmt, ...) blt::logging::log_cached(level, __FILE__, __LINE__, BLT_LOGGING_COMPILE_FMT(fmt), fmt, ##__VA_ARGS__)
 
 #ifdef BLT_DISABLE_TRACE
 #define BLT_TRACE(format, ...)
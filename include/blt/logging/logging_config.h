@@ -20,8 +20,10 @@
 #define BLT_LOGGING_LOGGING_CONFIG_H
 
 #include <array>
+#include <chrono>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <blt/fs/fwddecl.h>
 #include <blt/logging/fwddecl.h>
@@ -105,6 +107,43 @@ namespace blt::logging
 				// token used to describe that a non-format token should be consumed. aka a normal string from the file.
 				CONTENT
 			};
+
+			/**
+			 * Operations of the compiled render plan. Anything which only changes once a second (dates, times, literal text and colors
+			 * between them) is grouped into CACHED segments which each thread renders once per second.
+			 */
+			enum class render_op_t : u8
+			{
+				// literal text, index into the render text
+				TEXT,
+				// per second segment, index into the cached segments
+				CACHED,
+				YEAR,
+				MONTH,
+				DAY,
+				HOUR,
+				MINUTE,
+				SECOND,
+				MS,
+				NS,
+				UNIX,
+				UNIX_NANO,
+				LEVEL_COLOR,
+				CONDITIONAL_ERROR_COLOR,
+				LEVEL_NAME,
+				THREAD_NAME,
+				FILE,
+				LINE,
+				STR
+			};
+
+			struct render_step_t
+			{
+				render_op_t op;
+				u32 index = 0;
+			};
+
+			struct prefix_cache_t;
 		}
 	}
 
@@ -121,6 +160,19 @@ namespace blt::logging
 
 	inline constexpr size_t LOG_LEVEL_COUNT = 6;
 
+	/**
+	 * What a thread should do when its async log buffer is full
+	 */
+	enum class log_overflow_policy_t : u8
+	{
+		// wait for the background thread to make room
+		BLOCK,
+		// silently discard the record
+		DROP,
+		// discard the record and count it, the background thread writes a notice with the number of records lost
+		COUNT
+	};
+
 	class logging_config_t
 	{
 		friend logger_t;
@@ -139,6 +191,12 @@ namespace blt::logging
 			return *this;
 		}
 
+		logging_config_t& set_log_outputs(std::vector<fs::writer_t*> outputs)
+		{
+			m_log_outputs = std::move(outputs);
+			return *this;
+		}
+
 		logging_config_t& add_injector(injector_t& injector)
 		{
 			m_injectors.push_back(&injector);
@@ -194,9 +252,70 @@ namespace blt::logging
 		logging_config_t& set_ensure_alignment(const bool ensure_alignment)
 		{
 			this->m_ensure_alignment = ensure_alignment;
+			compile();
+			return *this;
+		}
+
+		/**
+		 * In async mode each thread appends finished log records to its own buffer and a single background thread writes them to the log
+		 * outputs in batches. Records from one thread stay in order, records from different threads may interleave differently than in sync mode.
+		 * Should be set before logging from multiple threads.
+		 */
+		logging_config_t& set_async(const bool async)
+		{
+			this->m_async = async;
 			return *this;
 		}
 
+		/**
+		 * Number of records each thread can have waiting for the background thread. Only applies to threads which have not logged yet.
+		 */
+		logging_config_t& set_async_buffer_size(const size_t records)
+		{
+			this->m_async_buffer_size = records;
+			return *this;
+		}
+
+		logging_config_t& set_overflow_policy(const log_overflow_policy_t policy)
+		{
+			this->m_overflow_policy = policy;
+			return *this;
+		}
+
+		/**
+		 * Upper bound on how long flush() and the flush at program exit will wait for buffered records to be written
+		 */
+		logging_config_t& set_flush_timeout(const std::chrono::milliseconds timeout)
+		{
+			this->m_flush_timeout = timeout;
+			return *this;
+		}
+
+		[[nodiscard]] bool is_async() const
+		{
+			return m_async;
+		}
+
+		[[nodiscard]] size_t get_async_buffer_size() const
+		{
+			return m_async_buffer_size;
+		}
+
+		[[nodiscard]] log_overflow_policy_t get_overflow_policy() const
+		{
+			return m_overflow_policy;
+		}
+
+		[[nodiscard]] std::chrono::milliseconds get_flush_timeout() const
+		{
+			return m_flush_timeout;
+		}
+
+		[[nodiscard]] const std::vector<fs::writer_t*>& get_log_outputs() const
+		{
+			return m_log_outputs;
+		}
+
 		[[nodiscard]] std::pair<const std::vector<tags::detail::log_tag_token_t>&, const std::vector<std::string>&> get_log_tag_tokens() const
 		{
 			return {m_log_tag_tokens, m_log_tag_content};
@@ -205,12 +324,22 @@ namespace blt::logging
 		std::optional<std::string> generate(const std::string& user_str, const std::string& thread_name, log_level_t level, const char* file,
 											i32 line) const;
 
+		/**
+		 * Appends the log line to out instead of building a new string.
+		 * @return false if the level is filtered out, in which case nothing is written
+		 */
+		bool generate(fmt_buffer_t& out, std::string_view user_str, std::string_view thread_name, log_level_t level, const char* file,
+					i32 line) const;
+
 		[[nodiscard]] const std::vector<injector_t*>& get_injectors() const
 		{
 			return m_injectors;
 		}
 
 	private:
+		void compile_render_plan();
+		void render_cached(tags::detail::prefix_cache_t& cache, i64 unix_seconds) const;
+
 		std::vector<injector_t*> m_injectors;
 		// wrappers for streams exist in blt/fs/stream_wrappers.h
 		std::vector<fs::writer_t*> m_log_outputs = get_default_log_outputs();
@@ -227,11 +356,24 @@ namespace blt::logging
 		// This creates output where the user message always starts at the same column.
 		bool m_ensure_alignment = true;
 
+		bool m_async = false;
+		size_t m_async_buffer_size = 4096;
+		log_overflow_policy_t m_overflow_policy = log_overflow_policy_t::BLOCK;
+		std::chrono::milliseconds m_flush_timeout{1000};
+
 		size_t m_longest_name_length = 0;
 
 		std::vector<std::string> m_log_tag_content;
 		std::vector<tags::detail::log_tag_token_t> m_log_tag_tokens;
 
+		// changes every compile so per thread caches know to re-render
+		u64 m_generation = 0;
+		std::vector<std::string> m_render_text;
+		std::vector<tags::detail::render_step_t> m_render_plan;
+		// steps of all cached segments, each segment is a [begin, end) range of this
+		std::vector<tags::detail::render_step_t> m_cached_steps;
+		std::vector<std::pair<u32, u32>> m_cached_segments;
+
 		static std::string get_default_log_format();
 		static std::vector<fs::writer_t*> get_default_log_outputs();
 		static std::array<std::string, LOG_LEVEL_COUNT> get_default_log_level_colors();
@@ -0,0 +1,191 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_PROFILING_PERF_COUNTERS_H
+#define BLT_PROFILING_PERF_COUNTERS_H
+
+#include <array>
+#include <string>
+#include <blt/std/types.h>
+
+namespace blt::profiling
+{
+	enum class perf_counter_t : u8
+	{
+		INSTRUCTIONS,
+		// core cycles, unlike rdtsc these follow the actual clock speed
+		CYCLES,
+		// L1 data cache read misses
+		L1D_MISSES,
+		// last level cache misses
+		LLC_MISSES,
+		BRANCH_MISSES,
+		CONTEXT_SWITCHES
+	};
+
+	static constexpr size_t PERF_COUNTER_COUNT = 6;
+
+	struct perf_values_t
+	{
+		std::array<u64, PERF_COUNTER_COUNT> values{};
+
+		u64& operator[](perf_counter_t counter)
+		{
+			return values[static_cast<size_t>(counter)];
+		}
+
+		u64 operator[](perf_counter_t counter) const
+		{
+			return values[static_cast<size_t>(counter)];
+		}
+
+		perf_values_t& operator+=(const perf_values_t& other)
+		{
+			for (size_t i = 0; i < PERF_COUNTER_COUNT; i++)
+				values[i] += other.values[i];
+			return *this;
+		}
+
+		// counters only grow, but scaled values of multiplexed counters can step back slightly, those clamp to 0
+		friend perf_values_t operator-(const perf_values_t& end, const perf_values_t& start)
+		{
+			perf_values_t result;
+			for (size_t i = 0; i < PERF_COUNTER_COUNT; i++)
+				result.values[i] = end.values[i] > start.values[i] ? end.values[i] - start.values[i] : 0;
+			return result;
+		}
+
+		// instructions per cycle, 0 without cycles
+		[[nodiscard]] double ipc() const
+		{
+			const auto cycles = (*this)[perf_counter_t::CYCLES];
+			return cycles == 0 ? 0 : static_cast<double>((*this)[perf_counter_t::INSTRUCTIONS]) / static_cast<double>(cycles);
+		}
+
+		// events per thousand instructions (MPKI for the miss counters), 0 without instructions
+		[[nodiscard]] double per_kilo_instruction(const perf_counter_t counter) const
+		{
+			const auto instructions = (*this)[perf_counter_t::INSTRUCTIONS];
+			return instructions == 0 ? 0 : static_cast<double>((*this)[counter]) * 1000.0 / static_cast<double>(instructions);
+		}
+	};
+
+	namespace detail
+	{
+		// rdpmc returns a register only pmc_width bits wide, the upper bits are garbage and have to take the sign of the top one
+		constexpr i64 sign_extend_pmc(const u64 raw, const u16 width)
+		{
+			if (width == 0 || width >= 64)
+				return static_cast<i64>(raw);
+			return static_cast<i64>(raw << (64 - width)) >> (64 - width);
+		}
+
+		// ns passed since the kernel last updated a perf_event_mmap_page, from a TSC value and the page's time_offset / time_mult / time_shift
+		constexpr u64 perf_time_delta(const u64 tsc, const u64 offset, const u32 mult, const u16 shift)
+		{
+			const auto quotient = tsc >> shift;
+			const auto remainder = tsc & ((u64{1} << shift) - 1);
+			return offset + quotient * mult + ((remainder * mult) >> shift);
+		}
+
+		// estimate of the full count of a counter the kernel only had on the PMU for running of the enabled ns, as perf stat does
+		inline u64 scale_count(const u64 value, const u64 enabled, const u64 running)
+		{
+			if (running == 0 || running >= enabled)
+				return value;
+			return static_cast<u64>(static_cast<double>(value) * static_cast<double>(enabled) / static_cast<double>(running));
+		}
+	}
+
+	/**
+	* Hardware counters of the calling thread, opened with perf_event_open. The hardware counters are opened as one group so the kernel
+	* always schedules them together and their ratios stay meaningful. When the kernel allows it (perf_event_mmap_page::cap_user_rdpmc)
+	* they are read with rdpmc without entering the kernel, otherwise with a single read() of the group. Both scale counts of a multiplexed
+	* group by time enabled / time running, so the start and end of an interval may come from either. Context switches are a software event
+	* and always cost a read().
+	*
+	* Nothing here throws. Counters the kernel refuses (perf_event_paranoid, seccomp, containers, VMs without a PMU, other platforms) are
+	* left out, has() tells which ones are counted, missing ones read as 0, and error() says why they are missing.
+	*
+	* Must only be read from the thread which created it.
+	*/
+	class perf_counter_group_t
+	{
+	public:
+		perf_counter_group_t();
+
+		perf_counter_group_t(const perf_counter_group_t&) = delete;
+		perf_counter_group_t& operator=(const perf_counter_group_t&) = delete;
+
+		~perf_counter_group_t();
+
+		[[nodiscard]] bool has(const perf_counter_t counter) const
+		{
+			return m_mask & (1u << static_cast<u32>(counter));
+		}
+
+		// true if at least one counter is counted
+		[[nodiscard]] bool available() const
+		{
+			return m_mask != 0;
+		}
+
+		// bit i set if perf_counter_t(i) is counted
+		[[nodiscard]] u32 mask() const
+		{
+			return m_mask;
+		}
+
+		[[nodiscard]] bool uses_rdpmc() const
+		{
+			return m_rdpmc;
+		}
+
+		// why counters are missing, empty if all of them were opened
+		[[nodiscard]] const std::string& error() const
+		{
+			return m_error;
+		}
+
+		[[nodiscard]] perf_values_t read() const;
+
+	private:
+		struct counter_t
+		{
+			int fd = -1;
+			// perf_event_mmap_page, only mapped when rdpmc is used
+			void* page = nullptr;
+		};
+
+		bool read_rdpmc(perf_values_t& values) const;
+
+		void read_group(perf_values_t& values) const;
+
+		std::array<counter_t, PERF_COUNTER_COUNT> m_counters{};
+		// hardware counters in the order they joined the group, the order read() of the group returns them in
+		std::array<perf_counter_t, PERF_COUNTER_COUNT> m_group_order{};
+		size_t m_group_size = 0;
+		u32 m_mask = 0;
+		bool m_rdpmc = false;
+		// context switches come from getrusage() if the software event cannot be opened
+		bool m_rusage_switches = false;
+		std::string m_error;
+	};
+}
+
+#endif //BLT_PROFILING_PERF_COUNTERS_H
@@ -8,10 +8,15 @@
 #ifndef BLT_PROFILER_V2_H
 #define BLT_PROFILER_V2_H
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <blt/logging/logging.h>
+#include <blt/profiling/perf_counters.h>
 
 namespace blt
 {
@@ -23,6 +28,16 @@ namespace blt
     static inline constexpr std::uint32_t PRINT_WALL = 0x4;
     // print out the thread CPU time
     static inline constexpr std::uint32_t PRINT_THREAD = 0x8;
+    // print out the p50, p90, p99, p99.9 and max wall time, of intervals which record them, see recordPercentiles()
+    static inline constexpr std::uint32_t PRINT_PERCENTILES = 0x10;
+    // print out IPC, L1D / LLC / branch misses per thousand instructions and context switches, see recordCounters()
+    static inline constexpr std::uint32_t PRINT_COUNTERS = 0x20;
+
+    // what intervals record besides their totals, see recordEvents(), recordScopes(), recordCounters() and recordPercentiles()
+    static inline constexpr std::uint8_t RECORD_EVENTS = 0x1;
+    static inline constexpr std::uint8_t RECORD_SCOPES = 0x2;
+    static inline constexpr std::uint8_t RECORD_COUNTERS = 0x4;
+    static inline constexpr std::uint8_t RECORD_PERCENTILES = 0x8;
 
     enum class sort_by
     {
@@ -35,6 +50,86 @@ namespace blt
     typedef std::int64_t pf_time_t;
     typedef std::uint64_t pf_cycle_t;
 
+    /**
+     * Fixed size log-linear histogram of durations in nanoseconds, in the style of HdrHistogram. Values below SUB_BUCKETS are counted
+     * exactly, above that every power of two is split into SUB_BUCKETS / 2 buckets, so a recorded value is off by at most 1 / (SUB_BUCKETS / 2)
+     * of itself (about 3%) over the whole 64 bit range. Histograms of the same interval on different threads are combined with merge().
+     */
+    class latency_histogram_t
+    {
+    public:
+        static inline constexpr std::size_t SUB_BUCKET_BITS = 6;
+        static inline constexpr std::size_t SUB_BUCKETS = 1ull << SUB_BUCKET_BITS;
+        static inline constexpr std::size_t HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+        static inline constexpr std::size_t BUCKET_COUNT = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * HALF_SUB_BUCKETS;
+
+        static std::size_t bucket_of(std::uint64_t value)
+        {
+            if (value < SUB_BUCKETS)
+                return static_cast<std::size_t>(value);
+#if defined(__GNUC__) || defined(__clang__)
+            const auto msb = static_cast<std::size_t>(63 - __builtin_clzll(value));
+#else
+            std::size_t msb = 63;
+            while (!(value >> msb))
+                msb--;
+#endif
+            // keep the top SUB_BUCKET_BITS bits of the value
+            const auto shift = msb - (SUB_BUCKET_BITS - 1);
+            return shift * HALF_SUB_BUCKETS + static_cast<std::size_t>(value >> shift);
+        }
+
+        // largest value which falls into the bucket
+        static std::uint64_t highest_value_of(std::size_t bucket);
+
+        void record(std::uint64_t value)
+        {
+            add(bucket_of(value), 1);
+            if (value > max_value)
+                max_value = value;
+        }
+
+        void add(std::size_t bucket, std::uint64_t count)
+        {
+            buckets[bucket] += count;
+            total += count;
+        }
+
+        void merge(const latency_histogram_t& other);
+
+        /**
+         * Removes the values of an earlier copy of this histogram, leaving the ones recorded since. The max is then only known to the
+         * precision of its bucket.
+         */
+        void subtract(const latency_histogram_t& earlier);
+
+        /**
+         * @param percentile between 0 and 100
+         * @return the highest value the percentile could be, at most max(). 0 if the histogram is empty.
+         */
+        [[nodiscard]] std::uint64_t value_at_percentile(double percentile) const;
+
+        [[nodiscard]] std::uint64_t count() const
+        {
+            return total;
+        }
+
+        [[nodiscard]] std::uint64_t max() const
+        {
+            return max_value;
+        }
+
+        void set_max(std::uint64_t value)
+        {
+            max_value = value;
+        }
+
+    private:
+        std::array<std::uint64_t, BUCKET_COUNT> buckets{};
+        std::uint64_t total = 0;
+        std::uint64_t max_value = 0;
+    };
+
     struct interval_t
     {
         pf_time_t wall_start = 0;
@@ -51,6 +146,16 @@ namespace blt
 
         std::uint64_t count = 0;
         std::string interval_name;
+        // id the interval records events and scopes under, -1 if its profile records neither
+        std::int64_t interned_id = -1;
+        std::uint8_t record_flags = 0;
+        // wall times, allocated when the interval first ends with RECORD_PERCENTILES since it is about 15KiB
+        std::unique_ptr<latency_histogram_t> wall_histogram;
+
+        profiling::perf_values_t counters_start;
+        profiling::perf_values_t counters_total;
+        // counters which were counted, see profiling::perf_counter_group_t::mask()
+        std::uint32_t counter_mask = 0;
 
         interval_t() = default;
 
@@ -72,6 +177,8 @@ namespace blt
         std::vector<interval_t*> intervals;
         std::vector<cycle_interval_t*> cycle_intervals;
         std::string name;
+        // set by recordEvents(), recordScopes(), recordCounters() and recordPercentiles()
+        std::uint8_t record_flags = 0;
 
         explicit profile_t(std::string name): name(std::move(name))
         {
@@ -106,6 +213,59 @@ namespace blt
 
     void clearProfile(profile_t& profiler);
 
+    // events kept per thread by default, about 1.5MiB
+    static inline constexpr std::size_t DEFAULT_TRACE_EVENTS = 65536;
+
+    /**
+     * Makes every interval of the profile, including ones created later, record an event each time it ends, holding its start and end time.
+     * Events go into a ring buffer per thread which keeps the newest events_per_thread of them, a thread allocates its buffer when it records
+     * its first event, so the size only applies to threads which have not recorded anything yet. Buffers of exited threads are kept.
+     */
+    void recordEvents(profile_t& profiler, std::size_t events_per_thread = DEFAULT_TRACE_EVENTS);
+
+    /**
+     * Writes the recorded events of the profile in the Chrome trace event format, which chrome://tracing and Perfetto (ui.perfetto.dev) load.
+     * Threads are named by blt::logging::get_thread_name() at the time they recorded their first event. Events are not removed.
+     */
+    void writeTrace(std::ostream& stream, const profile_t& profiler);
+
+    /**
+     * Makes every interval of the profile, including ones created later, take part in the scope tree. Each thread keeps a stack of the
+     * intervals it has started, an interval started while another is running becomes its child, so time is split into inclusive time
+     * (everything between start and end) and exclusive time (inclusive minus the inclusive time of its children). The tree is keyed by
+     * interval, the same interval reached through different parents gets a node for each path. Intervals of other profiles nested in between
+     * are transparent, their time counts as exclusive time of the nearest enclosing interval of this profile.
+     * Ending an interval also ends any still running intervals started after it on the same thread.
+     * Wall time, thread CPU time and cycles are recorded, so scoped intervals pay for reading the thread CPU time.
+     */
+    void recordScopes(profile_t& profiler);
+
+    /**
+     * Writes the scope tree of the profile, merged over all threads, as a table with inclusive and exclusive times
+     * @param flags which of PRINT_CYCLES, PRINT_THREAD and PRINT_WALL to show
+     */
+    void writeScopes(std::ostream& stream, const profile_t& profiler, std::uint32_t flags = PRINT_CYCLES | PRINT_THREAD | PRINT_WALL);
+
+    /**
+     * Writes the scope tree in the collapsed stack format ("outer;inner 1234" per line) read by flamegraph.pl and speedscope. Every
+     * path is weighted by its exclusive time, in nanoseconds for wall and thread time.
+     */
+    void writeCollapsedStacks(std::ostream& stream, const profile_t& profiler, sort_by metric = sort_by::WALL);
+
+    /**
+     * Makes every interval of the profile, including ones created later, count hardware events while it runs (see
+     * profiling::perf_counter_group_t), shown with PRINT_COUNTERS. Each thread opens its counters the first time it starts such an interval.
+     * Counters the kernel does not allow are left out and show as "-", the table then notes why.
+     */
+    void recordCounters(profile_t& profiler);
+
+    /**
+     * Makes every interval of the profile, including ones created later, keep a latency_histogram_t of its wall times, shown with
+     * PRINT_PERCENTILES. The histograms are about 15KiB each, one per interval and, for the lock free intervals, per thread, so they are only
+     * allocated for profiles which ask for them. Intervals show "-" for the times they ended before this was called.
+     */
+    void recordPercentiles(profile_t& profiler);
+
     namespace _internal
     {
         void startInterval(const std::string& profile_name, const std::string& interval_name);
@@ -118,6 +278,78 @@ namespace blt
         void writeProfile(std::ostream& stream, const std::string& profile_name,
                           std::uint32_t flags = AVERAGE_HISTORY | PRINT_CYCLES | PRINT_THREAD | PRINT_WALL,
                           sort_by sort = sort_by::CYCLES);
+
+        // same as blt::recordEvents() for both kinds of intervals of this profile
+        void recordEvents(const std::string& profile_name, std::size_t events_per_thread = DEFAULT_TRACE_EVENTS);
+
+        void writeTrace(std::ostream& stream, const std::string& profile_name);
+
+        void recordScopes(const std::string& profile_name);
+
+        void writeScopes(std::ostream& stream, const std::string& profile_name, std::uint32_t flags = PRINT_CYCLES | PRINT_THREAD | PRINT_WALL);
+
+        void writeCollapsedStacks(std::ostream& stream, const std::string& profile_name, sort_by metric = sort_by::WALL);
+
+        void recordCounters(const std::string& profile_name);
+
+        void recordPercentiles(const std::string& profile_name);
+
+        /**
+         * Low overhead intervals
+         * ----------------------
+         * Intervals are interned once into a numeric id (normally once per call site, see BLT_INTERVAL_ID) and every thread accumulates
+         * into its own slots, so starting and ending an interval takes no lock, does no lookup and never touches memory shared with other
+         * threads. Slots are only merged when the profile is printed or written with printProfile / writeProfile above, which also reset them.
+         * Only wall time and cycles are recorded, reading the thread CPU time is a syscall and would cost more than everything else together.
+         * Profiles which record scopes (see recordScopes()) are the exception, their scope tree includes thread time.
+         * Starting an interval again before it was ended on the same thread restarts it.
+         */
+        using interval_id_t = std::uint32_t;
+
+        // ids are never released, at most MAX_INTERVAL_IDS distinct intervals can exist
+        static inline constexpr std::size_t MAX_INTERVAL_IDS = 65536;
+
+        /**
+         * @return the id for this profile and interval, the same pair always returns the same id
+         * @throws std::runtime_error if MAX_INTERVAL_IDS intervals already exist
+         */
+        interval_id_t intern_interval(std::string_view profile_name, std::string_view interval_name);
+
+        void start_interval(interval_id_t id);
+
+        void end_interval(interval_id_t id);
+
+        struct interval_overhead_t
+        {
+            double cycles = 0;
+            double wall_ns = 0;
+        };
+
+        /**
+         * Measures the average cost of one start_interval / end_interval pair on the calling thread
+         */
+        interval_overhead_t measure_interval_overhead(std::size_t iterations = 100000);
+
+        class scoped_interval_t
+        {
+        private:
+            interval_id_t id;
+
+        public:
+            explicit scoped_interval_t(interval_id_t id): id(id)
+            {
+                start_interval(id);
+            }
+
+            scoped_interval_t(const scoped_interval_t&) = delete;
+
+            scoped_interval_t& operator=(const scoped_interval_t&) = delete;
+
+            ~scoped_interval_t()
+            {
+                end_interval(id);
+            }
+        };
     }
 
     class auto_interval
@@ -148,12 +380,43 @@ namespace blt
     };
 }
 
+#define BLT_PROFILER_CONCAT_IMPL(a, b) a##b
+#define BLT_PROFILER_CONCAT(a, b) BLT_PROFILER_CONCAT_IMPL(a, b)
+
 #ifdef BLT_DISABLE_PROFILING
     #define BLT_START_INTERVAL(profileName, intervalName)
     #define BLT_END_INTERVAL(profileName, intervalName)
     #define BLT_PRINT_PROFILE(profileName, ...)
     #define BLT_WRITE_PROFILE(stream, profileName)
+    #define BLT_START_FAST_INTERVAL(profileName, intervalName)
+    #define BLT_END_FAST_INTERVAL(profileName, intervalName)
+    #define BLT_PROFILE_SCOPE(profileName, intervalName)
+    #define BLT_RECORD_EVENTS(profileName, ...)
+    #define BLT_WRITE_TRACE(stream, profileName)
+    #define BLT_RECORD_SCOPES(profileName)
+    #define BLT_WRITE_SCOPES(stream, profileName, ...)
+    #define BLT_WRITE_COLLAPSED_STACKS(stream, profileName, ...)
+    #define BLT_RECORD_COUNTERS(profileName)
+    #define BLT_RECORD_PERCENTILES(profileName)
 #else
+/**
+ * Interns the interval the first time this call site runs and returns the cached id afterwards. The names must not change between calls
+ * from the same call site, use BLT_START_INTERVAL for names built at runtime.
+ */
+#define BLT_INTERVAL_ID(profileName, intervalName) ([&]() {                                                                         \
+        static const blt::_internal::interval_id_t blt_interval_id = blt::_internal::intern_interval(profileName, intervalName);    \
+        return blt_interval_id;                                                                                                     \
+    }())
+/**
+ * Lock free versions of BLT_START_INTERVAL and BLT_END_INTERVAL, they show up in the same BLT_PRINT_PROFILE / BLT_WRITE_PROFILE output.
+ */
+#define BLT_START_FAST_INTERVAL(profileName, intervalName) blt::_internal::start_interval(BLT_INTERVAL_ID(profileName, intervalName))
+#define BLT_END_FAST_INTERVAL(profileName, intervalName) blt::_internal::end_interval(BLT_INTERVAL_ID(profileName, intervalName))
+/**
+ * Measures the rest of the enclosing scope as a fast interval
+ */
+#define BLT_PROFILE_SCOPE(profileName, intervalName) \
+    blt::_internal::scoped_interval_t BLT_PROFILER_CONCAT(blt_profile_scope_, __COUNTER__)(BLT_INTERVAL_ID(profileName, intervalName))
 /**
  * Starts an interval to be measured, when ended the row will be added to the specified profile.
  */
@@ -173,6 +436,35 @@ namespace blt
  * writes the profile to an output stream, ordered from least time to most time, in CSV format.
  */
 #define BLT_WRITE_PROFILE(stream, profileName, ...) blt::_internal::writeProfile(stream, profileName, ##__VA_ARGS__)
+/**
+ * Starts recording an event every time an interval of the profile ends.
+ * @param eventsPerThread size of the ring buffer of each thread (default: blt::DEFAULT_TRACE_EVENTS)
+ */
+#define BLT_RECORD_EVENTS(profileName, ...) blt::_internal::recordEvents(profileName, ##__VA_ARGS__)
+/**
+ * writes the recorded events of the profile as Chrome trace event JSON
+ */
+#define BLT_WRITE_TRACE(stream, profileName) blt::_internal::writeTrace(stream, profileName)
+/**
+ * Starts building the tree of nested intervals of the profile
+ */
+#define BLT_RECORD_SCOPES(profileName) blt::_internal::recordScopes(profileName)
+/**
+ * writes the scope tree of the profile as a table of inclusive and exclusive times
+ */
+#define BLT_WRITE_SCOPES(stream, profileName, ...) blt::_internal::writeScopes(stream, profileName, ##__VA_ARGS__)
+/**
+ * writes the scope tree of the profile as collapsed stacks, for flamegraph.pl or speedscope
+ */
+#define BLT_WRITE_COLLAPSED_STACKS(stream, profileName, ...) blt::_internal::writeCollapsedStacks(stream, profileName, ##__VA_ARGS__)
+/**
+ * Starts counting hardware events for the intervals of the profile, print them with blt::PRINT_COUNTERS
+ */
+#define BLT_RECORD_COUNTERS(profileName) blt::_internal::recordCounters(profileName)
+/**
+ * Starts keeping a wall time histogram for the intervals of the profile, print the percentiles with blt::PRINT_PERCENTILES
+ */
+#define BLT_RECORD_PERCENTILES(profileName) blt::_internal::recordPercentiles(profileName)
 #endif
 
 #endif //BLT_PROFILER_V2_H
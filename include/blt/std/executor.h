@@ -0,0 +1,1135 @@
+#pragma once
+/*
+ *  Work stealing task executor
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_STD_EXECUTOR_H
+#define BLT_STD_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <blt/std/memory_util.h>
+#include <blt/std/types.h>
+
+namespace blt
+{
+    namespace detail
+    {
+        /**
+         * Small block allocator used for executor tasks and their shared result state. Every thread owns a set of size class free lists,
+         * blocks freed by another thread are pushed onto the owner's lock free remote list and reclaimed the next time the owner runs dry.
+         * In the steady state submitting a task does not touch the global heap.
+         */
+        class task_allocator_t
+        {
+            public:
+                static constexpr size_t SIZE_CLASSES = 5;
+                static constexpr size_t MIN_BLOCK_SIZE = 64;
+                static constexpr size_t MAX_BLOCK_SIZE = MIN_BLOCK_SIZE << (SIZE_CLASSES - 1);
+                static constexpr size_t LARGE_CLASS = SIZE_CLASSES;
+
+                static void* allocate(const size_t bytes)
+                {
+                    const auto size_class = class_for(bytes + sizeof(block_header_t));
+                    auto* holder = local_holder();
+                    if (size_class == LARGE_CLASS || holder == nullptr)
+                        return new_block(nullptr, LARGE_CLASS, bytes + sizeof(block_header_t));
+
+                    auto* pool = holder->pool;
+                    auto*& head = pool->local[size_class];
+                    if (head == nullptr)
+                        head = pool->remote[size_class].exchange(nullptr, std::memory_order_acquire);
+                    if (head == nullptr)
+                    {
+                        pool->refs.fetch_add(1, std::memory_order_relaxed);
+                        return new_block(pool, size_class, MIN_BLOCK_SIZE << size_class);
+                    }
+                    auto* block = head;
+                    head = block->next;
+                    return block;
+                }
+
+                static void deallocate(void* ptr)
+                {
+                    auto* header = static_cast<block_header_t*>(ptr) - 1;
+                    auto* pool = header->owner;
+                    if (pool == nullptr)
+                    {
+                        ::operator delete(header);
+                        return;
+                    }
+                    auto* block = static_cast<free_block_t*>(ptr);
+                    auto* holder = local_holder();
+                    if (holder != nullptr && holder->pool == pool)
+                    {
+                        block->next = pool->local[header->size_class];
+                        pool->local[header->size_class] = block;
+                        return;
+                    }
+                    // once pushed the block may be reclaimed at any moment, our own reference keeps the pool valid until we are done with it
+                    pool->refs.fetch_add(1, std::memory_order_relaxed);
+                    auto& remote = pool->remote[header->size_class];
+                    block->next = remote.load(std::memory_order_relaxed);
+                    while (!remote.compare_exchange_weak(block->next, block, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    {}
+                    // the owning thread may have exited between our push and now, in which case nobody else will reclaim the block
+                    if (!pool->alive.load(std::memory_order_seq_cst))
+                        drain_remote(pool);
+                    release(pool);
+                }
+
+            private:
+                struct pool_t;
+
+                struct alignas(16) block_header_t
+                {
+                    pool_t* owner;
+                    size_t size_class;
+                };
+
+                struct free_block_t
+                {
+                    free_block_t* next;
+                };
+
+                struct pool_t
+                {
+                    // one reference for the owning thread plus one for every block this pool has created
+                    std::atomic<size_t> refs{1};
+                    std::atomic_bool alive{true};
+                    free_block_t* local[SIZE_CLASSES]{};
+                    std::atomic<free_block_t*> remote[SIZE_CLASSES]{};
+                };
+
+                struct pool_holder_t
+                {
+                    pool_t* pool = new pool_t;
+
+                    ~pool_holder_t()
+                    {
+                        destroyed() = true;
+                        pool->alive.store(false, std::memory_order_seq_cst);
+                        for (auto*& head : pool->local)
+                        {
+                            while (head != nullptr)
+                            {
+                                auto* next = head->next;
+                                delete_block(pool, head);
+                                head = next;
+                            }
+                        }
+                        drain_remote(pool);
+                        release(pool);
+                    }
+                };
+
+                static bool& destroyed()
+                {
+                    static thread_local bool is_destroyed = false;
+                    return is_destroyed;
+                }
+
+                static pool_holder_t* local_holder()
+                {
+                    if (destroyed())
+                        return nullptr;
+                    static thread_local pool_holder_t holder;
+                    return &holder;
+                }
+
+                static size_t class_for(const size_t bytes)
+                {
+                    size_t size_class = 0;
+                    while (size_class < SIZE_CLASSES && (MIN_BLOCK_SIZE << size_class) < bytes)
+                        ++size_class;
+                    return size_class;
+                }
+
+                static void* new_block(pool_t* owner, const size_t size_class, const size_t bytes)
+                {
+                    auto* header = static_cast<block_header_t*>(::operator new(bytes));
+                    header->owner = owner;
+                    header->size_class = size_class;
+                    return header + 1;
+                }
+
+                static void delete_block(pool_t* pool, free_block_t* block)
+                {
+                    ::operator delete(reinterpret_cast<block_header_t*>(block) - 1);
+                    release(pool);
+                }
+
+                static void drain_remote(pool_t* pool)
+                {
+                    // hold a reference so the pool cannot be freed out from under us by a concurrent drain
+                    pool->refs.fetch_add(1, std::memory_order_relaxed);
+                    for (auto& remote : pool->remote)
+                    {
+                        auto* head = remote.exchange(nullptr, std::memory_order_acquire);
+                        while (head != nullptr)
+                        {
+                            auto* next = head->next;
+                            delete_block(pool, head);
+                            head = next;
+                        }
+                    }
+                    release(pool);
+                }
+
+                static void release(pool_t* pool)
+                {
+                    if (pool->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        delete pool;
+                }
+        };
+
+        /**
+         * Intrusive type erased unit of work. The run function is responsible for both invoking and destroying the task.
+         */
+        struct executor_task_t
+        {
+            executor_task_t* next = nullptr;
+            void (* run)(executor_task_t*) = nullptr;
+        };
+
+        template<typename F>
+        struct executor_task_impl_t : executor_task_t
+        {
+            F func;
+
+            explicit executor_task_impl_t(F&& f): func(std::move(f))
+            {
+                run = [](executor_task_t* self) {
+                    auto* task = static_cast<executor_task_impl_t*>(self);
+                    task->func();
+                    task->~executor_task_impl_t();
+                    task_allocator_t::deallocate(task);
+                };
+            }
+
+            static executor_task_impl_t* create(F&& f)
+            {
+                static_assert(alignof(executor_task_impl_t) <= alignof(std::max_align_t), "Over aligned tasks are not supported!");
+                return new(task_allocator_t::allocate(sizeof(executor_task_impl_t))) executor_task_impl_t(std::move(f));
+            }
+        };
+
+        struct task_state_base_t;
+    }
+
+    template<typename T>
+    class task_handle;
+
+    /**
+     * Chase-Lev work stealing deque. (Lê, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models")
+     * The owning thread pushes and pops from the bottom, any other thread may steal from the top.
+     * @tparam T element type, must be trivially copyable (usually a pointer)
+     */
+    template<typename T>
+    class chase_lev_deque
+    {
+            static_assert(std::is_trivially_copyable_v<T>, "Deque elements must be trivially copyable!");
+
+            struct ring_t
+            {
+                i64 capacity;
+                i64 mask;
+                std::unique_ptr<std::atomic<T>[]> data;
+
+                explicit ring_t(i64 capacity): capacity(capacity), mask(capacity - 1), data(new std::atomic<T>[static_cast<size_t>(capacity)])
+                {}
+
+                void put(i64 index, T value)
+                {
+                    data[static_cast<size_t>(index & mask)].store(value, std::memory_order_relaxed);
+                }
+
+                T get(i64 index) const
+                {
+                    return data[static_cast<size_t>(index & mask)].load(std::memory_order_relaxed);
+                }
+            };
+
+        public:
+            explicit chase_lev_deque(size_t initial_capacity = 256)
+            {
+                size_t capacity = 1;
+                while (capacity < initial_capacity)
+                    capacity <<= 1;
+                auto* ring = new ring_t(static_cast<i64>(capacity));
+                m_rings.emplace_back(ring);
+                m_ring.store(ring, std::memory_order_relaxed);
+            }
+
+            chase_lev_deque(const chase_lev_deque& copy) = delete;
+
+            chase_lev_deque& operator=(const chase_lev_deque& copy) = delete;
+
+            /**
+             * Owner only. Pushes a value onto the bottom of the deque, growing the buffer if required.
+             */
+            void push(T value)
+            {
+                const auto bottom = m_bottom.load(std::memory_order_relaxed);
+                const auto top = m_top.load(std::memory_order_acquire);
+                auto* ring = m_ring.load(std::memory_order_relaxed);
+                if (bottom - top > ring->capacity - 1)
+                    ring = grow(ring, top, bottom);
+                ring->put(bottom, value);
+                m_bottom.store(bottom + 1, std::memory_order_release);
+            }
+
+            /**
+             * Owner only. Pops the most recently pushed value.
+             * @return true if a value was written into out
+             */
+            bool pop(T& out)
+            {
+                const auto bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+                auto* ring = m_ring.load(std::memory_order_relaxed);
+                m_bottom.store(bottom, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                auto top = m_top.load(std::memory_order_relaxed);
+
+                if (top > bottom)
+                {
+                    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                    return false;
+                }
+
+                out = ring->get(bottom);
+                if (top != bottom)
+                    return true;
+
+                // last element, race against the thieves for it
+                const bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                return won;
+            }
+
+            /**
+             * Any thread. Takes the oldest value from the top of the deque.
+             * @return true if a value was written into out. A false return does not guarantee the deque is empty, only that this steal lost.
+             */
+            bool steal(T& out)
+            {
+                auto top = m_top.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                const auto bottom = m_bottom.load(std::memory_order_acquire);
+
+                if (top >= bottom)
+                    return false;
+
+                auto* ring = m_ring.load(std::memory_order_acquire);
+                out = ring->get(top);
+                return m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] bool empty() const
+            {
+                const auto bottom = m_bottom.load(std::memory_order_seq_cst);
+                const auto top = m_top.load(std::memory_order_seq_cst);
+                return bottom <= top;
+            }
+
+            [[nodiscard]] size_t size() const
+            {
+                const auto bottom = m_bottom.load(std::memory_order_seq_cst);
+                const auto top = m_top.load(std::memory_order_seq_cst);
+                return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+            }
+
+        private:
+            ring_t* grow(ring_t* old, i64 top, i64 bottom)
+            {
+                auto* ring = new ring_t(old->capacity * 2);
+                for (i64 i = top; i < bottom; i++)
+                    ring->put(i, old->get(i));
+                // thieves may still be reading from the old ring, it is kept alive until the deque is destroyed.
+                m_rings.emplace_back(ring);
+                m_ring.store(ring, std::memory_order_release);
+                return ring;
+            }
+
+            alignas(mem::cache_line_size) std::atomic<i64> m_top{0};
+            alignas(mem::cache_line_size) std::atomic<i64> m_bottom{0};
+            std::atomic<ring_t*> m_ring{nullptr};
+            std::vector<std::unique_ptr<ring_t>> m_rings;
+    };
+
+    /**
+     * Multi producer intrusive injection queue. Producers push with a single CAS, consumers take the whole chain at once
+     * with an exchange which avoids the ABA problem of a popping Treiber stack.
+     */
+    class injection_queue_t
+    {
+        public:
+            void push(detail::executor_task_t* task)
+            {
+                auto* head = m_head.load(std::memory_order_relaxed);
+                do
+                {
+                    task->next = head;
+                } while (!m_head.compare_exchange_weak(head, task, std::memory_order_seq_cst, std::memory_order_relaxed));
+            }
+
+            /**
+             * @return every task in the queue linked through next, newest first
+             */
+            detail::executor_task_t* take_all()
+            {
+                if (m_head.load(std::memory_order_relaxed) == nullptr)
+                    return nullptr;
+                return m_head.exchange(nullptr, std::memory_order_acquire);
+            }
+
+            [[nodiscard]] bool empty() const
+            {
+                return m_head.load(std::memory_order_seq_cst) == nullptr;
+            }
+
+        private:
+            alignas(mem::cache_line_size) std::atomic<detail::executor_task_t*> m_head{nullptr};
+    };
+
+    /**
+     * Work stealing executor. Each worker owns a chase_lev_deque, tasks submitted from outside the executor go into a lock free
+     * injection queue. Idle workers spin briefly then park on a condition variable, submitters only touch the park mutex when
+     * a worker is actually asleep.
+     */
+    class work_stealing_executor
+    {
+        public:
+            explicit work_stealing_executor(size_t threads = std::thread::hardware_concurrency())
+            {
+                if (threads == 0)
+                    threads = 1;
+                m_workers.reserve(threads);
+                for (size_t i = 0; i < threads; i++)
+                    m_workers.emplace_back(new worker_t(i));
+                for (size_t i = 0; i < threads; i++)
+                    m_workers[i]->thread = std::thread([this, i]() {
+                        worker_loop(i);
+                    });
+            }
+
+            work_stealing_executor(const work_stealing_executor& copy) = delete;
+
+            work_stealing_executor(work_stealing_executor&& move) = delete;
+
+            work_stealing_executor& operator=(const work_stealing_executor& copy) = delete;
+
+            work_stealing_executor& operator=(work_stealing_executor&& move) = delete;
+
+            /**
+             * Queues func to be run on the executor. Tasks submitted from a worker thread go onto that worker's own deque,
+             * everything else goes into the shared injection queue.
+             */
+            template<typename F>
+            void execute(F&& func)
+            {
+                submit_task(detail::executor_task_impl_t<std::decay_t<F>>::create(std::decay_t<F>(std::forward<F>(func))));
+            }
+
+            /**
+             * Queues func to be run on the executor.
+             * @return a handle which can be waited on, chained with then() or combined with when_all(). The result is stored inline with
+             * the task in pooled storage.
+             */
+            template<typename F>
+            task_handle<std::invoke_result_t<std::decay_t<F>>> submit(F&& func);
+
+            void submit_task(detail::executor_task_t* task)
+            {
+                auto& ctx = context();
+                if (ctx.executor == this)
+                    m_workers[ctx.index]->deque.push(task);
+                else
+                    m_injection.push(task);
+                wake_one();
+            }
+
+            [[nodiscard]] size_t thread_count() const
+            {
+                return m_workers.size();
+            }
+
+            /**
+             * @return true if the calling thread is one of this executor's workers
+             */
+            [[nodiscard]] bool in_worker() const
+            {
+                return context().executor == this;
+            }
+
+            /**
+             * Runs a single pending task on the calling thread if one can be found. Used to help out instead of blocking.
+             * @return true if a task was run
+             */
+            bool try_run_one()
+            {
+                auto& ctx = context();
+                auto* task = ctx.executor == this ? find_task(ctx.index) : find_task_external();
+                if (task == nullptr)
+                    return false;
+                task->run(task);
+                return true;
+            }
+
+            ~work_stealing_executor()
+            {
+                {
+                    std::scoped_lock lock(m_park_mutex);
+                    m_stopping.store(true, std::memory_order_seq_cst);
+                    ++m_park_epoch;
+                }
+                m_park_cv.notify_all();
+                for (auto& worker : m_workers)
+                {
+                    if (worker->thread.joinable())
+                        worker->thread.join();
+                }
+            }
+
+        private:
+            // number of times a worker will look for work before parking
+            static constexpr size_t SPIN_LIMIT = 64;
+
+            struct alignas(mem::cache_line_size) worker_t
+            {
+                chase_lev_deque<detail::executor_task_t*> deque;
+                std::thread thread;
+                u64 rng_state;
+
+                explicit worker_t(const size_t index): rng_state(0x9E3779B97F4A7C15ull * (index + 1))
+                {}
+
+                u64 next_random()
+                {
+                    // xorshift64
+                    rng_state ^= rng_state << 13;
+                    rng_state ^= rng_state >> 7;
+                    rng_state ^= rng_state << 17;
+                    return rng_state;
+                }
+            };
+
+            struct worker_context_t
+            {
+                work_stealing_executor* executor = nullptr;
+                size_t index = 0;
+            };
+
+            static worker_context_t& context()
+            {
+                static thread_local worker_context_t ctx;
+                return ctx;
+            }
+
+            void wake_one()
+            {
+                // pairs with the seq_cst updates of m_searching / m_sleepers in the worker loop, either the worker sees our task or we see
+                // the worker. A worker which is already searching will find the task on its own so there is no need to wake another.
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (m_searching.load(std::memory_order_relaxed) != 0 || m_sleepers.load(std::memory_order_relaxed) == 0)
+                    return;
+                {
+                    std::scoped_lock lock(m_park_mutex);
+                    ++m_park_epoch;
+                }
+                m_park_cv.notify_one();
+            }
+
+            [[nodiscard]] bool has_visible_work() const
+            {
+                if (!m_injection.empty())
+                    return true;
+                for (const auto& worker : m_workers)
+                {
+                    if (!worker->deque.empty())
+                        return true;
+                }
+                return false;
+            }
+
+            detail::executor_task_t* take_injected(chase_lev_deque<detail::executor_task_t*>& local)
+            {
+                auto* task = m_injection.take_all();
+                if (task == nullptr)
+                    return nullptr;
+                if (task->next == nullptr)
+                    return task;
+                // the chain is newest first. Pushing it in that order leaves the oldest tasks at the bottom of our deque so they are
+                // popped first, while thieves take the newest from the top. The very oldest task is run right away.
+                while (task->next != nullptr)
+                {
+                    auto* next = task->next;
+                    local.push(task);
+                    task = next;
+                }
+                wake_one();
+                return task;
+            }
+
+            detail::executor_task_t* steal_from_others(size_t self, u64 random)
+            {
+                const auto count = m_workers.size();
+                const auto start = static_cast<size_t>(random % count);
+                for (size_t i = 0; i < count; i++)
+                {
+                    const auto victim = (start + i) % count;
+                    if (victim == self)
+                        continue;
+                    detail::executor_task_t* task;
+                    if (m_workers[victim]->deque.steal(task))
+                        return task;
+                }
+                return nullptr;
+            }
+
+            detail::executor_task_t* find_task(size_t index)
+            {
+                auto& worker = *m_workers[index];
+                detail::executor_task_t* task;
+                if (worker.deque.pop(task))
+                    return task;
+                if ((task = take_injected(worker.deque)) != nullptr)
+                    return task;
+                return steal_from_others(index, worker.next_random());
+            }
+
+            detail::executor_task_t* find_task_external()
+            {
+                // external threads have no deque to hold the rest of an injected batch, so they only steal
+                return steal_from_others(m_workers.size(), static_cast<u64>(std::hash<std::thread::id>{}(std::this_thread::get_id())));
+            }
+
+            void park()
+            {
+                std::unique_lock lock(m_park_mutex);
+                const auto epoch = m_park_epoch;
+                m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+                if (!has_visible_work() && !m_stopping.load(std::memory_order_relaxed))
+                {
+                    m_park_cv.wait(lock, [this, epoch]() {
+                        return m_park_epoch != epoch;
+                    });
+                }
+                m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            void worker_loop(size_t index)
+            {
+                auto& ctx = context();
+                ctx.executor = this;
+                ctx.index = index;
+
+                bool searching = false;
+                size_t spins = 0;
+                while (true)
+                {
+                    if (auto* task = find_task(index))
+                    {
+                        // the last searcher to find work hands the searching role to a sleeper so new work keeps getting picked up
+                        if (searching)
+                        {
+                            searching = false;
+                            if (m_searching.fetch_sub(1, std::memory_order_seq_cst) == 1)
+                                wake_one();
+                        }
+                        task->run(task);
+                        spins = 0;
+                        continue;
+                    }
+                    if (m_stopping.load(std::memory_order_acquire) && !has_visible_work())
+                        break;
+                    if (!searching)
+                    {
+                        searching = true;
+                        m_searching.fetch_add(1, std::memory_order_seq_cst);
+                    }
+                    if (++spins < SPIN_LIMIT)
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    spins = 0;
+                    searching = false;
+                    m_searching.fetch_sub(1, std::memory_order_seq_cst);
+                    park();
+                }
+
+                if (searching)
+                    m_searching.fetch_sub(1, std::memory_order_seq_cst);
+                ctx.executor = nullptr;
+            }
+
+            std::vector<std::unique_ptr<worker_t>> m_workers;
+            injection_queue_t m_injection;
+
+            alignas(mem::cache_line_size) std::atomic<size_t> m_sleepers{0};
+            std::atomic<size_t> m_searching{0};
+            std::atomic_bool m_stopping{false};
+            std::mutex m_park_mutex;
+            std::condition_variable m_park_cv;
+            u64 m_park_epoch = 0;
+    };
+
+    namespace detail
+    {
+        /**
+         * Threads blocking on a task_handle park on one of a fixed set of buckets keyed by the state address, so states do not need to
+         * carry their own mutex and condition variable.
+         */
+        struct wait_bucket_t
+        {
+            std::mutex mutex;
+            std::condition_variable cv;
+
+            static wait_bucket_t& for_address(const void* address)
+            {
+                static wait_bucket_t buckets[64];
+                return buckets[(reinterpret_cast<std::uintptr_t>(address) >> 6) % 64];
+            }
+        };
+
+        /**
+         * Shared state between a submitted task, its handles and any continuations. The state doubles as the executor task, so submitting
+         * is a single pooled allocation.
+         */
+        struct task_state_base_t : executor_task_t
+        {
+            static constexpr u32 READY = 0x1;
+            static constexpr u32 HAS_WAITERS = 0x2;
+
+            std::atomic<u32> refs{1};
+            std::atomic<u32> status{0};
+            // chain of tasks to submit when this one completes, set to completed_marker() once that has happened
+            std::atomic<executor_task_t*> continuations{nullptr};
+            work_stealing_executor* executor = nullptr;
+            std::exception_ptr exception;
+            void (* destroy)(task_state_base_t*) = nullptr;
+
+            static executor_task_t* completed_marker()
+            {
+                static executor_task_t marker;
+                return &marker;
+            }
+
+            [[nodiscard]] bool ready() const
+            {
+                return status.load(std::memory_order_acquire) & READY;
+            }
+
+            void acquire()
+            {
+                refs.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void release()
+            {
+                if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    destroy(this);
+            }
+
+            void schedule(executor_task_t* task) const
+            {
+                if (executor != nullptr)
+                    executor->submit_task(task);
+                else
+                    task->run(task);
+            }
+
+            /**
+             * Adds a task to be submitted once this state completes, or submits it right away if that has already happened.
+             */
+            void add_continuation(executor_task_t* task)
+            {
+                auto* head = continuations.load(std::memory_order_acquire);
+                do
+                {
+                    if (head == completed_marker())
+                    {
+                        schedule(task);
+                        return;
+                    }
+                    task->next = head;
+                } while (!continuations.compare_exchange_weak(head, task, std::memory_order_acq_rel, std::memory_order_acquire));
+            }
+
+            void complete()
+            {
+                const auto previous = status.fetch_or(READY, std::memory_order_acq_rel);
+                if (previous & HAS_WAITERS)
+                {
+                    auto& bucket = wait_bucket_t::for_address(this);
+                    {
+                        // waiters flag themselves while holding the bucket lock, taking it here closes the window before they sleep
+                        std::scoped_lock lock(bucket.mutex);
+                    }
+                    bucket.cv.notify_all();
+                }
+                auto* head = continuations.exchange(completed_marker(), std::memory_order_acq_rel);
+                while (head != nullptr)
+                {
+                    auto* next = head->next;
+                    schedule(head);
+                    head = next;
+                }
+            }
+
+            void wait()
+            {
+                if (ready())
+                    return;
+                // a worker blocking on a task would deadlock a busy executor, so workers help out instead
+                if (executor != nullptr && executor->in_worker())
+                {
+                    while (!ready())
+                    {
+                        if (!executor->try_run_one())
+                            std::this_thread::yield();
+                    }
+                    return;
+                }
+                for (size_t i = 0; i < 64 && !ready(); i++)
+                    std::this_thread::yield();
+                if (ready())
+                    return;
+                auto& bucket = wait_bucket_t::for_address(this);
+                std::unique_lock lock(bucket.mutex);
+                if (status.fetch_or(HAS_WAITERS, std::memory_order_acq_rel) & READY)
+                    return;
+                bucket.cv.wait(lock, [this]() {
+                    return ready();
+                });
+            }
+        };
+
+        template<typename R>
+        struct task_result_t : task_state_base_t
+        {
+            alignas(R) unsigned char storage[sizeof(R)];
+            bool has_value = false;
+
+            R& value()
+            {
+                return *std::launder(reinterpret_cast<R*>(storage));
+            }
+
+            template<typename F>
+            void store(F& func)
+            {
+                new(storage) R(func());
+                has_value = true;
+            }
+
+            ~task_result_t()
+            {
+                if (has_value)
+                    value().~R();
+            }
+        };
+
+        template<>
+        struct task_result_t<void> : task_state_base_t
+        {
+            template<typename F>
+            static void store(F& func)
+            {
+                func();
+            }
+        };
+
+        template<typename R, typename F>
+        struct task_state_t : task_result_t<R>
+        {
+            union
+            {
+                F func;
+            };
+
+            bool has_func = true;
+
+            explicit task_state_t(F&& f): func(std::move(f))
+            {
+                this->run = [](executor_task_t* self) {
+                    auto* state = static_cast<task_state_t*>(self);
+                    try
+                    {
+                        state->store(state->func);
+                    } catch (...)
+                    {
+                        state->exception = std::current_exception();
+                    }
+                    state->func.~F();
+                    state->has_func = false;
+                    state->complete();
+                    state->release();
+                };
+                this->destroy = [](task_state_base_t* self) {
+                    auto* state = static_cast<task_state_t*>(self);
+                    state->~task_state_t();
+                    task_allocator_t::deallocate(state);
+                };
+            }
+
+            ~task_state_t()
+            {
+                if (has_func)
+                    func.~F();
+            }
+
+            /**
+             * Creates the state with one reference held by the task itself and one for the returned handle.
+             */
+            static task_state_t* create(work_stealing_executor* executor, F&& f)
+            {
+                static_assert(alignof(task_state_t) <= alignof(std::max_align_t), "Over aligned task results are not supported!");
+                auto* state = new(task_allocator_t::allocate(sizeof(task_state_t))) task_state_t(std::move(f));
+                state->executor = executor;
+                state->refs.store(2, std::memory_order_relaxed);
+                return state;
+            }
+        };
+
+        /**
+         * State produced by when_all, completed by the last of its inputs rather than by running a function.
+         */
+        struct when_all_state_t : task_result_t<void>
+        {
+            std::atomic<size_t> remaining;
+
+            explicit when_all_state_t(const size_t count): remaining(count)
+            {
+                this->run = [](executor_task_t*) {};
+                this->destroy = [](task_state_base_t* self) {
+                    auto* state = static_cast<when_all_state_t*>(self);
+                    state->~when_all_state_t();
+                    task_allocator_t::deallocate(state);
+                };
+            }
+
+            static when_all_state_t* create(work_stealing_executor* executor, size_t count)
+            {
+                auto* state = new(task_allocator_t::allocate(sizeof(when_all_state_t))) when_all_state_t(count);
+                state->executor = executor;
+                return state;
+            }
+
+            void input_done()
+            {
+                if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    complete();
+            }
+
+            /**
+             * Registers a continuation on input which counts down this state. The continuation holds a reference to this state.
+             */
+            void watch(task_state_base_t* input)
+            {
+                acquire();
+                auto* state = this;
+                auto notify = [state]() {
+                    state->input_done();
+                    state->release();
+                };
+                input->add_continuation(executor_task_impl_t<decltype(notify)>::create(std::move(notify)));
+            }
+        };
+    }
+
+    /**
+     * Handle to the result of a task submitted with work_stealing_executor::submit. Handles are reference counted and cheap to copy.
+     * @tparam T result type of the task
+     */
+    template<typename T>
+    class task_handle
+    {
+            template<typename>
+            friend class task_handle;
+
+            friend class work_stealing_executor;
+
+            template<typename... Handles>
+            friend task_handle<void> when_all(const Handles&... handles);
+
+            template<typename U>
+            friend task_handle<void> when_all(const std::vector<task_handle<U>>& handles);
+
+        public:
+            task_handle() = default;
+
+            task_handle(const task_handle& copy): m_state(copy.m_state)
+            {
+                if (m_state != nullptr)
+                    m_state->acquire();
+            }
+
+            task_handle(task_handle&& move) noexcept: m_state(std::exchange(move.m_state, nullptr))
+            {}
+
+            task_handle& operator=(const task_handle& copy)
+            {
+                if (this != &copy)
+                {
+                    reset();
+                    m_state = copy.m_state;
+                    if (m_state != nullptr)
+                        m_state->acquire();
+                }
+                return *this;
+            }
+
+            task_handle& operator=(task_handle&& move) noexcept
+            {
+                if (this != &move)
+                {
+                    reset();
+                    m_state = std::exchange(move.m_state, nullptr);
+                }
+                return *this;
+            }
+
+            [[nodiscard]] bool valid() const
+            {
+                return m_state != nullptr;
+            }
+
+            [[nodiscard]] bool ready() const
+            {
+                return m_state->ready();
+            }
+
+            /**
+             * Blocks until the task has completed. Worker threads run other tasks while they wait.
+             */
+            void wait() const
+            {
+                m_state->wait();
+            }
+
+            /**
+             * Waits for the task then returns its result, rethrowing any exception the task threw.
+             */
+            decltype(auto) get() const
+            {
+                wait();
+                if (m_state->exception)
+                    std::rethrow_exception(m_state->exception);
+                if constexpr (std::is_void_v<T>)
+                    return;
+                else
+                    return static_cast<detail::task_result_t<T>*>(m_state)->value();
+            }
+
+            /**
+             * Schedules func to run on the same executor once this task completes. func receives a reference to the result (nothing for void
+             * tasks), if this task threw the exception is forwarded to the returned handle instead.
+             */
+            template<typename F>
+            auto then(F&& func) const
+            {
+                using func_t = std::decay_t<F>;
+                auto continuation = [parent = *this, func = func_t(std::forward<F>(func))]() mutable {
+                    if constexpr (std::is_void_v<T>)
+                    {
+                        parent.get();
+                        return func();
+                    } else
+                        return func(parent.get());
+                };
+                using result_t = std::invoke_result_t<decltype(continuation)&>;
+                auto* state = detail::task_state_t<result_t, decltype(continuation)>::create(m_state->executor, std::move(continuation));
+                m_state->add_continuation(state);
+                return task_handle<result_t>{state};
+            }
+
+            ~task_handle()
+            {
+                reset();
+            }
+
+        private:
+            explicit task_handle(detail::task_state_base_t* state): m_state(state)
+            {}
+
+            void reset()
+            {
+                if (m_state != nullptr)
+                    std::exchange(m_state, nullptr)->release();
+            }
+
+            detail::task_state_base_t* m_state = nullptr;
+    };
+
+    /**
+     * @return a handle which becomes ready once every input has completed. Exceptions are not forwarded, call get() on the inputs.
+     */
+    template<typename... Handles>
+    task_handle<void> when_all(const Handles&... handles)
+    {
+        static_assert(sizeof...(Handles) > 0, "when_all requires at least one handle!");
+        auto* executor = std::get<0>(std::forward_as_tuple(handles...)).m_state->executor;
+        auto* state = detail::when_all_state_t::create(executor, sizeof...(Handles) + 1);
+        (state->watch(handles.m_state), ...);
+        // the extra count stops the state completing while inputs are still being registered
+        state->input_done();
+        return task_handle<void>{state};
+    }
+
+    template<typename T>
+    task_handle<void> when_all(const std::vector<task_handle<T>>& handles)
+    {
+        auto* state = detail::when_all_state_t::create(handles.empty() ? nullptr : handles.front().m_state->executor, handles.size() + 1);
+        for (const auto& handle : handles)
+            state->watch(handle.m_state);
+        state->input_done();
+        return task_handle<void>{state};
+    }
+
+    /**
+     * @return the process wide executor used by the parallel algorithms, created with one worker per hardware thread on first use.
+     */
+    inline work_stealing_executor& global_executor()
+    {
+        static work_stealing_executor executor;
+        return executor;
+    }
+
+    template<typename F>
+    task_handle<std::invoke_result_t<std::decay_t<F>>> work_stealing_executor::submit(F&& func)
+    {
+        using func_t = std::decay_t<F>;
+        auto* state = detail::task_state_t<std::invoke_result_t<func_t>, func_t>::create(this, func_t(std::forward<F>(func)));
+        submit_task(state);
+        return task_handle<std::invoke_result_t<func_t>>{state};
+    }
+}
+
+#endif //BLT_STD_EXECUTOR_H
@@ -64,6 +64,9 @@
 
 namespace blt::mem
 {
+    // std::hardware_destructive_interference_size is not reliably available (and warns on GCC), 64 bytes is correct for x86 and most ARM cores.
+    inline constexpr std::size_t cache_line_size = 64;
+
     template <typename R, typename T>
     static R type_cast(T type)
     {
@@ -134,6 +137,47 @@ namespace blt::mem
         return fromBytes<little_endian>(in, *out);
     }
 
+    /**
+     * Reverses the bytes of every element in place. Uses AVX2 or SSSE3 shuffles when the CPU running the program supports them
+     * (checked once at runtime), otherwise swaps one element at a time.
+     */
+    void reverse_array(std::uint16_t* data, std::size_t count);
+    void reverse_array(std::uint32_t* data, std::size_t count);
+    void reverse_array(std::uint64_t* data, std::size_t count);
+
+    template <typename T>
+    void reverse_array(T* data, const std::size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Type must be trivially copyable to be reversible!");
+        static_assert(std::is_arithmetic_v<T>, "Only arithmetic types can be reversed in bulk!");
+        if constexpr (sizeof(T) == 2)
+            reverse_array(reinterpret_cast<std::uint16_t*>(data), count);
+        else if constexpr (sizeof(T) == 4)
+            reverse_array(reinterpret_cast<std::uint32_t*>(data), count);
+        else if constexpr (sizeof(T) == 8)
+            reverse_array(reinterpret_cast<std::uint64_t*>(data), count);
+    }
+
+    // bulk fromBytes, in and out may not overlap unless they are the same pointer
+    template <bool little_endian = false, typename T>
+    void fromBytesArray(const void* in, T* out, const std::size_t count)
+    {
+        if (in != out && count > 0)
+            std::memcpy(out, in, count * sizeof(T));
+        if constexpr (sizeof(T) > 1 && ENDIAN_LOOKUP(little_endian))
+            reverse_array(out, count);
+    }
+
+    // bulk toBytes, in and out may not overlap unless they are the same pointer
+    template <bool little_endian = false, typename T>
+    void toBytesArray(const T* in, void* out, const std::size_t count)
+    {
+        if (in != out && count > 0)
+            std::memcpy(out, in, count * sizeof(T));
+        if constexpr (sizeof(T) > 1 && ENDIAN_LOOKUP(little_endian))
+            reverse_array(static_cast<T*>(out), count);
+    }
+
     inline std::size_t next_byte_allocation(std::size_t prev_size, std::size_t default_allocation_block = 8192, std::size_t default_size = 16)
     {
         if (prev_size < default_size)
@@ -8,6 +8,14 @@
 #define BLT_QUEUE_H
 
 #include <blt/std/memory_util.h>
+#include <blt/std/types.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 /**
  *
@@ -87,49 +95,170 @@ namespace blt
     };
     
     /**
-     * Standard array backed first in last out queue (stack)
-     * @tparam T type stored in the queue
+     * Array backed first in first out queue. Elements live in a circular buffer over uninitialized storage, so popping frees the slot
+     * for reuse and a queue with a bounded number of live elements stops allocating once it has grown to fit them.
+     * @tparam T type stored in the queue, only needs to be move constructible
      */
     template<typename T>
     class flat_queue
     {
         private:
-            int m_size = 16;
-            int m_headIndex = 0;
-            int m_insertIndex = 0;
-            T* m_data;
+            static constexpr blt::size_t default_capacity = 16;
+            
+            T* m_data = nullptr;
+            // always zero or a power of two
+            blt::size_t m_capacity = 0;
+            blt::size_t m_head = 0;
+            blt::size_t m_size = 0;
+            
+            [[nodiscard]] T* slot(const blt::size_t index) const
+            {
+                return m_data + ((m_head + index) & (m_capacity - 1));
+            }
             
             /**
-             * Expands the internal array to allow for more storage of elements
+             * Moves the elements into a new buffer of the given capacity, unwrapping them so the head is at index 0.
              */
-            void expand()
+            void reallocate(const blt::size_t new_capacity)
             {
-                int new_size = blt::mem::next_byte_allocation(m_size);
-                int removed_size = m_size - m_headIndex;
-                auto tempData = new T[new_size];
-                // only copy data from where we've removed onward
-                for (int i = 0; i < removed_size; i++)
-                    tempData[i] = m_data[i + m_headIndex]; // but don't copy data we've pop'd
-                delete[] m_data;
-                m_headIndex = 0;
-                m_insertIndex = removed_size - 1;
-                m_data = tempData;
-                m_size = new_size;
+                auto* new_data = std::allocator<T>{}.allocate(new_capacity);
+                for (blt::size_t i = 0; i < m_size; i++)
+                {
+                    auto* old = slot(i);
+                    new(new_data + i) T(std::move_if_noexcept(*old));
+                    old->~T();
+                }
+                if (m_data != nullptr)
+                    std::allocator<T>{}.deallocate(m_data, m_capacity);
+                m_data = new_data;
+                m_capacity = new_capacity;
+                m_head = 0;
+            }
+            
+            void destroy()
+            {
+                clear();
+                if (m_data != nullptr)
+                    std::allocator<T>{}.deallocate(m_data, m_capacity);
+                m_data = nullptr;
+                m_capacity = 0;
             }
+            
+            template<bool Const>
+            class iterator_base
+            {
+                    friend class flat_queue;
+                    using queue_t = std::conditional_t<Const, const flat_queue, flat_queue>;
+                public:
+                    using iterator_category = std::forward_iterator_tag;
+                    using value_type = T;
+                    using difference_type = blt::ptrdiff_t;
+                    using pointer = std::conditional_t<Const, const T*, T*>;
+                    using reference = std::conditional_t<Const, const T&, T&>;
+                    
+                    iterator_base() = default;
+                    
+                    reference operator*() const
+                    {
+                        return *m_queue->slot(m_index);
+                    }
+                    
+                    pointer operator->() const
+                    {
+                        return m_queue->slot(m_index);
+                    }
+                    
+                    iterator_base& operator++()
+                    {
+                        ++m_index;
+                        return *this;
+                    }
+                    
+                    iterator_base operator++(int)
+                    {
+                        auto copy = *this;
+                        ++m_index;
+                        return copy;
+                    }
+                    
+                    friend bool operator==(const iterator_base& a, const iterator_base& b)
+                    {
+                        return a.m_index == b.m_index;
+                    }
+                    
+                    friend bool operator!=(const iterator_base& a, const iterator_base& b)
+                    {
+                        return a.m_index != b.m_index;
+                    }
+                
+                private:
+                    iterator_base(queue_t* queue, const blt::size_t index): m_queue(queue), m_index(index)
+                    {}
+                    
+                    queue_t* m_queue = nullptr;
+                    blt::size_t m_index = 0;
+            };
         
         public:
-            flat_queue(): m_data(new T[m_size])
+            using iterator = iterator_base<false>;
+            using const_iterator = iterator_base<true>;
+            
+            flat_queue() = default;
+            
+            flat_queue(const flat_queue& copy)
             {
+                reserve(copy.m_size);
+                for (const auto& v : copy)
+                    push(v);
+            }
             
+            flat_queue(flat_queue&& move) noexcept:
+                    m_data(std::exchange(move.m_data, nullptr)), m_capacity(std::exchange(move.m_capacity, 0)),
+                    m_head(std::exchange(move.m_head, 0)), m_size(std::exchange(move.m_size, 0))
+            {}
+            
+            flat_queue& operator=(const flat_queue& copy)
+            {
+                if (&copy == this)
+                    return *this;
+                clear();
+                reserve(copy.m_size);
+                for (const auto& v : copy)
+                    push(v);
+                return *this;
+            }
+            
+            flat_queue& operator=(flat_queue&& move) noexcept
+            {
+                if (&move == this)
+                    return *this;
+                destroy();
+                m_data = std::exchange(move.m_data, nullptr);
+                m_capacity = std::exchange(move.m_capacity, 0);
+                m_head = std::exchange(move.m_head, 0);
+                m_size = std::exchange(move.m_size, 0);
+                return *this;
+            }
+            
+            template<typename... Args>
+            inline T& emplace(Args&& ... args)
+            {
+                if (m_size == m_capacity)
+                    reallocate(m_capacity == 0 ? default_capacity : m_capacity * 2);
+                auto* ptr = slot(m_size);
+                new(ptr) T(std::forward<Args>(args)...);
+                ++m_size;
+                return *ptr;
             }
             
             inline void push(const T& t)
             {
-                if (m_insertIndex + 1 >= m_size)
-                {
-                    expand();
-                }
-                m_data[m_insertIndex++] = t;
+                emplace(t);
+            }
+            
+            inline void push(T&& t)
+            {
+                emplace(std::move(t));
             }
             
             /**
@@ -138,44 +267,95 @@ namespace blt
              */
             [[nodiscard]] const T& front() const
             {
-                return m_data[m_headIndex];
+                return *slot(0);
             }
             
             [[nodiscard]] T& front()
             {
-                return m_data[m_headIndex];
+                return *slot(0);
+            }
+            
+            /**
+             * Warning does not contain runtime error checking!
+             * @return the most recently pushed element
+             */
+            [[nodiscard]] const T& back() const
+            {
+                return *slot(m_size - 1);
+            }
+            
+            [[nodiscard]] T& back()
+            {
+                return *slot(m_size - 1);
             }
             
             inline void pop()
             {
                 if (empty())
                     return;
-                m_headIndex++;
+                slot(0)->~T();
+                m_head = (m_head + 1) & (m_capacity - 1);
+                --m_size;
+            }
+            
+            /**
+             * Makes sure at least size elements fit without reallocating
+             */
+            void reserve(const blt::size_t size)
+            {
+                if (size <= m_capacity)
+                    return;
+                blt::size_t new_capacity = m_capacity == 0 ? default_capacity : m_capacity;
+                while (new_capacity < size)
+                    new_capacity *= 2;
+                reallocate(new_capacity);
+            }
+            
+            void clear()
+            {
+                while (!empty())
+                    pop();
+                m_head = 0;
             }
             
             [[nodiscard]] inline bool empty() const
             {
-                return m_headIndex >= m_size;
+                return m_size == 0;
             }
             
-            [[nodiscard]] inline int size() const
+            [[nodiscard]] inline blt::size_t size() const
+            {
+                return m_size;
+            }
+            
+            [[nodiscard]] inline blt::size_t capacity() const
+            {
+                return m_capacity;
+            }
+            
+            inline iterator begin()
+            {
+                return {this, 0};
+            }
+            
+            inline iterator end()
             {
-                return m_insertIndex - m_headIndex;
+                return {this, m_size};
             }
             
-            inline T* begin()
+            inline const_iterator begin() const
             {
-                return m_data[m_headIndex];
+                return {this, 0};
             }
             
-            inline T* end()
+            inline const_iterator end() const
             {
-                return m_data[m_insertIndex];
+                return {this, m_size};
             }
             
             ~flat_queue()
             {
-                delete[](m_data);
+                destroy();
             }
     };
     
@@ -236,6 +416,337 @@ namespace blt
                 }
             }
     };
+    
+    namespace detail
+    {
+        inline blt::size_t bounded_queue_capacity(const blt::size_t requested)
+        {
+            blt::size_t capacity = 2;
+            while (capacity < requested)
+                capacity <<= 1;
+            return capacity;
+        }
+        
+        template<typename T>
+        struct bounded_queue_slot_t
+        {
+            std::atomic<blt::size_t> sequence;
+            alignas(T) unsigned char storage[sizeof(T)];
+            
+            T* get()
+            {
+                return std::launder(reinterpret_cast<T*>(storage));
+            }
+        };
+    }
+    
+    /**
+     * Bounded lock-free queue using per slot sequence counters (Dmitry Vyukov's bounded MPMC queue). The capacity is rounded up to a power of two.
+     * When MultiProducer or MultiConsumer is false the matching side skips the CAS on its index and must only be used by one thread at a time.
+     * Constructing T inside a push must not throw, a half constructed slot would never be published.
+     * @tparam T type stored in the queue
+     * @tparam MultiProducer can more than one thread push concurrently
+     * @tparam MultiConsumer can more than one thread pop concurrently
+     */
+    template<typename T, bool MultiProducer = true, bool MultiConsumer = true>
+    class bounded_queue
+    {
+        private:
+            using slot_t = detail::bounded_queue_slot_t<T>;
+            
+            alignas(mem::cache_line_size) std::atomic<blt::size_t> m_tail{0};
+            alignas(mem::cache_line_size) std::atomic<blt::size_t> m_head{0};
+            alignas(mem::cache_line_size) slot_t* m_slots;
+            blt::size_t m_capacity;
+            blt::size_t m_mask;
+            
+            /**
+             * Claims up to max contiguous slots starting at index. A slot is ready when its sequence equals its position plus the offset,
+             * which is 0 for producers (slot is empty) and 1 for consumers (slot has been published).
+             * @return number of slots claimed, 0 if the queue was full / empty
+             */
+            template<bool Multi>
+            blt::size_t claim(std::atomic<blt::size_t>& index, const blt::size_t offset, const blt::size_t max, blt::size_t& pos)
+            {
+                pos = index.load(std::memory_order_relaxed);
+                while (true)
+                {
+                    const auto seq = m_slots[pos & m_mask].sequence.load(std::memory_order_acquire);
+                    const auto diff = static_cast<blt::ptrdiff_t>(seq - (pos + offset));
+                    if (diff < 0)
+                        return 0;
+                    if (diff > 0)
+                    {
+                        // another thread claimed this slot, catch up
+                        pos = index.load(std::memory_order_relaxed);
+                        continue;
+                    }
+                    blt::size_t available = 1;
+                    while (available < max && m_slots[(pos + available) & m_mask].sequence.load(std::memory_order_acquire) == pos + available +
+                           offset)
+                        ++available;
+                    if constexpr (Multi)
+                    {
+                        if (index.compare_exchange_weak(pos, pos + available, std::memory_order_relaxed))
+                            return available;
+                    } else
+                    {
+                        index.store(pos + available, std::memory_order_relaxed);
+                        return available;
+                    }
+                }
+            }
+        
+        public:
+            explicit bounded_queue(const blt::size_t capacity): m_capacity(detail::bounded_queue_capacity(capacity)), m_mask(m_capacity - 1)
+            {
+                m_slots = new slot_t[m_capacity];
+                for (blt::size_t i = 0; i < m_capacity; i++)
+                    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            
+            bounded_queue(const bounded_queue&) = delete;
+            bounded_queue& operator=(const bounded_queue&) = delete;
+            
+            template<typename... Args>
+            bool try_emplace(Args&& ... args)
+            {
+                blt::size_t pos;
+                if (claim<MultiProducer>(m_tail, 0, 1, pos) == 0)
+                    return false;
+                auto& slot = m_slots[pos & m_mask];
+                new(slot.storage) T(std::forward<Args>(args)...);
+                slot.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+            
+            bool try_push(const T& t)
+            {
+                return try_emplace(t);
+            }
+            
+            bool try_push(T&& t)
+            {
+                return try_emplace(std::move(t));
+            }
+            
+            /**
+             * Pushes up to count elements constructed from *begin, *(begin + 1), ... with a single claim on the tail.
+             * Use std::make_move_iterator to move elements in.
+             * @return number of elements pushed, which may be less than count if the queue fills up
+             */
+            template<typename Iter>
+            blt::size_t try_push_n(Iter begin, const blt::size_t count)
+            {
+                if (count == 0)
+                    return 0;
+                blt::size_t pos;
+                const auto claimed = claim<MultiProducer>(m_tail, 0, std::min(count, m_capacity), pos);
+                for (blt::size_t i = 0; i < claimed; i++, ++begin)
+                {
+                    auto& slot = m_slots[(pos + i) & m_mask];
+                    new(slot.storage) T(*begin);
+                    slot.sequence.store(pos + i + 1, std::memory_order_release);
+                }
+                return claimed;
+            }
+            
+            bool try_pop(T& out)
+            {
+                blt::size_t pos;
+                if (claim<MultiConsumer>(m_head, 1, 1, pos) == 0)
+                    return false;
+                auto& slot = m_slots[pos & m_mask];
+                out = std::move(*slot.get());
+                slot.get()->~T();
+                slot.sequence.store(pos + m_capacity, std::memory_order_release);
+                return true;
+            }
+            
+            /**
+             * Pops up to count elements, move assigning each into *out++.
+             * @return number of elements popped
+             */
+            template<typename Iter>
+            blt::size_t try_pop_n(Iter out, const blt::size_t count)
+            {
+                if (count == 0)
+                    return 0;
+                blt::size_t pos;
+                const auto claimed = claim<MultiConsumer>(m_head, 1, std::min(count, m_capacity), pos);
+                for (blt::size_t i = 0; i < claimed; i++, ++out)
+                {
+                    auto& slot = m_slots[(pos + i) & m_mask];
+                    *out = std::move(*slot.get());
+                    slot.get()->~T();
+                    slot.sequence.store(pos + i + m_capacity, std::memory_order_release);
+                }
+                return claimed;
+            }
+            
+            /**
+             * Only exact when no other thread is modifying the queue.
+             */
+            [[nodiscard]] blt::size_t size_approx() const
+            {
+                const auto head = m_head.load(std::memory_order_relaxed);
+                const auto tail = m_tail.load(std::memory_order_relaxed);
+                return static_cast<blt::ptrdiff_t>(tail - head) > 0 ? tail - head : 0;
+            }
+            
+            [[nodiscard]] blt::size_t capacity() const
+            {
+                return m_capacity;
+            }
+            
+            ~bounded_queue()
+            {
+                const auto tail = m_tail.load(std::memory_order_relaxed);
+                for (auto pos = m_head.load(std::memory_order_relaxed); pos != tail; ++pos)
+                    m_slots[pos & m_mask].get()->~T();
+                delete[] m_slots;
+            }
+    };
+    
+    /**
+     * Single producer single consumer specialization. With only one thread on each side the slots do not need sequence counters,
+     * each side publishes its index and keeps a cached copy of the other side's index so it rarely touches the shared cache line.
+     */
+    template<typename T>
+    class bounded_queue<T, false, false>
+    {
+        private:
+            struct storage_t
+            {
+                alignas(T) unsigned char data[sizeof(T)];
+                
+                T* get()
+                {
+                    return std::launder(reinterpret_cast<T*>(data));
+                }
+            };
+            
+            // producer owned
+            alignas(mem::cache_line_size) std::atomic<blt::size_t> m_tail{0};
+            blt::size_t m_head_cache = 0;
+            // consumer owned
+            alignas(mem::cache_line_size) std::atomic<blt::size_t> m_head{0};
+            blt::size_t m_tail_cache = 0;
+            alignas(mem::cache_line_size) storage_t* m_data;
+            blt::size_t m_capacity;
+            blt::size_t m_mask;
+            
+            blt::size_t writable(const blt::size_t tail, const blt::size_t count)
+            {
+                if (m_capacity - (tail - m_head_cache) < count)
+                    m_head_cache = m_head.load(std::memory_order_acquire);
+                return std::min(count, m_capacity - (tail - m_head_cache));
+            }
+            
+            blt::size_t readable(const blt::size_t head, const blt::size_t count)
+            {
+                if (m_tail_cache - head < count)
+                    m_tail_cache = m_tail.load(std::memory_order_acquire);
+                return std::min(count, m_tail_cache - head);
+            }
+        
+        public:
+            explicit bounded_queue(const blt::size_t capacity): m_capacity(detail::bounded_queue_capacity(capacity)), m_mask(m_capacity - 1)
+            {
+                m_data = new storage_t[m_capacity];
+            }
+            
+            bounded_queue(const bounded_queue&) = delete;
+            bounded_queue& operator=(const bounded_queue&) = delete;
+            
+            template<typename... Args>
+            bool try_emplace(Args&& ... args)
+            {
+                const auto tail = m_tail.load(std::memory_order_relaxed);
+                if (writable(tail, 1) == 0)
+                    return false;
+                new(m_data[tail & m_mask].data) T(std::forward<Args>(args)...);
+                m_tail.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+            
+            bool try_push(const T& t)
+            {
+                return try_emplace(t);
+            }
+            
+            bool try_push(T&& t)
+            {
+                return try_emplace(std::move(t));
+            }
+            
+            template<typename Iter>
+            blt::size_t try_push_n(Iter begin, const blt::size_t count)
+            {
+                const auto tail = m_tail.load(std::memory_order_relaxed);
+                const auto amount = writable(tail, count);
+                for (blt::size_t i = 0; i < amount; i++, ++begin)
+                    new(m_data[(tail + i) & m_mask].data) T(*begin);
+                if (amount > 0)
+                    m_tail.store(tail + amount, std::memory_order_release);
+                return amount;
+            }
+            
+            bool try_pop(T& out)
+            {
+                const auto head = m_head.load(std::memory_order_relaxed);
+                if (readable(head, 1) == 0)
+                    return false;
+                auto* value = m_data[head & m_mask].get();
+                out = std::move(*value);
+                value->~T();
+                m_head.store(head + 1, std::memory_order_release);
+                return true;
+            }
+            
+            template<typename Iter>
+            blt::size_t try_pop_n(Iter out, const blt::size_t count)
+            {
+                const auto head = m_head.load(std::memory_order_relaxed);
+                const auto amount = readable(head, count);
+                for (blt::size_t i = 0; i < amount; i++, ++out)
+                {
+                    auto* value = m_data[(head + i) & m_mask].get();
+                    *out = std::move(*value);
+                    value->~T();
+                }
+                if (amount > 0)
+                    m_head.store(head + amount, std::memory_order_release);
+                return amount;
+            }
+            
+            [[nodiscard]] blt::size_t size_approx() const
+            {
+                return m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_relaxed);
+            }
+            
+            [[nodiscard]] blt::size_t capacity() const
+            {
+                return m_capacity;
+            }
+            
+            ~bounded_queue()
+            {
+                const auto tail = m_tail.load(std::memory_order_relaxed);
+                for (auto pos = m_head.load(std::memory_order_relaxed); pos != tail; ++pos)
+                    m_data[pos & m_mask].get()->~T();
+                delete[] m_data;
+            }
+    };
+    
+    template<typename T>
+    using mpmc_queue = bounded_queue<T, true, true>;
+    
+    template<typename T>
+    using mpsc_queue = bounded_queue<T, true, false>;
+    
+    template<typename T>
+    using spsc_queue = bounded_queue<T, false, false>;
 }
 
 #endif //BLT_QUEUE_H
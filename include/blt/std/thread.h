@@ -134,7 +134,6 @@ namespace blt
                             {
                                 // should be safe right?
                                 std::unique_lock lock(queue_mutex);
-                                lock.lock();
                                 auto& func_q = std::get<std::queue<thread_function>>(func_queue);
                                 if (func_q.empty())
                                 {
@@ -142,7 +141,7 @@ namespace blt
                                     std::this_thread::sleep_for(std::chrono::milliseconds(16));
                                     continue;
                                 }
-                                auto func = func_q.front();
+                                auto func = std::move(func_q.front());
                                 func_q.pop();
                                 lock.unlock();
                                 func();
@@ -0,0 +1,74 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLT_STD_TSC_H
+#define BLT_STD_TSC_H
+
+#include <chrono>
+#include <blt/std/types.h>
+
+namespace blt::system
+{
+	struct tsc_calibration_t
+	{
+		// CPUID 0x80000007 EDX bit 8, the TSC ticks at a constant rate through frequency changes and sleep states
+		bool invariant = false;
+		// CPUID 0x80000001 EDX bit 27
+		bool has_rdtscp = false;
+		// true if now_ns() and unix_now_ns() are derived from the TSC, false if they read the system clocks
+		bool used = false;
+		// ticks per second measured against CLOCK_MONOTONIC, 0 if the TSC could not be measured
+		double frequency_hz = 0;
+	};
+
+	static constexpr auto DEFAULT_TSC_CALIBRATION = std::chrono::milliseconds(2);
+
+	/**
+	* The TSC calibration, measured on first use of anything in this header. Call it at startup to pay the DEFAULT_TSC_CALIBRATION wait
+	* up front instead of in the first timed call.
+	*
+	* The TSC is only used when it is invariant. The short initial measurement is refined while the program runs: now_ns() re-anchors against
+	* CLOCK_MONOTONIC and CLOCK_REALTIME after windows doubling up to a second, measuring the frequency over each window, so the estimate
+	* converges and the realtime clock picks up NTP adjustments within a second.
+	*/
+	tsc_calibration_t tsc_calibration();
+
+	/**
+	* Measures the TSC frequency again from scratch, waiting for duration. Only needed if the clocks were disturbed, for example after the
+	* machine resumed from suspend or the process was migrated to another host.
+	*/
+	tsc_calibration_t recalibrate_tsc(std::chrono::nanoseconds duration = DEFAULT_TSC_CALIBRATION);
+
+	/**
+	* @return monotonic nanoseconds with an unspecified origin, from rdtsc when the TSC is usable and CLOCK_MONOTONIC otherwise
+	*/
+	i64 now_ns();
+
+	/**
+	* @return nanoseconds since the unix epoch, from rdtsc when the TSC is usable and CLOCK_REALTIME otherwise. Unlike now_ns() this may
+	* step backwards when the system clock is adjusted.
+	*/
+	i64 unix_now_ns();
+
+	/**
+	* Converts a difference of rdtsc() values into nanoseconds with the measured frequency, 0 if there is none.
+	*/
+	double tsc_to_ns(u64 ticks);
+}
+
+#endif //BLT_STD_TSC_H
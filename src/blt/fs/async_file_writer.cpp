@@ -0,0 +1,534 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <blt/fs/async_file_writer.h>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define BLT_HAS_IO_URING
+#endif
+
+namespace blt::fs
+{
+	namespace detail
+	{
+		class async_backend_t
+		{
+		public:
+			virtual ~async_backend_t() = default;
+
+			// only a single write is ever in flight
+			virtual void submit(int fd, const char* data, size_t bytes, u64 offset) = 0;
+
+			/**
+			* @return result of the write in flight (bytes written or -errno), or nothing if it is still running and block is false
+			*/
+			virtual std::optional<i64> reap(bool block) = 0;
+		};
+	}
+
+#ifdef __unix__
+	namespace
+	{
+		constexpr size_t IO_THREADS = 2;
+
+		class io_thread_pool_t
+		{
+		public:
+			explicit io_thread_pool_t(const size_t threads)
+			{
+				for (size_t i = 0; i < threads; ++i)
+					m_threads.emplace_back([this]() {
+						run();
+					});
+			}
+
+			io_thread_pool_t(const io_thread_pool_t&) = delete;
+			io_thread_pool_t& operator=(const io_thread_pool_t&) = delete;
+
+			void execute(std::function<void()> job)
+			{
+				{
+					std::scoped_lock lock{m_mutex};
+					m_jobs.push_back(std::move(job));
+				}
+				m_cv.notify_one();
+			}
+
+			~io_thread_pool_t()
+			{
+				{
+					std::scoped_lock lock{m_mutex};
+					m_stopping = true;
+				}
+				m_cv.notify_all();
+				for (auto& thread : m_threads)
+					thread.join();
+			}
+
+		private:
+			void run()
+			{
+				while (true)
+				{
+					std::function<void()> job;
+					{
+						std::unique_lock lock{m_mutex};
+						m_cv.wait(lock, [this]() {
+							return m_stopping || !m_jobs.empty();
+						});
+						if (m_jobs.empty())
+							return;
+						job = std::move(m_jobs.front());
+						m_jobs.pop_front();
+					}
+					job();
+				}
+			}
+
+			std::mutex m_mutex;
+			std::condition_variable m_cv;
+			std::deque<std::function<void()>> m_jobs;
+			bool m_stopping = false;
+			std::vector<std::thread> m_threads;
+		};
+
+		io_thread_pool_t& get_io_pool()
+		{
+			static io_thread_pool_t pool{IO_THREADS};
+			return pool;
+		}
+
+		class thread_pool_backend_t final : public detail::async_backend_t
+		{
+		public:
+			thread_pool_backend_t()
+			{
+				// constructed before the backend so it is destroyed after it, even for writers with static storage
+				get_io_pool();
+			}
+
+			void submit(const int fd, const char* data, const size_t bytes, const u64 offset) override
+			{
+				{
+					std::scoped_lock lock{m_mutex};
+					m_done = false;
+				}
+				get_io_pool().execute([this, fd, data, bytes, offset]() {
+					const auto written = pwrite(fd, data, bytes, static_cast<off_t>(offset));
+					const i64 result = written < 0 ? -static_cast<i64>(errno) : static_cast<i64>(written);
+					std::scoped_lock lock{m_mutex};
+					m_result = result;
+					m_done = true;
+					// notified under the lock, the writer is free to destroy this backend as soon as it sees the result
+					m_cv.notify_all();
+				});
+			}
+
+			std::optional<i64> reap(const bool block) override
+			{
+				std::unique_lock lock{m_mutex};
+				if (block)
+					m_cv.wait(lock, [this]() {
+						return m_done;
+					});
+				if (!m_done)
+					return {};
+				return m_result;
+			}
+
+		private:
+			std::mutex m_mutex;
+			std::condition_variable m_cv;
+			bool m_done = true;
+			i64 m_result = 0;
+		};
+
+#ifdef BLT_HAS_IO_URING
+		/**
+		* Minimal io_uring ring driven through the raw syscalls, the writer only ever needs one submission and one completion at a time
+		*/
+		class io_uring_backend_t final : public detail::async_backend_t
+		{
+		public:
+			static std::unique_ptr<detail::async_backend_t> create()
+			{
+				io_uring_params params{};
+				const int fd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+				if (fd < 0)
+					return nullptr;
+				std::unique_ptr<io_uring_backend_t> backend{new io_uring_backend_t(fd)};
+				// IORING_OP_WRITE arrived in the same kernel (5.6) as this feature
+				if (!(params.features & IORING_FEAT_RW_CUR_POS) || !backend->map(params))
+					return nullptr;
+				return backend;
+			}
+
+			void submit(const int fd, const char* data, const size_t bytes, const u64 offset) override
+			{
+				const unsigned tail = *m_sq_tail;
+				const unsigned index = tail & *m_sq_mask;
+				auto& sqe = m_sqes[index];
+				std::memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = IORING_OP_WRITE;
+				sqe.fd = fd;
+				sqe.addr = reinterpret_cast<u64>(data);
+				// anything past this comes back as a short write and is resubmitted
+				sqe.len = static_cast<u32>(std::min<size_t>(bytes, std::numeric_limits<u32>::max()));
+				sqe.off = offset;
+				m_sq_array[index] = index;
+				__atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+				while (enter(1, 0, 0) < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					// the kernel never consumed the entry, take it back and report the failure as the write's result
+					__atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+					m_submit_error = errno;
+					break;
+				}
+			}
+
+			std::optional<i64> reap(const bool block) override
+			{
+				if (m_submit_error != 0)
+					return -static_cast<i64>(std::exchange(m_submit_error, 0));
+				while (true)
+				{
+					const unsigned head = *m_cq_head;
+					if (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+					{
+						const i64 result = m_cqes[head & *m_cq_mask].res;
+						__atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+						return result;
+					}
+					if (!block)
+						return {};
+					if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+						return -static_cast<i64>(errno);
+				}
+			}
+
+			~io_uring_backend_t() override
+			{
+				if (m_sqes != nullptr)
+					munmap(m_sqes, m_sqes_size);
+				if (m_cq_ring != nullptr && m_cq_ring != m_sq_ring)
+					munmap(m_cq_ring, m_cq_size);
+				if (m_sq_ring != nullptr)
+					munmap(m_sq_ring, m_sq_size);
+				close(m_fd);
+			}
+
+		private:
+			static constexpr unsigned RING_ENTRIES = 2;
+
+			explicit io_uring_backend_t(const int fd): m_fd(fd)
+			{}
+
+			bool map(const io_uring_params& params)
+			{
+				m_sq_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+				m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+				if (single_mmap)
+					m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+
+				m_sq_ring = map_region(m_sq_size, IORING_OFF_SQ_RING);
+				if (m_sq_ring == nullptr)
+					return false;
+				m_cq_ring = single_mmap ? m_sq_ring : map_region(m_cq_size, IORING_OFF_CQ_RING);
+				if (m_cq_ring == nullptr)
+					return false;
+				m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+				m_sqes = static_cast<io_uring_sqe*>(map_region(m_sqes_size, IORING_OFF_SQES));
+				if (m_sqes == nullptr)
+					return false;
+
+				auto* sq = static_cast<char*>(m_sq_ring);
+				m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+				m_sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+				m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+				auto* cq = static_cast<char*>(m_cq_ring);
+				m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+				m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+				m_cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+				m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+				return true;
+			}
+
+			[[nodiscard]] void* map_region(const size_t size, const off_t offset) const
+			{
+				void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+				return region == MAP_FAILED ? nullptr : region;
+			}
+
+			[[nodiscard]] int enter(const unsigned to_submit, const unsigned min_complete, const unsigned flags) const
+			{
+				return static_cast<int>(syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, nullptr, 0));
+			}
+
+			int m_fd;
+			int m_submit_error = 0;
+
+			void* m_sq_ring = nullptr;
+			void* m_cq_ring = nullptr;
+			size_t m_sq_size = 0;
+			size_t m_cq_size = 0;
+			io_uring_sqe* m_sqes = nullptr;
+			size_t m_sqes_size = 0;
+
+			unsigned* m_sq_tail = nullptr;
+			unsigned* m_sq_mask = nullptr;
+			unsigned* m_sq_array = nullptr;
+			unsigned* m_cq_head = nullptr;
+			unsigned* m_cq_tail = nullptr;
+			unsigned* m_cq_mask = nullptr;
+			io_uring_cqe* m_cqes = nullptr;
+		};
+#endif
+
+		std::unique_ptr<detail::async_backend_t> create_backend(const async_backend_type_t type)
+		{
+#ifdef BLT_HAS_IO_URING
+			if (type != async_backend_type_t::THREAD_POOL)
+			{
+				if (auto backend = io_uring_backend_t::create())
+					return backend;
+			}
+#endif
+			if (type == async_backend_type_t::IO_URING)
+				throw std::runtime_error("io_uring is not available");
+			return std::make_unique<thread_pool_backend_t>();
+		}
+
+		size_t page_size()
+		{
+			static const auto size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			return size;
+		}
+	}
+
+	async_file_writer_t::async_file_writer_t(const std::string& name, const size_t buffer_size, const async_backend_type_t backend):
+		async_file_writer_t(buffer_size, backend)
+	{
+		async_file_writer_t::newfile(name);
+	}
+
+	async_file_writer_t::async_file_writer_t(const size_t buffer_size, const async_backend_type_t backend): m_backend(create_backend(backend))
+	{
+#ifdef BLT_HAS_IO_URING
+		m_uses_io_uring = dynamic_cast<io_uring_backend_t*>(m_backend.get()) != nullptr;
+#endif
+		const auto page = page_size();
+		m_buffer_size = std::max(page, (buffer_size + page - 1) / page * page);
+		m_storage.reset(static_cast<char*>(std::aligned_alloc(page, m_buffer_size * 2)));
+		if (!m_storage)
+			throw std::bad_alloc();
+		m_buffers[0] = m_storage.get();
+		m_buffers[1] = m_storage.get() + m_buffer_size;
+	}
+
+	async_file_writer_t::~async_file_writer_t()
+	{
+		if (m_fd < 0)
+			return;
+		flush();
+		close(m_fd);
+	}
+
+	i64 async_file_writer_t::write(const char* buffer, size_t bytes)
+	{
+		const auto total = bytes;
+		progress(false);
+		while (bytes > 0)
+		{
+			const auto amount = std::min(bytes, m_buffer_size - m_active_size);
+			std::memcpy(m_buffers[m_active] + m_active_size, buffer, amount);
+			m_active_size += amount;
+			m_accepted += amount;
+			buffer += amount;
+			bytes -= amount;
+			if (m_active_size == m_buffer_size)
+			{
+				// only blocks when the caller has filled a whole buffer while the other one was still being written
+				reap(true);
+				submit_active();
+			}
+		}
+		return static_cast<i64>(total);
+	}
+
+	void async_file_writer_t::flush()
+	{
+		wait(fence());
+	}
+
+	void async_file_writer_t::newfile(const std::string& new_name)
+	{
+		if (m_fd >= 0)
+		{
+			flush();
+			close(m_fd);
+		}
+		m_error = 0;
+		const bool truncate = m_mode.find('w') != std::string::npos;
+		m_fd = open(new_name.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : O_APPEND), 0644);
+		if (m_fd < 0)
+			throw std::runtime_error("Failed to open file for writing");
+		m_offset = truncate ? 0 : static_cast<u64>(lseek(m_fd, 0, SEEK_END));
+	}
+
+	u64 async_file_writer_t::fence()
+	{
+		m_fenced = m_accepted;
+		progress(false);
+		return m_accepted;
+	}
+
+	bool async_file_writer_t::is_complete(const u64 ticket)
+	{
+		progress(false);
+		return m_completed >= ticket;
+	}
+
+	void async_file_writer_t::wait(const u64 ticket)
+	{
+		m_fenced = std::max(m_fenced, std::min(ticket, m_accepted));
+		while (m_completed < ticket && m_completed < m_accepted)
+			progress(true);
+	}
+
+	bool async_file_writer_t::reap(const bool block)
+	{
+		while (m_in_flight)
+		{
+			const auto result = m_backend->reap(block);
+			if (!result)
+				return false;
+			if (*result == -EINTR || *result == -EAGAIN)
+			{
+				m_backend->submit(m_fd, m_flight_data, m_flight_remaining, m_flight_offset);
+				continue;
+			}
+			if (*result <= 0 || static_cast<size_t>(*result) >= m_flight_remaining)
+			{
+				if (*result < 0)
+					m_error = static_cast<int>(-*result);
+				else if (*result == 0)
+					m_error = EIO;
+				m_completed += m_flight_remaining;
+				m_in_flight = false;
+				break;
+			}
+			// short write, the rest goes out as its own write
+			const auto written = static_cast<size_t>(*result);
+			m_completed += written;
+			m_flight_data += written;
+			m_flight_remaining -= written;
+			m_flight_offset += written;
+			m_backend->submit(m_fd, m_flight_data, m_flight_remaining, m_flight_offset);
+		}
+		return true;
+	}
+
+	void async_file_writer_t::submit_active()
+	{
+		if (m_active_size == 0)
+			return;
+		m_in_flight = true;
+		m_flight_data = m_buffers[m_active];
+		m_flight_remaining = m_active_size;
+		m_flight_offset = m_offset;
+		m_offset += m_active_size;
+		m_submitted += m_active_size;
+		m_active ^= 1;
+		m_active_size = 0;
+		m_backend->submit(m_fd, m_flight_data, m_flight_remaining, m_flight_offset);
+	}
+
+	void async_file_writer_t::progress(const bool block)
+	{
+		if (!reap(block))
+			return;
+		// fenced bytes which were waiting on the previous write to finish
+		if (m_fenced > m_submitted)
+		{
+			submit_active();
+			if (block)
+				reap(true);
+		}
+	}
+#else
+	async_file_writer_t::async_file_writer_t(const std::string&, const size_t buffer_size, const async_backend_type_t):
+		m_buffer_size(buffer_size)
+	{
+		throw std::runtime_error("async_file_writer_t is not supported on this platform");
+	}
+
+	async_file_writer_t::async_file_writer_t(const size_t buffer_size, const async_backend_type_t): m_buffer_size(buffer_size)
+	{
+		throw std::runtime_error("async_file_writer_t is not supported on this platform");
+	}
+
+	async_file_writer_t::~async_file_writer_t() = default;
+
+	i64 async_file_writer_t::write(const char*, const size_t)
+	{
+		return -1;
+	}
+
+	void async_file_writer_t::flush()
+	{}
+
+	void async_file_writer_t::newfile(const std::string&)
+	{}
+
+	u64 async_file_writer_t::fence()
+	{
+		return 0;
+	}
+
+	bool async_file_writer_t::is_complete(u64)
+	{
+		return true;
+	}
+
+	void async_file_writer_t::wait(u64)
+	{}
+#endif
+}
@@ -0,0 +1,119 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <stdexcept>
+#include <blt/fs/buffered_reader.h>
+
+namespace blt::fs
+{
+	buffered_reader_t::buffered_reader_t(reader_t& reader, const size_t buffer_size): m_reader(&reader)
+	{
+		if (buffer_size == 0)
+			throw std::invalid_argument("buffered_reader_t needs a buffer to read into");
+		m_buffer.resize(buffer_size);
+	}
+
+	i64 buffered_reader_t::read(char* buffer, const size_t bytes)
+	{
+		if (m_end - m_pos >= bytes)
+		{
+			std::memcpy(buffer, m_buffer.data() + m_pos, bytes);
+			m_pos += bytes;
+			return static_cast<i64>(bytes);
+		}
+		return static_cast<i64>(read_slow(buffer, bytes));
+	}
+
+	std::string_view buffered_reader_t::peek(size_t bytes)
+	{
+		bytes = std::min(bytes, m_buffer.size());
+		if (m_end - m_pos < bytes)
+			fill(bytes);
+		return {m_buffer.data() + m_pos, std::min(bytes, m_end - m_pos)};
+	}
+
+	size_t buffered_reader_t::skip(const size_t bytes)
+	{
+		size_t skipped = 0;
+		while (skipped < bytes)
+		{
+			if (m_pos == m_end)
+			{
+				fill(1);
+				if (m_pos == m_end)
+					break;
+			}
+			const auto amount = std::min(bytes - skipped, m_end - m_pos);
+			m_pos += amount;
+			skipped += amount;
+		}
+		return skipped;
+	}
+
+	size_t buffered_reader_t::read_slow(char* buffer, const size_t bytes)
+	{
+		// drain what is left, then either go straight to the wrapped reader or refill and copy
+		size_t copied = m_end - m_pos;
+		std::memcpy(buffer, m_buffer.data() + m_pos, copied);
+		m_pos = m_end = 0;
+		while (copied < bytes && !m_eof)
+		{
+			const auto remaining = bytes - copied;
+			if (remaining >= m_buffer.size())
+			{
+				// larger than the buffer, copying through it would only cost time
+				const auto amount = m_reader->read(buffer + copied, remaining);
+				if (amount <= 0)
+				{
+					m_eof = true;
+					break;
+				}
+				copied += static_cast<size_t>(amount);
+				continue;
+			}
+			fill(remaining);
+			const auto amount = std::min(remaining, m_end - m_pos);
+			if (amount == 0)
+				break;
+			std::memcpy(buffer + copied, m_buffer.data() + m_pos, amount);
+			m_pos += amount;
+			copied += amount;
+		}
+		return copied;
+	}
+
+	void buffered_reader_t::fill(const size_t wanted)
+	{
+		if (m_pos > 0)
+		{
+			std::memmove(m_buffer.data(), m_buffer.data() + m_pos, m_end - m_pos);
+			m_end -= m_pos;
+			m_pos = 0;
+		}
+		while (m_end < wanted && !m_eof)
+		{
+			const auto amount = m_reader->read(m_buffer.data() + m_end, m_buffer.size() - m_end);
+			if (amount <= 0)
+			{
+				m_eof = true;
+				break;
+			}
+			m_end += static_cast<size_t>(amount);
+		}
+	}
+}
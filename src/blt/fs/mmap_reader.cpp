@@ -0,0 +1,156 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <blt/fs/mmap_reader.h>
+#include <blt/std/mmap.h>
+
+#ifdef __unix__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace blt::fs
+{
+#ifdef __unix__
+	namespace
+	{
+		size_t page_size()
+		{
+			static const auto size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+			return size;
+		}
+	}
+
+	mmap_reader_t::mmap_reader_t(const std::string& path, const size_t read_ahead): m_read_ahead(read_ahead)
+	{
+		const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			throw std::runtime_error("Unable to open '" + path + "' for mapping: " + std::strerror(errno));
+		struct stat info{};
+		if (fstat(fd, &info) != 0)
+		{
+			const auto error = errno;
+			close(fd);
+			throw std::runtime_error("Unable to stat '" + path + "': " + std::strerror(error));
+		}
+		m_size = static_cast<size_t>(info.st_size);
+		// mmap rejects empty mappings, an empty file is simply a reader with nothing in it
+		if (m_size > 0)
+		{
+			void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping == MAP_FAILED)
+			{
+				const auto error = handle_mmap_error();
+				close(fd);
+				throw std::runtime_error("Unable to map '" + path + "': " + error);
+			}
+			m_data = static_cast<const char*>(mapping);
+			madvise(mapping, m_size, MADV_SEQUENTIAL);
+			advance(0);
+		}
+		// the mapping keeps its own reference to the file
+		close(fd);
+	}
+
+	void mmap_reader_t::advance(const size_t bytes)
+	{
+		m_pos += bytes;
+		if (m_read_ahead == 0 || m_pos + m_read_ahead / 2 < m_advised || m_advised >= m_size)
+			return;
+		// request the next window once the reader is halfway through the current one
+		const auto begin = std::max(m_advised, m_pos) & ~(page_size() - 1);
+		const auto end = std::min(m_size, m_pos + m_read_ahead);
+		if (end > begin)
+			madvise(const_cast<char*>(m_data) + begin, end - begin, MADV_WILLNEED);
+		m_advised = end;
+	}
+
+	void mmap_reader_t::release()
+	{
+		if (m_data != nullptr)
+			munmap(const_cast<char*>(m_data), m_size);
+		m_data = nullptr;
+	}
+#else
+	mmap_reader_t::mmap_reader_t(const std::string&, const size_t read_ahead): m_read_ahead(read_ahead)
+	{
+		throw std::runtime_error("mmap_reader_t is not supported on this platform");
+	}
+
+	void mmap_reader_t::advance(const size_t bytes)
+	{
+		m_pos += bytes;
+	}
+
+	void mmap_reader_t::release()
+	{}
+#endif
+
+	mmap_reader_t::mmap_reader_t(mmap_reader_t&& move) noexcept: m_data(std::exchange(move.m_data, nullptr)), m_size(std::exchange(move.m_size, 0)),
+																m_pos(std::exchange(move.m_pos, 0)), m_advised(std::exchange(move.m_advised, 0)),
+																m_read_ahead(move.m_read_ahead)
+	{}
+
+	mmap_reader_t& mmap_reader_t::operator=(mmap_reader_t&& move) noexcept
+	{
+		if (this == &move)
+			return *this;
+		release();
+		m_data = std::exchange(move.m_data, nullptr);
+		m_size = std::exchange(move.m_size, 0);
+		m_pos = std::exchange(move.m_pos, 0);
+		m_advised = std::exchange(move.m_advised, 0);
+		m_read_ahead = move.m_read_ahead;
+		return *this;
+	}
+
+	mmap_reader_t::~mmap_reader_t()
+	{
+		release();
+	}
+
+	i64 mmap_reader_t::read(char* buffer, size_t bytes)
+	{
+		bytes = std::min(bytes, remaining());
+		if (bytes > 0)
+			std::memcpy(buffer, m_data + m_pos, bytes);
+		advance(bytes);
+		return static_cast<i64>(bytes);
+	}
+
+	std::optional<std::string_view> mmap_reader_t::read_view(size_t bytes)
+	{
+		bytes = std::min(bytes, remaining());
+		const std::string_view view{m_data + m_pos, bytes};
+		advance(bytes);
+		return view;
+	}
+
+	void mmap_reader_t::seek(const size_t position)
+	{
+		m_pos = std::min(position, m_size);
+		// a jump means the pages ahead have to be requested again
+		m_advised = m_pos;
+		advance(0);
+	}
+}
@@ -17,15 +17,27 @@ namespace blt::nbt {
     }
     
     std::string readUTF8String(blt::fs::reader_t& stream) {
-        int16_t utflen;
+        uint16_t utflen;
         
         readData(stream, utflen);
         
+        // decode straight out of the reader's memory instead of copying into a temporary buffer first
+        if (stream.supports_views()) {
+            const auto view = *stream.read_view(utflen);
+            if (view.size() != utflen)
+                throw std::runtime_error("NBT data ended in the middle of a string!");
+            const blt::string::utf8_string str{const_cast<char*>(view.data()), static_cast<unsigned int>(view.size())};
+            return blt::string::getStringFromUTF8(str);
+        }
+        
         blt::string::utf8_string str{};
         str.size = utflen;
         str.characters = new char[str.size];
         
-        stream.read(str.characters, str.size);
+        if (stream.read(str.characters, str.size) != static_cast<blt::i64>(str.size)) {
+            delete[] str.characters;
+            throw std::runtime_error("NBT data ended in the middle of a string!");
+        }
         
         auto strOut = blt::string::getStringFromUTF8(str);
         delete[] str.characters;
@@ -4,9 +4,426 @@
  * See LICENSE file for license detail
  */
 #include <blt/fs/nbt_block.h>
+#include <blt/config.h>
+#include <blt/std/memory_util.h>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
 #include <string>
-#include <fstream>
 
-namespace blt::nbt {
+#ifdef __unix__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
 
-}
\ No newline at end of file
+#ifdef ZLIB_FOUND
+#include <zlib.h>
+#endif
+
+namespace blt::nbt
+{
+	namespace
+	{
+		// magic, version, entry count
+		constexpr size_t HEADER_PREFIX = 3 * sizeof(u32);
+		constexpr size_t TABLE_ENTRY = 2 * sizeof(u32);
+		// stored length, compression, uncompressed length
+		constexpr size_t PAYLOAD_PREFIX = sizeof(u32) + sizeof(u8) + sizeof(u32);
+
+		u32 sectors_for(const size_t bytes)
+		{
+			return static_cast<u32>((bytes + region_file_t::SECTOR_SIZE - 1) / region_file_t::SECTOR_SIZE);
+		}
+
+		template <typename T>
+		void put(char* out, const T value)
+		{
+			mem::toBytes(value, out);
+		}
+
+		template <typename T>
+		T get(const char* in)
+		{
+			T value;
+			mem::fromBytes(in, value);
+			return value;
+		}
+
+		class string_writer_t final : public fs::writer_t
+		{
+		public:
+			i64 write(const char* buffer, const size_t bytes) override
+			{
+				str.append(buffer, bytes);
+				return static_cast<i64>(bytes);
+			}
+
+			std::string str;
+		};
+
+		std::string compress(const std::string_view data, const region_compression_t compression)
+		{
+			switch (compression)
+			{
+				case region_compression_t::NONE:
+					return std::string{data};
+#ifdef ZLIB_FOUND
+				case region_compression_t::ZLIB:
+				{
+					std::string out(compressBound(static_cast<uLong>(data.size())), '\0');
+					auto length = static_cast<uLongf>(out.size());
+					if (compress2(reinterpret_cast<Bytef*>(out.data()), &length, reinterpret_cast<const Bytef*>(data.data()),
+								  static_cast<uLong>(data.size()), Z_DEFAULT_COMPRESSION) != Z_OK)
+						throw std::runtime_error("Unable to compress region entry!");
+					out.resize(length);
+					return out;
+				}
+#endif
+				default:
+					throw std::runtime_error("Region compression is not supported by this build!");
+			}
+		}
+
+		std::string decompress(std::string stored, const region_compression_t compression, const size_t raw_length)
+		{
+			switch (compression)
+			{
+				case region_compression_t::NONE:
+					return stored;
+#ifdef ZLIB_FOUND
+				case region_compression_t::ZLIB:
+				{
+					std::string out(raw_length, '\0');
+					auto length = static_cast<uLongf>(out.size());
+					if (uncompress(reinterpret_cast<Bytef*>(out.data()), &length, reinterpret_cast<const Bytef*>(stored.data()),
+								   static_cast<uLong>(stored.size())) != Z_OK || length != raw_length)
+						throw std::runtime_error("Region entry is corrupt, unable to decompress!");
+					return out;
+				}
+#endif
+				default:
+					throw std::runtime_error("Region compression is not supported by this build!");
+			}
+		}
+
+#ifdef __unix__
+		void read_fully(const int fd, char* buffer, size_t bytes, off_t offset)
+		{
+			while (bytes > 0)
+			{
+				const auto amount = pread(fd, buffer, bytes, offset);
+				if (amount < 0 && errno == EINTR)
+					continue;
+				if (amount < 0)
+					throw std::runtime_error(std::string("Unable to read region file: ") + std::strerror(errno));
+				if (amount == 0)
+					throw std::runtime_error("Region file ended in the middle of an entry!");
+				buffer += amount;
+				bytes -= static_cast<size_t>(amount);
+				offset += amount;
+			}
+		}
+
+		void write_fully(const int fd, const char* buffer, size_t bytes, off_t offset)
+		{
+			while (bytes > 0)
+			{
+				const auto amount = pwrite(fd, buffer, bytes, offset);
+				if (amount < 0 && errno == EINTR)
+					continue;
+				if (amount < 0)
+					throw std::runtime_error(std::string("Unable to write region file: ") + std::strerror(errno));
+				buffer += amount;
+				bytes -= static_cast<size_t>(amount);
+				offset += amount;
+			}
+		}
+
+		off_t sector_offset(const u32 sector)
+		{
+			return static_cast<off_t>(sector) * static_cast<off_t>(region_file_t::SECTOR_SIZE);
+		}
+#endif
+	}
+
+#ifdef __unix__
+	region_file_t::region_file_t(const std::string& path, u32 entry_count)
+	{
+		m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (m_fd < 0)
+			throw std::runtime_error("Unable to open region file '" + path + "': " + std::strerror(errno));
+		try
+		{
+			struct stat info{};
+			if (fstat(m_fd, &info) != 0)
+				throw std::runtime_error("Unable to stat region file '" + path + "': " + std::strerror(errno));
+			const auto file_size = static_cast<size_t>(info.st_size);
+
+			if (file_size == 0)
+			{
+				if (entry_count == 0)
+					throw std::runtime_error("Region files need at least one entry!");
+				m_header_sectors = sectors_for(HEADER_PREFIX + entry_count * TABLE_ENTRY);
+				std::string header(m_header_sectors * SECTOR_SIZE, '\0');
+				put(header.data(), MAGIC);
+				put(header.data() + sizeof(u32), VERSION);
+				put(header.data() + 2 * sizeof(u32), entry_count);
+				write_fully(m_fd, header.data(), header.size(), 0);
+				m_entries.resize(entry_count);
+				m_used.assign(m_header_sectors, true);
+				return;
+			}
+
+			char prefix[HEADER_PREFIX];
+			if (file_size < HEADER_PREFIX)
+				throw std::runtime_error("'" + path + "' is not a region file!");
+			read_fully(m_fd, prefix, HEADER_PREFIX, 0);
+			if (get<u32>(prefix) != MAGIC)
+				throw std::runtime_error("'" + path + "' is not a region file!");
+			if (get<u32>(prefix + sizeof(u32)) != VERSION)
+				throw std::runtime_error("Region file '" + path + "' has an unsupported version!");
+			entry_count = get<u32>(prefix + 2 * sizeof(u32));
+			m_header_sectors = sectors_for(HEADER_PREFIX + static_cast<size_t>(entry_count) * TABLE_ENTRY);
+			const auto file_sectors = sectors_for(file_size);
+			if (entry_count == 0 || file_sectors < m_header_sectors)
+				throw std::runtime_error("Region file '" + path + "' has a corrupt header!");
+
+			std::string table(static_cast<size_t>(entry_count) * TABLE_ENTRY, '\0');
+			read_fully(m_fd, table.data(), table.size(), HEADER_PREFIX);
+			m_entries.resize(entry_count);
+			m_used.assign(file_sectors, false);
+			mark_sectors(0, m_header_sectors, true);
+			for (u32 i = 0; i < entry_count; ++i)
+			{
+				auto& entry = m_entries[i];
+				entry.first_sector = get<u32>(table.data() + i * TABLE_ENTRY);
+				entry.sector_count = get<u32>(table.data() + i * TABLE_ENTRY + sizeof(u32));
+				if (entry.sector_count == 0)
+				{
+					entry.first_sector = 0;
+					continue;
+				}
+				const auto end = static_cast<size_t>(entry.first_sector) + entry.sector_count;
+				if (entry.first_sector < m_header_sectors || end > file_sectors)
+					throw std::runtime_error("Region file '" + path + "' has an entry outside of the file!");
+				for (auto sector = entry.first_sector; sector < end; ++sector)
+				{
+					if (m_used[sector])
+						throw std::runtime_error("Region file '" + path + "' has overlapping entries!");
+					m_used[sector] = true;
+				}
+			}
+		} catch (...)
+		{
+			close(m_fd);
+			throw;
+		}
+	}
+
+	region_file_t::~region_file_t()
+	{
+		if (m_fd >= 0)
+			close(m_fd);
+	}
+
+	bool region_file_t::contains(const u32 index) const
+	{
+		if (index >= capacity())
+			throw std::out_of_range("Region entry index out of range!");
+		std::shared_lock lock{m_mutex};
+		return m_entries[index].sector_count != 0;
+	}
+
+	std::optional<std::string> region_file_t::read(const u32 index) const
+	{
+		if (index >= capacity())
+			throw std::out_of_range("Region entry index out of range!");
+		std::string stored;
+		region_compression_t compression;
+		size_t raw_length;
+		{
+			// held while reading so a writer cannot hand the sectors to another entry underneath us
+			std::shared_lock lock{m_mutex};
+			const auto entry = m_entries[index];
+			if (entry.sector_count == 0)
+				return {};
+			char prefix[PAYLOAD_PREFIX];
+			read_fully(m_fd, prefix, PAYLOAD_PREFIX, sector_offset(entry.first_sector));
+			const auto length = get<u32>(prefix);
+			compression = static_cast<region_compression_t>(prefix[sizeof(u32)]);
+			raw_length = get<u32>(prefix + sizeof(u32) + sizeof(u8));
+			if (PAYLOAD_PREFIX + length > static_cast<size_t>(entry.sector_count) * SECTOR_SIZE)
+				throw std::runtime_error("Region entry is longer than its sectors!");
+			stored.resize(length);
+			read_fully(m_fd, stored.data(), length, sector_offset(entry.first_sector) + static_cast<off_t>(PAYLOAD_PREFIX));
+		}
+		return decompress(std::move(stored), compression, raw_length);
+	}
+
+	void region_file_t::write(const u32 index, const std::string_view data, const region_compression_t compression)
+	{
+		if (index >= capacity())
+			throw std::out_of_range("Region entry index out of range!");
+		if (data.size() > std::numeric_limits<u32>::max())
+			throw std::runtime_error("Region entries are limited to 4GiB!");
+		// compressing and padding happen before the lock is taken, readers only wait on the disk write
+		const auto stored = compress(data, compression);
+		const auto sectors = sectors_for(PAYLOAD_PREFIX + stored.size());
+		std::string buffer(static_cast<size_t>(sectors) * SECTOR_SIZE, '\0');
+		put(buffer.data(), static_cast<u32>(stored.size()));
+		buffer[sizeof(u32)] = static_cast<char>(compression);
+		put(buffer.data() + sizeof(u32) + sizeof(u8), static_cast<u32>(data.size()));
+		std::memcpy(buffer.data() + PAYLOAD_PREFIX, stored.data(), stored.size());
+
+		std::unique_lock lock{m_mutex};
+		auto& entry = m_entries[index];
+		if (entry.sector_count >= sectors)
+		{
+			// fits where it is, give back the tail
+			free_sectors(entry.first_sector + sectors, entry.sector_count - sectors);
+		} else
+		{
+			free_sectors(entry.first_sector, entry.sector_count);
+			entry.first_sector = allocate_sectors(sectors);
+		}
+		entry.sector_count = sectors;
+		write_fully(m_fd, buffer.data(), buffer.size(), sector_offset(entry.first_sector));
+		write_entry(index);
+	}
+
+	void region_file_t::write(const u32 index, tag_compound& root, const region_compression_t compression)
+	{
+		string_writer_t writer;
+		NBTWriter{writer}.write(root);
+		write(index, writer.str, compression);
+	}
+
+	bool region_file_t::erase(const u32 index)
+	{
+		if (index >= capacity())
+			throw std::out_of_range("Region entry index out of range!");
+		std::unique_lock lock{m_mutex};
+		auto& entry = m_entries[index];
+		if (entry.sector_count == 0)
+			return false;
+		free_sectors(entry.first_sector, entry.sector_count);
+		entry = {};
+		write_entry(index);
+		return true;
+	}
+
+	void region_file_t::sync()
+	{
+		std::unique_lock lock{m_mutex};
+		if (fsync(m_fd) != 0)
+			throw std::runtime_error(std::string("Unable to sync region file: ") + std::strerror(errno));
+	}
+
+	void region_file_t::write_entry(const u32 index)
+	{
+		char data[TABLE_ENTRY];
+		put(data, m_entries[index].first_sector);
+		put(data + sizeof(u32), m_entries[index].sector_count);
+		write_fully(m_fd, data, TABLE_ENTRY, static_cast<off_t>(HEADER_PREFIX + index * TABLE_ENTRY));
+	}
+#else
+	region_file_t::region_file_t(const std::string&, u32)
+	{
+		throw std::runtime_error("region_file_t is not supported on this platform");
+	}
+
+	region_file_t::~region_file_t() = default;
+
+	bool region_file_t::contains(u32) const
+	{
+		return false;
+	}
+
+	std::optional<std::string> region_file_t::read(u32) const
+	{
+		return {};
+	}
+
+	void region_file_t::write(u32, std::string_view, region_compression_t)
+	{}
+
+	void region_file_t::write(u32, tag_compound&, region_compression_t)
+	{}
+
+	bool region_file_t::erase(u32)
+	{
+		return false;
+	}
+
+	void region_file_t::sync()
+	{}
+
+	void region_file_t::write_entry(u32)
+	{}
+#endif
+
+	std::optional<nbt_document_t> region_file_t::read_document(const u32 index) const
+	{
+		const auto data = read(index);
+		if (!data)
+			return {};
+		return nbt_document_t::read(std::string_view{*data});
+	}
+
+	size_t region_file_t::sector_count() const
+	{
+		std::shared_lock lock{m_mutex};
+		return m_used.size();
+	}
+
+	bool region_file_t::supports(const region_compression_t compression)
+	{
+		switch (compression)
+		{
+			case region_compression_t::NONE:
+				return true;
+			case region_compression_t::ZLIB:
+#ifdef ZLIB_FOUND
+				return true;
+#else
+				return false;
+#endif
+			default:
+				return false;
+		}
+	}
+
+	u32 region_file_t::allocate_sectors(const u32 count)
+	{
+		// first fit, the run may also be the free sectors at the very end of the file
+		u32 run = 0;
+		for (auto sector = m_header_sectors; sector < m_used.size(); ++sector)
+		{
+			run = m_used[sector] ? 0 : run + 1;
+			if (run == count)
+			{
+				const auto first = sector + 1 - count;
+				mark_sectors(first, count, true);
+				return first;
+			}
+		}
+		// grow the file, reusing a free run at its end
+		const auto first = static_cast<u32>(m_used.size() - run);
+		m_used.resize(static_cast<size_t>(first) + count, false);
+		mark_sectors(first, count, true);
+		return first;
+	}
+
+	void region_file_t::free_sectors(const u32 first, const u32 count)
+	{
+		mark_sectors(first, count, false);
+	}
+
+	void region_file_t::mark_sectors(const u32 first, const u32 count, const bool used)
+	{
+		for (u32 i = 0; i < count; ++i)
+			m_used[first + i] = used;
+	}
+}
@@ -0,0 +1,553 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <blt/fs/nbt_document.h>
+#include <blt/fs/nbt_visitor.h>
+
+namespace blt::nbt
+{
+	namespace
+	{
+		bool is_ascii(const std::string_view str)
+		{
+			return std::all_of(str.begin(), str.end(), [](const char c) {
+				return static_cast<unsigned char>(c) < 0x80;
+			});
+		}
+
+		bool is_container(const nbt_tag type)
+		{
+			return type == nbt_tag::COMPOUND || type == nbt_tag::LIST;
+		}
+	}
+
+	/**
+	* Appends records as the events of a document arrive, used both for parsed data and for converting a tag tree
+	*/
+	class nbt_document_t::builder_t final : public nbt_visitor_t
+	{
+	public:
+		/**
+		* @param encoded strings are in the modified UTF-8 of NBT data and have to be decoded (false when they come from a tag tree)
+		*/
+		builder_t(nbt_document_t& document, const bool encoded): m_document(document), m_encoded(encoded)
+		{}
+
+		visit_t key(nbt_tag, const std::string_view name) override
+		{
+			m_name = m_document.intern(m_encoded && !is_ascii(name) ? decode_string(name) : name);
+			return visit_t::CONTINUE;
+		}
+
+		visit_t begin_compound() override
+		{
+			open(nbt_tag::COMPOUND, nbt_tag::END);
+			return visit_t::CONTINUE;
+		}
+
+		visit_t end_compound() override
+		{
+			close();
+			return visit_t::CONTINUE;
+		}
+
+		visit_t begin_list(const nbt_tag type, i32) override
+		{
+			open(nbt_tag::LIST, type);
+			return visit_t::CONTINUE;
+		}
+
+		visit_t end_list() override
+		{
+			close();
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_byte(const i8 value) override
+		{
+			push(nbt_tag::BYTE).value.byte = value;
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_short(const i16 value) override
+		{
+			push(nbt_tag::SHORT).value.short_value = value;
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_int(const i32 value) override
+		{
+			push(nbt_tag::INT).value.int_value = value;
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_long(const i64 value) override
+		{
+			push(nbt_tag::LONG).value.long_value = value;
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_float(const f32 value) override
+		{
+			push(nbt_tag::FLOAT).value.float_value = value;
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_double(const f64 value) override
+		{
+			push(nbt_tag::DOUBLE).value.double_value = value;
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_string(const std::string_view value) override
+		{
+			if (m_encoded && !is_ascii(value))
+				store_string(decode_string(value));
+			else
+				store_string(value);
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_byte_array(const nbt_array_view_t<i8> value) override
+		{
+			auto* data = allocate_array<i8>(nbt_tag::BYTE_ARRAY, value.size());
+			std::memcpy(data, value.bytes().data(), value.size());
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_int_array(const nbt_array_view_t<i32> value) override
+		{
+			value.copy_to(allocate_array<i32>(nbt_tag::INT_ARRAY, value.size()));
+			return visit_t::CONTINUE;
+		}
+
+		visit_t value_long_array(const nbt_array_view_t<i64> value) override
+		{
+			value.copy_to(allocate_array<i64>(nbt_tag::LONG_ARRAY, value.size()));
+			return visit_t::CONTINUE;
+		}
+
+		/**
+		* Arrays from a tag tree are already in native order
+		*/
+		template <typename T>
+		void native_array(const nbt_tag type, const std::vector<T>& values)
+		{
+			if (!values.empty())
+				std::memcpy(allocate_array<T>(type, values.size()), values.data(), values.size() * sizeof(T));
+			else
+				allocate_array<T>(type, 0);
+		}
+
+	private:
+		detail::nbt_record_t& push(const nbt_tag type)
+		{
+			auto& records = m_document.m_records;
+			const auto index = records.size();
+			if (index >= NO_NAME)
+				throw std::runtime_error("NBT document has too many tags!");
+			if (!m_open.empty())
+				++records[m_open.back()].count;
+			auto& record = records.emplace_back();
+			record.type = type;
+			record.element_type = nbt_tag::END;
+			record.name = std::exchange(m_name, NO_NAME);
+			record.end = static_cast<u32>(index + 1);
+			record.count = 0;
+			record.value.long_value = 0;
+			return record;
+		}
+
+		void open(const nbt_tag type, const nbt_tag element_type)
+		{
+			const auto index = static_cast<u32>(m_document.m_records.size());
+			push(type).element_type = element_type;
+			m_open.push_back(index);
+		}
+
+		void close()
+		{
+			m_document.m_records[m_open.back()].end = static_cast<u32>(m_document.m_records.size());
+			m_open.pop_back();
+		}
+
+		void store_string(const std::string_view value)
+		{
+			auto* data = static_cast<char*>(m_document.allocate(value.size(), 1));
+			if (!value.empty())
+				std::memcpy(data, value.data(), value.size());
+			auto& record = push(nbt_tag::STRING);
+			record.count = static_cast<u32>(value.size());
+			record.value.data = data;
+		}
+
+		template <typename T>
+		T* allocate_array(const nbt_tag type, const size_t count)
+		{
+			auto* data = static_cast<T*>(m_document.allocate(count * sizeof(T), alignof(T)));
+			auto& record = push(type);
+			record.count = static_cast<u32>(count);
+			record.value.data = data;
+			return data;
+		}
+
+		nbt_document_t& m_document;
+		bool m_encoded;
+		u32 m_name = NO_NAME;
+		// compounds and lists which have been opened but not closed yet
+		std::vector<u32> m_open;
+	};
+
+	namespace
+	{
+		template <typename Builder>
+		void feed_tree(Builder& builder, tag_t* tag)
+		{
+			switch (tag->getType())
+			{
+				case nbt_tag::BYTE:
+					builder.value_byte(static_cast<tag_byte*>(tag)->get());
+					break;
+				case nbt_tag::SHORT:
+					builder.value_short(static_cast<tag_short*>(tag)->get());
+					break;
+				case nbt_tag::INT:
+					builder.value_int(static_cast<tag_int*>(tag)->get());
+					break;
+				case nbt_tag::LONG:
+					builder.value_long(static_cast<tag_long*>(tag)->get());
+					break;
+				case nbt_tag::FLOAT:
+					builder.value_float(static_cast<tag_float*>(tag)->get());
+					break;
+				case nbt_tag::DOUBLE:
+					builder.value_double(static_cast<tag_double*>(tag)->get());
+					break;
+				case nbt_tag::STRING:
+					builder.value_string(static_cast<tag_string*>(tag)->get());
+					break;
+				case nbt_tag::BYTE_ARRAY:
+					builder.native_array(nbt_tag::BYTE_ARRAY, static_cast<tag_byte_array*>(tag)->get());
+					break;
+				case nbt_tag::INT_ARRAY:
+					builder.native_array(nbt_tag::INT_ARRAY, static_cast<tag_int_array*>(tag)->get());
+					break;
+				case nbt_tag::LONG_ARRAY:
+					builder.native_array(nbt_tag::LONG_ARRAY, static_cast<tag_long_array*>(tag)->get());
+					break;
+				case nbt_tag::LIST:
+				{
+					const auto& elements = static_cast<tag_list*>(tag)->get();
+					builder.begin_list(elements.empty() ? nbt_tag::END : elements.front()->getType(), static_cast<i32>(elements.size()));
+					for (auto* element : elements)
+						feed_tree(builder, element);
+					builder.end_list();
+					break;
+				}
+				case nbt_tag::COMPOUND:
+					builder.begin_compound();
+					for (const auto& [name, child] : static_cast<tag_compound*>(tag)->get())
+					{
+						builder.key(child->getType(), name);
+						feed_tree(builder, child);
+					}
+					builder.end_compound();
+					break;
+				default:
+					throw std::runtime_error("Tag Type not found!");
+			}
+		}
+
+		tag_t* to_tag(const nbt_node_t& node)
+		{
+			const std::string name{node.name()};
+			switch (node.type())
+			{
+				case nbt_tag::BYTE:
+					return new tag_byte(name, node.as_byte());
+				case nbt_tag::SHORT:
+					return new tag_short(name, node.as_short());
+				case nbt_tag::INT:
+					return new tag_int(name, node.as_int());
+				case nbt_tag::LONG:
+					return new tag_long(name, node.as_long());
+				case nbt_tag::FLOAT:
+					return new tag_float(name, node.as_float());
+				case nbt_tag::DOUBLE:
+					return new tag_double(name, node.as_double());
+				case nbt_tag::STRING:
+					return new tag_string(name, std::string(node.as_string()));
+				case nbt_tag::BYTE_ARRAY:
+				{
+					const auto values = node.as_byte_array();
+					return new tag_byte_array(name, std::vector<i8>(values.begin(), values.end()));
+				}
+				case nbt_tag::INT_ARRAY:
+				{
+					const auto values = node.as_int_array();
+					return new tag_int_array(name, std::vector<i32>(values.begin(), values.end()));
+				}
+				case nbt_tag::LONG_ARRAY:
+				{
+					const auto values = node.as_long_array();
+					return new tag_long_array(name, std::vector<i64>(values.begin(), values.end()));
+				}
+				case nbt_tag::LIST:
+				case nbt_tag::COMPOUND:
+				{
+					std::vector<tag_t*> children;
+					children.reserve(node.size());
+					for (const auto child : node)
+						children.push_back(to_tag(child));
+					if (node.type() == nbt_tag::LIST)
+						return new tag_list(name, children);
+					return new tag_compound(name, children);
+				}
+				default:
+					throw std::runtime_error("Tag Type not found!");
+			}
+		}
+	}
+
+	nbt_node_t::iterator& nbt_node_t::iterator::operator++()
+	{
+		m_index = m_document->m_records[m_index].end;
+		return *this;
+	}
+
+	nbt_tag nbt_node_t::type() const
+	{
+		return record().type;
+	}
+
+	nbt_tag nbt_node_t::element_type() const
+	{
+		return record().element_type;
+	}
+
+	std::string_view nbt_node_t::name() const
+	{
+		const auto name = record().name;
+		return name == nbt_document_t::NO_NAME ? std::string_view{} : m_document->m_names[name];
+	}
+
+	size_t nbt_node_t::size() const
+	{
+		return record().count;
+	}
+
+	i8 nbt_node_t::as_byte() const
+	{
+		return record(nbt_tag::BYTE).value.byte;
+	}
+
+	i16 nbt_node_t::as_short() const
+	{
+		return record(nbt_tag::SHORT).value.short_value;
+	}
+
+	i32 nbt_node_t::as_int() const
+	{
+		return record(nbt_tag::INT).value.int_value;
+	}
+
+	i64 nbt_node_t::as_long() const
+	{
+		return record(nbt_tag::LONG).value.long_value;
+	}
+
+	f32 nbt_node_t::as_float() const
+	{
+		return record(nbt_tag::FLOAT).value.float_value;
+	}
+
+	f64 nbt_node_t::as_double() const
+	{
+		return record(nbt_tag::DOUBLE).value.double_value;
+	}
+
+	std::string_view nbt_node_t::as_string() const
+	{
+		const auto& rec = record(nbt_tag::STRING);
+		return {static_cast<const char*>(rec.value.data), rec.count};
+	}
+
+	span<const i8> nbt_node_t::as_byte_array() const
+	{
+		const auto& rec = record(nbt_tag::BYTE_ARRAY);
+		return {static_cast<const i8*>(rec.value.data), rec.count};
+	}
+
+	span<const i32> nbt_node_t::as_int_array() const
+	{
+		const auto& rec = record(nbt_tag::INT_ARRAY);
+		return {static_cast<const i32*>(rec.value.data), rec.count};
+	}
+
+	span<const i64> nbt_node_t::as_long_array() const
+	{
+		const auto& rec = record(nbt_tag::LONG_ARRAY);
+		return {static_cast<const i64*>(rec.value.data), rec.count};
+	}
+
+	std::optional<nbt_node_t> nbt_node_t::find(const std::string_view name) const
+	{
+		const auto& rec = record(nbt_tag::COMPOUND);
+		const auto id = m_document->find_name(name);
+		// a name which was never interned cannot belong to any tag
+		if (id == nbt_document_t::NO_NAME)
+			return {};
+		const auto& records = m_document->m_records;
+		for (auto index = m_index + 1; index < rec.end; index = records[index].end)
+		{
+			if (records[index].name == id)
+				return nbt_node_t{m_document, index};
+		}
+		return {};
+	}
+
+	nbt_node_t nbt_node_t::at(const size_t index) const
+	{
+		const auto& rec = record();
+		if (!is_container(rec.type) || index >= rec.count)
+			throw std::out_of_range("NBT child index out of range!");
+		// records of tags without children are exactly one long
+		if (rec.type == nbt_tag::LIST && !is_container(rec.element_type))
+			return {m_document, static_cast<u32>(m_index + 1 + index)};
+		auto it = begin();
+		for (size_t i = 0; i < index; ++i)
+			++it;
+		return *it;
+	}
+
+	nbt_node_t::iterator nbt_node_t::begin() const
+	{
+		return {m_document, m_index + 1};
+	}
+
+	nbt_node_t::iterator nbt_node_t::end() const
+	{
+		return {m_document, record().end};
+	}
+
+	const detail::nbt_record_t& nbt_node_t::record() const
+	{
+		return m_document->m_records[m_index];
+	}
+
+	const detail::nbt_record_t& nbt_node_t::record(const nbt_tag expected) const
+	{
+		const auto& rec = record();
+		if (rec.type != expected)
+			throw std::runtime_error("Requested Tag does not match stored type!");
+		return rec;
+	}
+
+	nbt_document_t::nbt_document_t(): m_arena(std::make_unique<bump_allocator<ARENA_BLOCK_SIZE>>())
+	{}
+
+	nbt_document_t::nbt_document_t(nbt_document_t&&) noexcept = default;
+
+	nbt_document_t& nbt_document_t::operator=(nbt_document_t&&) noexcept = default;
+
+	nbt_document_t::~nbt_document_t() = default;
+
+	nbt_document_t nbt_document_t::read(fs::reader_t& reader)
+	{
+		nbt_document_t document;
+		builder_t builder{document, true};
+		visit(reader, builder);
+		return document;
+	}
+
+	nbt_document_t nbt_document_t::read(const std::string_view data)
+	{
+		nbt_document_t document;
+		builder_t builder{document, true};
+		visit(data, builder);
+		return document;
+	}
+
+	nbt_document_t nbt_document_t::from_compound(tag_compound& root)
+	{
+		nbt_document_t document;
+		builder_t builder{document, false};
+		builder.key(nbt_tag::COMPOUND, root.getName());
+		feed_tree(builder, &root);
+		return document;
+	}
+
+	tag_compound* nbt_document_t::to_compound() const
+	{
+		return static_cast<tag_compound*>(to_tag(root()));
+	}
+
+	void nbt_document_t::clear()
+	{
+		m_records.clear();
+		m_names.clear();
+		m_name_ids.clear();
+		m_large.clear();
+		// dropping the arena hands its blocks back in one go
+		m_arena = std::make_unique<bump_allocator<ARENA_BLOCK_SIZE>>();
+	}
+
+	u32 nbt_document_t::intern(const std::string_view name)
+	{
+		const auto it = m_name_ids.find(name);
+		if (it != m_name_ids.end())
+			return it->second;
+		auto* data = static_cast<char*>(allocate(name.size(), 1));
+		if (!name.empty())
+			std::memcpy(data, name.data(), name.size());
+		const std::string_view stored{data, name.size()};
+		const auto id = static_cast<u32>(m_names.size());
+		m_names.push_back(stored);
+		m_name_ids.emplace(stored, id);
+		return id;
+	}
+
+	u32 nbt_document_t::find_name(const std::string_view name) const
+	{
+		const auto it = m_name_ids.find(name);
+		return it == m_name_ids.end() ? NO_NAME : it->second;
+	}
+
+	void* nbt_document_t::allocate(const size_t bytes, const size_t alignment)
+	{
+		if (bytes == 0)
+			return nullptr;
+		if (bytes > LARGE_PAYLOAD)
+			return m_large.emplace_back(new char[bytes]).get();
+		switch (alignment)
+		{
+			case 8:
+				return m_arena->allocate<u64>((bytes + 7) / 8);
+			case 4:
+				return m_arena->allocate<u32>((bytes + 3) / 4);
+			case 2:
+				return m_arena->allocate<u16>((bytes + 1) / 2);
+			default:
+				return m_arena->allocate<u8>(bytes);
+		}
+	}
+}
@@ -0,0 +1,367 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <blt/format/format.h>
+#include <blt/fs/nbt_visitor.h>
+
+namespace blt::nbt
+{
+	namespace
+	{
+		// the depth limit of the NBT format, also keeps hostile input from overflowing the stack
+		constexpr size_t MAX_DEPTH = 512;
+		// readers without views are read (and skipped) this much at a time, so a corrupt length cannot allocate far beyond the data
+		constexpr size_t READ_CHUNK = 64 * 1024;
+
+		[[noreturn]] void throw_truncated()
+		{
+			throw std::runtime_error("NBT data ended in the middle of a tag!");
+		}
+
+		class memory_source_t
+		{
+		public:
+			explicit memory_source_t(const std::string_view data): m_data(data)
+			{}
+
+			std::string_view take(const size_t bytes)
+			{
+				if (bytes > m_data.size())
+					throw_truncated();
+				const auto view = m_data.substr(0, bytes);
+				m_data.remove_prefix(bytes);
+				return view;
+			}
+
+			void skip(const size_t bytes)
+			{
+				take(bytes);
+			}
+
+		private:
+			std::string_view m_data;
+		};
+
+		class reader_source_t
+		{
+		public:
+			explicit reader_source_t(fs::reader_t& reader): m_reader(reader), m_views(reader.supports_views())
+			{}
+
+			/**
+			* @return view of the next bytes, valid until the next call when the reader has no views of its own
+			*/
+			std::string_view take(const size_t bytes)
+			{
+				if (m_views)
+				{
+					const auto view = *m_reader.read_view(bytes);
+					if (view.size() != bytes)
+						throw_truncated();
+					return view;
+				}
+				size_t read = 0;
+				while (read < bytes)
+				{
+					// grown as the data arrives, truncated input throws long before the scratch buffer reaches the length it claims
+					const auto target = std::min(bytes, std::max(read * 2, read + READ_CHUNK));
+					if (m_scratch.size() < target)
+						m_scratch.resize(target);
+					const auto amount = m_reader.read(m_scratch.data() + read, target - read);
+					if (amount <= 0)
+						throw_truncated();
+					read += static_cast<size_t>(amount);
+				}
+				return {m_scratch.data(), bytes};
+			}
+
+			void skip(size_t bytes)
+			{
+				while (bytes > 0)
+				{
+					const auto amount = std::min(bytes, READ_CHUNK);
+					take(amount);
+					bytes -= amount;
+				}
+			}
+
+		private:
+			fs::reader_t& m_reader;
+			bool m_views;
+			std::vector<char> m_scratch;
+		};
+
+		size_t fixed_size(const nbt_tag type)
+		{
+			switch (type)
+			{
+				case nbt_tag::BYTE:
+					return 1;
+				case nbt_tag::SHORT:
+					return 2;
+				case nbt_tag::INT:
+				case nbt_tag::FLOAT:
+					return 4;
+				case nbt_tag::LONG:
+				case nbt_tag::DOUBLE:
+					return 8;
+				default:
+					return 0;
+			}
+		}
+
+		template <typename Source>
+		class walker_t
+		{
+		public:
+			walker_t(Source& source, nbt_visitor_t& visitor): m_source(source), m_visitor(visitor)
+			{}
+
+			bool walk()
+			{
+				const auto type = static_cast<nbt_tag>(read<i8>());
+				if (type != nbt_tag::COMPOUND)
+					throw std::runtime_error("Incorrectly formatted NBT data! Root tag must be a compound tag!");
+				return named(type, 0);
+			}
+
+		private:
+			template <typename T>
+			T read()
+			{
+				T value;
+				mem::fromBytes(m_source.take(sizeof(T)).data(), value);
+				return value;
+			}
+
+			size_t read_length()
+			{
+				const auto length = read<i32>();
+				if (length < 0)
+					throw std::runtime_error("Negative length in NBT data!");
+				return static_cast<size_t>(length);
+			}
+
+			std::string_view read_string()
+			{
+				return m_source.take(read<u16>());
+			}
+
+			/**
+			* Reads the name following a tag id and reports the tag
+			*/
+			bool named(const nbt_tag type, const size_t depth)
+			{
+				switch (m_visitor.key(type, read_string()))
+				{
+					case visit_t::STOP:
+						return false;
+					case visit_t::SKIP:
+						skip(type, depth);
+						return true;
+					default:
+						return value(type, depth);
+				}
+			}
+
+			bool value(const nbt_tag type, const size_t depth)
+			{
+				visit_t result;
+				switch (type)
+				{
+					case nbt_tag::BYTE:
+						result = m_visitor.value_byte(read<i8>());
+						break;
+					case nbt_tag::SHORT:
+						result = m_visitor.value_short(read<i16>());
+						break;
+					case nbt_tag::INT:
+						result = m_visitor.value_int(read<i32>());
+						break;
+					case nbt_tag::LONG:
+						result = m_visitor.value_long(read<i64>());
+						break;
+					case nbt_tag::FLOAT:
+						result = m_visitor.value_float(read<f32>());
+						break;
+					case nbt_tag::DOUBLE:
+						result = m_visitor.value_double(read<f64>());
+						break;
+					case nbt_tag::STRING:
+						result = m_visitor.value_string(read_string());
+						break;
+					case nbt_tag::BYTE_ARRAY:
+						result = m_visitor.value_byte_array(nbt_array_view_t<i8>{m_source.take(read_length())});
+						break;
+					case nbt_tag::INT_ARRAY:
+						result = m_visitor.value_int_array(nbt_array_view_t<i32>{m_source.take(read_length() * sizeof(i32))});
+						break;
+					case nbt_tag::LONG_ARRAY:
+						result = m_visitor.value_long_array(nbt_array_view_t<i64>{m_source.take(read_length() * sizeof(i64))});
+						break;
+					case nbt_tag::LIST:
+						return list(depth + 1);
+					case nbt_tag::COMPOUND:
+						return compound(depth + 1);
+					default:
+						throw std::runtime_error("Invalid tag type in NBT data!");
+				}
+				return result != visit_t::STOP;
+			}
+
+			bool compound(const size_t depth)
+			{
+				check_depth(depth);
+				switch (m_visitor.begin_compound())
+				{
+					case visit_t::STOP:
+						return false;
+					case visit_t::SKIP:
+						skip_compound(depth);
+						return true;
+					default:
+						break;
+				}
+				while (true)
+				{
+					const auto type = static_cast<nbt_tag>(read<i8>());
+					if (type == nbt_tag::END)
+						break;
+					if (!named(type, depth))
+						return false;
+				}
+				return m_visitor.end_compound() != visit_t::STOP;
+			}
+
+			bool list(const size_t depth)
+			{
+				check_depth(depth);
+				const auto type = static_cast<nbt_tag>(read<i8>());
+				const auto length = read_length();
+				switch (m_visitor.begin_list(type, static_cast<i32>(length)))
+				{
+					case visit_t::STOP:
+						return false;
+					case visit_t::SKIP:
+						skip_list(type, length, depth);
+						return true;
+					default:
+						break;
+				}
+				for (size_t i = 0; i < length; ++i)
+				{
+					if (!value(type, depth))
+						return false;
+				}
+				return m_visitor.end_list() != visit_t::STOP;
+			}
+
+			void skip(const nbt_tag type, const size_t depth)
+			{
+				if (const auto size = fixed_size(type))
+				{
+					m_source.skip(size);
+					return;
+				}
+				switch (type)
+				{
+					case nbt_tag::STRING:
+						m_source.skip(read<u16>());
+						break;
+					case nbt_tag::BYTE_ARRAY:
+						m_source.skip(read_length());
+						break;
+					case nbt_tag::INT_ARRAY:
+						m_source.skip(read_length() * sizeof(i32));
+						break;
+					case nbt_tag::LONG_ARRAY:
+						m_source.skip(read_length() * sizeof(i64));
+						break;
+					case nbt_tag::LIST:
+					{
+						check_depth(depth + 1);
+						const auto element = static_cast<nbt_tag>(read<i8>());
+						skip_list(element, read_length(), depth + 1);
+						break;
+					}
+					case nbt_tag::COMPOUND:
+						check_depth(depth + 1);
+						skip_compound(depth + 1);
+						break;
+					default:
+						throw std::runtime_error("Invalid tag type in NBT data!");
+				}
+			}
+
+			void skip_list(const nbt_tag type, const size_t length, const size_t depth)
+			{
+				if (length == 0)
+					return;
+				// lists of numbers are skipped in one go
+				if (const auto size = fixed_size(type))
+				{
+					m_source.skip(length * size);
+					return;
+				}
+				for (size_t i = 0; i < length; ++i)
+					skip(type, depth);
+			}
+
+			void skip_compound(const size_t depth)
+			{
+				while (true)
+				{
+					const auto type = static_cast<nbt_tag>(read<i8>());
+					if (type == nbt_tag::END)
+						return;
+					m_source.skip(read<u16>());
+					skip(type, depth);
+				}
+			}
+
+			static void check_depth(const size_t depth)
+			{
+				if (depth > MAX_DEPTH)
+					throw std::runtime_error("NBT data is nested too deeply!");
+			}
+
+			Source& m_source;
+			nbt_visitor_t& m_visitor;
+		};
+	}
+
+	bool visit(fs::reader_t& reader, nbt_visitor_t& visitor)
+	{
+		reader_source_t source{reader};
+		return walker_t{source, visitor}.walk();
+	}
+
+	bool visit(const std::string_view data, nbt_visitor_t& visitor)
+	{
+		memory_source_t source{data};
+		return walker_t{source, visitor}.walk();
+	}
+
+	std::string decode_string(const std::string_view str)
+	{
+		const string::utf8_string utf8{const_cast<char*>(str.data()), static_cast<unsigned int>(str.size())};
+		return string::getStringFromUTF8(utf8);
+	}
+}
@@ -15,22 +15,108 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <cstring>
+#include <thread>
 #include <blt/fs/threaded_writers.h>
 
 namespace blt::fs
 {
-	concurrent_file_writer::concurrent_file_writer(writer_t* writer): m_writer{writer}
-	{}
+	namespace
+	{
+		constexpr u64 OFFSET_BITS = 40;
+		constexpr u64 OFFSET_MASK = (1ull << OFFSET_BITS) - 1;
+	}
+
+	concurrent_file_writer::concurrent_file_writer(writer_t* writer, const size_t buffer_size): m_writer{writer}, m_buffer_size{buffer_size}
+	{
+		if (buffer_size == WRITE_THROUGH)
+			return;
+		for (auto& slab : m_slabs)
+			slab.data = std::unique_ptr<char[]>(new char[buffer_size]);
+	}
 
 	i64 concurrent_file_writer::write(const char* buffer, const size_t bytes)
 	{
-		std::scoped_lock lock{m_mutex};
-		return m_writer->write(buffer, bytes);
+		if (m_buffer_size == WRITE_THROUGH)
+		{
+			std::scoped_lock lock{m_mutex};
+			return m_writer->write(buffer, bytes);
+		}
+		if (bytes == 0)
+			return 0;
+		if (bytes > m_buffer_size / 4)
+		{
+			const auto lock = drain();
+			return m_writer->write(buffer, bytes);
+		}
+		while (true)
+		{
+			const auto state = m_state.fetch_add(bytes, std::memory_order_acq_rel);
+			const auto generation = state >> OFFSET_BITS;
+			const auto offset = state & OFFSET_MASK;
+			if (offset + bytes <= m_buffer_size)
+			{
+				auto& slab = m_slabs[generation & 1];
+				std::memcpy(slab.data.get() + offset, buffer, bytes);
+				slab.committed.fetch_add(bytes, std::memory_order_release);
+				return static_cast<i64>(bytes);
+			}
+			if (offset <= m_buffer_size)
+				seal(generation, offset);
+			else
+				wait_for_next(generation);
+		}
 	}
 
 	void concurrent_file_writer::flush()
 	{
-		std::scoped_lock lock{m_mutex};
+		if (m_buffer_size == WRITE_THROUGH)
+		{
+			std::scoped_lock lock{m_mutex};
+			m_writer->flush();
+			return;
+		}
+		const auto lock = drain();
 		m_writer->flush();
 	}
-}
\ No newline at end of file
+
+	concurrent_file_writer::~concurrent_file_writer()
+	{
+		if (m_buffer_size != WRITE_THROUGH)
+			drain();
+	}
+
+	void concurrent_file_writer::seal(const u64 generation, const u64 used)
+	{
+		std::scoped_lock lock{m_mutex};
+		// the previous sealer wrote out the other buffer while holding the lock, so it is empty by now
+		m_state.store((generation + 1) << OFFSET_BITS, std::memory_order_release);
+		auto& slab = m_slabs[generation & 1];
+		// threads which reserved space before the seal may still be copying into it
+		while (slab.committed.load(std::memory_order_acquire) != used)
+			std::this_thread::yield();
+		if (used > 0)
+			m_writer->write(slab.data.get(), used);
+		slab.committed.store(0, std::memory_order_relaxed);
+	}
+
+	void concurrent_file_writer::wait_for_next(const u64 generation) const
+	{
+		while ((m_state.load(std::memory_order_acquire) >> OFFSET_BITS) == generation)
+			std::this_thread::yield();
+	}
+
+	std::unique_lock<std::mutex> concurrent_file_writer::drain()
+	{
+		// a reservation larger than the buffer closes it, whoever seals it writes out everything reserved before
+		const auto state = m_state.fetch_add(m_buffer_size + 1, std::memory_order_acq_rel);
+		const auto generation = state >> OFFSET_BITS;
+		const auto offset = state & OFFSET_MASK;
+		if (offset <= m_buffer_size)
+			seal(generation, offset);
+		else
+			wait_for_next(generation);
+		// the next generation is published while the sealer holds the lock, taking it waits for the sealer's write to finish
+		return std::unique_lock{m_mutex};
+	}
+}
@@ -0,0 +1,322 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <blt/fs/fwddecl.h>
+#include <blt/logging/logging.h>
+#include <blt/std/queue.h>
+
+namespace blt::logging
+{
+	namespace
+	{
+		constexpr size_t DRAIN_BATCH_SIZE = 256;
+		// the background thread is woken by producers, this is only a safety net against a missed wakeup
+		constexpr auto IDLE_WAIT = std::chrono::milliseconds(50);
+
+		struct thread_buffer_t
+		{
+			explicit thread_buffer_t(const size_t size): records(size)
+			{}
+
+			spsc_queue<std::string> records;
+			// written only by the owning thread
+			std::atomic<u64> pushed = 0;
+			std::atomic<u64> dropped = 0;
+			// written only by the background thread
+			std::atomic<u64> drained = 0;
+			u64 reported_drops = 0;
+			std::atomic_bool closed = false;
+		};
+
+		class async_logger_t
+		{
+		public:
+			async_logger_t(): m_thread([this]() {
+				run();
+			})
+			{}
+
+			async_logger_t(const async_logger_t&) = delete;
+			async_logger_t& operator=(const async_logger_t&) = delete;
+
+			void submit(std::string str)
+			{
+				auto& buffer = local_buffer();
+				const auto& config = get_global_config();
+				while (!buffer.records.try_push(std::move(str)))
+				{
+					switch (config.get_overflow_policy())
+					{
+						case log_overflow_policy_t::BLOCK:
+							if (m_stopping.load(std::memory_order_relaxed))
+								return;
+							wake();
+							std::this_thread::yield();
+							continue;
+						case log_overflow_policy_t::COUNT:
+							buffer.dropped.store(buffer.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+							[[fallthrough]];
+						case log_overflow_policy_t::DROP:
+							return;
+					}
+				}
+				buffer.pushed.store(buffer.pushed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+				if (m_sleeping.load(std::memory_order_seq_cst))
+					wake();
+			}
+
+			bool flush()
+			{
+				std::vector<std::pair<std::shared_ptr<thread_buffer_t>, u64>> targets;
+				{
+					std::scoped_lock lock{m_buffers_mutex};
+					for (const auto& buffer : m_buffers)
+						targets.emplace_back(buffer, buffer->pushed.load(std::memory_order_acquire));
+				}
+				const auto is_flushed = [&targets]() {
+					for (const auto& [buffer, pushed] : targets)
+					{
+						if (buffer->drained.load(std::memory_order_acquire) < pushed)
+							return false;
+					}
+					return true;
+				};
+				std::unique_lock lock{m_wait_mutex};
+				++m_flush_waiters;
+				m_wait_cv.notify_one();
+				const auto flushed = m_flushed_cv.wait_for(lock, get_global_config().get_flush_timeout(), is_flushed);
+				--m_flush_waiters;
+				return flushed;
+			}
+
+			[[nodiscard]] u64 dropped()
+			{
+				std::scoped_lock lock{m_buffers_mutex};
+				u64 total = m_retired_drops;
+				for (const auto& buffer : m_buffers)
+					total += buffer->dropped.load(std::memory_order_relaxed);
+				return total;
+			}
+
+			~async_logger_t()
+			{
+				{
+					std::scoped_lock lock{m_wait_mutex};
+					m_stopping = true;
+					m_wait_cv.notify_one();
+				}
+				m_thread.join();
+			}
+
+		private:
+			struct local_handle_t
+			{
+				std::shared_ptr<thread_buffer_t> buffer;
+
+				~local_handle_t()
+				{
+					if (buffer)
+						buffer->closed.store(true, std::memory_order_release);
+				}
+			};
+
+			thread_buffer_t& local_buffer()
+			{
+				thread_local local_handle_t handle;
+				if (!handle.buffer)
+				{
+					handle.buffer = std::make_shared<thread_buffer_t>(get_global_config().get_async_buffer_size());
+					std::scoped_lock lock{m_buffers_mutex};
+					m_buffers.push_back(handle.buffer);
+				}
+				return *handle.buffer;
+			}
+
+			void wake()
+			{
+				std::scoped_lock lock{m_wait_mutex};
+				m_wait_cv.notify_one();
+			}
+
+			[[nodiscard]] bool has_pending()
+			{
+				std::scoped_lock lock{m_buffers_mutex};
+				for (const auto& buffer : m_buffers)
+				{
+					if (buffer->records.size_approx() > 0)
+						return true;
+				}
+				return false;
+			}
+
+			static void write(std::string& str)
+			{
+				if (!detail::apply_injectors(str))
+					return;
+				for (auto* output : get_global_config().get_log_outputs())
+					output->write(str.data(), str.size());
+			}
+
+			/**
+			 * Writes out everything currently buffered by every thread and retires buffers of threads which have exited.
+			 * @return number of records written
+			 */
+			size_t drain(std::vector<std::string>& batch)
+			{
+				// the outputs are written without the lock, a thread logging for the first time only waits for this copy
+				{
+					std::scoped_lock lock{m_buffers_mutex};
+					m_draining.assign(m_buffers.begin(), m_buffers.end());
+				}
+				size_t written = 0;
+				for (const auto& handle : m_draining)
+				{
+					auto& buffer = *handle;
+					size_t drained = 0;
+					// read before draining so a record pushed right before the thread exited is not missed
+					const auto closed = buffer.closed.load(std::memory_order_acquire);
+					while (const auto count = buffer.records.try_pop_n(batch.begin(), batch.size()))
+					{
+						for (size_t i = 0; i < count; ++i)
+							write(batch[i]);
+						drained += count;
+					}
+					const auto dropped = buffer.dropped.load(std::memory_order_relaxed);
+					if (dropped != buffer.reported_drops)
+					{
+						auto notice = "[blt::logging] " + std::to_string(dropped - buffer.reported_drops) +
+							" log records dropped, the async buffer was full\n";
+						write(notice);
+						buffer.reported_drops = dropped;
+					}
+					if (drained > 0)
+						m_drained.emplace_back(handle, drained);
+					written += drained;
+					if (closed)
+						m_closed.push_back(handle);
+				}
+				m_draining.clear();
+				if (!m_closed.empty())
+				{
+					std::scoped_lock lock{m_buffers_mutex};
+					for (const auto& buffer : m_closed)
+					{
+						m_retired_drops += buffer->dropped.load(std::memory_order_relaxed);
+						m_buffers.erase(std::find(m_buffers.begin(), m_buffers.end(), buffer));
+					}
+					m_closed.clear();
+				}
+				if (written > 0)
+				{
+					for (auto* output : get_global_config().get_log_outputs())
+						output->flush();
+				}
+				// only now are the records visible to flush(), which promises they have reached the outputs
+				for (auto& [buffer, count] : m_drained)
+					buffer->drained.store(buffer->drained.load(std::memory_order_relaxed) + count, std::memory_order_release);
+				m_drained.clear();
+				return written;
+			}
+
+			void run()
+			{
+				std::vector<std::string> batch(DRAIN_BATCH_SIZE);
+				while (true)
+				{
+					const auto written = drain(batch);
+					{
+						std::scoped_lock lock{m_wait_mutex};
+						if (m_flush_waiters > 0)
+							m_flushed_cv.notify_all();
+					}
+					if (written > 0)
+						continue;
+
+					std::unique_lock lock{m_wait_mutex};
+					if (m_stopping)
+						break;
+					m_sleeping.store(true, std::memory_order_seq_cst);
+					lock.unlock();
+					// producers check m_sleeping after pushing, so anything pushed before this point is seen here
+					const auto pending = has_pending();
+					lock.lock();
+					if (!pending && !m_stopping && m_flush_waiters == 0)
+						m_wait_cv.wait_for(lock, IDLE_WAIT);
+					m_sleeping.store(false, std::memory_order_relaxed);
+				}
+
+				// exit flush, bounded so a thread which keeps logging (or a blocked producer) cannot stall shutdown forever
+				const auto deadline = std::chrono::steady_clock::now() + get_global_config().get_flush_timeout();
+				while (std::chrono::steady_clock::now() < deadline && drain(batch) > 0)
+				{}
+			}
+
+			std::mutex m_buffers_mutex;
+			std::vector<std::shared_ptr<thread_buffer_t>> m_buffers;
+			u64 m_retired_drops = 0;
+			// owned by the background thread
+			std::vector<std::pair<std::shared_ptr<thread_buffer_t>, size_t>> m_drained;
+			std::vector<std::shared_ptr<thread_buffer_t>> m_draining;
+			std::vector<std::shared_ptr<thread_buffer_t>> m_closed;
+
+			std::mutex m_wait_mutex;
+			std::condition_variable m_wait_cv;
+			std::condition_variable m_flushed_cv;
+			size_t m_flush_waiters = 0;
+			std::atomic_bool m_stopping = false;
+			std::atomic_bool m_sleeping = false;
+
+			std::thread m_thread;
+		};
+
+		async_logger_t& get_async_logger()
+		{
+			static async_logger_t logger;
+			return logger;
+		}
+	}
+
+	void detail::submit_async(std::string str)
+	{
+		get_async_logger().submit(std::move(str));
+	}
+
+	bool flush()
+	{
+		if (!get_global_config().is_async())
+		{
+			for (auto* output : get_global_config().get_log_outputs())
+				output->flush();
+			return true;
+		}
+		return get_async_logger().flush();
+	}
+
+	u64 get_dropped_records()
+	{
+		if (!get_global_config().is_async())
+			return 0;
+		return get_async_logger().dropped();
+	}
+}
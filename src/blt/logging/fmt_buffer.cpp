@@ -0,0 +1,332 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <streambuf>
+#include <blt/logging/fmt_buffer.h>
+
+namespace blt::logging
+{
+	namespace
+	{
+		constexpr size_t INITIAL_CAPACITY = 256;
+		// used when the spec does not give a precision, matches what the stream based formatter always did
+		constexpr int DEFAULT_PRECISION = 16;
+
+		class fmt_buffer_streambuf_t final : public std::streambuf
+		{
+		public:
+			explicit fmt_buffer_streambuf_t(fmt_buffer_t& buffer): m_buffer(buffer)
+			{}
+
+		protected:
+			int_type overflow(const int_type ch) override
+			{
+				if (!traits_type::eq_int_type(ch, traits_type::eof()))
+					m_buffer.append(traits_type::to_char_type(ch));
+				return traits_type::not_eof(ch);
+			}
+
+			std::streamsize xsputn(const char* str, const std::streamsize count) override
+			{
+				m_buffer.append(std::string_view{str, static_cast<size_t>(count)});
+				return count;
+			}
+
+		private:
+			fmt_buffer_t& m_buffer;
+		};
+
+		/**
+		 * Pads everything written since start out to the spec's width. Writing first and moving afterward means no formatter has to know its
+		 * length ahead of time.
+		 */
+		void pad_field(fmt_buffer_t& out, const fmt_spec_t& spec, const size_t start)
+		{
+			const auto length = out.size() - start;
+			if (spec.width <= 0 || static_cast<size_t>(spec.width) <= length)
+				return;
+			const auto padding = static_cast<size_t>(spec.width) - length;
+			const auto fill = spec.prefix_char.value_or(' ');
+			size_t before = 0;
+			switch (spec.alignment)
+			{
+				case fmt_align_t::LEFT:
+					break;
+				case fmt_align_t::CENTER:
+					before = padding / 2;
+					break;
+				case fmt_align_t::RIGHT:
+					before = padding;
+					break;
+			}
+			auto* end = out.extend(padding);
+			auto* field = end - length;
+			if (before > 0)
+			{
+				std::memmove(field + before, field, length);
+				std::fill_n(field, before, fill);
+			}
+			std::fill_n(field + before + length, padding - before, fill);
+		}
+
+		void to_upper(fmt_buffer_t& out, const size_t start)
+		{
+			auto* begin = out.data() + start;
+			std::transform(begin, out.data() + out.size(), begin, [](const char c) {
+				return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+			});
+		}
+
+		/**
+		 * Runs a std::to_chars call directly into the buffer, growing the guess until the output fits
+		 */
+		template <typename Func>
+		void append_chars(fmt_buffer_t& out, Func&& func)
+		{
+			size_t guess = 64;
+			while (true)
+			{
+				auto* begin = out.extend(guess);
+				const auto [ptr, ec] = func(begin, begin + guess);
+				if (ec == std::errc{})
+				{
+					out.shrink(guess - static_cast<size_t>(ptr - begin));
+					return;
+				}
+				out.shrink(guess);
+				guess *= 4;
+			}
+		}
+
+		template <typename T>
+		void write_floating(fmt_buffer_t& out, const fmt_spec_t& spec, const T value)
+		{
+			const auto start = out.size();
+			if (!std::signbit(value))
+			{
+				if (spec.sign == fmt_sign_t::PLUS)
+					out.append('+');
+				else if (spec.sign == fmt_sign_t::SPACE)
+					out.append(' ');
+			}
+			const auto number_start = out.size();
+			const int precision = spec.precision > 0 ? static_cast<int>(spec.precision) : DEFAULT_PRECISION;
+			switch (spec.type)
+			{
+				case fmt_type_t::FIXED_POINT:
+					append_chars(out, [&](char* begin, char* end) {
+						return std::to_chars(begin, end, value, std::chars_format::fixed, precision);
+					});
+					break;
+				case fmt_type_t::EXPONENT:
+					append_chars(out, [&](char* begin, char* end) {
+						return std::to_chars(begin, end, value, std::chars_format::scientific, precision);
+					});
+					break;
+				case fmt_type_t::HEX_FLOAT:
+					append_chars(out, [&](char* begin, char* end) {
+						return std::to_chars(begin, end, value, std::chars_format::hex);
+					});
+					if (std::isfinite(value))
+					{
+						// to_chars leaves out the 0x printf and iostreams put in front
+						const auto prefix_pos = number_start + (std::signbit(value) ? 1 : 0);
+						out.extend(2);
+						auto* data = out.data();
+						std::memmove(data + prefix_pos + 2, data + prefix_pos, out.size() - prefix_pos - 2);
+						data[prefix_pos] = '0';
+						data[prefix_pos + 1] = 'x';
+					}
+					break;
+				default:
+					append_chars(out, [&](char* begin, char* end) {
+						return std::to_chars(begin, end, value, std::chars_format::general, precision);
+					});
+					break;
+			}
+			if (spec.uppercase)
+				to_upper(out, number_start);
+			pad_field(out, spec, start);
+		}
+	}
+
+	class fmt_buffer_stream_t final : public std::ostream
+	{
+	public:
+		explicit fmt_buffer_stream_t(fmt_buffer_t& buffer): std::ostream(nullptr), m_buf(buffer)
+		{
+			rdbuf(&m_buf);
+		}
+
+	private:
+		fmt_buffer_streambuf_t m_buf;
+	};
+
+	fmt_buffer_t::fmt_buffer_t() = default;
+
+	fmt_buffer_t::~fmt_buffer_t() = default;
+
+	void fmt_buffer_t::append(const std::string_view str)
+	{
+		if (str.empty())
+			return;
+		std::memcpy(extend(str.size()), str.data(), str.size());
+	}
+
+	void fmt_buffer_t::append(const size_t count, const char c)
+	{
+		std::fill_n(extend(count), count, c);
+	}
+
+	std::ostream& fmt_buffer_t::stream()
+	{
+		if (!m_stream)
+			m_stream = std::make_unique<fmt_buffer_stream_t>(*this);
+		return *m_stream;
+	}
+
+	void fmt_buffer_t::grow(const size_t min_capacity)
+	{
+		const auto capacity = std::max(std::max(INITIAL_CAPACITY, m_capacity * 2), min_capacity);
+		// not make_unique, which would zero the new storage
+		std::unique_ptr<char[]> data{new char[capacity]};
+		if (m_size > 0)
+			std::memcpy(data.get(), m_data.get(), m_size);
+		m_data = std::move(data);
+		m_capacity = capacity;
+	}
+
+	void write_string(fmt_buffer_t& out, const fmt_spec_t& spec, const std::string_view str)
+	{
+		const auto start = out.size();
+		out.append(str);
+		pad_field(out, spec, start);
+	}
+
+	void write_integer(fmt_buffer_t& out, const fmt_spec_t& spec, const u64 magnitude, const bool negative)
+	{
+		int base = 10;
+		if (spec.type == fmt_type_t::HEX)
+			base = 16;
+		else if (spec.type == fmt_type_t::OCTAL)
+			base = 8;
+
+		const auto start = out.size();
+		if (negative)
+			out.append('-');
+		else if (spec.sign == fmt_sign_t::SPACE)
+			out.append(' ');
+		else if (spec.sign == fmt_sign_t::PLUS && base == 10)
+			out.append('+');
+		if (spec.alternate_form && magnitude != 0)
+		{
+			if (base == 16)
+				out.append(spec.uppercase ? "0X" : "0x");
+			else if (base == 8)
+				out.append('0');
+		}
+		const auto digits_start = out.size();
+		append_chars(out, [&](char* begin, char* end) {
+			return std::to_chars(begin, end, magnitude, base);
+		});
+		if (spec.uppercase && base == 16)
+			to_upper(out, digits_start);
+		pad_field(out, spec, start);
+	}
+
+	void write_float(fmt_buffer_t& out, const fmt_spec_t& spec, const double value)
+	{
+		write_floating(out, spec, value);
+	}
+
+	void write_float(fmt_buffer_t& out, const fmt_spec_t& spec, const long double value)
+	{
+		write_floating(out, spec, value);
+	}
+
+	void write_binary(fmt_buffer_t& out, const fmt_spec_t& spec, const void* data, const size_t bytes)
+	{
+		const auto start = out.size();
+		if (spec.alternate_form)
+		{
+			out.append('0');
+			out.append(spec.uppercase ? 'B' : 'b');
+		}
+		const auto* buffer = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < bytes; ++i)
+		{
+			auto* bits = out.extend(8);
+			for (size_t j = 0; j < 8; ++j)
+				bits[j] = (buffer[i] & (1 << j)) ? '1' : '0';
+			// special seperator defined via sign (weird hack, change?)
+			if (spec.sign == fmt_sign_t::SPACE && i != bytes - 1)
+				out.append(' ');
+		}
+		pad_field(out, spec, start);
+	}
+
+	std::ostream& setup_stream(fmt_buffer_t& out, const fmt_spec_t& spec)
+	{
+		auto& stream = out.stream();
+		stream.clear();
+		// flags are reset every time so nothing set by one argument leaks into the next
+		stream.flags(std::ios_base::dec);
+		stream << std::setfill(spec.prefix_char.value_or(' '));
+		if (spec.alignment == fmt_align_t::LEFT)
+			stream << std::left;
+		else
+			stream << std::right;
+		stream << std::setw(spec.width > 0 ? static_cast<i32>(spec.width) : 0);
+		stream << std::setprecision(spec.precision > 0 ? static_cast<i32>(spec.precision) : DEFAULT_PRECISION);
+		if (spec.alternate_form)
+			stream << std::showbase;
+		if (spec.uppercase)
+			stream << std::uppercase;
+		if (spec.sign == fmt_sign_t::PLUS)
+			stream << std::showpos;
+		switch (spec.type)
+		{
+			case fmt_type_t::OCTAL:
+				stream << std::oct;
+				break;
+			case fmt_type_t::HEX:
+				stream << std::hex;
+				break;
+			case fmt_type_t::HEX_FLOAT:
+				stream << std::hexfloat;
+				break;
+			case fmt_type_t::EXPONENT:
+				stream << std::scientific;
+				break;
+			case fmt_type_t::FIXED_POINT:
+				stream << std::fixed;
+				break;
+			case fmt_type_t::UNSPECIFIED:
+				stream << std::boolalpha;
+				break;
+			default:
+				break;
+		}
+		return stream;
+	}
+}
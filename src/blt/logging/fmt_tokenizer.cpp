@@ -18,6 +18,7 @@
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <blt/logging/fmt_buffer.h>
 #include <blt/logging/fmt_tokenizer.h>
 
 namespace blt::logging
@@ -194,9 +195,9 @@ namespace blt::logging
             const auto arg_id = std::stoul(std::string(next_value));
             if (arg_id >= m_handlers.size())
                 throw std::runtime_error("Invalid arg id " + std::to_string(arg_id) + ", max arg supported: " + std::to_string(m_handlers.size()));
-            std::stringstream ss;
-            m_handlers[arg_id](ss, fmt_spec_t{});
-            return ss.str();
+            fmt_buffer_t buffer;
+            m_handlers[arg_id](buffer, fmt_spec_t{});
+            return std::string(buffer.view());
         }
         throw std::runtime_error("Expected number when parsing arg or number, unexpected value '" + std::string(value) + '\'');
     }
@@ -39,10 +39,11 @@ namespace blt::logging
 
 	struct logging_thread_context_t
 	{
-		std::stringstream stream;
 		std::stringstream logging_stream;
 		std::string thread_name;
-		logger_t logger{stream};
+		logger_t logger;
+		// the finished log line, kept separate from the logger's buffer which holds the user string while the line is generated
+		fmt_buffer_t line_buffer;
 	};
 
 	logging_thread_context_t& get_thread_context()
@@ -51,81 +52,99 @@ namespace blt::logging
 		return context;
 	}
 
-	std::string logger_t::to_string() const
+	namespace
 	{
-		return dynamic_cast<std::stringstream&>(m_stream).str();
-	}
+		size_t find_ending_brace(const std::string_view fmt, size_t begin)
+		{
+			size_t braces = 0;
+			for (; begin < fmt.size(); ++begin)
+			{
+				if (fmt[begin] == '{')
+					++braces;
+				else if (fmt[begin] == '}')
+					--braces;
+				if (braces == 0)
+					return begin;
+			}
+			return std::string::npos;
+		}
 
-	size_t logger_t::find_ending_brace(size_t begin) const
-	{
-		size_t braces = 0;
-		for (; begin < m_fmt.size(); ++begin)
+		// copies str, dropping the backslash of every escaped '{'
+		template <typename Out>
+		void append_unescaped(Out& out, const std::string_view str)
 		{
-			if (m_fmt[begin] == '{')
-				++braces;
-			else if (m_fmt[begin] == '}')
-				--braces;
-			if (braces == 0)
-				return begin;
+			size_t last = 0;
+			size_t pos = 0;
+			while (pos = str.find('{', pos), pos != std::string_view::npos)
+			{
+				if (pos > 0 && str[pos - 1] == '\\')
+				{
+					out.append(str.substr(last, pos - 1 - last));
+					last = pos;
+				}
+				++pos;
+			}
+			out.append(str.substr(last));
 		}
-		return std::string::npos;
-	}
 
-	void logger_t::setup_stream(const fmt_spec_t& spec) const
-	{
-		if (spec.prefix_char)
-			m_stream << std::setfill(*spec.prefix_char);
-		else
-			m_stream << std::setfill(' ');
-		switch (spec.alignment)
+		std::string process_escapes(const std::string_view str)
 		{
-			case fmt_align_t::LEFT:
-				m_stream << std::left;
-				break;
-			case fmt_align_t::CENTER:
-				// TODO?
-				break;
-			case fmt_align_t::RIGHT:
-				m_stream << std::right;
-				break;
+			std::string result;
+			append_unescaped(result, str);
+			return result;
+		}
+
+		std::optional<std::pair<size_t, size_t>> find_next_fmt(const std::string_view fmt, const size_t last_pos)
+		{
+			auto begin = fmt.find('{', last_pos);
+			while (begin != std::string::npos && begin > 0 && fmt[begin - 1] == '\\')
+				begin = fmt.find('{', begin + 1);
+			if (begin == std::string::npos)
+				return {};
+			const auto end = find_ending_brace(fmt, begin);
+			if (end == std::string::npos)
+			{
+				std::stringstream ss;
+				ss << "Invalid format string, missing closing '}' near " << fmt.substr(std::min(static_cast<i64>(begin) - 5, static_cast<i64>(0)));
+				throw std::runtime_error(ss.str());
+			}
+			return std::pair{begin, end};
 		}
-		if (spec.width > 0)
-			m_stream << std::setw(static_cast<i32>(spec.width));
-		else
-			m_stream << std::setw(0);
-		if (spec.precision > 0)
-			m_stream << std::setprecision(static_cast<i32>(spec.precision));
-		else
-			m_stream << std::setprecision(16);
-		if (spec.alternate_form)
-			m_stream << std::showbase;
-		else
-			m_stream << std::noshowbase;
-		if (spec.uppercase)
-			m_stream << std::uppercase;
-		else
-			m_stream << std::nouppercase;
-		if (spec.sign == fmt_sign_t::PLUS)
-			m_stream << std::showpos;
-		else
-			m_stream << std::noshowpos;
 	}
 
-	std::string logger_t::process_string(const std::string_view str)
+	std::optional<detail::compiled_fmt_t> detail::compile_fmt(const std::string_view fmt)
 	{
-		auto result = std::string(str);
-		size_t pos = 0;
-		while (pos = result.find('{', pos), pos != std::string::npos)
+		// nested references are resolved against the argument values, so this parser must never see one
+		std::vector<fmt_arg_t> no_args;
+		fmt_parser_t parser{no_args};
+		compiled_fmt_t compiled;
+		size_t last_pos = 0;
+		i64 next_arg = 0;
+		while (const auto pair = find_next_fmt(fmt, last_pos))
 		{
-			if (pos > 0 && result[pos - 1] == '\\')
-			{
-				auto before = result.substr(0, pos - 1);
-				auto after = result.substr(pos);
-				result = before + after;
-			} else
-				++pos;
+			const auto [begin, end] = *pair;
+			const auto body = fmt.substr(begin + 1, end - begin - 1);
+			if (body.find('{') != std::string_view::npos)
+				return {};
+			compiled.sections.push_back(process_escapes(fmt.substr(last_pos, begin - last_pos)));
+			auto spec = body.empty() ? fmt_spec_t{} : parser.parse(body);
+			if (spec.arg_id == -1)
+				spec.arg_id = next_arg++;
+			compiled.specs.push_back(spec);
+			last_pos = end + 1;
 		}
-		return result;
+		compiled.sections.push_back(process_escapes(fmt.substr(last_pos)));
+		return compiled;
+	}
+
+	std::string logger_t::to_string() const
+	{
+		return std::string(m_buffer.view());
+	}
+
+	size_t logger_t::find_ending_brace(const size_t begin) const
+	{
+		return blt::logging::find_ending_brace(m_fmt, begin);
 	}
 
 	void logger_t::process_strings()
@@ -134,60 +153,36 @@ namespace blt::logging
 		auto str_it = m_string_sections.begin();
 		for (; spec_it != m_fmt_specs.end(); ++spec_it, ++str_it)
 		{
-			m_stream << process_string(*str_it);
+			append_unescaped(m_buffer, *str_it);
 			auto arg_pos = spec_it->arg_id;
 			if (arg_pos == -1)
 				arg_pos = static_cast<i64>(m_arg_pos++);
 
-			setup_stream(*spec_it);
-			m_arg_print_funcs[arg_pos](m_stream, *spec_it);
+			if (static_cast<size_t>(arg_pos) >= m_arg_print_funcs.size())
+			{
+				m_buffer.append("{MISSING ARG}");
+				continue;
+			}
+			m_arg_print_funcs[arg_pos](m_buffer, *spec_it);
 		}
-		m_stream << process_string(*str_it);
+		append_unescaped(m_buffer, *str_it);
 	}
 
-	void logger_t::handle_type(std::ostream& stream, const fmt_spec_t& spec)
+	void logger_t::process_compiled(const detail::compiled_fmt_t& fmt, const fmt_arg_t* args, const size_t arg_count)
 	{
-		switch (spec.type)
+		m_buffer.clear();
+		for (size_t i = 0; i < fmt.specs.size(); ++i)
 		{
-			case fmt_type_t::DECIMAL:
-				stream << std::noboolalpha;
-				stream << std::dec;
-				break;
-			case fmt_type_t::OCTAL:
-				stream << std::oct;
-				break;
-			case fmt_type_t::HEX:
-				stream << std::hex;
-				break;
-			case fmt_type_t::HEX_FLOAT:
-				stream << std::hexfloat;
-				break;
-			case fmt_type_t::EXPONENT:
-				stream << std::scientific;
-				break;
-			case fmt_type_t::FIXED_POINT:
-				stream << std::fixed;
-				break;
-			case fmt_type_t::GENERAL:
-				stream << std::defaultfloat;
-				break;
-			case fmt_type_t::UNSPECIFIED:
-				stream << std::boolalpha;
-				stream << std::dec;
-				break;
-			default:
-				break;
+			const auto& spec = fmt.specs[i];
+			m_buffer.append(fmt.sections[i]);
+			if (static_cast<size_t>(spec.arg_id) >= arg_count)
+			{
+				m_buffer.append("{MISSING ARG}");
+				continue;
+			}
+			args[spec.arg_id](m_buffer, spec);
 		}
-	}
-
-	void logger_t::exponential(std::ostream& stream)
-	{
-		stream << std::scientific;
-	}
-
-	void logger_t::fixed(std::ostream& stream)
-	{
-		stream << std::fixed;
+		m_buffer.append(fmt.sections.back());
 	}
 
 	void logger_t::compile(std::string fmt)
@@ -195,9 +190,6 @@ namespace blt::logging
 		m_fmt = std::move(fmt);
 		m_last_fmt_pos = 0;
 		m_arg_pos = 0;
-		auto& ss = dynamic_cast<std::stringstream&>(m_stream);
-		ss.str("");
-		m_stream.clear();
 		m_string_sections.clear();
 		m_fmt_specs.clear();
 		ptrdiff_t last_pos = 0;
@@ -217,20 +209,10 @@ namespace blt::logging
 
 	std::optional<std::pair<size_t, size_t>> logger_t::consume_to_next_fmt()
 	{
-		auto begin = m_fmt.find('{', m_last_fmt_pos);
-		while (begin != std::string::npos && begin > 0 && m_fmt[begin - 1] == '\\')
-			begin = m_fmt.find('{', begin + 1);;
-		if (begin == std::string::npos)
-			return {};
-		const auto end = find_ending_brace(begin);
-		if (end == std::string::npos)
-		{
-			std::stringstream ss;
-			ss << "Invalid format string, missing closing '}' near " << m_fmt.substr(std::min(static_cast<i64>(begin) - 5, static_cast<i64>(0)));
-			throw std::runtime_error(ss.str());
-		}
-		m_last_fmt_pos = end + 1;
-		return std::pair{begin, end};
+		auto pair = find_next_fmt(m_fmt, m_last_fmt_pos);
+		if (pair)
+			m_last_fmt_pos = pair->second + 1;
+		return pair;
 	}
 
 	logger_t& get_global_logger()
@@ -238,35 +220,89 @@ namespace blt::logging
 		return get_thread_context().logger;
 	}
 
-	void print(std::string str)
+	bool detail::apply_injectors(std::string& str)
 	{
-#ifdef BLT_LOGGING_THREAD_SAFE
-		std::scoped_lock lock{global_logging_mutex};
-#endif
 		const auto& config = get_global_config();
 		bool should_print = true;
-		if (!config.get_injectors().empty())
+		for (const auto& injector : config.get_injectors())
+		{
+			auto [new_logging_output, should_continue, should_log] = injector->inject(str);
+			if (!should_log)
+				should_print = false;
+			str = std::move(new_logging_output);
+			if (!should_continue)
+				break;
+		}
+		return should_print;
+	}
+
+	namespace
+	{
+		void write_outputs(const std::string_view str)
 		{
-			for (const auto& injector : config.get_injectors())
+			for (auto* output : get_global_config().get_log_outputs())
+				output->write(str.data(), str.size());
+		}
+
+		void write_line(const std::string_view str)
+		{
+			const auto& config = get_global_config();
+			// injectors work on strings, and async records outlive the thread's buffers, so only the plain sync path stays a view
+			if (config.is_async() || !config.get_injectors().empty())
 			{
-				auto [new_logging_output, should_continue, should_log] = injector->inject(str);
-				if (!should_log)
-					should_print = false;
-				str = std::move(new_logging_output);
-				if (!should_continue)
-					break;
+				print(std::string(str));
+				return;
 			}
+#ifdef BLT_LOGGING_THREAD_SAFE
+			std::scoped_lock lock{global_logging_mutex};
+#endif
+			write_outputs(str);
+		}
+	}
+
+	void print(std::string str)
+	{
+		if (get_global_config().is_async())
+		{
+			detail::submit_async(std::move(str));
+			return;
 		}
-		if (should_print)
-			std::cout << str;
+#ifdef BLT_LOGGING_THREAD_SAFE
+		std::scoped_lock lock{global_logging_mutex};
+#endif
+		if (detail::apply_injectors(str))
+			write_outputs(str);
 	}
 
 	void newline()
 	{
+		if (get_global_config().is_async())
+		{
+			detail::submit_async("\n");
+			return;
+		}
 #ifdef BLT_LOGGING_THREAD_SAFE
 		std::scoped_lock lock{global_logging_mutex};
 #endif
-		std::cout << std::endl;
+		write_outputs("\n");
+		for (auto* output : get_global_config().get_log_outputs())
+			output->flush();
+	}
+
+	void detail::log_formatted(const log_level_t level, const char* file, const i32 line, std::string_view user_str)
+	{
+		if (!user_str.empty() && user_str.back() == '\n')
+			user_str.remove_suffix(1);
+		if (level == log_level_t::NONE)
+		{
+			write_line(user_str);
+			newline();
+			return;
+		}
+		auto& context = get_thread_context();
+		context.line_buffer.clear();
+		if (get_global_config().generate(context.line_buffer, user_str, context.thread_name, level, file, line))
+			write_line(context.line_buffer.view());
 	}
 
 	logging_config_t& get_global_config()
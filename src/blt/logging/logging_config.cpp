@@ -15,16 +15,20 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <atomic>
+#include <charconv>
+#include <cstring>
 #include <ctime>
 #include <iostream>
+#include <limits>
 #include <blt/config.h>
 #include <blt/fs/path_helper.h>
 #include <blt/fs/stream_wrappers.h>
 #include <blt/logging/ansi.h>
+#include <blt/logging/fmt_buffer.h>
 #include <blt/logging/logging_config.h>
 #include <blt/std/hashmap.h>
-#include <blt/std/system.h>
-#include <blt/std/time.h>
+#include <blt/std/tsc.h>
 
 namespace blt::logging
 {
@@ -97,203 +101,472 @@ namespace blt::logging
 		m_longest_name_length = 0;
 		for (const auto& name : m_log_level_names)
 			m_longest_name_length = std::max(m_longest_name_length, name.size());
-	}
 
-	std::string add_year(const tm* current_time)
-	{
-		return std::to_string(current_time->tm_year + 1900);
+		compile_render_plan();
 	}
 
-	std::string add_month(const tm* current_time, const bool ensure_alignment)
+	void logging_config_t::compile_render_plan()
 	{
-		auto str = std::to_string(current_time->tm_mon + 1);
-		if (ensure_alignment && str.size() < 2)
-			str.insert(str.begin(), '0');
-		return str;
-	}
+		using tags::detail::log_tag_token_t;
+		using tags::detail::render_op_t;
+		static std::atomic<u64> generation_counter = 0;
+		m_generation = ++generation_counter;
+		m_render_text.clear();
+		m_render_plan.clear();
+		m_cached_steps.clear();
+		m_cached_segments.clear();
 
-	std::string add_day(const tm* current_time, const bool ensure_alignment)
-	{
-		auto str = std::to_string(current_time->tm_mday);
-		if (ensure_alignment && str.size() < 2)
-			str.insert(str.begin(), '0');
-		return str;
+		// a run of steps which only change once a second, flushed whenever a step which changes every line is reached
+		std::vector<std::string> run_text;
+		std::vector<tags::detail::render_step_t> run_steps;
+		bool run_has_time = false;
+		const auto add_text = [&](std::string text) {
+			if (text.empty())
+				return;
+			run_steps.push_back({render_op_t::TEXT, static_cast<u32>(run_text.size())});
+			run_text.push_back(std::move(text));
+		};
+		const auto add_time = [&](const render_op_t op) {
+			run_steps.push_back({op});
+			run_has_time = true;
+		};
+		const auto flush_run = [&]() {
+			if (run_has_time)
+			{
+				const auto begin = static_cast<u32>(m_cached_steps.size());
+				for (auto step : run_steps)
+				{
+					if (step.op == render_op_t::TEXT)
+					{
+						step.index = static_cast<u32>(m_render_text.size());
+						m_render_text.push_back(std::move(run_text[step.index]));
+					}
+					m_cached_steps.push_back(step);
+				}
+				m_render_plan.push_back({render_op_t::CACHED, static_cast<u32>(m_cached_segments.size())});
+				m_cached_segments.emplace_back(begin, static_cast<u32>(m_cached_steps.size()));
+			} else if (!run_steps.empty())
+			{
+				std::string merged;
+				for (const auto& text : run_text)
+					merged += text;
+				m_render_plan.push_back({render_op_t::TEXT, static_cast<u32>(m_render_text.size())});
+				m_render_text.push_back(std::move(merged));
+			}
+			run_text.clear();
+			run_steps.clear();
+			run_has_time = false;
+		};
+		const auto add_step = [&](const render_op_t op) {
+			flush_run();
+			m_render_plan.push_back({op});
+		};
+
+		size_t content = 0;
+		for (const auto token : m_log_tag_tokens)
+		{
+			switch (token)
+			{
+				case log_tag_token_t::YEAR:
+					add_time(render_op_t::YEAR);
+					break;
+				case log_tag_token_t::MONTH:
+					add_time(render_op_t::MONTH);
+					break;
+				case log_tag_token_t::DAY:
+					add_time(render_op_t::DAY);
+					break;
+				case log_tag_token_t::HOUR:
+					add_time(render_op_t::HOUR);
+					break;
+				case log_tag_token_t::MINUTE:
+					add_time(render_op_t::MINUTE);
+					break;
+				case log_tag_token_t::SECOND:
+					add_time(render_op_t::SECOND);
+					break;
+				case log_tag_token_t::ISO_YEAR:
+					add_time(render_op_t::YEAR);
+					add_text("-");
+					add_time(render_op_t::MONTH);
+					add_text("-");
+					add_time(render_op_t::DAY);
+					break;
+				case log_tag_token_t::TIME:
+					add_time(render_op_t::HOUR);
+					add_text(":");
+					add_time(render_op_t::MINUTE);
+					add_text(":");
+					add_time(render_op_t::SECOND);
+					break;
+				case log_tag_token_t::FULL_TIME:
+					add_time(render_op_t::YEAR);
+					add_text("-");
+					add_time(render_op_t::MONTH);
+					add_text("-");
+					add_time(render_op_t::DAY);
+					add_text(" ");
+					add_time(render_op_t::HOUR);
+					add_text(":");
+					add_time(render_op_t::MINUTE);
+					add_text(":");
+					add_time(render_op_t::SECOND);
+					break;
+				// fixed width sub second fields are patched into the cached segment on every line
+				case log_tag_token_t::MS:
+					if (m_ensure_alignment)
+						add_time(render_op_t::MS);
+					else
+						add_step(render_op_t::MS);
+					break;
+				case log_tag_token_t::NS:
+					if (m_ensure_alignment)
+						add_time(render_op_t::NS);
+					else
+						add_step(render_op_t::NS);
+					break;
+				case log_tag_token_t::UNIX:
+					add_step(render_op_t::UNIX);
+					break;
+				case log_tag_token_t::UNIX_NANO:
+					add_step(render_op_t::UNIX_NANO);
+					break;
+				case log_tag_token_t::LC:
+					if (m_use_color)
+						add_step(render_op_t::LEVEL_COLOR);
+					break;
+				case log_tag_token_t::EC:
+					if (m_use_color)
+						add_text(m_error_color);
+					break;
+				case log_tag_token_t::CEC:
+					if (m_use_color)
+						add_step(render_op_t::CONDITIONAL_ERROR_COLOR);
+					break;
+				case log_tag_token_t::RESET:
+					if (m_use_color)
+						add_text(build(ansi::color::color_mode::RESET_ALL));
+					break;
+				case log_tag_token_t::LL:
+					add_step(render_op_t::LEVEL_NAME);
+					break;
+				case log_tag_token_t::TN:
+					add_step(render_op_t::THREAD_NAME);
+					break;
+				case log_tag_token_t::FILE:
+					add_step(render_op_t::FILE);
+					break;
+				case log_tag_token_t::LINE:
+					add_step(render_op_t::LINE);
+					break;
+				case log_tag_token_t::STR:
+					add_step(render_op_t::STR);
+					break;
+				case log_tag_token_t::CONTENT:
+					add_text(m_log_tag_content[content++]);
+					break;
+			}
+		}
+		flush_run();
 	}
 
-	std::string add_hour(const tm* current_time, const bool ensure_alignment)
+	namespace tags::detail
 	{
-		auto str = std::to_string(current_time->tm_hour);
-		if (ensure_alignment && str.size() < 2)
-			str.insert(str.begin(), '0');
-		return str;
+		struct segment_patch_t
+		{
+			u32 offset;
+			render_op_t op;
+		};
+
+		struct cached_segment_t
+		{
+			u32 offset;
+			u32 length;
+			u32 patches_begin;
+			u32 patches_end;
+		};
+
+		/**
+		 * Per thread copy of the cached segments for the current second, with the offsets at which the ms/ns digits go
+		 */
+		struct prefix_cache_t
+		{
+			const logging_config_t* config = nullptr;
+			u64 generation = 0;
+			i64 second = 0;
+			fmt_buffer_t text;
+			std::vector<cached_segment_t> segments;
+			std::vector<segment_patch_t> patches;
+		};
 	}
 
-	std::string add_minute(const tm* current_time, const bool ensure_alignment)
+	namespace
 	{
-		auto str = std::to_string(current_time->tm_min);
-		if (ensure_alignment && str.size() < 2)
-			str.insert(str.begin(), '0');
-		return str;
+		constexpr i64 SECONDS_PER_DAY = 86400;
+		// every time zone offset (and so every DST transition) is a multiple of 15 minutes
+		constexpr i64 OFFSET_PERIOD = 15 * 60;
+
+		struct civil_time_t
+		{
+			i64 year;
+			u32 month;
+			u32 day;
+			u32 hour;
+			u32 minute;
+			u32 second;
+		};
+
+		i64 floor_div(const i64 value, const i64 divisor)
+		{
+			return value / divisor - ((value % divisor) < 0 ? 1 : 0);
+		}
+
+		// days since 1970-01-01 to year/month/day, Howard Hinnant's civil_from_days
+		void civil_from_days(i64 days, civil_time_t& out)
+		{
+			days += 719468;
+			const i64 era = floor_div(days, 146097);
+			const auto doe = static_cast<u32>(days - era * 146097);
+			const u32 yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+			const u32 doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+			const u32 mp = (5 * doy + 2) / 153;
+			out.day = doy - (153 * mp + 2) / 5 + 1;
+			out.month = mp < 10 ? mp + 3 : mp - 9;
+			out.year = static_cast<i64>(yoe) + era * 400 + (out.month <= 2 ? 1 : 0);
+		}
+
+		i64 days_from_civil(i64 year, const u32 month, const u32 day)
+		{
+			year -= month <= 2 ? 1 : 0;
+			const i64 era = floor_div(year, 400);
+			const auto yoe = static_cast<u32>(year - era * 400);
+			const u32 doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+			const u32 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+			return era * 146097 + static_cast<i64>(doe) - 719468;
+		}
+
+		/**
+		 * Local time from unix seconds. The UTC offset only changes on 15 minute boundaries so localtime_r is called at most once per
+		 * boundary per thread, everything else is arithmetic.
+		 */
+		civil_time_t local_time(const i64 unix_seconds)
+		{
+			thread_local i64 offset_period = std::numeric_limits<i64>::min();
+			thread_local i64 utc_offset = 0;
+			const auto period = floor_div(unix_seconds, OFFSET_PERIOD);
+			if (period != offset_period)
+			{
+				const auto time = static_cast<std::time_t>(unix_seconds);
+				std::tm tm{};
+#ifdef _WIN32
+				localtime_s(&tm, &time);
+#else
+				localtime_r(&time, &tm);
+#endif
+				const auto local_seconds = days_from_civil(tm.tm_year + 1900, static_cast<u32>(tm.tm_mon + 1), static_cast<u32>(tm.tm_mday)) *
+					SECONDS_PER_DAY + tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+				utc_offset = local_seconds - unix_seconds;
+				offset_period = period;
+			}
+			const auto local_seconds = unix_seconds + utc_offset;
+			const auto days = floor_div(local_seconds, SECONDS_PER_DAY);
+			const auto seconds_of_day = static_cast<u32>(local_seconds - days * SECONDS_PER_DAY);
+			civil_time_t civil{};
+			civil_from_days(days, civil);
+			civil.hour = seconds_of_day / 3600;
+			civil.minute = seconds_of_day / 60 % 60;
+			civil.second = seconds_of_day % 60;
+			return civil;
+		}
+
+		void append_number(fmt_buffer_t& out, const u64 value, const size_t min_digits)
+		{
+			char digits[20];
+			const auto [ptr, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+			const auto length = static_cast<size_t>(ptr - digits);
+			if (length < min_digits)
+				out.append(min_digits - length, '0');
+			out.append(std::string_view{digits, length});
+		}
+
+		void write_fixed_digits(char* dest, u64 value, const size_t digits)
+		{
+			for (size_t i = digits; i > 0; --i)
+			{
+				dest[i - 1] = static_cast<char>('0' + value % 10);
+				value /= 10;
+			}
+		}
+
+		tags::detail::prefix_cache_t& get_prefix_cache()
+		{
+			thread_local tags::detail::prefix_cache_t cache;
+			return cache;
+		}
 	}
 
-	std::string add_second(const tm* current_time, const bool ensure_alignment)
+	void logging_config_t::render_cached(tags::detail::prefix_cache_t& cache, const i64 unix_seconds) const
 	{
-		auto str = std::to_string(current_time->tm_sec);
-		if (ensure_alignment && str.size() < 2)
-			str.insert(str.begin(), '0');
-		return str;
+		using tags::detail::render_op_t;
+		cache.config = this;
+		cache.generation = m_generation;
+		cache.second = unix_seconds;
+		cache.text.clear();
+		cache.segments.clear();
+		cache.patches.clear();
+		const auto time = local_time(unix_seconds);
+		const auto digits = m_ensure_alignment ? 2 : 0;
+		for (const auto& [begin, end] : m_cached_segments)
+		{
+			tags::detail::cached_segment_t segment{static_cast<u32>(cache.text.size()), 0, static_cast<u32>(cache.patches.size()), 0};
+			for (auto i = begin; i < end; ++i)
+			{
+				const auto& step = m_cached_steps[i];
+				switch (step.op)
+				{
+					case render_op_t::TEXT:
+						cache.text.append(m_render_text[step.index]);
+						break;
+					case render_op_t::YEAR:
+						if (time.year < 0)
+							cache.text.append('-');
+						append_number(cache.text, static_cast<u64>(time.year < 0 ? -time.year : time.year), 0);
+						break;
+					case render_op_t::MONTH:
+						append_number(cache.text, time.month, digits);
+						break;
+					case render_op_t::DAY:
+						append_number(cache.text, time.day, digits);
+						break;
+					case render_op_t::HOUR:
+						append_number(cache.text, time.hour, digits);
+						break;
+					case render_op_t::MINUTE:
+						append_number(cache.text, time.minute, digits);
+						break;
+					case render_op_t::SECOND:
+						append_number(cache.text, time.second, digits);
+						break;
+					case render_op_t::MS:
+						cache.patches.push_back({static_cast<u32>(cache.text.size()) - segment.offset, step.op});
+						cache.text.append(4, '0');
+						break;
+					case render_op_t::NS:
+						cache.patches.push_back({static_cast<u32>(cache.text.size()) - segment.offset, step.op});
+						cache.text.append(9, '0');
+						break;
+					default:
+						break;
+				}
+			}
+			segment.length = static_cast<u32>(cache.text.size()) - segment.offset;
+			segment.patches_end = static_cast<u32>(cache.patches.size());
+			cache.segments.push_back(segment);
+		}
 	}
 
 	std::optional<std::string> logging_config_t::generate(const std::string& user_str, const std::string& thread_name, const log_level_t level,
 														const char* file, const i32 line) const
 	{
-		if (level < m_level)
+		fmt_buffer_t buffer;
+		if (!generate(buffer, user_str, thread_name, level, file, line))
 			return {};
+		return std::string(buffer.view());
+	}
 
-		std::string fmt;
+	bool logging_config_t::generate(fmt_buffer_t& out, const std::string_view user_str, const std::string_view thread_name, const log_level_t level,
+									const char* file, const i32 line) const
+	{
+		using tags::detail::render_op_t;
+		if (level < m_level)
+			return false;
 
-		const std::time_t time = std::time(nullptr);
-		const auto current_time = std::localtime(&time);
-		const auto millis_time = system::getCurrentTimeMilliseconds();
-		const auto nano_time = system::getCurrentTimeNanoseconds();
+		// the only clock read, everything down to the calendar date is derived from it
+		const auto nano_time = system::unix_now_ns();
+		const auto millis_time = floor_div(nano_time, 1000000);
+		const auto unix_seconds = floor_div(nano_time, 1000000000);
 
-		size_t content = 0;
-		for (const auto& log_tag_token : m_log_tag_tokens)
+		auto& cache = get_prefix_cache();
+		if (!m_cached_segments.empty() && (cache.config != this || cache.generation != m_generation || cache.second != unix_seconds))
+			render_cached(cache, unix_seconds);
+
+		for (const auto& step : m_render_plan)
 		{
-			switch (log_tag_token)
+			switch (step.op)
 			{
-				case tags::detail::log_tag_token_t::YEAR:
-					fmt += add_year(current_time);
-					break;
-				case tags::detail::log_tag_token_t::MONTH:
-					fmt += add_month(current_time, m_ensure_alignment);
-					break;
-				case tags::detail::log_tag_token_t::DAY:
-					fmt += add_day(current_time, m_ensure_alignment);
-					break;
-				case tags::detail::log_tag_token_t::HOUR:
-					fmt += add_hour(current_time, m_ensure_alignment);
-					break;
-				case tags::detail::log_tag_token_t::MINUTE:
-					fmt += add_minute(current_time, m_ensure_alignment);
-					break;
-				case tags::detail::log_tag_token_t::SECOND:
-					fmt += add_second(current_time, m_ensure_alignment);
-					break;
-				case tags::detail::log_tag_token_t::MS:
-				{
-					auto str = std::to_string(millis_time % 1000);
-					if (m_ensure_alignment)
-					{
-						for (size_t i = str.size(); i < 4; ++i)
-							str.insert(str.begin(), '0');
-					}
-					fmt += str;
+				case render_op_t::TEXT:
+					out.append(m_render_text[step.index]);
 					break;
-				}
-				case tags::detail::log_tag_token_t::NS:
+				case render_op_t::CACHED:
 				{
-					auto str = std::to_string(nano_time % 1000000000ul);
-					if (m_ensure_alignment)
+					const auto& segment = cache.segments[step.index];
+					auto* dest = out.extend(segment.length);
+					std::memcpy(dest, cache.text.data() + segment.offset, segment.length);
+					for (auto i = segment.patches_begin; i < segment.patches_end; ++i)
 					{
-						for (size_t i = str.size(); i < 9; ++i)
-							str.insert(str.begin(), '0');
+						const auto& patch = cache.patches[i];
+						if (patch.op == render_op_t::MS)
+							write_fixed_digits(dest + patch.offset, static_cast<u64>(millis_time % 1000), 4);
+						else
+							write_fixed_digits(dest + patch.offset, static_cast<u64>(nano_time % 1000000000), 9);
 					}
-					fmt += str;
 					break;
 				}
-				case tags::detail::log_tag_token_t::UNIX:
-				{
-					fmt += std::to_string(millis_time);
+				case render_op_t::MS:
+					append_number(out, static_cast<u64>(millis_time % 1000), 0);
 					break;
-				}
-				case tags::detail::log_tag_token_t::UNIX_NANO:
-				{
-					fmt += std::to_string(nano_time);
+				case render_op_t::NS:
+					append_number(out, static_cast<u64>(nano_time % 1000000000), 0);
 					break;
-				}
-				case tags::detail::log_tag_token_t::ISO_YEAR:
-				{
-					fmt += add_year(current_time);
-					fmt += '-';
-					fmt += add_month(current_time, m_ensure_alignment);
-					fmt += '-';
-					fmt += add_day(current_time, m_ensure_alignment);
+				case render_op_t::UNIX:
+					append_number(out, static_cast<u64>(millis_time), 0);
 					break;
-				}
-				case tags::detail::log_tag_token_t::TIME:
-					fmt += add_hour(current_time, m_ensure_alignment);
-					fmt += ':';
-					fmt += add_minute(current_time, m_ensure_alignment);
-					fmt += ':';
-					fmt += add_second(current_time, m_ensure_alignment);
-					break;
-				case tags::detail::log_tag_token_t::FULL_TIME:
-					fmt += add_year(current_time);
-					fmt += '-';
-					fmt += add_month(current_time, m_ensure_alignment);
-					fmt += '-';
-					fmt += add_day(current_time, m_ensure_alignment);
-					fmt += ' ';
-					fmt += add_hour(current_time, m_ensure_alignment);
-					fmt += ':';
-					fmt += add_minute(current_time, m_ensure_alignment);
-					fmt += ':';
-					fmt += add_second(current_time, m_ensure_alignment);
-					break;
-				case tags::detail::log_tag_token_t::LC:
-					if (!m_use_color)
-						break;
-					fmt += m_log_level_colors[static_cast<u8>(level)];
+				case render_op_t::UNIX_NANO:
+					append_number(out, static_cast<u64>(nano_time), 0);
 					break;
-				case tags::detail::log_tag_token_t::EC:
-					if (!m_use_color)
-						break;
-					fmt += m_error_color;
+				case render_op_t::LEVEL_COLOR:
+					out.append(m_log_level_colors[static_cast<u8>(level)]);
 					break;
-				case tags::detail::log_tag_token_t::CEC:
-					if (!m_use_color)
-						break;
+				case render_op_t::CONDITIONAL_ERROR_COLOR:
 					if (static_cast<u8>(level) >= static_cast<u8>(log_level_t::ERROR))
-						fmt += m_error_color;
-					break;
-				case tags::detail::log_tag_token_t::RESET:
-					if (!m_use_color)
-						break;
-					fmt += build(ansi::color::color_mode::RESET_ALL);
+						out.append(m_error_color);
 					break;
-				case tags::detail::log_tag_token_t::LL:
-					fmt += m_log_level_names[static_cast<u8>(level)];
+				case render_op_t::LEVEL_NAME:
+					out.append(m_log_level_names[static_cast<u8>(level)]);
 					break;
-				case tags::detail::log_tag_token_t::TN:
-					fmt += thread_name;
+				case render_op_t::THREAD_NAME:
+					out.append(thread_name);
 					break;
-				case tags::detail::log_tag_token_t::FILE:
+				case render_op_t::FILE:
 					if (m_print_full_name)
-						fmt += file;
+						out.append(file);
 					else
 					{
 						static auto CMAKE_STRING_LEN = strlen(CMAKE_SOURCE_DIR);
-						std::string file_str{file};
-						auto pos = file_str.find(CMAKE_SOURCE_DIR);
-						if (pos != std::string::npos)
-							file_str.erase(pos, CMAKE_STRING_LEN + 1);
-						fmt += file_str;
+						const std::string_view file_str{file};
+						const auto pos = file_str.find(CMAKE_SOURCE_DIR);
+						if (pos != std::string_view::npos)
+						{
+							out.append(file_str.substr(0, pos));
+							out.append(file_str.substr(std::min(file_str.size(), pos + CMAKE_STRING_LEN + 1)));
+						} else
+							out.append(file_str);
 					}
 					break;
-				case tags::detail::log_tag_token_t::LINE:
-					fmt += std::to_string(line);
+				case render_op_t::LINE:
+					if (line < 0)
+						out.append('-');
+					append_number(out, static_cast<u64>(line < 0 ? -static_cast<i64>(line) : line), 0);
 					break;
-				case tags::detail::log_tag_token_t::STR:
-					fmt += user_str;
+				case render_op_t::STR:
+					out.append(user_str);
 					break;
-				case tags::detail::log_tag_token_t::CONTENT:
-					fmt += m_log_tag_content[content++];
+				default:
 					break;
 			}
 		}
 
-		return fmt;
+		return true;
 	}
 
 	std::string logging_config_t::get_default_log_format()
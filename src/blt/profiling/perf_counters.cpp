@@ -0,0 +1,249 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <blt/profiling/perf_counters.h>
+#include <blt/std/system.h>
+
+#if defined(__linux__)
+	#include <atomic>
+	#include <cerrno>
+	#include <cstring>
+	#include <linux/perf_event.h>
+	#include <sys/mman.h>
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+namespace blt::profiling
+{
+#if defined(__linux__)
+	namespace
+	{
+		struct counter_config_t
+		{
+			perf_counter_t counter;
+			const char* name;
+			u32 type;
+			u64 config;
+		};
+
+		constexpr std::array<counter_config_t, 5> HARDWARE_COUNTERS{
+			counter_config_t{perf_counter_t::INSTRUCTIONS, "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+			counter_config_t{perf_counter_t::CYCLES, "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+			counter_config_t{
+				perf_counter_t::L1D_MISSES, "L1D misses", PERF_TYPE_HW_CACHE,
+				PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+			},
+			counter_config_t{perf_counter_t::LLC_MISSES, "LLC misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+			counter_config_t{perf_counter_t::BRANCH_MISSES, "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		};
+
+		int open_counter(const u32 type, const u64 config, const int group_fd, const bool exclude_kernel)
+		{
+			perf_event_attr attr{};
+			attr.size = sizeof(attr);
+			attr.type = type;
+			attr.config = config;
+			attr.exclude_kernel = exclude_kernel;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			// pid 0 and cpu -1 count the calling thread on any cpu
+			return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC));
+		}
+
+		std::string describe_errno(const int error)
+		{
+			std::string description = std::strerror(error);
+			if (error == EACCES || error == EPERM)
+				description += ", see /proc/sys/kernel/perf_event_paranoid";
+			else if (error == ENOENT || error == EOPNOTSUPP)
+				description += ", the CPU or hypervisor does not expose it";
+			return description;
+		}
+
+		void append_error(std::string& errors, const char* name, const int error)
+		{
+			if (!errors.empty())
+				errors += "; ";
+			errors += name;
+			errors += ": ";
+			errors += describe_errno(error);
+		}
+
+		u64 rdpmc(const u32 index)
+		{
+	#if defined(__x86_64__) || defined(__i386__)
+			u32 low, high;
+			asm volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(index));
+			return static_cast<u64>(high) << 32 | low;
+	#else
+			(void) index;
+			return 0;
+	#endif
+		}
+	}
+
+	perf_counter_group_t::perf_counter_group_t()
+	{
+		int leader = -1;
+		for (const auto& [counter, name, type, config] : HARDWARE_COUNTERS)
+		{
+			const auto fd = open_counter(type, config, leader, true);
+			if (fd < 0)
+			{
+				append_error(m_error, name, errno);
+				continue;
+			}
+			if (leader < 0)
+				leader = fd;
+			m_counters[static_cast<size_t>(counter)].fd = fd;
+			m_group_order[m_group_size++] = counter;
+			m_mask |= 1u << static_cast<u32>(counter);
+		}
+
+	#if defined(__x86_64__) || defined(__i386__)
+		// rdpmc needs every counter's page, and the kernel has to allow it for all of them
+		m_rdpmc = m_group_size > 0;
+		const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		for (size_t i = 0; i < m_group_size && m_rdpmc; i++)
+		{
+			auto& counter = m_counters[static_cast<size_t>(m_group_order[i])];
+			auto* page = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, counter.fd, 0);
+			if (page == MAP_FAILED)
+			{
+				m_rdpmc = false;
+				break;
+			}
+			counter.page = page;
+			m_rdpmc = static_cast<const perf_event_mmap_page*>(page)->cap_user_rdpmc;
+		}
+	#endif
+
+		// a software event, it only counts the switches themselves if kernel events may be counted
+		const auto switches = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, -1, false);
+		if (switches >= 0)
+			m_counters[static_cast<size_t>(perf_counter_t::CONTEXT_SWITCHES)].fd = switches;
+		else
+			m_rusage_switches = true;
+		m_mask |= 1u << static_cast<u32>(perf_counter_t::CONTEXT_SWITCHES);
+	}
+
+	perf_counter_group_t::~perf_counter_group_t()
+	{
+		const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		for (const auto& counter : m_counters)
+		{
+			if (counter.page != nullptr)
+				munmap(counter.page, page_size);
+			if (counter.fd >= 0)
+				close(counter.fd);
+		}
+	}
+
+	perf_values_t perf_counter_group_t::read() const
+	{
+		perf_values_t values;
+		if (m_group_size > 0 && !(m_rdpmc && read_rdpmc(values)))
+			read_group(values);
+		if (m_rusage_switches)
+		{
+			rusage usage{};
+			if (getrusage(RUSAGE_THREAD, &usage) == 0)
+				values[perf_counter_t::CONTEXT_SWITCHES] = static_cast<u64>(usage.ru_nvcsw + usage.ru_nivcsw);
+		} else
+		{
+			// a group of its own: nr, time enabled, time running, value
+			u64 switches[4]{};
+			if (::read(m_counters[static_cast<size_t>(perf_counter_t::CONTEXT_SWITCHES)].fd, switches, sizeof(switches)) ==
+				static_cast<ssize_t>(sizeof(switches)))
+				values[perf_counter_t::CONTEXT_SWITCHES] = switches[3];
+		}
+		return values;
+	}
+
+	bool perf_counter_group_t::read_rdpmc(perf_values_t& values) const
+	{
+		for (size_t i = 0; i < m_group_size; i++)
+		{
+			const auto counter = m_group_order[i];
+			const volatile auto* page = static_cast<const volatile perf_event_mmap_page*>(m_counters[static_cast<size_t>(counter)].page);
+			u32 sequence;
+			u64 count, enabled, running;
+			do
+			{
+				sequence = page->lock;
+				std::atomic_signal_fence(std::memory_order_seq_cst);
+				const auto index = page->index;
+				// 0 while the counter is not on the PMU, the group has to be read through the kernel then
+				if (!page->cap_user_rdpmc || index == 0)
+					return false;
+				enabled = page->time_enabled;
+				running = page->time_running;
+				// the times are only current as of the last time the kernel touched the page, the TSC tells how much time passed since
+				if (enabled != running)
+				{
+					if (!page->cap_user_time)
+						return false;
+					const auto delta = detail::perf_time_delta(system::rdtsc(), page->time_offset, page->time_mult, page->time_shift);
+					enabled += delta;
+					running += delta;
+				}
+				count = static_cast<u64>(page->offset) + static_cast<u64>(detail::sign_extend_pmc(rdpmc(index - 1), page->pmc_width));
+				std::atomic_signal_fence(std::memory_order_seq_cst);
+			} while (page->lock != sequence);
+			// scaled like read_group(), so an interval started through one and ended through the other still subtracts like for like
+			values[counter] = detail::scale_count(count, enabled, running);
+		}
+		return true;
+	}
+
+	void perf_counter_group_t::read_group(perf_values_t& values) const
+	{
+		// nr, time enabled, time running, then one value per counter
+		std::array<u64, 3 + PERF_COUNTER_COUNT> buffer{};
+		const auto leader = m_counters[static_cast<size_t>(m_group_order[0])].fd;
+		if (::read(leader, buffer.data(), sizeof(buffer)) <= 0)
+			return;
+		const auto enabled = buffer[1];
+		const auto running = buffer[2];
+		// the kernel may have multiplexed the group with others, estimate the full count
+		for (size_t i = 0; i < m_group_size && i < buffer[0]; i++)
+			values[m_group_order[i]] = detail::scale_count(buffer[3 + i], enabled, running);
+	}
+#else
+	perf_counter_group_t::perf_counter_group_t()
+	{
+		m_error = "hardware counters are only supported on Linux";
+	}
+
+	perf_counter_group_t::~perf_counter_group_t() = default;
+
+	perf_values_t perf_counter_group_t::read() const
+	{
+		return {};
+	}
+
+	bool perf_counter_group_t::read_rdpmc(perf_values_t&) const
+	{
+		return false;
+	}
+
+	void perf_counter_group_t::read_group(perf_values_t&) const
+	{}
+#endif
+}
@@ -6,8 +6,18 @@
 #include <blt/profiling/profiler_v2.h>
 #include <blt/std/time.h>
 #include <blt/std/system.h>
+#include <blt/std/tsc.h>
 #include <blt/format/format.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
 #include <blt/std/hashmap.h>
 #include <blt/compatibility.h>
 
@@ -48,28 +58,150 @@ namespace blt
         unit wall;
     };
     
+    // columns shown by PRINT_PERCENTILES, followed by the max
+    constexpr std::array<double, 4> PERCENTILES{50, 90, 99, 99.9};
+    constexpr std::array<const char*, 4> PERCENTILE_NAMES{"p50", "p90", "p99", "p99.9"};
+    
+    std::uint64_t latency_histogram_t::highest_value_of(std::size_t bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+            return bucket;
+        const auto shift = bucket / HALF_SUB_BUCKETS - 1;
+        const auto sub_bucket = static_cast<std::uint64_t>(bucket - shift * HALF_SUB_BUCKETS);
+        // wraps to the largest 64 bit value for the last bucket
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+    
+    void latency_histogram_t::merge(const latency_histogram_t& other)
+    {
+        for (std::size_t i = 0; i < BUCKET_COUNT; i++)
+            buckets[i] += other.buckets[i];
+        total += other.total;
+        max_value = std::max(max_value, other.max_value);
+    }
+    
+    void latency_histogram_t::subtract(const latency_histogram_t& earlier)
+    {
+        std::size_t highest = 0;
+        for (std::size_t i = 0; i < BUCKET_COUNT; i++)
+        {
+            buckets[i] -= earlier.buckets[i];
+            if (buckets[i] != 0)
+                highest = i;
+        }
+        total -= earlier.total;
+        max_value = total == 0 ? 0 : std::min(max_value, highest_value_of(highest));
+    }
+    
+    std::uint64_t latency_histogram_t::value_at_percentile(double percentile) const
+    {
+        if (total == 0)
+            return 0;
+        percentile = std::clamp(percentile, 0.0, 100.0);
+        const auto wanted = std::max<std::uint64_t>(static_cast<std::uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(total))), 1);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < BUCKET_COUNT; i++)
+        {
+            seen += buckets[i];
+            if (seen >= wanted)
+                return std::min(highest_value_of(i), max_value);
+        }
+        return max_value;
+    }
+    
+    namespace
+    {
+        // adds a finished interval to the event buffer of the calling thread, defined with the lock free intervals
+        void record_event(std::uint32_t id, pf_time_t begin, pf_time_t end);
+        
+        void push_scope(std::uint32_t id, pf_time_t wall, pf_time_t thread, pf_cycle_t cycles);
+        
+        void pop_scope(std::uint32_t id, pf_time_t wall, pf_time_t thread, pf_cycle_t cycles);
+        
+        std::uint8_t profile_record_flags(const std::string& profile_name);
+        
+        // why the hardware counters of the last thread to open them are missing, shown when printing so that need not open any itself
+        struct counter_error_t
+        {
+            std::mutex lock;
+            std::string error;
+        };
+        
+        counter_error_t& counter_error()
+        {
+            // leaked, threads may still open counters during static destruction
+            static auto* error = new counter_error_t();
+            return *error;
+        }
+        
+        struct local_counters_t
+        {
+            profiling::perf_counter_group_t group;
+            
+            local_counters_t()
+            {
+                if (group.error().empty())
+                    return;
+                auto& error = counter_error();
+                std::scoped_lock lock(error.lock);
+                error.error = group.error();
+            }
+        };
+        
+        // counters of the calling thread, opened on first use
+        profiling::perf_counter_group_t& local_counters()
+        {
+            thread_local local_counters_t counters;
+            return counters.group;
+        }
+        
+        std::string recorded_counter_error()
+        {
+            auto& error = counter_error();
+            std::scoped_lock lock(error.lock);
+            return error.error;
+        }
+    }
+    
     interval_t* createInterval(profile_t& profiler, std::string interval_name)
     {
         auto interval = new interval_t(
-                blt::system::getCurrentTimeNanoseconds(), 0, 0,
+                blt::system::now_ns(), 0, 0,
                 blt::system::getCPUThreadTime(), 0, 0,
                 blt::system::rdtsc(), 0, 0,
                 0, std::move(interval_name));
+        if (profiler.record_flags)
+        {
+            interval->interned_id = _internal::intern_interval(profiler.name, interval->interval_name);
+            interval->record_flags = profiler.record_flags;
+        }
         profiler.intervals.push_back(interval);
         return interval;
     }
     
     void startInterval(interval_t* interval)
     {
-        interval->wall_start = blt::system::getCurrentTimeNanoseconds();
+        interval->wall_start = blt::system::now_ns();
         interval->thread_start = blt::system::getCPUThreadTime();
         interval->cycles_start = blt::system::rdtsc();
+        
+        if (interval->record_flags & RECORD_SCOPES)
+            push_scope(static_cast<std::uint32_t>(interval->interned_id), interval->wall_start, interval->thread_start, interval->cycles_start);
+        // last, so the profiler itself is counted as little as possible
+        if (interval->record_flags & RECORD_COUNTERS)
+            interval->counters_start = local_counters().read();
     }
     
     void endInterval(interval_t* interval)
     {
+        if (interval->record_flags & RECORD_COUNTERS)
+        {
+            auto& counters = local_counters();
+            interval->counters_total += counters.read() - interval->counters_start;
+            interval->counter_mask |= counters.mask();
+        }
         interval->cycles_end = blt::system::rdtsc();
-        interval->wall_end = blt::system::getCurrentTimeNanoseconds();
+        interval->wall_end = blt::system::now_ns();
         interval->thread_end = blt::system::getCPUThreadTime();
         
         interval->cycles_total += interval->cycles_end - interval->cycles_start;
@@ -77,6 +209,18 @@ namespace blt
         interval->thread_total += interval->thread_end - interval->thread_start;
         
         interval->count++;
+        
+        if (interval->record_flags & RECORD_PERCENTILES)
+        {
+            if (!interval->wall_histogram)
+                interval->wall_histogram = std::make_unique<latency_histogram_t>();
+            interval->wall_histogram->record(static_cast<std::uint64_t>(std::max<pf_time_t>(interval->wall_end - interval->wall_start, 0)));
+        }
+        
+        if (interval->record_flags & RECORD_EVENTS)
+            record_event(static_cast<std::uint32_t>(interval->interned_id), interval->wall_start, interval->wall_end);
+        if (interval->record_flags & RECORD_SCOPES)
+            pop_scope(static_cast<std::uint32_t>(interval->interned_id), interval->wall_end, interval->thread_end, interval->cycles_end);
     }
     
     void clearProfile(profile_t& profiler)
@@ -138,6 +282,8 @@ namespace blt
         bool printCycles = flags & PRINT_CYCLES;
         bool printThread = flags & PRINT_THREAD;
         bool printWall = flags & PRINT_WALL;
+        bool printPercentiles = flags & PRINT_PERCENTILES;
+        bool printCounters = flags & PRINT_COUNTERS;
 
         sort_intervals(profiler.intervals, sort, printHistory);
 
@@ -158,7 +304,24 @@ namespace blt
             formatter.addColumn("CPU Time (" + thread_unit_string += ")");
         if (printWall)
             formatter.addColumn("Wall Time (" + wall_unit_string += ")");
+        if (printPercentiles)
+        {
+            for (const auto& percentile : PERCENTILE_NAMES)
+                formatter.addColumn(std::string(percentile) + " (" + wall_unit_string + ")");
+            formatter.addColumn("max (" + wall_unit_string + ")");
+        }
+        if (printCounters)
+        {
+            formatter.addColumn("IPC");
+            formatter.addColumn("L1D MPKI");
+            formatter.addColumn("LLC MPKI");
+            formatter.addColumn("Branch MPKI");
+            formatter.addColumn("Ctx Switches");
+        }
 
+        // only worth a note if counters were recorded but the hardware ones could not be opened
+        bool counters_recorded = false;
+        bool hardware_counted = false;
         for (size_t i = 0; i < profiler.intervals.size(); i++)
         {
             blt::string::TableRow row;
@@ -179,12 +342,45 @@ namespace blt
                 row.rowValues.push_back(std::to_string(thread / static_cast<double>(thread_unit_divide)));
             if (printWall)
                 row.rowValues.push_back(std::to_string(wall / static_cast<double>(wall_unit_divide)));
+            if (printPercentiles)
+            {
+                const auto& histogram = interval->wall_histogram;
+                for (const auto percentile : PERCENTILES)
+                    row.rowValues.push_back(histogram ? std::to_string(static_cast<double>(histogram->value_at_percentile(percentile)) / wall_unit_divide)
+                                                      : "-");
+                row.rowValues.push_back(histogram ? std::to_string(static_cast<double>(histogram->max()) / wall_unit_divide) : "-");
+            }
+            if (printCounters)
+            {
+                using profiling::perf_counter_t;
+                const auto& counters = interval->counters_total;
+                const auto counted = [interval](perf_counter_t counter) {
+                    return (interval->counter_mask & (1u << static_cast<std::uint32_t>(counter))) != 0;
+                };
+                const auto per_kilo = [&](perf_counter_t counter) {
+                    return counted(perf_counter_t::INSTRUCTIONS) && counted(counter) ? std::to_string(counters.per_kilo_instruction(counter)) : "-";
+                };
+                counters_recorded |= interval->counter_mask != 0;
+                hardware_counted |= counted(perf_counter_t::INSTRUCTIONS) || counted(perf_counter_t::CYCLES);
+                row.rowValues.push_back(counted(perf_counter_t::INSTRUCTIONS) && counted(perf_counter_t::CYCLES) ? std::to_string(counters.ipc()) : "-");
+                row.rowValues.push_back(per_kilo(perf_counter_t::L1D_MISSES));
+                row.rowValues.push_back(per_kilo(perf_counter_t::LLC_MISSES));
+                row.rowValues.push_back(per_kilo(perf_counter_t::BRANCH_MISSES));
+                if (counted(perf_counter_t::CONTEXT_SWITCHES))
+                {
+                    const auto switches = static_cast<double>(counters[perf_counter_t::CONTEXT_SWITCHES]);
+                    row.rowValues.push_back(std::to_string(printHistory ? switches / static_cast<double>(interval->count) : switches));
+                } else
+                    row.rowValues.push_back("-");
+            }
             formatter.addRow(row);
         }
 
         auto lines = formatter.createTable(true, true);
         for (const auto& line : lines)
             stream << line << "\n";
+        if (printCounters && counters_recorded && !hardware_counted)
+            stream << "Hardware counters unavailable: " << recorded_counter_error() << "\n";
     }
     
     void printProfile(profile_t& profiler, const std::uint32_t flags, sort_by sort, blt::logging::log_level_t log_level)
@@ -215,6 +411,9 @@ namespace blt
         {
             auto interval = new interval_t();
             interval->interval_name = interval_name;
+            interval->record_flags = profile_record_flags(profile_name);
+            if (interval->record_flags)
+                interval->interned_id = _internal::intern_interval(profile_name, interval_name);
             profile[interval_name] = interval;
         }
         blt::startInterval(profile[interval_name]);
@@ -228,28 +427,1076 @@ namespace blt
         blt::endInterval(profiles[profile_name].at(interval_name));
     }
     
+    /**
+     * lock free intervals
+     * -------------------
+     */
+    
+    namespace
+    {
+        template <typename T>
+        void add_relaxed(std::atomic<T>& value, T amount)
+        {
+            // single writer, so a plain load and store is enough and avoids a locked instruction
+            value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+        
+        struct counter_slot_t
+        {
+            profiling::perf_values_t start;
+            std::array<std::atomic<std::uint64_t>, profiling::PERF_COUNTER_COUNT> total{};
+            std::atomic<std::uint32_t> mask = 0;
+        };
+        
+        // only ever written by the thread owning it, the totals are atomic so they can be read while merging
+        struct thread_slot_t
+        {
+            pf_time_t wall_start = 0;
+            pf_cycle_t cycles_start = 0;
+            std::atomic<pf_time_t> wall_total = 0;
+            std::atomic<pf_cycle_t> cycles_total = 0;
+            std::atomic<std::uint64_t> count = 0;
+            std::atomic<std::uint64_t> wall_max = 0;
+            // buckets of a latency_histogram_t, allocated when the interval first ends with RECORD_PERCENTILES on this thread
+            std::atomic<std::atomic<std::uint64_t>*> wall_histogram = nullptr;
+            // allocated when the interval first starts with RECORD_COUNTERS on this thread
+            std::atomic<counter_slot_t*> counters = nullptr;
+            
+            ~thread_slot_t()
+            {
+                delete[] wall_histogram.load();
+                delete counters.load();
+            }
+        };
+        
+        // slots of one thread, allocated in blocks the first time one of their ids is used so existing slots never move
+        struct thread_intervals_t
+        {
+            static constexpr std::size_t BLOCK_SIZE = 256;
+            static constexpr std::size_t BLOCK_COUNT = _internal::MAX_INTERVAL_IDS / BLOCK_SIZE;
+            
+            std::array<std::atomic<thread_slot_t*>, BLOCK_COUNT> blocks{};
+            
+            thread_slot_t& slot(_internal::interval_id_t id)
+            {
+                auto& block = blocks[id / BLOCK_SIZE];
+                auto* slots = block.load(std::memory_order_relaxed);
+                if (slots == nullptr)
+                {
+                    slots = new thread_slot_t[BLOCK_SIZE];
+                    block.store(slots, std::memory_order_release);
+                }
+                return slots[id % BLOCK_SIZE];
+            }
+            
+            // for the merging thread
+            [[nodiscard]] const thread_slot_t* find(_internal::interval_id_t id) const
+            {
+                auto* slots = blocks[id / BLOCK_SIZE].load(std::memory_order_acquire);
+                return slots == nullptr ? nullptr : &slots[id % BLOCK_SIZE];
+            }
+            
+            ~thread_intervals_t()
+            {
+                for (auto& block : blocks)
+                    delete[] block.load();
+            }
+        };
+        
+        struct interned_interval_t
+        {
+            std::string profile_name;
+            std::string interval_name;
+            // totals at the last print, slots are never reset since other threads own them
+            pf_time_t wall_printed = 0;
+            pf_cycle_t cycles_printed = 0;
+            std::uint64_t count_printed = 0;
+            std::unique_ptr<latency_histogram_t> histogram_printed{};
+            profiling::perf_values_t counters_printed{};
+        };
+        
+        struct trace_event_t
+        {
+            _internal::interval_id_t id;
+            pf_time_t begin;
+            pf_time_t end;
+        };
+        
+        // newest events of one thread. Only that thread writes, writeTrace copies the events out while they may still be written
+        class thread_trace_t
+        {
+        private:
+            struct slot_t
+            {
+                std::atomic<_internal::interval_id_t> id = 0;
+                std::atomic<pf_time_t> begin = 0;
+                std::atomic<pf_time_t> end = 0;
+            };
+            
+            std::unique_ptr<slot_t[]> slots;
+            std::uint64_t mask;
+            // events are claimed before their slot is overwritten and committed once it is complete
+            std::atomic<std::uint64_t> claimed = 0;
+            std::atomic<std::uint64_t> committed = 0;
+        
+        public:
+            const std::size_t thread_index;
+            const std::string thread_name;
+            
+            thread_trace_t(std::size_t capacity, std::size_t thread_index, std::string thread_name):
+                    thread_index(thread_index), thread_name(std::move(thread_name))
+            {
+                std::size_t size = 1;
+                while (size < capacity)
+                    size <<= 1;
+                slots = std::make_unique<slot_t[]>(size);
+                mask = size - 1;
+            }
+            
+            void record(_internal::interval_id_t id, pf_time_t begin, pf_time_t end)
+            {
+                const auto index = claimed.load(std::memory_order_relaxed);
+                claimed.store(index + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                auto& slot = slots[index & mask];
+                slot.id.store(id, std::memory_order_relaxed);
+                slot.begin.store(begin, std::memory_order_relaxed);
+                slot.end.store(end, std::memory_order_relaxed);
+                committed.store(index + 1, std::memory_order_release);
+            }
+            
+            // copies out the committed events, leaving out any the thread overwrote during the copy
+            void snapshot(std::vector<trace_event_t>& out) const
+            {
+                const auto capacity = mask + 1;
+                const auto end = committed.load(std::memory_order_acquire);
+                auto begin = end > capacity ? end - capacity : 0;
+                std::vector<trace_event_t> events;
+                events.reserve(end - begin);
+                for (auto i = begin; i < end; i++)
+                {
+                    const auto& slot = slots[i & mask];
+                    events.push_back({slot.id.load(std::memory_order_relaxed), slot.begin.load(std::memory_order_relaxed),
+                                      slot.end.load(std::memory_order_relaxed)});
+                }
+                // any slot written after the fence in record() also makes its claim visible here
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const auto overwritten = claimed.load(std::memory_order_relaxed);
+                const auto skip = overwritten > capacity + begin ? std::min<std::uint64_t>(overwritten - capacity - begin, events.size()) : 0;
+                out.insert(out.end(), events.begin() + static_cast<std::ptrdiff_t>(skip), events.end());
+            }
+        };
+        
+        // node of the call tree of one thread. Only the owning thread writes, children are published through first_child
+        struct scope_node_t
+        {
+            static constexpr std::uint32_t NONE = std::numeric_limits<std::uint32_t>::max();
+            
+            _internal::interval_id_t id = 0;
+            std::atomic<std::uint32_t> first_child = NONE;
+            std::atomic<std::uint32_t> next_sibling = NONE;
+            // inclusive totals
+            std::atomic<pf_time_t> wall = 0;
+            std::atomic<pf_time_t> thread = 0;
+            std::atomic<pf_cycle_t> cycles = 0;
+            std::atomic<std::uint64_t> count = 0;
+        };
+        
+        // scope stack and call tree of one thread, node 0 is the root. Nodes are allocated in blocks so they never move.
+        struct thread_scopes_t
+        {
+            static constexpr std::size_t BLOCK_SIZE = 256;
+            static constexpr std::size_t BLOCK_COUNT = 1024;
+            
+            struct frame_t
+            {
+                _internal::interval_id_t id;
+                std::uint32_t node;
+                pf_time_t wall_start;
+                pf_time_t thread_start;
+                pf_cycle_t cycles_start;
+            };
+            
+            std::array<std::atomic<scope_node_t*>, BLOCK_COUNT> blocks{};
+            std::uint32_t size = 0;
+            std::vector<frame_t> stack;
+            
+            thread_scopes_t()
+            {
+                create(scope_node_t::NONE, 0);
+            }
+            
+            [[nodiscard]] const scope_node_t& node(std::uint32_t index) const
+            {
+                return blocks[index / BLOCK_SIZE].load(std::memory_order_acquire)[index % BLOCK_SIZE];
+            }
+            
+            scope_node_t& node(std::uint32_t index)
+            {
+                return blocks[index / BLOCK_SIZE].load(std::memory_order_relaxed)[index % BLOCK_SIZE];
+            }
+            
+            /**
+             * @return the child of parent for this interval, created if needed. NONE once the tree is full, deeper scopes are then not
+             * recorded.
+             */
+            std::uint32_t child(std::uint32_t parent, _internal::interval_id_t id)
+            {
+                if (parent == scope_node_t::NONE)
+                    return scope_node_t::NONE;
+                auto& parent_node = node(parent);
+                for (auto index = parent_node.first_child.load(std::memory_order_relaxed); index != scope_node_t::NONE;
+                     index = node(index).next_sibling.load(std::memory_order_relaxed))
+                {
+                    if (node(index).id == id)
+                        return index;
+                }
+                const auto index = create(id, parent_node.first_child.load(std::memory_order_relaxed));
+                if (index != scope_node_t::NONE)
+                    parent_node.first_child.store(index, std::memory_order_release);
+                return index;
+            }
+            
+            ~thread_scopes_t()
+            {
+                for (auto& block : blocks)
+                    delete[] block.load();
+            }
+        
+        private:
+            std::uint32_t create(_internal::interval_id_t id, std::uint32_t next_sibling)
+            {
+                if (size == BLOCK_SIZE * BLOCK_COUNT)
+                    return scope_node_t::NONE;
+                auto& block = blocks[size / BLOCK_SIZE];
+                if (block.load(std::memory_order_relaxed) == nullptr)
+                    block.store(new scope_node_t[BLOCK_SIZE], std::memory_order_release);
+                auto& created = node(size);
+                created.id = id;
+                created.next_sibling.store(next_sibling, std::memory_order_relaxed);
+                return size++;
+            }
+        };
+        
+        // RECORD_ flags of the lock free intervals of each id, static so checking them needs no initialization guard
+        std::array<std::atomic<std::uint8_t>, _internal::MAX_INTERVAL_IDS> id_flags{};
+        
+        struct interval_registry_t
+        {
+            std::mutex lock;
+            std::vector<interned_interval_t> intervals;
+            hashmap_t<std::string, hashmap_t<std::string, _internal::interval_id_t>> ids;
+            // every thread which ever used an interval. Totals have to outlive their thread so they are kept here,
+            // and handed to new threads once their thread exits to keep the memory bounded by the number of live threads
+            std::vector<std::unique_ptr<thread_intervals_t>> threads;
+            std::vector<thread_intervals_t*> retired;
+            // event buffers are never handed on, the events of exited threads are what make a trace useful
+            std::vector<std::unique_ptr<thread_trace_t>> traces;
+            std::size_t trace_capacity = DEFAULT_TRACE_EVENTS;
+            // scope trees are handed on like the interval slots, they are merged by path so it does not matter which thread built them
+            std::vector<std::unique_ptr<thread_scopes_t>> scopes;
+            std::vector<thread_scopes_t*> retired_scopes;
+            hashmap_t<std::string, std::uint8_t> profile_flags;
+        };
+        
+        interval_registry_t& registry()
+        {
+            // leaked, threads may still end intervals during static destruction
+            static auto* registry = new interval_registry_t();
+            return *registry;
+        }
+        
+        struct thread_handle_t
+        {
+            thread_intervals_t* intervals;
+            
+            thread_handle_t()
+            {
+                auto& reg = registry();
+                std::scoped_lock lock(reg.lock);
+                if (!reg.retired.empty())
+                {
+                    intervals = reg.retired.back();
+                    reg.retired.pop_back();
+                } else
+                    intervals = reg.threads.emplace_back(std::make_unique<thread_intervals_t>()).get();
+            }
+            
+            ~thread_handle_t()
+            {
+                auto& reg = registry();
+                std::scoped_lock lock(reg.lock);
+                reg.retired.push_back(intervals);
+            }
+        };
+        
+        thread_intervals_t& local_intervals()
+        {
+            thread_local thread_handle_t handle;
+            return *handle.intervals;
+        }
+        
+        struct scope_handle_t
+        {
+            thread_scopes_t* scopes;
+            
+            scope_handle_t()
+            {
+                auto& reg = registry();
+                std::scoped_lock lock(reg.lock);
+                if (!reg.retired_scopes.empty())
+                {
+                    scopes = reg.retired_scopes.back();
+                    reg.retired_scopes.pop_back();
+                } else
+                    scopes = reg.scopes.emplace_back(std::make_unique<thread_scopes_t>()).get();
+            }
+            
+            ~scope_handle_t()
+            {
+                auto& reg = registry();
+                std::scoped_lock lock(reg.lock);
+                // scopes still open when the thread exits are never ended
+                scopes->stack.clear();
+                reg.retired_scopes.push_back(scopes);
+            }
+        };
+        
+        thread_scopes_t& local_scopes()
+        {
+            thread_local scope_handle_t handle;
+            return *handle.scopes;
+        }
+        
+        void push_scope(std::uint32_t id, pf_time_t wall, pf_time_t thread, pf_cycle_t cycles)
+        {
+            auto& scopes = local_scopes();
+            const auto parent = scopes.stack.empty() ? 0 : scopes.stack.back().node;
+            scopes.stack.push_back({id, scopes.child(parent, id), wall, thread, cycles});
+        }
+        
+        void pop_scope(std::uint32_t id, pf_time_t wall, pf_time_t thread, pf_cycle_t cycles)
+        {
+            auto& scopes = local_scopes();
+            auto& stack = scopes.stack;
+            auto frame = std::find_if(stack.rbegin(), stack.rend(), [id](const thread_scopes_t::frame_t& f) {
+                return f.id == id;
+            });
+            if (frame == stack.rend())
+                return;
+            // scopes started after this one and not ended yet end with it
+            const auto first = frame.base() - 1;
+            for (auto it = first; it != stack.end(); ++it)
+            {
+                if (it->node == scope_node_t::NONE)
+                    continue;
+                auto& node = scopes.node(it->node);
+                add_relaxed(node.wall, wall - it->wall_start);
+                add_relaxed(node.thread, thread - it->thread_start);
+                add_relaxed(node.cycles, cycles - it->cycles_start);
+                add_relaxed(node.count, std::uint64_t{1});
+            }
+            stack.erase(first, stack.end());
+        }
+        
+        void record_event(std::uint32_t id, pf_time_t begin, pf_time_t end)
+        {
+            thread_local thread_trace_t* trace = nullptr;
+            if (trace == nullptr)
+            {
+                auto& reg = registry();
+                std::scoped_lock lock(reg.lock);
+                trace = reg.traces.emplace_back(
+                        std::make_unique<thread_trace_t>(reg.trace_capacity, reg.traces.size(), blt::logging::get_thread_name())).get();
+            }
+            trace->record(id, begin, end);
+        }
+        
+        std::uint8_t profile_record_flags(const std::string& profile_name)
+        {
+            auto& reg = registry();
+            std::scoped_lock lock(reg.lock);
+            auto it = reg.profile_flags.find(profile_name);
+            return it == reg.profile_flags.end() ? 0 : it->second;
+        }
+        
+        void write_json_string(std::ostream& stream, std::string_view str)
+        {
+            stream << '"';
+            for (const char c : str)
+            {
+                switch (c)
+                {
+                    case '"':
+                        stream << "\\\"";
+                        break;
+                    case '\\':
+                        stream << "\\\\";
+                        break;
+                    case '\n':
+                        stream << "\\n";
+                        break;
+                    case '\t':
+                        stream << "\\t";
+                        break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20)
+                        {
+                            constexpr char hex[] = "0123456789abcdef";
+                            stream << "\\u00" << hex[(c >> 4) & 0xF] << hex[c & 0xF];
+                        } else
+                            stream << c;
+                }
+            }
+            stream << '"';
+        }
+        
+        // trace timestamps are in microseconds, written exactly instead of going through a double
+        void write_micros(std::ostream& stream, pf_time_t nanoseconds)
+        {
+            const auto fraction = std::to_string(nanoseconds % 1000);
+            stream << nanoseconds / 1000 << '.' << std::string(3 - fraction.size(), '0') << fraction;
+        }
+        
+        void write_trace(std::ostream& stream, const std::string& process_name, const hashset_t<_internal::interval_id_t>& ids)
+        {
+            std::vector<std::pair<const thread_trace_t*, std::vector<trace_event_t>>> threads;
+            std::vector<std::string> names;
+            {
+                auto& reg = registry();
+                std::scoped_lock lock(reg.lock);
+                for (const auto& trace : reg.traces)
+                {
+                    std::vector<trace_event_t> events;
+                    trace->snapshot(events);
+                    events.erase(std::remove_if(events.begin(), events.end(), [&ids](const trace_event_t& event) {
+                        return ids.find(event.id) == ids.end();
+                    }), events.end());
+                    if (!events.empty())
+                        threads.emplace_back(trace.get(), std::move(events));
+                }
+                for (const auto& interval : reg.intervals)
+                    names.push_back(interval.interval_name);
+            }
+            
+            // relative to the first event so the numbers stay readable
+            pf_time_t origin = std::numeric_limits<pf_time_t>::max();
+            for (const auto& [trace, events] : threads)
+                for (const auto& event : events)
+                    origin = std::min(origin, event.begin);
+            
+            stream << R"({"displayTimeUnit":"ns","traceEvents":[)";
+            stream << R"({"name":"process_name","ph":"M","pid":0,"tid":0,"args":{"name":)";
+            write_json_string(stream, process_name);
+            stream << "}}";
+            for (const auto& [trace, events] : threads)
+            {
+                stream << ",\n" << R"({"name":"thread_name","ph":"M","pid":0,"tid":)" << trace->thread_index << R"(,"args":{"name":)";
+                write_json_string(stream, trace->thread_name.empty() ? "thread " + std::to_string(trace->thread_index) : trace->thread_name);
+                stream << "}}";
+                for (const auto& event : events)
+                {
+                    stream << ",\n" << R"({"name":)";
+                    write_json_string(stream, names[event.id]);
+                    stream << R"(,"ph":"X","pid":0,"tid":)" << trace->thread_index << R"(,"ts":)";
+                    write_micros(stream, event.begin - origin);
+                    stream << R"(,"dur":)";
+                    write_micros(stream, std::max<pf_time_t>(event.end - event.begin, 0));
+                    stream << "}";
+                }
+            }
+            stream << "]}\n";
+        }
+        
+        // scope trees of all threads merged by path, only keeping the intervals being written
+        struct merged_scope_t
+        {
+            _internal::interval_id_t id = 0;
+            std::string name;
+            pf_time_t wall = 0;
+            pf_time_t thread = 0;
+            pf_cycle_t cycles = 0;
+            std::uint64_t count = 0;
+            // inclusive times of the children
+            pf_time_t child_wall = 0;
+            pf_time_t child_thread = 0;
+            pf_cycle_t child_cycles = 0;
+            std::vector<std::size_t> children;
+            
+            // the totals are read while threads keep ending scopes, so children can briefly add up to more than their parent
+            [[nodiscard]] pf_time_t exclusive_wall() const
+            {
+                return std::max<pf_time_t>(wall - child_wall, 0);
+            }
+            
+            [[nodiscard]] pf_time_t exclusive_thread() const
+            {
+                return std::max<pf_time_t>(thread - child_thread, 0);
+            }
+            
+            [[nodiscard]] pf_cycle_t exclusive_cycles() const
+            {
+                return cycles > child_cycles ? cycles - child_cycles : 0;
+            }
+        };
+        
+        // index 0 is the root
+        using scope_tree_t = std::vector<merged_scope_t>;
+        
+        scope_tree_t merge_scopes(const hashset_t<_internal::interval_id_t>& ids)
+        {
+            scope_tree_t tree(1);
+            hashmap_t<std::uint64_t, std::size_t> merged_children;
+            auto& reg = registry();
+            std::scoped_lock lock(reg.lock);
+            for (const auto& scopes : reg.scopes)
+            {
+                // (node, merged node of its nearest written ancestor). Nodes of other intervals are skipped, their children are merged into
+                // that ancestor instead, so their time stays in its exclusive time
+                std::vector<std::pair<std::uint32_t, std::size_t>> pending;
+                const thread_scopes_t& tree_of_thread = *scopes;
+                for (auto child = tree_of_thread.node(0).first_child.load(std::memory_order_acquire); child != scope_node_t::NONE;
+                     child = tree_of_thread.node(child).next_sibling.load(std::memory_order_relaxed))
+                    pending.emplace_back(child, 0);
+                while (!pending.empty())
+                {
+                    const auto [index, parent] = pending.back();
+                    pending.pop_back();
+                    const auto& node = tree_of_thread.node(index);
+                    auto target = parent;
+                    if (ids.find(node.id) != ids.end())
+                    {
+                        const auto key = (static_cast<std::uint64_t>(parent) << 32) | node.id;
+                        auto it = merged_children.find(key);
+                        if (it == merged_children.end())
+                        {
+                            it = merged_children.insert({key, tree.size()}).first;
+                            tree[parent].children.push_back(tree.size());
+                            auto& merged = tree.emplace_back();
+                            merged.id = node.id;
+                            merged.name = reg.intervals[node.id].interval_name;
+                        }
+                        target = it->second;
+                        const auto wall = node.wall.load(std::memory_order_relaxed);
+                        const auto thread = node.thread.load(std::memory_order_relaxed);
+                        const auto cycles = node.cycles.load(std::memory_order_relaxed);
+                        auto& merged = tree[target];
+                        merged.wall += wall;
+                        merged.thread += thread;
+                        merged.cycles += cycles;
+                        merged.count += node.count.load(std::memory_order_relaxed);
+                        auto& merged_parent = tree[parent];
+                        merged_parent.child_wall += wall;
+                        merged_parent.child_thread += thread;
+                        merged_parent.child_cycles += cycles;
+                    }
+                    for (auto child = node.first_child.load(std::memory_order_acquire); child != scope_node_t::NONE;
+                         child = tree_of_thread.node(child).next_sibling.load(std::memory_order_relaxed))
+                        pending.emplace_back(child, target);
+                }
+            }
+            // heaviest first, the order threads and children were seen in means nothing
+            for (auto& merged : tree)
+                std::sort(merged.children.begin(), merged.children.end(), [&tree](std::size_t a, std::size_t b) {
+                    return tree[a].wall > tree[b].wall;
+                });
+            return tree;
+        }
+        
+        std::pair<std::string, double> scope_unit(pf_time_t largest)
+        {
+            if (largest > 1e9)
+                return {"s", 1e9};
+            if (largest > 1e6)
+                return {"ms", 1e6};
+            return {"ns", 1};
+        }
+        
+        void write_scopes(std::ostream& stream, const std::string& name, const scope_tree_t& tree, std::uint32_t flags)
+        {
+            const bool printCycles = flags & PRINT_CYCLES;
+            const bool printThread = flags & PRINT_THREAD;
+            const bool printWall = flags & PRINT_WALL;
+            
+            pf_time_t largest_wall = 0;
+            pf_time_t largest_thread = 0;
+            for (const auto child : tree.front().children)
+            {
+                largest_wall = std::max(largest_wall, tree[child].wall);
+                largest_thread = std::max(largest_thread, tree[child].thread);
+            }
+            const auto [wall_unit, wall_divide] = scope_unit(largest_wall);
+            const auto [thread_unit, thread_divide] = scope_unit(largest_thread);
+            
+            string::TableFormatter formatter{name};
+            formatter.addColumn("Interval");
+            formatter.addColumn("Count");
+            if (printWall)
+            {
+                formatter.addColumn("Wall Incl (" + wall_unit + ")");
+                formatter.addColumn("Wall Excl (" + wall_unit + ")");
+            }
+            if (printThread)
+            {
+                formatter.addColumn("CPU Incl (" + thread_unit + ")");
+                formatter.addColumn("CPU Excl (" + thread_unit + ")");
+            }
+            if (printCycles)
+            {
+                formatter.addColumn("Cycles Incl");
+                formatter.addColumn("Cycles Excl");
+            }
+            
+            // depth first, children indented under their parent
+            std::vector<std::pair<std::size_t, std::size_t>> pending;
+            for (auto it = tree.front().children.rbegin(); it != tree.front().children.rend(); ++it)
+                pending.emplace_back(*it, 0);
+            while (!pending.empty())
+            {
+                const auto [index, depth] = pending.back();
+                pending.pop_back();
+                const auto& scope = tree[index];
+                
+                blt::string::TableRow row;
+                row.rowValues.push_back(std::string(depth * 2, '.') + scope.name);
+                row.rowValues.push_back(std::to_string(scope.count));
+                if (printWall)
+                {
+                    row.rowValues.push_back(std::to_string(static_cast<double>(scope.wall) / wall_divide));
+                    row.rowValues.push_back(std::to_string(static_cast<double>(scope.exclusive_wall()) / wall_divide));
+                }
+                if (printThread)
+                {
+                    row.rowValues.push_back(std::to_string(static_cast<double>(scope.thread) / thread_divide));
+                    row.rowValues.push_back(std::to_string(static_cast<double>(scope.exclusive_thread()) / thread_divide));
+                }
+                if (printCycles)
+                {
+                    row.rowValues.push_back(blt::string::withGrouping(scope.cycles));
+                    row.rowValues.push_back(blt::string::withGrouping(scope.exclusive_cycles()));
+                }
+                formatter.addRow(row);
+                
+                for (auto it = scope.children.rbegin(); it != scope.children.rend(); ++it)
+                    pending.emplace_back(*it, depth + 1);
+            }
+            
+            for (const auto& line : formatter.createTable(true, true))
+                stream << line << "\n";
+        }
+        
+        void write_collapsed_stacks(std::ostream& stream, const scope_tree_t& tree, sort_by metric)
+        {
+            // ';' separates frames and the weight follows the last space, a name must not break either
+            const auto frame_name = [](std::string name) {
+                std::replace(name.begin(), name.end(), ';', ':');
+                std::replace(name.begin(), name.end(), '\n', ' ');
+                return name;
+            };
+            std::vector<std::pair<std::size_t, std::string>> pending;
+            for (const auto child : tree.front().children)
+                pending.emplace_back(child, frame_name(tree[child].name));
+            while (!pending.empty())
+            {
+                auto [index, path] = std::move(pending.back());
+                pending.pop_back();
+                const auto& scope = tree[index];
+                std::uint64_t weight = 0;
+                switch (metric)
+                {
+                    case sort_by::CYCLES:
+                        weight = scope.exclusive_cycles();
+                        break;
+                    case sort_by::WALL:
+                        weight = static_cast<std::uint64_t>(scope.exclusive_wall());
+                        break;
+                    case sort_by::THREAD:
+                        weight = static_cast<std::uint64_t>(scope.exclusive_thread());
+                        break;
+                }
+                if (weight > 0)
+                    stream << path << ' ' << weight << '\n';
+                for (const auto child : scope.children)
+                    pending.emplace_back(child, path + ';' + frame_name(tree[child].name));
+            }
+        }
+        
+        /**
+         * Sums the slots of every thread for the intervals of a profile into new intervals, adding them to the profile
+         * @return number of intervals added
+         */
+        std::size_t merge_intervals(profile_t& profile, const std::string& profile_name)
+        {
+            auto& reg = registry();
+            std::scoped_lock lock(reg.lock);
+            auto it = reg.ids.find(profile_name);
+            if (it == reg.ids.end())
+                return 0;
+            std::size_t added = 0;
+            for (const auto& [interval_name, id] : it->second)
+            {
+                auto& interned = reg.intervals[id];
+                pf_time_t wall = 0;
+                pf_cycle_t cycles = 0;
+                std::uint64_t count = 0;
+                profiling::perf_values_t counters;
+                std::uint32_t counter_mask = 0;
+                // only intervals recording percentiles have buckets, the others go without a histogram
+                std::unique_ptr<latency_histogram_t> histogram;
+                for (const auto& thread : reg.threads)
+                {
+                    if (const auto* slot = thread->find(id))
+                    {
+                        wall += slot->wall_total.load(std::memory_order_relaxed);
+                        cycles += slot->cycles_total.load(std::memory_order_relaxed);
+                        count += slot->count.load(std::memory_order_relaxed);
+                        if (const auto* buckets = slot->wall_histogram.load(std::memory_order_acquire))
+                        {
+                            if (!histogram)
+                                histogram = std::make_unique<latency_histogram_t>();
+                            for (std::size_t i = 0; i < latency_histogram_t::BUCKET_COUNT; i++)
+                            {
+                                const auto bucket_count = buckets[i].load(std::memory_order_relaxed);
+                                if (bucket_count != 0)
+                                    histogram->add(i, bucket_count);
+                            }
+                            histogram->set_max(std::max(histogram->max(), slot->wall_max.load(std::memory_order_relaxed)));
+                        }
+                        if (const auto* slot_counters = slot->counters.load(std::memory_order_acquire))
+                        {
+                            for (std::size_t i = 0; i < profiling::PERF_COUNTER_COUNT; i++)
+                                counters.values[i] += slot_counters->total[i].load(std::memory_order_relaxed);
+                            counter_mask |= slot_counters->mask.load(std::memory_order_relaxed);
+                        }
+                    }
+                }
+                // the totals and buckets are read one after the other while threads keep ending intervals, so they can disagree slightly
+                if (histogram)
+                {
+                    auto cumulative = std::make_unique<latency_histogram_t>(*histogram);
+                    if (interned.histogram_printed)
+                        histogram->subtract(*interned.histogram_printed);
+                    interned.histogram_printed = std::move(cumulative);
+                }
+                auto* interval = new interval_t();
+                interval->interval_name = interval_name;
+                interval->wall_total = wall - interned.wall_printed;
+                interval->cycles_total = cycles - interned.cycles_printed;
+                interval->count = count - interned.count_printed;
+                interval->counters_total = counters - interned.counters_printed;
+                interval->counter_mask = counter_mask;
+                interned.counters_printed = counters;
+                interned.wall_printed = wall;
+                interned.cycles_printed = cycles;
+                interned.count_printed = count;
+                interval->wall_histogram = std::move(histogram);
+                if (interval->count == 0)
+                {
+                    delete interval;
+                    continue;
+                }
+                
+                // a fast and a legacy interval of the same name are shown as one row
+                auto existing = std::find_if(profile.intervals.begin(), profile.intervals.end(), [&interval_name](const interval_t* i) {
+                    return i->interval_name == interval_name;
+                });
+                if (existing != profile.intervals.end())
+                {
+                    (*existing)->wall_total += interval->wall_total;
+                    (*existing)->cycles_total += interval->cycles_total;
+                    (*existing)->count += interval->count;
+                    (*existing)->counters_total += interval->counters_total;
+                    (*existing)->counter_mask |= interval->counter_mask;
+                    if ((*existing)->wall_histogram && interval->wall_histogram)
+                        (*existing)->wall_histogram->merge(*interval->wall_histogram);
+                    else if (interval->wall_histogram)
+                        (*existing)->wall_histogram = std::move(interval->wall_histogram);
+                    delete interval;
+                    continue;
+                }
+                profile.intervals.push_back(interval);
+                added++;
+            }
+            return added;
+        }
+        
+        /**
+         * Moves the legacy intervals of a profile and the merged fast intervals into the profile.
+         * Thread times are only shown when at least one interval recorded them.
+         */
+        void collect_profile(profile_t& profile, const std::string& profile_name, std::uint32_t& flags)
+        {
+            {
+                std::scoped_lock lock(profileLock);
+                auto it = profiles.find(profile_name);
+                if (it != profiles.end())
+                {
+                    for (const auto& i : it->second)
+                        profile.intervals.push_back(i.second);
+                    profiles.erase(it);
+                }
+            }
+            if (merge_intervals(profile, profile_name) == profile.intervals.size())
+                flags &= ~PRINT_THREAD;
+        }
+    }
+    
+    _internal::interval_id_t _internal::intern_interval(std::string_view profile_name, std::string_view interval_name)
+    {
+        auto& reg = registry();
+        std::scoped_lock lock(reg.lock);
+        auto& profile = reg.ids[std::string(profile_name)];
+        std::string name(interval_name);
+        auto it = profile.find(name);
+        if (it != profile.end())
+            return it->second;
+        if (reg.intervals.size() >= MAX_INTERVAL_IDS)
+            throw std::runtime_error("Cannot intern interval '" + name + "', the profiler is limited to " + std::to_string(MAX_INTERVAL_IDS) +
+                                     " intervals");
+        auto id = static_cast<interval_id_t>(reg.intervals.size());
+        if (auto flags = reg.profile_flags.find(std::string(profile_name)); flags != reg.profile_flags.end())
+            id_flags[id].store(flags->second, std::memory_order_relaxed);
+        reg.intervals.push_back(interned_interval_t{std::string(profile_name), name});
+        profile.insert({std::move(name), id});
+        return id;
+    }
+    
+    void _internal::start_interval(interval_id_t id)
+    {
+        auto& slot = local_intervals().slot(id);
+        slot.wall_start = blt::system::now_ns();
+        slot.cycles_start = blt::system::rdtsc();
+        const auto flags = id_flags[id].load(std::memory_order_relaxed);
+        if (flags & RECORD_SCOPES)
+            push_scope(id, slot.wall_start, blt::system::getCPUThreadTime(), slot.cycles_start);
+        if (flags & RECORD_COUNTERS)
+        {
+            auto* counters = slot.counters.load(std::memory_order_relaxed);
+            if (counters == nullptr)
+            {
+                counters = new counter_slot_t();
+                slot.counters.store(counters, std::memory_order_release);
+            }
+            counters->start = local_counters().read();
+        }
+    }
+    
+    void _internal::end_interval(interval_id_t id)
+    {
+        const auto flags = id_flags[id].load(std::memory_order_relaxed);
+        auto& slot = local_intervals().slot(id);
+        // counted first and only if the interval was started with counters, the flag may have been set in between
+        auto* counters = flags & RECORD_COUNTERS ? slot.counters.load(std::memory_order_relaxed) : nullptr;
+        if (counters != nullptr)
+        {
+            auto& group = local_counters();
+            const auto delta = group.read() - counters->start;
+            for (std::size_t i = 0; i < profiling::PERF_COUNTER_COUNT; i++)
+                add_relaxed(counters->total[i], delta.values[i]);
+            counters->mask.store(counters->mask.load(std::memory_order_relaxed) | group.mask(), std::memory_order_relaxed);
+        }
+        const auto cycles = blt::system::rdtsc();
+        const auto wall = blt::system::now_ns();
+        add_relaxed(slot.cycles_total, cycles - slot.cycles_start);
+        add_relaxed(slot.wall_total, wall - slot.wall_start);
+        add_relaxed(slot.count, std::uint64_t{1});
+        
+        if (flags & RECORD_PERCENTILES)
+        {
+            const auto duration = static_cast<std::uint64_t>(std::max<pf_time_t>(wall - slot.wall_start, 0));
+            auto* buckets = slot.wall_histogram.load(std::memory_order_relaxed);
+            if (buckets == nullptr)
+            {
+                buckets = new std::atomic<std::uint64_t>[latency_histogram_t::BUCKET_COUNT]();
+                slot.wall_histogram.store(buckets, std::memory_order_release);
+            }
+            add_relaxed(buckets[latency_histogram_t::bucket_of(duration)], std::uint64_t{1});
+            if (duration > slot.wall_max.load(std::memory_order_relaxed))
+                slot.wall_max.store(duration, std::memory_order_relaxed);
+        }
+        
+        if (flags & RECORD_EVENTS)
+            record_event(id, slot.wall_start, wall);
+        if (flags & RECORD_SCOPES)
+            pop_scope(id, wall, blt::system::getCPUThreadTime(), cycles);
+    }
+    
+    _internal::interval_overhead_t _internal::measure_interval_overhead(std::size_t iterations)
+    {
+        static const auto id = intern_interval("blt::profiler", "overhead");
+        iterations = std::max<std::size_t>(iterations, 1);
+        // warm up, so the slot is allocated and the clocks are in the cache
+        for (std::size_t i = 0; i < 1000; i++)
+        {
+            start_interval(id);
+            end_interval(id);
+        }
+        const auto wall_start = blt::system::now_ns();
+        const auto cycles_start = blt::system::rdtsc();
+        for (std::size_t i = 0; i < iterations; i++)
+        {
+            start_interval(id);
+            end_interval(id);
+        }
+        const auto cycles_end = blt::system::rdtsc();
+        const auto wall_end = blt::system::now_ns();
+        return {static_cast<double>(cycles_end - cycles_start) / static_cast<double>(iterations),
+                static_cast<double>(wall_end - wall_start) / static_cast<double>(iterations)};
+    }
+    
+    namespace
+    {
+        void enable_recording(profile_t& profiler, std::uint8_t flag)
+        {
+            profiler.record_flags |= flag;
+            for (auto* interval : profiler.intervals)
+            {
+                if (interval->interned_id < 0)
+                    interval->interned_id = _internal::intern_interval(profiler.name, interval->interval_name);
+                interval->record_flags |= flag;
+            }
+        }
+        
+        void enable_recording(const std::string& profile_name, std::uint8_t flag)
+        {
+            {
+                auto& reg = registry();
+                std::scoped_lock lock(reg.lock);
+                reg.profile_flags[profile_name] |= flag;
+                auto it = reg.ids.find(profile_name);
+                if (it != reg.ids.end())
+                    for (const auto& [name, id] : it->second)
+                        id_flags[id].fetch_or(flag, std::memory_order_relaxed);
+            }
+            std::scoped_lock lock(profileLock);
+            auto it = profiles.find(profile_name);
+            if (it == profiles.end())
+                return;
+            for (auto& [name, interval] : it->second)
+            {
+                if (interval->interned_id < 0)
+                    interval->interned_id = _internal::intern_interval(profile_name, name);
+                interval->record_flags |= flag;
+            }
+        }
+        
+        void set_trace_capacity(std::size_t events_per_thread)
+        {
+            auto& reg = registry();
+            std::scoped_lock lock(reg.lock);
+            reg.trace_capacity = std::max<std::size_t>(events_per_thread, 1);
+        }
+        
+        hashset_t<_internal::interval_id_t> ids_of(const profile_t& profiler, std::uint8_t flag)
+        {
+            hashset_t<_internal::interval_id_t> ids;
+            for (const auto* interval : profiler.intervals)
+                if (interval->record_flags & flag)
+                    ids.insert(static_cast<_internal::interval_id_t>(interval->interned_id));
+            return ids;
+        }
+        
+        hashset_t<_internal::interval_id_t> ids_of(const std::string& profile_name)
+        {
+            hashset_t<_internal::interval_id_t> ids;
+            auto& reg = registry();
+            std::scoped_lock lock(reg.lock);
+            auto it = reg.ids.find(profile_name);
+            if (it != reg.ids.end())
+                for (const auto& [name, id] : it->second)
+                    ids.insert(id);
+            return ids;
+        }
+    }
+    
+    void recordEvents(profile_t& profiler, std::size_t events_per_thread)
+    {
+        set_trace_capacity(events_per_thread);
+        enable_recording(profiler, RECORD_EVENTS);
+    }
+    
+    void writeTrace(std::ostream& stream, const profile_t& profiler)
+    {
+        write_trace(stream, profiler.name, ids_of(profiler, RECORD_EVENTS));
+    }
+    
+    void recordScopes(profile_t& profiler)
+    {
+        enable_recording(profiler, RECORD_SCOPES);
+    }
+    
+    void writeScopes(std::ostream& stream, const profile_t& profiler, std::uint32_t flags)
+    {
+        write_scopes(stream, profiler.name, merge_scopes(ids_of(profiler, RECORD_SCOPES)), flags);
+    }
+    
+    void writeCollapsedStacks(std::ostream& stream, const profile_t& profiler, sort_by metric)
+    {
+        write_collapsed_stacks(stream, merge_scopes(ids_of(profiler, RECORD_SCOPES)), metric);
+    }
+    
+    void recordCounters(profile_t& profiler)
+    {
+        enable_recording(profiler, RECORD_COUNTERS);
+    }
+    
+    void recordPercentiles(profile_t& profiler)
+    {
+        enable_recording(profiler, RECORD_PERCENTILES);
+    }
+    
+    void _internal::recordEvents(const std::string& profile_name, std::size_t events_per_thread)
+    {
+        set_trace_capacity(events_per_thread);
+        enable_recording(profile_name, RECORD_EVENTS);
+    }
+    
+    void _internal::writeTrace(std::ostream& stream, const std::string& profile_name)
+    {
+        write_trace(stream, profile_name, ids_of(profile_name));
+    }
+    
+    void _internal::recordScopes(const std::string& profile_name)
+    {
+        enable_recording(profile_name, RECORD_SCOPES);
+    }
+    
+    void _internal::recordCounters(const std::string& profile_name)
+    {
+        enable_recording(profile_name, RECORD_COUNTERS);
+    }
+    
+    void _internal::recordPercentiles(const std::string& profile_name)
+    {
+        enable_recording(profile_name, RECORD_PERCENTILES);
+    }
+    
+    void _internal::writeScopes(std::ostream& stream, const std::string& profile_name, std::uint32_t flags)
+    {
+        write_scopes(stream, profile_name, merge_scopes(ids_of(profile_name)), flags);
+    }
+    
+    void _internal::writeCollapsedStacks(std::ostream& stream, const std::string& profile_name, sort_by metric)
+    {
+        write_collapsed_stacks(stream, merge_scopes(ids_of(profile_name)), metric);
+    }
+    
     void _internal::writeProfile(std::ostream& stream, const std::string& profile_name, std::uint32_t flags, sort_by sort)
     {
-        if (profiles.find(profile_name) == profiles.end())
-            return;
-        auto& pref = profiles[profile_name];
         profile_t profile{profile_name};
-        for (const auto& i : pref)
-            profile.intervals.push_back(i.second);
+        collect_profile(profile, profile_name, flags);
+        if (profile.intervals.empty())
+            return;
         blt::writeProfile(stream, profile, flags, sort);
-        profiles.erase(profile_name);
     }
     
     void _internal::printProfile(const std::string& profile_name, std::uint32_t flags, sort_by sort, blt::logging::log_level_t log_level)
     {
-        if (profiles.find(profile_name) == profiles.end())
-            return;
-        auto& pref = profiles[profile_name];
         profile_t profile{profile_name};
-        for (const auto& i : pref)
-            profile.intervals.push_back(i.second);
+        collect_profile(profile, profile_name, flags);
+        if (profile.intervals.empty())
+            return;
         blt::printProfile(profile, flags, sort, log_level);
-        profiles.erase(profile_name);
     }
     
     interval_t::interval_t(pf_time_t wallStart, pf_time_t wallEnd, pf_time_t wallTotal, pf_time_t threadStart, pf_time_t threadEnd,
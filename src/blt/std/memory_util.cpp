@@ -0,0 +1,142 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <blt/std/memory_util.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	#define BLT_REVERSE_X86
+	#include <immintrin.h>
+#endif
+
+namespace blt::mem
+{
+	namespace
+	{
+		template <typename T>
+		void reverse_scalar(T* data, const std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				reverse(data[i]);
+		}
+
+#ifdef BLT_REVERSE_X86
+		// byte order within each 16 byte lane which reverses every element of Size bytes
+		template <std::size_t Size>
+		constexpr std::array<char, 16> shuffle_mask()
+		{
+			std::array<char, 16> mask{};
+			for (std::size_t i = 0; i < 16; ++i)
+				mask[i] = static_cast<char>(i / Size * Size + (Size - 1 - i % Size));
+			return mask;
+		}
+
+		template <std::size_t Size>
+		constexpr std::array<char, 16> SHUFFLE_MASK = shuffle_mask<Size>();
+
+		// the target attributes let these be compiled without -mavx2, they are only called once the CPU has been checked
+		template <typename T>
+		__attribute__((target("ssse3"))) void reverse_ssse3(T* data, const std::size_t count)
+		{
+			constexpr std::size_t per_vector = 16 / sizeof(T);
+			const auto mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(SHUFFLE_MASK<sizeof(T)>.data()));
+			std::size_t i = 0;
+			for (; i + per_vector <= count; i += per_vector)
+			{
+				auto* ptr = reinterpret_cast<__m128i*>(data + i);
+				_mm_storeu_si128(ptr, _mm_shuffle_epi8(_mm_loadu_si128(ptr), mask));
+			}
+			reverse_scalar(data + i, count - i);
+		}
+
+		template <typename T>
+		__attribute__((target("avx2"))) void reverse_avx2(T* data, const std::size_t count)
+		{
+			constexpr std::size_t per_vector = 32 / sizeof(T);
+			// vpshufb shuffles within each 128 bit lane, so the same mask goes in both halves
+			const auto lane = _mm_loadu_si128(reinterpret_cast<const __m128i*>(SHUFFLE_MASK<sizeof(T)>.data()));
+			const auto mask = _mm256_broadcastsi128_si256(lane);
+			std::size_t i = 0;
+			// two vectors per iteration to keep both load ports busy
+			for (; i + per_vector * 2 <= count; i += per_vector * 2)
+			{
+				auto* ptr = reinterpret_cast<__m256i*>(data + i);
+				const auto a = _mm256_loadu_si256(ptr);
+				const auto b = _mm256_loadu_si256(ptr + 1);
+				_mm256_storeu_si256(ptr, _mm256_shuffle_epi8(a, mask));
+				_mm256_storeu_si256(ptr + 1, _mm256_shuffle_epi8(b, mask));
+			}
+			for (; i + per_vector <= count; i += per_vector)
+			{
+				auto* ptr = reinterpret_cast<__m256i*>(data + i);
+				_mm256_storeu_si256(ptr, _mm256_shuffle_epi8(_mm256_loadu_si256(ptr), mask));
+			}
+			reverse_scalar(data + i, count - i);
+		}
+
+		enum class reverse_isa_t
+		{
+			SCALAR, SSSE3, AVX2
+		};
+
+		reverse_isa_t detect_isa()
+		{
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+				return reverse_isa_t::AVX2;
+			if (__builtin_cpu_supports("ssse3"))
+				return reverse_isa_t::SSSE3;
+			return reverse_isa_t::SCALAR;
+		}
+
+		const reverse_isa_t reverse_isa = detect_isa();
+#endif
+
+		template <typename T>
+		void reverse_dispatch(T* data, const std::size_t count)
+		{
+#ifdef BLT_REVERSE_X86
+			switch (reverse_isa)
+			{
+				case reverse_isa_t::AVX2:
+					reverse_avx2(data, count);
+					return;
+				case reverse_isa_t::SSSE3:
+					reverse_ssse3(data, count);
+					return;
+				default:
+					break;
+			}
+#endif
+			reverse_scalar(data, count);
+		}
+	}
+
+	void reverse_array(std::uint16_t* data, const std::size_t count)
+	{
+		reverse_dispatch(data, count);
+	}
+
+	void reverse_array(std::uint32_t* data, const std::size_t count)
+	{
+		reverse_dispatch(data, count);
+	}
+
+	void reverse_array(std::uint64_t* data, const std::size_t count)
+	{
+		reverse_dispatch(data, count);
+	}
+}
@@ -0,0 +1,334 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <blt/std/system.h>
+#include <blt/std/tsc.h>
+
+#if (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)) && !defined(__EMSCRIPTEN__)
+	#define BLT_HAS_TSC
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+	#else
+		#include <cpuid.h>
+	#endif
+#endif
+
+namespace blt::system
+{
+	namespace
+	{
+		// re-anchoring windows start at the calibration time and double up to this
+		constexpr i64 MAX_RESYNC_NS = 1000000000;
+		// ns per tick are kept as fixed point with this many fractional bits
+		constexpr u32 MULT_SHIFT = 32;
+#if defined(__SIZEOF_INT128__)
+		__extension__ using u128 = unsigned __int128;
+#endif
+
+		i64 monotonic_clock_ns()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		i64 unix_clock_ns()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		bool cpuid_edx_bit(const u32 leaf, const u32 bit)
+		{
+#if defined(BLT_HAS_TSC) && defined(_MSC_VER)
+			int registers[4];
+			__cpuid(registers, static_cast<int>(leaf & 0x80000000));
+			if (static_cast<u32>(registers[0]) < leaf)
+				return false;
+			__cpuid(registers, static_cast<int>(leaf));
+			return static_cast<u32>(registers[3]) & (1u << bit);
+#elif defined(BLT_HAS_TSC)
+			unsigned int eax, ebx, ecx, edx;
+			// checks the highest supported leaf, so unsupported leaves read as unset
+			if (!__get_cpuid(leaf, &eax, &ebx, &ecx, &edx))
+				return false;
+			return edx & (1u << bit);
+#else
+			(void) leaf;
+			(void) bit;
+			return false;
+#endif
+		}
+
+		// a TSC value and the clocks read as close to it as possible
+		struct clock_pair_t
+		{
+			u64 tsc;
+			i64 monotonic;
+			i64 realtime;
+		};
+
+		clock_pair_t read_clock_pair()
+		{
+			// the clocks are read between two rdtsc, the tightest of a few tries pins them to the midpoint best
+			clock_pair_t best{};
+			u64 best_width = std::numeric_limits<u64>::max();
+			for (int i = 0; i < 5; i++)
+			{
+				const auto before = rdtsc();
+				const auto monotonic = monotonic_clock_ns();
+				const auto realtime = unix_clock_ns();
+				const auto after = rdtsc();
+				if (after >= before && after - before < best_width)
+				{
+					best_width = after - before;
+					best = {before + (after - before) / 2, monotonic, realtime};
+				}
+			}
+			return best;
+		}
+
+		// what the conversion needs, replaced as a whole on every re-anchor
+		struct anchor_t
+		{
+			u64 tsc;
+			// the TSC value after which the next reader re-anchors
+			u64 limit;
+			u64 mult;
+			i64 monotonic;
+			i64 realtime;
+		};
+
+		i64 extrapolate(const anchor_t& anchor, const u64 tsc, const i64 base)
+		{
+			// another core may read a TSC value from just before the anchor, those clamp to it
+			const auto ticks = tsc > anchor.tsc ? tsc - anchor.tsc : 0;
+#if defined(__SIZEOF_INT128__)
+			return base + static_cast<i64>((static_cast<u128>(ticks) * anchor.mult) >> MULT_SHIFT);
+#else
+			return base + static_cast<i64>(static_cast<long double>(ticks) * static_cast<long double>(anchor.mult) /
+				static_cast<long double>(1ull << MULT_SHIFT));
+#endif
+		}
+
+		class tsc_state_t
+		{
+		public:
+			tsc_state_t()
+			{
+				m_calibration.invariant = cpuid_edx_bit(0x80000007, 8);
+				m_calibration.has_rdtscp = cpuid_edx_bit(0x80000001, 27);
+				calibrate(DEFAULT_TSC_CALIBRATION);
+			}
+
+			tsc_calibration_t calibration()
+			{
+				std::scoped_lock guard(m_lock);
+				return m_calibration;
+			}
+
+			tsc_calibration_t recalibrate(const std::chrono::nanoseconds duration)
+			{
+				std::scoped_lock guard(m_lock);
+				calibrate(duration);
+				return m_calibration;
+			}
+
+			[[nodiscard]] bool used() const
+			{
+				return m_used.load(std::memory_order_relaxed);
+			}
+
+			i64 now(const bool realtime)
+			{
+				auto anchor = load();
+				const auto tsc = rdtsc();
+				if (tsc >= anchor.limit)
+					anchor = resync(tsc, anchor);
+				return extrapolate(anchor, tsc, realtime ? anchor.realtime : anchor.monotonic);
+			}
+
+			double frequency() const
+			{
+				return m_frequency.load(std::memory_order_relaxed);
+			}
+
+		private:
+			// m_lock has to be held
+			void calibrate(const std::chrono::nanoseconds duration)
+			{
+#if defined(BLT_HAS_TSC)
+				const auto start = read_clock_pair();
+				// spinning rather than sleeping keeps the core awake, a sleeping one may take a while to read the end pair
+				const auto wait_until = start.monotonic + std::max<i64>(duration.count(), 1);
+				while (monotonic_clock_ns() < wait_until)
+				{}
+				const auto end = read_clock_pair();
+				const auto frequency = measure_frequency(start, end);
+				m_calibration.frequency_hz = frequency;
+				m_frequency.store(frequency, std::memory_order_relaxed);
+				// a TSC which changes rate or stops in sleep states cannot be converted with one frequency
+				m_calibration.used = m_calibration.invariant && frequency > 0;
+				m_window = std::min(std::max<i64>(end.monotonic - start.monotonic, 1), MAX_RESYNC_NS);
+				m_raw = end;
+				if (m_calibration.used)
+				{
+					auto monotonic = end.monotonic;
+					// recalibrating must not step now_ns() back either
+					if (m_sequence.load(std::memory_order_relaxed) != 0)
+					{
+						const auto anchor = load();
+						monotonic = std::max(monotonic, extrapolate(anchor, end.tsc, anchor.monotonic));
+					}
+					store({end.tsc, window_limit(end.tsc, frequency), to_mult(frequency), monotonic, end.realtime});
+				}
+#else
+				(void) duration;
+				m_calibration.used = false;
+#endif
+				m_used.store(m_calibration.used, std::memory_order_relaxed);
+			}
+
+			anchor_t resync(const u64 tsc, const anchor_t& current)
+			{
+				// one thread re-anchors, the others keep extrapolating the current anchor for the few ns it takes
+				std::unique_lock guard(m_lock, std::try_to_lock);
+				if (!guard.owns_lock())
+					return current;
+				auto anchor = load();
+				if (tsc < anchor.limit)
+					return anchor;
+				const auto pair = read_clock_pair();
+				auto frequency = measure_frequency(m_raw, pair);
+				// a jump this large means the clocks were disturbed (suspend, migration), not that the estimate was off
+				if (frequency <= 0 || std::abs(frequency - m_calibration.frequency_hz) > m_calibration.frequency_hz * 0.01)
+					frequency = m_calibration.frequency_hz;
+				m_calibration.frequency_hz = frequency;
+				m_frequency.store(frequency, std::memory_order_relaxed);
+				m_window = std::min(m_window * 2, MAX_RESYNC_NS);
+				m_raw = pair;
+				// never behind what the old anchor already handed out, so now_ns() stays monotonic
+				const auto monotonic = std::max(pair.monotonic, extrapolate(anchor, pair.tsc, anchor.monotonic));
+				anchor = {pair.tsc, window_limit(pair.tsc, frequency), to_mult(frequency), monotonic, pair.realtime};
+				store(anchor);
+				return anchor;
+			}
+
+			static double measure_frequency(const clock_pair_t& start, const clock_pair_t& end)
+			{
+				if (end.monotonic <= start.monotonic || end.tsc <= start.tsc)
+					return 0;
+				return static_cast<double>(end.tsc - start.tsc) * 1e9 / static_cast<double>(end.monotonic - start.monotonic);
+			}
+
+			static u64 to_mult(const double frequency)
+			{
+				return static_cast<u64>(std::llround(1e9 / frequency * static_cast<double>(1ull << MULT_SHIFT)));
+			}
+
+			[[nodiscard]] u64 window_limit(const u64 tsc, const double frequency) const
+			{
+				return tsc + static_cast<u64>(static_cast<double>(m_window) * frequency / 1e9);
+			}
+
+			// a seqlock, an odd sequence means a store is in progress
+			anchor_t load() const
+			{
+				anchor_t anchor{};
+				u32 before, after;
+				do
+				{
+					before = m_sequence.load(std::memory_order_acquire);
+					anchor.tsc = m_tsc.load(std::memory_order_relaxed);
+					anchor.limit = m_limit.load(std::memory_order_relaxed);
+					anchor.mult = m_mult.load(std::memory_order_relaxed);
+					anchor.monotonic = m_monotonic.load(std::memory_order_relaxed);
+					anchor.realtime = m_realtime.load(std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_acquire);
+					after = m_sequence.load(std::memory_order_relaxed);
+				} while (before != after || (before & 1));
+				return anchor;
+			}
+
+			// m_lock has to be held
+			void store(const anchor_t& anchor)
+			{
+				const auto sequence = m_sequence.load(std::memory_order_relaxed);
+				m_sequence.store(sequence + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				m_tsc.store(anchor.tsc, std::memory_order_relaxed);
+				m_limit.store(anchor.limit, std::memory_order_relaxed);
+				m_mult.store(anchor.mult, std::memory_order_relaxed);
+				m_monotonic.store(anchor.monotonic, std::memory_order_relaxed);
+				m_realtime.store(anchor.realtime, std::memory_order_relaxed);
+				m_sequence.store(sequence + 2, std::memory_order_release);
+			}
+
+			std::atomic<u32> m_sequence = 0;
+			std::atomic<u64> m_tsc = 0;
+			std::atomic<u64> m_limit = 0;
+			std::atomic<u64> m_mult = 0;
+			std::atomic<i64> m_monotonic = 0;
+			std::atomic<i64> m_realtime = 0;
+			std::atomic<double> m_frequency = 0;
+			std::atomic<bool> m_used = false;
+
+			// everything below is guarded by m_lock
+			std::mutex m_lock;
+			tsc_calibration_t m_calibration;
+			// the clocks as read at the last anchor, the next frequency is measured from here
+			clock_pair_t m_raw{};
+			i64 m_window = 0;
+		};
+
+		tsc_state_t& state()
+		{
+			static tsc_state_t tsc_state;
+			return tsc_state;
+		}
+	}
+
+	tsc_calibration_t tsc_calibration()
+	{
+		return state().calibration();
+	}
+
+	tsc_calibration_t recalibrate_tsc(const std::chrono::nanoseconds duration)
+	{
+		return state().recalibrate(duration);
+	}
+
+	i64 now_ns()
+	{
+		auto& tsc = state();
+		return tsc.used() ? tsc.now(false) : monotonic_clock_ns();
+	}
+
+	i64 unix_now_ns()
+	{
+		auto& tsc = state();
+		return tsc.used() ? tsc.now(true) : unix_clock_ns();
+	}
+
+	double tsc_to_ns(const u64 ticks)
+	{
+		const auto frequency = state().frequency();
+		return frequency > 0 ? static_cast<double>(ticks) * 1e9 / frequency : 0;
+	}
+}
@@ -0,0 +1,366 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <blt/fs/async_file_writer.h>
+#include <blt/fs/file_writers.h>
+#include <blt/fs/mmap_reader.h>
+#include <blt/fs/nbt.h>
+#include <blt/fs/threaded_writers.h>
+#include <blt/logging/logging.h>
+#include <blt/std/assert.h>
+
+class string_writer_t final : public blt::fs::writer_t
+{
+public:
+	blt::i64 write(const char* buffer, const size_t bytes) override
+	{
+		data.append(buffer, bytes);
+		++writes;
+		return static_cast<blt::i64>(bytes);
+	}
+
+	void flush() override
+	{
+		++flushes;
+	}
+
+	std::string data;
+	size_t writes = 0;
+	size_t flushes = 0;
+};
+
+void write_file(const char* path, const std::string& contents)
+{
+	std::ofstream file{path, std::ios::binary | std::ios::trunc};
+	file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+std::string read_file(const std::string& path)
+{
+	std::ifstream file{path, std::ios::binary};
+	std::stringstream stream;
+	stream << file.rdbuf();
+	return stream.str();
+}
+
+std::string make_contents(const size_t size)
+{
+	std::string contents;
+	contents.reserve(size);
+	for (size_t i = 0; i < size; i++)
+		contents += static_cast<char>('a' + i % 26);
+	return contents;
+}
+
+void test_mmap_reader()
+{
+	const auto path = "fs_mmap.bin";
+	// larger than a page and than the read ahead window, so advising crosses windows
+	const auto contents = make_contents(3 * 4096 + 17);
+	write_file(path, contents);
+	{
+		blt::fs::mmap_reader_t reader{path, 4096};
+		BLT_ASSERT(reader.supports_views());
+		BLT_ASSERT(reader.size() == contents.size());
+		BLT_ASSERT(reader.data() == contents);
+
+		const auto first = *reader.read_view(10);
+		BLT_ASSERT(first == contents.substr(0, 10));
+		char buffer[20];
+		BLT_ASSERT(reader.read(buffer, sizeof(buffer)) == static_cast<blt::i64>(sizeof(buffer)));
+		BLT_ASSERT(std::string(buffer, sizeof(buffer)) == contents.substr(10, 20));
+		BLT_ASSERT(reader.position() == 30);
+		// views stay valid while later reads go on
+		BLT_ASSERT(first == contents.substr(0, 10));
+
+		const auto rest = *reader.read_view(contents.size());
+		BLT_ASSERT(rest.size() == contents.size() - 30);
+		BLT_ASSERT(rest == contents.substr(30));
+		BLT_ASSERT(reader.remaining() == 0);
+
+		// at the end reads come back short and views empty
+		BLT_ASSERT(reader.read(buffer, sizeof(buffer)) == 0);
+		BLT_ASSERT(reader.read_view(5)->empty());
+
+		reader.seek(contents.size() - 4);
+		BLT_ASSERT(reader.read(buffer, sizeof(buffer)) == 4);
+		BLT_ASSERT(std::string(buffer, 4) == contents.substr(contents.size() - 4));
+		reader.seek(contents.size() * 2);
+		BLT_ASSERT(reader.position() == contents.size());
+		reader.seek(0);
+		BLT_ASSERT(*reader.read_view(3) == contents.substr(0, 3));
+
+		auto moved = std::move(reader);
+		BLT_ASSERT(moved.position() == 3);
+		BLT_ASSERT(*moved.read_view(3) == contents.substr(3, 3));
+		BLT_ASSERT(reader.size() == 0 && reader.read_view(1)->empty());
+	}
+
+	write_file(path, "");
+	{
+		blt::fs::mmap_reader_t reader{path};
+		char buffer[4];
+		BLT_ASSERT(reader.size() == 0);
+		BLT_ASSERT(reader.data().empty());
+		BLT_ASSERT(reader.read(buffer, sizeof(buffer)) == 0);
+		BLT_ASSERT(reader.read_view(4)->empty());
+	}
+	std::remove(path);
+
+	bool threw = false;
+	try
+	{
+		blt::fs::mmap_reader_t reader{"fs_does_not_exist.bin"};
+	} catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	BLT_ASSERT(threw);
+	BLT_INFO("mmap reader passed");
+}
+
+void test_truncated_string()
+{
+	const auto path = "fs_truncated.bin";
+	// claims 10 bytes of string but only 3 follow
+	write_file(path, std::string("\0\x0a" "abc", 5));
+	bool threw = false;
+	try
+	{
+		blt::fs::mmap_reader_t reader{path};
+		(void) blt::nbt::readUTF8String(reader);
+	} catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	BLT_ASSERT(threw);
+	std::remove(path);
+	BLT_INFO("Truncated string passed");
+}
+
+void test_async_writer_backend(const blt::fs::async_backend_type_t backend)
+{
+	const auto path = "fs_async.bin";
+	std::remove(path);
+	const auto contents = make_contents(300 * 1024 + 123);
+	{
+		// a single page per buffer, so most writes fill a buffer while the other one is still in flight
+		blt::fs::async_file_writer_t writer{path, 4096, backend};
+		size_t offset = 0;
+		for (size_t chunk = 1; offset < contents.size(); chunk = chunk * 7 % 9973 + 1)
+		{
+			const auto amount = std::min(chunk, contents.size() - offset);
+			BLT_ASSERT(writer.write(contents.data() + offset, amount) == static_cast<blt::i64>(amount));
+			offset += amount;
+		}
+		const auto ticket = writer.fence();
+		BLT_ASSERT(ticket == contents.size());
+		writer.wait(ticket);
+		BLT_ASSERT(writer.is_complete(ticket));
+		BLT_ASSERT(writer.error() == 0);
+		BLT_ASSERT(read_file(path) == contents);
+
+		// fenced bytes go out without anyone waiting on them, polling is enough to see them complete
+		writer.write("tail", 4);
+		const auto tail = writer.fence();
+		BLT_ASSERT(tail == contents.size() + 4);
+		while (!writer.is_complete(tail))
+		{}
+		BLT_ASSERT(read_file(path) == contents + "tail");
+
+		// unfenced bytes stay buffered until flushed
+		writer.write("more", 4);
+		BLT_ASSERT(!writer.is_complete(tail + 4));
+		writer.flush();
+		BLT_ASSERT(writer.is_complete(tail + 4));
+		writer.write("end", 3);
+	}
+	// the destructor writes out what is left
+	BLT_ASSERT(read_file(path) == contents + "tailmoreend");
+
+	{
+		// append mode keeps what is in the file
+		blt::fs::async_file_writer_t writer{path, 4096, backend};
+		writer.write("!", 1);
+	}
+	BLT_ASSERT(read_file(path) == contents + "tailmoreend!");
+	std::remove(path);
+
+	{
+		// every write to /dev/full fails with ENOSPC, the error is kept instead of thrown
+		blt::fs::async_file_writer_t writer{"/dev/full", 4096, backend};
+		writer.write(contents.data(), 10000);
+		writer.flush();
+		BLT_ASSERT(writer.error() == ENOSPC);
+		BLT_ASSERT(writer.is_complete(10000));
+		// a new file starts without the error
+		writer.newfile(path);
+		BLT_ASSERT(writer.error() == 0);
+		writer.write("ok", 2);
+		writer.flush();
+		BLT_ASSERT(writer.error() == 0);
+		BLT_ASSERT(read_file(path) == "ok");
+	}
+	std::remove(path);
+}
+
+void test_async_writer()
+{
+	test_async_writer_backend(blt::fs::async_backend_type_t::THREAD_POOL);
+	bool io_uring = true;
+	try
+	{
+		const blt::fs::async_file_writer_t writer{4096, blt::fs::async_backend_type_t::IO_URING};
+		BLT_ASSERT(writer.uses_io_uring());
+	} catch (const std::runtime_error&)
+	{
+		// the kernel (or a seccomp filter) does not allow io_uring, AUTO has to fall back
+		io_uring = false;
+		const blt::fs::async_file_writer_t writer{};
+		BLT_ASSERT(!writer.uses_io_uring());
+	}
+	if (io_uring)
+		test_async_writer_backend(blt::fs::async_backend_type_t::IO_URING);
+
+	// rotating_writer names its files after the current date, newfile() moves to the next one
+	const auto now = blt::fs::rotating_writer::get_current_time();
+	const auto dated = std::to_string(now.year) + "-" + std::to_string(now.month) + "-" + std::to_string(now.day) + ".txt";
+	const auto rotated = "fs_rotated.txt";
+	std::remove(dated.c_str());
+	std::remove(rotated);
+	{
+		blt::fs::async_file_writer_t writer{4096, blt::fs::async_backend_type_t::THREAD_POOL};
+		blt::fs::rotating_writer rotating{writer, blt::fs::time_t{0, 0, 1}};
+		rotating.write("today", 5);
+		rotating.newfile(rotated);
+		// switching files writes out everything meant for the previous one
+		BLT_ASSERT(read_file(dated) == "today");
+		rotating.write("rotated", 7);
+		rotating.flush();
+		BLT_ASSERT(read_file(rotated) == "rotated");
+	}
+	std::remove(dated.c_str());
+	std::remove(rotated);
+	BLT_INFO("Async writer passed, io_uring {}", io_uring ? "tested" : "unavailable");
+}
+
+void check_concurrent_records(const size_t buffer_size)
+{
+	constexpr size_t threads = 8;
+	constexpr size_t records = 5000;
+	string_writer_t output;
+	{
+		blt::fs::concurrent_file_writer writer{&output, buffer_size};
+		std::vector<std::thread> writers;
+		for (size_t t = 0; t < threads; t++)
+		{
+			writers.emplace_back([&writer, t]() {
+				for (size_t i = 0; i < records; i++)
+				{
+					// every so often a record too large for the buffer, which goes around it
+					std::string record = std::to_string(t) + ":" + std::to_string(i) + ":" + std::string(i % 97 == 0 ? 300 : i % 13, 'x') + "\n";
+					BLT_ASSERT(writer.write(record.data(), record.size()) == static_cast<blt::i64>(record.size()));
+				}
+			});
+		}
+		for (auto& thread : writers)
+			thread.join();
+	}
+
+	// every record arrives whole and each thread's records arrive in the order it wrote them
+	std::vector<size_t> next(threads, 0);
+	std::stringstream stream{output.data};
+	for (std::string line; std::getline(stream, line);)
+	{
+		const auto first = line.find(':');
+		const auto second = line.find(':', first + 1);
+		BLT_ASSERT(first != std::string::npos && second != std::string::npos);
+		const auto thread = std::stoull(line.substr(0, first));
+		const auto index = std::stoull(line.substr(first + 1, second - first - 1));
+		BLT_ASSERT(thread < threads && index == next[thread]);
+		BLT_ASSERT(line.substr(second + 1) == std::string(index % 97 == 0 ? 300 : index % 13, 'x'));
+		++next[thread];
+	}
+	for (const auto count : next)
+		BLT_ASSERT(count == records);
+}
+
+void test_concurrent_writer()
+{
+	check_concurrent_records(blt::fs::concurrent_file_writer::WRITE_THROUGH);
+	// small enough that buffers are sealed constantly while other threads are still copying into them
+	check_concurrent_records(512);
+	check_concurrent_records(blt::fs::concurrent_file_writer::DEFAULT_BUFFER_SIZE);
+
+	{
+		// the default reaches the wrapped writer before write() returns
+		string_writer_t output;
+		blt::fs::concurrent_file_writer writer{&output};
+		writer.write("abc", 3);
+		BLT_ASSERT(output.data == "abc");
+		writer.flush();
+		BLT_ASSERT(output.flushes == 1);
+	}
+	{
+		string_writer_t output;
+		{
+			blt::fs::concurrent_file_writer writer{&output, 64};
+			writer.write("one,", 4);
+			writer.write("two,", 4);
+			BLT_ASSERT(output.data.empty());
+			// flush drains the buffer as a single write before flushing the wrapped writer
+			writer.flush();
+			BLT_ASSERT(output.data == "one,two,");
+			BLT_ASSERT(output.writes == 1 && output.flushes == 1);
+
+			// a full buffer is sealed by the write which no longer fits
+			writer.write("0123456789012345", 16);
+			writer.write("0123456789012345", 16);
+			writer.write("0123456789012345", 16);
+			writer.write("0123456789012345", 16);
+			BLT_ASSERT(output.data.size() == 8);
+			writer.write("!", 1);
+			BLT_ASSERT(output.data.size() == 8 + 64);
+
+			// a write larger than a quarter of the buffer drains what was buffered first, keeping the order
+			writer.write("small,", 6);
+			writer.write("this one does not go through the buffer", 39);
+			BLT_ASSERT(output.data.substr(output.data.size() - 46) == "!small,this one does not go through the buffer");
+			writer.write("last", 4);
+		}
+		// destruction drains the rest
+		BLT_ASSERT(output.data.substr(output.data.size() - 4) == "last");
+	}
+	BLT_INFO("Concurrent writer passed");
+}
+
+int main()
+{
+	test_mmap_reader();
+	test_truncated_string();
+	test_async_writer();
+	test_concurrent_writer();
+}
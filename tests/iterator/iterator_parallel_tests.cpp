@@ -0,0 +1,104 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include <blt/iterator/iterator.h>
+#include <blt/iterator/parallel.h>
+#include <blt/logging/logging.h>
+#include <blt/std/assert.h>
+
+void test_parallel_for()
+{
+    std::vector<blt::u64> values(100000);
+    blt::parallel_for(blt::iterate(values).enumerate(), [](auto pair) {
+        auto& [index, value] = pair;
+        value = index * 2;
+    }, 128);
+    for (blt::size_t i = 0; i < values.size(); i++)
+        BLT_ASSERT(values[i] == i * 2);
+
+    std::vector<blt::u64> other(values.size(), 1);
+    std::atomic<blt::u64> total = 0;
+    blt::parallel_for(blt::iterate(values).zip(other), [&total](auto pair) {
+        auto& [a, b] = pair;
+        total.fetch_add(a + b, std::memory_order_relaxed);
+    });
+    BLT_ASSERT(total == std::accumulate(values.begin(), values.end(), blt::u64{0}) + other.size());
+
+    // empty ranges and ranges smaller than the grain size run serially without touching the executor
+    std::vector<int> empty;
+    blt::parallel_for(empty, [](int) {
+        BLT_ASSERT(false && "Empty range should not call the function");
+    });
+    BLT_INFO("parallel_for tests passed");
+}
+
+void test_parallel_reduce()
+{
+    std::vector<blt::u64> values(250000);
+    std::iota(values.begin(), values.end(), 0);
+    const auto expected = std::accumulate(values.begin(), values.end(), blt::u64{0});
+
+    const auto sum = blt::parallel_reduce(values, blt::u64{0}, [](const blt::u64 a, const blt::u64 b) {
+        return a + b;
+    });
+    BLT_ASSERT(sum == expected);
+
+    const auto squares = blt::parallel_reduce(blt::iterate(values).map([](const blt::u64 v) {
+        return v % 7;
+    }), blt::u64{0}, std::plus<>{}, 1000);
+    blt::u64 expected_squares = 0;
+    for (const auto v : values)
+        expected_squares += v % 7;
+    BLT_ASSERT(squares == expected_squares);
+    BLT_INFO("parallel_reduce tests passed");
+}
+
+void bench_scaling()
+{
+    std::vector<double> values(1 << 22);
+    std::iota(values.begin(), values.end(), 1.0);
+    auto pipeline = blt::iterate(values).map([](const double v) {
+        return std::sqrt(v) * std::sin(v);
+    });
+
+    double serial_seconds = 0;
+    const auto max_threads = std::max(4u, std::thread::hardware_concurrency());
+    for (blt::size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        blt::work_stealing_executor executor{threads};
+        const auto start = std::chrono::steady_clock::now();
+        const auto result = blt::parallel_reduce(executor, pipeline, 0.0, std::plus<>{});
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (threads == 1)
+            serial_seconds = seconds;
+        BLT_INFO("parallel_reduce with {:>2} threads: {:>8.3f}ms speedup {:.2f}x (result {:.3f})", threads, seconds * 1000,
+                 serial_seconds / seconds, result);
+    }
+}
+
+int main()
+{
+    test_parallel_for();
+    test_parallel_reduce();
+    bench_scaling();
+}
@@ -15,9 +15,15 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
 #include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <new>
 #include <sstream>
 #include <thread>
 #include <blt/fs/filesystem.h>
@@ -30,6 +36,253 @@
 struct some_silly_type_t
 {};
 
+// counts heap allocations made by the current thread, used to check that formatting a log line does not allocate
+thread_local size_t allocation_count = 0;
+
+void* operator new(const size_t size)
+{
+	++allocation_count;
+	if (void* ptr = std::malloc(size == 0 ? 1 : size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+class string_writer_t final : public blt::fs::writer_t
+{
+public:
+	blt::i64 write(const char* buffer, const size_t bytes) override
+	{
+		data.append(buffer, bytes);
+		return static_cast<blt::i64>(bytes);
+	}
+
+	std::string data;
+};
+
+// holds the first write() until released, like an output stuck on a slow disk or terminal
+class blocking_writer_t final : public blt::fs::writer_t
+{
+public:
+	blt::i64 write(const char*, const size_t bytes) override
+	{
+		entered = true;
+		while (!release.load())
+			std::this_thread::yield();
+		return static_cast<blt::i64>(bytes);
+	}
+
+	std::atomic_bool entered = false;
+	std::atomic_bool release = false;
+};
+
+size_t count_lines(const std::string& str)
+{
+	return static_cast<size_t>(std::count(str.begin(), str.end(), '\n'));
+}
+
+void test_compiled_format()
+{
+	auto& logger = blt::logging::get_global_logger();
+	const auto check = [&logger](const std::string& fmt, const auto&... args) {
+		const auto compiled = blt::logging::detail::compile_fmt(fmt);
+		BLT_ASSERT(compiled.has_value());
+		const auto expected = logger.format(fmt, args...);
+		BLT_ASSERT(logger.format(*compiled, args...) == expected);
+	};
+	check("No args at all");
+	check("Escaped \\{ brace {} and {:>10}|", 42, "right");
+	check("Positionals '{1}' '{0}' '{}'", "first", "second");
+	check("{:#x} {:+.3f} {: b} {:t}", 4250, 3.14159, 69, some_silly_type_t{});
+	// nested arg references need the argument values and so are left to the runtime parser
+	BLT_ASSERT(!blt::logging::detail::compile_fmt("{0:{1}.{2}f}").has_value());
+
+	// a logger over a stream of its own appends everything it formats to it
+	std::stringstream own_stream;
+	blt::logging::logger_t stream_logger{own_stream};
+	BLT_ASSERT(stream_logger.format("first {}", 1) == "first 1");
+	BLT_ASSERT(stream_logger.format(*blt::logging::detail::compile_fmt(" second {:.1f}"), 2.0) == " second 2.0");
+	BLT_ASSERT(own_stream.str() == "first 1 second 2.0");
+
+	constexpr size_t iterations = 200000;
+	const std::string fmt = "Frame {} took {:.3f}ms with {} draw calls on '{}'";
+	const auto compiled = *blt::logging::detail::compile_fmt(fmt);
+	const auto time = [](const auto& func) {
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < iterations; i++)
+			func(i);
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) /
+			iterations;
+	};
+	size_t total = 0;
+	const auto uncached = time([&](const size_t i) {
+		total += logger.format(fmt, i, 16.6667, 1024, "main").size();
+	});
+	const auto cached = time([&](const size_t i) {
+		total += logger.format(compiled, i, 16.6667, 1024, "main").size();
+	});
+	BLT_INFO("Formatting ns/line: parsed every call {}, cached parse {} ({} bytes)", static_cast<blt::u64>(uncached),
+			static_cast<blt::u64>(cached), total);
+}
+
+void test_call_site_formats()
+{
+	auto& config = blt::logging::get_global_config();
+	const auto outputs = config.get_log_outputs();
+	string_writer_t writer;
+	config.set_log_outputs({&writer});
+
+	// a named array is not a literal, its contents can change between calls through the same call site
+	char buffer[32];
+	const auto log_buffer = [&buffer](const int value) {
+		BLT_INFO(buffer, value);
+	};
+	std::strcpy(buffer, "first {}");
+	log_buffer(1);
+	std::strcpy(buffer, "second {}");
+	log_buffer(2);
+
+	// the format expression is evaluated once per line
+	int evaluations = 0;
+	const auto next_format = [&evaluations]() {
+		++evaluations;
+		return "evaluated {}";
+	};
+	BLT_INFO(next_format(), 3);
+
+	config.set_log_outputs(outputs);
+	BLT_ASSERT(writer.data.find("first 1") != std::string::npos);
+	BLT_ASSERT(writer.data.find("second 2") != std::string::npos);
+	BLT_ASSERT(writer.data.find("evaluated 3") != std::string::npos);
+	BLT_ASSERT(evaluations == 1);
+	BLT_ASSERT(blt::logging::detail::is_literal_spelling(R"("literal")"));
+	BLT_ASSERT(blt::logging::detail::is_literal_spelling("R\"(raw)\""));
+	BLT_ASSERT(!blt::logging::detail::is_literal_spelling("buffer"));
+}
+
+void test_allocation_free_logging()
+{
+	const std::string name = "steady state";
+	const auto log_line = [&name](const int i) {
+		BLT_TRACE("Allocation check {} {:.3f} {:>12} {:#x} {}", i, i * 1.5, name, i, i % 2 == 0);
+	};
+	// the first lines grow the thread's buffers and parse the format
+	log_line(0);
+	log_line(1);
+	const auto before = allocation_count;
+	for (int i = 2; i < 5; i++)
+		log_line(i);
+	BLT_ASSERT_MSG(allocation_count == before, ("Log lines allocated " + std::to_string(allocation_count - before) + " times").c_str());
+}
+
+std::string strftime_now(const char* format)
+{
+	const auto time = std::time(nullptr);
+	std::tm tm{};
+	localtime_r(&time, &tm);
+	char buffer[64];
+	return {buffer, std::strftime(buffer, sizeof(buffer), format, &tm)};
+}
+
+void test_log_prefix()
+{
+	blt::logging::logging_config_t config;
+	config.set_use_color(false).set_log_format("{FULL_TIME}|{ISO_YEAR}T{TIME}|{MS}|{LL}|{STR}");
+	// the cached calendar has to agree with localtime, retried in case the second ticks over between the two
+	bool matched = false;
+	for (int i = 0; i < 3 && !matched; i++)
+	{
+		const auto before = strftime_now("%Y-%m-%d %H:%M:%S|%Y-%m-%dT%H:%M:%S|");
+		const auto line = *config.generate("message", "", blt::logging::log_level_t::INFO, __FILE__, __LINE__);
+		matched = line.compare(0, before.size(), before) == 0;
+		if (matched)
+			BLT_ASSERT(line.substr(before.size() + 4) == "|INFO|message");
+	}
+	BLT_ASSERT(matched);
+
+	constexpr size_t iterations = 200000;
+	auto& global = blt::logging::get_global_config();
+	blt::logging::fmt_buffer_t buffer;
+	const auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; i++)
+	{
+		buffer.clear();
+		global.generate(buffer, "message", "main", blt::logging::log_level_t::INFO, __FILE__, __LINE__);
+	}
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	BLT_INFO("Default log prefix takes {} ns/line", static_cast<blt::u64>(ns / iterations));
+}
+
+void test_async_logging()
+{
+	auto& config = blt::logging::get_global_config();
+	const auto outputs = config.get_log_outputs();
+	string_writer_t writer;
+	config.set_log_outputs({&writer}).set_async(true);
+
+	constexpr size_t threads = 4;
+	constexpr size_t lines = 2000;
+	std::vector<std::thread> loggers;
+	for (size_t t = 0; t < threads; t++)
+	{
+		loggers.emplace_back([t]() {
+			for (size_t i = 0; i < lines; i++)
+				BLT_INFO("async line {} from thread {}", i, t);
+		});
+	}
+	for (auto& thread : loggers)
+		thread.join();
+	BLT_ASSERT(blt::logging::flush());
+	BLT_ASSERT(count_lines(writer.data) == threads * lines);
+
+	// a tiny buffer which the background thread cannot keep up with loses records, but they are accounted for
+	writer.data.clear();
+	config.set_async_buffer_size(2).set_overflow_policy(blt::logging::log_overflow_policy_t::COUNT);
+	std::thread([]() {
+		for (size_t i = 0; i < lines; i++)
+			BLT_INFO("counted line {}", i);
+	}).join();
+	BLT_ASSERT(blt::logging::flush());
+	const auto dropped = blt::logging::get_dropped_records();
+	size_t notices = 0;
+	for (auto pos = writer.data.find("records dropped"); pos != std::string::npos; pos = writer.data.find("records dropped", pos + 1))
+		++notices;
+	BLT_ASSERT(count_lines(writer.data) - notices + dropped == lines);
+
+	// an output stuck in write() must not hold up a thread logging for the first time
+	config.set_async_buffer_size(4096).set_overflow_policy(blt::logging::log_overflow_policy_t::BLOCK);
+	blocking_writer_t blocking;
+	config.set_log_outputs({&blocking});
+	BLT_INFO("blocks the background thread");
+	while (!blocking.entered.load())
+		std::this_thread::yield();
+	std::atomic_bool logged = false;
+	std::thread first_log([&logged]() {
+		BLT_INFO("first line of a new thread");
+		logged = true;
+	});
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (!logged.load() && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::yield();
+	const bool logged_while_blocked = logged.load();
+	blocking.release = true;
+	first_log.join();
+	BLT_ASSERT(blt::logging::flush());
+	BLT_ASSERT(logged_while_blocked);
+
+	config.set_async(false).set_log_outputs(outputs);
+	BLT_INFO("Async logging wrote {} lines, dropped {} under the counting policy", threads * lines, dropped);
+}
+
 auto expected_str = std::string(R"(This is a println!
 This is a println with args '42'
 This is a println with multiple args '42' '32.342311859130859375' 'Hello World!'
@@ -159,6 +412,12 @@ int main()
 	// 					build(color::color_mode::RESET_ALL));
 
 
+	test_compiled_format();
+	test_call_site_formats();
+	test_allocation_free_logging();
+	test_log_prefix();
+	test_async_logging();
+
 	std::ofstream os("test.txt");
 	blt::fs::fstream_writer_t wtr(os);
 	blt::fs::writer_string_wrapper_t writer(wtr);
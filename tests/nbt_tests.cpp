@@ -0,0 +1,672 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <blt/fs/mmap_reader.h>
+#include <blt/fs/nbt.h>
+#include <blt/fs/nbt_block.h>
+#include <blt/fs/nbt_document.h>
+#include <blt/fs/nbt_visitor.h>
+#include <blt/fs/stream_wrappers.h>
+#include <blt/logging/logging.h>
+#include <blt/std/assert.h>
+#include <blt/std/memory_util.h>
+
+class string_writer_t final : public blt::fs::writer_t
+{
+public:
+	blt::i64 write(const char* buffer, const size_t bytes) override
+	{
+		str.append(buffer, bytes);
+		return static_cast<blt::i64>(bytes);
+	}
+
+	std::string str;
+};
+
+// writes every event it sees as text, so two walks can be compared
+class recording_visitor_t final : public blt::nbt::nbt_visitor_t
+{
+public:
+	blt::nbt::visit_t key(blt::nbt::nbt_tag type, const std::string_view name) override
+	{
+		out << "key " << static_cast<int>(type) << ' ' << name << '\n';
+		return name == skipped ? blt::nbt::visit_t::SKIP : blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t begin_compound() override
+	{
+		out << "{\n";
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t end_compound() override
+	{
+		out << "}\n";
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t begin_list(blt::nbt::nbt_tag type, const blt::i32 length) override
+	{
+		out << "[ " << static_cast<int>(type) << ' ' << length << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t end_list() override
+	{
+		out << "]\n";
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_byte(const blt::i8 value) override
+	{
+		out << static_cast<int>(value) << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_short(const blt::i16 value) override
+	{
+		out << value << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_int(const blt::i32 value) override
+	{
+		out << value << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_long(const blt::i64 value) override
+	{
+		out << value << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_float(const float value) override
+	{
+		out << value << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_double(const double value) override
+	{
+		out << value << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_string(const std::string_view value) override
+	{
+		out << '"' << blt::nbt::decode_string(value) << "\"\n";
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_byte_array(const blt::nbt::nbt_array_view_t<blt::i8> value) override
+	{
+		out << "bytes";
+		for (size_t i = 0; i < value.size(); i++)
+			out << ' ' << static_cast<int>(value[i]);
+		out << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_int_array(const blt::nbt::nbt_array_view_t<blt::i32> value) override
+	{
+		out << "ints";
+		for (size_t i = 0; i < value.size(); i++)
+			out << ' ' << value[i];
+		out << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	blt::nbt::visit_t value_long_array(const blt::nbt::nbt_array_view_t<blt::i64> value) override
+	{
+		out << "longs";
+		for (size_t i = 0; i < value.size(); i++)
+			out << ' ' << value[i];
+		out << '\n';
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	std::stringstream out;
+	std::string_view skipped;
+};
+
+// pulls a single value out of every entity and skips everything else
+class health_visitor_t final : public blt::nbt::nbt_visitor_t
+{
+public:
+	blt::nbt::visit_t key(blt::nbt::nbt_tag, const std::string_view name) override
+	{
+		if (name == "health")
+			return blt::nbt::visit_t::CONTINUE;
+		// the root and the entity list have to be entered to reach the entities
+		return name.empty() || name == "entities" ? blt::nbt::visit_t::CONTINUE : blt::nbt::visit_t::SKIP;
+	}
+
+	blt::nbt::visit_t value_float(const float value) override
+	{
+		total += value;
+		++count;
+		return blt::nbt::visit_t::CONTINUE;
+	}
+
+	double total = 0;
+	size_t count = 0;
+};
+
+std::string write_document(blt::nbt::tag_compound* root)
+{
+	string_writer_t writer;
+	blt::nbt::NBTWriter nbt_writer{writer};
+	nbt_writer.write(root);
+	return writer.str;
+}
+
+blt::nbt::tag_compound* make_sample()
+{
+	return new blt::nbt::tag_compound("root", {
+		new blt::nbt::tag_byte("byte", 8),
+		new blt::nbt::tag_short("short", 32767),
+		new blt::nbt::tag_compound("nested", {
+			new blt::nbt::tag_list("longs", {
+				new blt::nbt::tag_long("", 1230),
+				new blt::nbt::tag_long("", 9999999999),
+				new blt::nbt::tag_long("", -55),
+			}),
+			new blt::nbt::tag_double("double", 1320.5),
+			new blt::nbt::tag_compound("inner", {
+				new blt::nbt::tag_int("int", 32),
+				new blt::nbt::tag_byte_array("bytes", {51, 23, -12}),
+				new blt::nbt::tag_string("string", "I have stringy contents"),
+				new blt::nbt::tag_int_array("ints", {1230, -234023, 21300}),
+				new blt::nbt::tag_long_array("longs", {323200234402304, -230023})
+			})
+		})
+	});
+}
+
+blt::nbt::tag_compound* make_entities(const size_t count)
+{
+	std::vector<blt::nbt::tag_t*> entities;
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto d = static_cast<double>(i);
+		std::vector<blt::i32> data(16, static_cast<blt::i32>(i));
+		entities.push_back(new blt::nbt::tag_compound("", {
+			new blt::nbt::tag_string("id", "minecraft:zombie"),
+			new blt::nbt::tag_list("pos", {
+				new blt::nbt::tag_double("", d), new blt::nbt::tag_double("", d * 2), new blt::nbt::tag_double("", d * 3)
+			}),
+			new blt::nbt::tag_float("health", 20.0f),
+			new blt::nbt::tag_int_array("data", data),
+			new blt::nbt::tag_compound("attributes", {
+				new blt::nbt::tag_string("name", "generic.movement_speed"),
+				new blt::nbt::tag_double("base", 0.23),
+				new blt::nbt::tag_byte("persistent", 1)
+			})
+		}));
+	}
+	return new blt::nbt::tag_compound("", {new blt::nbt::tag_list("entities", entities)});
+}
+
+void test_visitor_events()
+{
+	const auto document = write_document(make_sample());
+
+	recording_visitor_t from_memory;
+	BLT_ASSERT(blt::nbt::visit(std::string_view{document}, from_memory));
+	const auto events = from_memory.out.str();
+	BLT_ASSERT(events.find("key 2 short\n32767\n") != std::string::npos);
+	BLT_ASSERT(events.find("key 9 longs\n[ 4 3\n1230\n9999999999\n-55\n]\n") != std::string::npos);
+	BLT_ASSERT(events.find("\"I have stringy contents\"") != std::string::npos);
+	BLT_ASSERT(events.find("bytes 51 23 -12\n") != std::string::npos);
+	BLT_ASSERT(events.find("ints 1230 -234023 21300\n") != std::string::npos);
+	BLT_ASSERT(events.find("longs 323200234402304 -230023\n") != std::string::npos);
+
+	// a reader without views goes through the scratch buffer and has to produce the same events
+	std::stringstream stream{document};
+	blt::fs::fstream_reader_t reader{stream};
+	recording_visitor_t from_reader;
+	BLT_ASSERT(blt::nbt::visit(reader, from_reader));
+	BLT_ASSERT(from_reader.out.str() == events);
+
+	recording_visitor_t skipping;
+	skipping.skipped = "nested";
+	BLT_ASSERT(blt::nbt::visit(std::string_view{document}, skipping));
+	const auto skipped_events = skipping.out.str();
+	BLT_ASSERT(skipped_events.find("key 10 nested\n") != std::string::npos);
+	BLT_ASSERT(skipped_events.find("inner") == std::string::npos);
+	BLT_ASSERT(skipped_events.find("short") != std::string::npos);
+
+	class stopping_visitor_t final : public blt::nbt::nbt_visitor_t
+	{
+	public:
+		blt::nbt::visit_t value_short(blt::i16) override
+		{
+			return blt::nbt::visit_t::STOP;
+		}
+	} stopping;
+	BLT_ASSERT(!blt::nbt::visit(std::string_view{document}, stopping));
+
+	bool threw = false;
+	try
+	{
+		recording_visitor_t truncated;
+		blt::nbt::visit(std::string_view{document}.substr(0, document.size() - 4), truncated);
+	} catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	BLT_ASSERT(threw);
+
+	// a long array claiming 16GiB with a few bytes behind it, read without views, is reported as truncated instead of allocated
+	std::stringstream huge{std::string{"\x0a\0\0\x0c\0\x01x\x7f\xff\xff\xff\0\0\0\0\0\0\0\x01", 19}};
+	blt::fs::fstream_reader_t huge_reader{huge};
+	threw = false;
+	try
+	{
+		recording_visitor_t truncated;
+		blt::nbt::visit(huge_reader, truncated);
+	} catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	BLT_ASSERT(threw);
+}
+
+void test_document()
+{
+	// the pointer version of NBTWriter::write takes ownership, so the tree to convert is built separately
+	const auto document = write_document(make_sample());
+	auto* sample = make_sample();
+
+	const auto check = [](const blt::nbt::nbt_document_t& doc) {
+		const auto root = doc.root();
+		BLT_ASSERT(root.type() == blt::nbt::nbt_tag::COMPOUND);
+		BLT_ASSERT(root.name() == "root");
+		BLT_ASSERT(root.size() == 3);
+		BLT_ASSERT(root.find("byte")->as_byte() == 8);
+		BLT_ASSERT(root.find("short")->as_short() == 32767);
+		BLT_ASSERT(!root.find("missing"));
+		const auto nested = *root.find("nested");
+		const auto longs = *nested.find("longs");
+		BLT_ASSERT(longs.element_type() == blt::nbt::nbt_tag::LONG);
+		BLT_ASSERT(longs.size() == 3);
+		BLT_ASSERT(longs.at(1).as_long() == 9999999999);
+		BLT_ASSERT(longs.at(2).as_long() == -55);
+		BLT_ASSERT(nested.find("double")->as_double() == 1320.5);
+		const auto inner = *nested.find("inner");
+		BLT_ASSERT(inner.find("int")->as_int() == 32);
+		BLT_ASSERT(inner.find("string")->as_string() == "I have stringy contents");
+		const auto bytes = inner.find("bytes")->as_byte_array();
+		BLT_ASSERT(bytes.size() == 3 && bytes[2] == -12);
+		const auto ints = inner.find("ints")->as_int_array();
+		BLT_ASSERT(ints.size() == 3 && ints[1] == -234023);
+		const auto long_array = inner.find("longs")->as_long_array();
+		BLT_ASSERT(long_array.size() == 2 && long_array[0] == 323200234402304);
+		size_t children = 0;
+		for (const auto child : inner)
+		{
+			BLT_ASSERT(!child.name().empty());
+			children++;
+		}
+		BLT_ASSERT(children == 5);
+	};
+
+	const auto parsed = blt::nbt::nbt_document_t::read(std::string_view{document});
+	check(parsed);
+	check(blt::nbt::nbt_document_t::from_compound(*sample));
+
+	// and back into a tag tree, then through the writer and the parser once more
+	auto* converted = parsed.to_compound();
+	BLT_ASSERT(converted->getName() == "root");
+	BLT_ASSERT(converted->getTag<blt::nbt::tag_compound>("nested")->getTag<blt::nbt::tag_list>("longs")->size() == 3);
+	check(blt::nbt::nbt_document_t::read(std::string_view{write_document(converted)}));
+	delete sample;
+
+	auto cleared = blt::nbt::nbt_document_t::read(std::string_view{document});
+	cleared.clear();
+	BLT_ASSERT(cleared.empty());
+}
+
+template <typename T>
+void check_reverse_array()
+{
+	// every length up to a few vectors, so each loop and the scalar tail get exercised
+	for (size_t count = 0; count < 80; ++count)
+	{
+		std::vector<T> values(count);
+		for (size_t i = 0; i < count; ++i)
+			values[i] = static_cast<T>(0x0102030405060708ull * (i + 1));
+		auto expected = values;
+		for (auto& value : expected)
+			blt::mem::reverse(value);
+		blt::mem::reverse_array(values.data(), values.size());
+		BLT_ASSERT(values == expected);
+	}
+}
+
+void test_bulk_arrays()
+{
+	check_reverse_array<std::uint16_t>();
+	check_reverse_array<std::uint32_t>();
+	check_reverse_array<std::uint64_t>();
+	check_reverse_array<blt::i32>();
+	check_reverse_array<blt::i64>();
+
+	// the sample arrays have to match what the per element code wrote
+	const auto document = write_document(make_sample());
+	const char int_array[] = {'\0', '\0', '\0', '\3', '\0', '\0', '\x04', '\xCE'};
+	BLT_ASSERT(document.find(std::string_view{int_array, sizeof(int_array)}) != std::string::npos);
+
+	// an array cut short by the end of the data throws instead of leaving zeroes behind
+	std::stringstream truncated{std::string{"\0\0\0\4\0\0\0\1\0\0\0\2", 12}};
+	blt::fs::fstream_reader_t reader{truncated};
+	blt::nbt::tag_int_array array;
+	bool threw = false;
+	try
+	{
+		array.readPayload(reader);
+	} catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	BLT_ASSERT(threw);
+
+	// a length of 16GiB with a single value behind it fails on the missing data, not on the allocation
+	std::stringstream huge{std::string{"\x7f\xff\xff\xff\0\0\0\0\0\0\0\x01", 12}};
+	blt::fs::fstream_reader_t huge_reader{huge};
+	blt::nbt::tag_long_array long_array;
+	threw = false;
+	try
+	{
+		long_array.readPayload(huge_reader);
+	} catch (const std::runtime_error&)
+	{
+		threw = true;
+	}
+	BLT_ASSERT(threw);
+
+	// arrays larger than one chunk still arrive whole when the reader hands them out in pieces
+	std::vector<blt::i32> large(100000);
+	for (size_t i = 0; i < large.size(); i++)
+		large[i] = static_cast<blt::i32>(i * 7919);
+	std::string payload{"\0\x01\x86\xa0", 4};
+	for (const auto value : large)
+	{
+		const auto bits = static_cast<blt::u32>(value);
+		for (int shift = 24; shift >= 0; shift -= 8)
+			payload += static_cast<char>(bits >> shift);
+	}
+	std::stringstream large_stream{payload};
+	blt::fs::fstream_reader_t large_reader{large_stream};
+	blt::nbt::tag_int_array large_array;
+	large_array.readPayload(large_reader);
+	BLT_ASSERT(large_array.get() == large);
+}
+
+void benchmark_arrays()
+{
+	using clock = std::chrono::steady_clock;
+	const auto ms_since = [](const clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	constexpr size_t int_count = 4 * 1024 * 1024;
+	constexpr size_t long_count = 2 * 1024 * 1024;
+	std::vector<blt::i32> ints(int_count);
+	std::vector<blt::i64> longs(long_count);
+	for (size_t i = 0; i < int_count; ++i)
+		ints[i] = static_cast<blt::i32>(i * 2654435761u);
+	for (size_t i = 0; i < long_count; ++i)
+		longs[i] = static_cast<blt::i64>(i * 0x9E3779B97F4A7C15ull);
+
+	auto start = clock::now();
+	const auto document = write_document(new blt::nbt::tag_compound("arrays", {
+		new blt::nbt::tag_int_array("ints", ints),
+		new blt::nbt::tag_long_array("longs", longs)
+	}));
+	const auto write_ms = ms_since(start);
+
+	start = clock::now();
+	std::stringstream stream{document};
+	blt::fs::fstream_reader_t reader{stream};
+	blt::nbt::NBTReader nbt_reader{reader};
+	nbt_reader.read();
+	const auto read_ms = ms_since(start);
+	BLT_ASSERT(nbt_reader.getTag<blt::nbt::tag_int_array>("ints")->get() == ints);
+	BLT_ASSERT(nbt_reader.getTag<blt::nbt::tag_long_array>("longs")->get() == longs);
+
+	// what the array tags used to do, one read and conversion per element
+	// compounds do not keep their order, so find each payload by its tag header
+	const auto payload = [&document](const std::string_view header) {
+		const auto position = document.find(header);
+		BLT_ASSERT(position != std::string::npos);
+		return static_cast<std::streamoff>(position + header.size() + sizeof(blt::i32));
+	};
+	const auto ints_at = payload(std::string_view{"\x0B\x00\x04ints", 7});
+	const auto longs_at = payload(std::string_view{"\x0C\x00\x05longs", 8});
+
+	start = clock::now();
+	std::stringstream element_stream{document};
+	blt::fs::fstream_reader_t element_reader{element_stream};
+	element_stream.seekg(ints_at);
+	std::vector<blt::i32> element_ints(int_count);
+	for (auto& value : element_ints)
+		blt::nbt::readData(element_reader, value);
+	element_stream.seekg(longs_at);
+	std::vector<blt::i64> element_longs(long_count);
+	for (auto& value : element_longs)
+		blt::nbt::readData(element_reader, value);
+	const auto element_ms = ms_since(start);
+	BLT_ASSERT(element_ints == ints);
+	BLT_ASSERT(element_longs == longs);
+
+	start = clock::now();
+	for (auto& value : ints)
+		blt::mem::reverse(value);
+	const auto scalar_swap_ms = ms_since(start);
+	start = clock::now();
+	blt::mem::reverse_array(ints.data(), ints.size());
+	const auto bulk_swap_ms = ms_since(start);
+
+	const auto megabytes = static_cast<double>(document.size()) / (1024.0 * 1024.0);
+	BLT_INFO("NBT arrays ({:.1f}MiB): bulk write {:.2f}ms, bulk read {:.2f}ms ({:.1f}MiB/s), per element read {:.2f}ms ({:.1f}MiB/s)", megabytes,
+			write_ms, read_ms, megabytes / read_ms * 1000.0, element_ms, megabytes / element_ms * 1000.0);
+	BLT_INFO("Byte swapping {} ints: scalar {:.2f}ms, reverse_array {:.2f}ms", int_count, scalar_swap_ms, bulk_swap_ms);
+}
+
+void test_region()
+{
+	using blt::nbt::region_file_t;
+	using blt::nbt::region_compression_t;
+	const auto path = "nbt_region.blt";
+	std::remove(path);
+
+	const auto sample = write_document(make_sample());
+	const auto entities = write_document(make_entities(200));
+	const auto small = write_document(new blt::nbt::tag_compound("small", {new blt::nbt::tag_int("value", 1)}));
+	const auto compression = region_file_t::supports(region_compression_t::ZLIB) ? region_compression_t::ZLIB : region_compression_t::NONE;
+	{
+		region_file_t region{path, 64};
+		BLT_ASSERT(region.capacity() == 64);
+		region.write(0, sample);
+		region.write(5, entities);
+		region.write(63, small);
+		BLT_ASSERT(!region.contains(1));
+		BLT_ASSERT(!region.read(1));
+		BLT_ASSERT(*region.read(5) == entities);
+		region.sync();
+	}
+
+	region_file_t region{path};
+	BLT_ASSERT(region.capacity() == 64);
+	BLT_ASSERT(*region.read(0) == sample);
+	BLT_ASSERT(*region.read(5) == entities);
+	BLT_ASSERT(*region.read(63) == small);
+	BLT_ASSERT(region.read_document(0)->root().find("byte")->as_byte() == 8);
+
+	// shrinking happens in place and the freed sectors are handed to the next entry which fits, so the file does not grow
+	const auto sectors = region.sector_count();
+	region.write(5, small);
+	region.write(6, sample);
+	BLT_ASSERT(region.sector_count() == sectors);
+	BLT_ASSERT(*region.read(5) == small);
+	BLT_ASSERT(*region.read(6) == sample);
+	// growing moves the entry
+	region.write(63, entities, compression);
+	BLT_ASSERT(*region.read(63) == entities);
+	BLT_ASSERT(region.erase(0));
+	BLT_ASSERT(!region.erase(0));
+	BLT_ASSERT(!region.contains(0));
+
+	// readers run alongside a writer flipping an entry between two documents
+	std::vector<std::thread> readers;
+	std::atomic<bool> torn = false;
+	for (int i = 0; i < 4; i++)
+	{
+		readers.emplace_back([&region, &sample, &small, &entities, &torn]() {
+			for (int j = 0; j < 200; j++)
+			{
+				const auto data = region.read(6);
+				if (!data || (*data != sample && *data != small) || *region.read(63) != entities)
+					torn = true;
+			}
+		});
+	}
+	for (int j = 0; j < 200; j++)
+		region.write(6, j % 2 == 0 ? small : sample);
+	for (auto& reader : readers)
+		reader.join();
+	BLT_ASSERT(!torn);
+
+	std::remove(path);
+	{
+		std::ofstream file{path, std::ios::binary};
+		file << "definitely not a region file";
+	}
+	bool rejected = false;
+	try
+	{
+		region_file_t invalid{path};
+	} catch (const std::runtime_error&)
+	{
+		rejected = true;
+	}
+	BLT_ASSERT(rejected);
+	std::remove(path);
+}
+
+void benchmark_visitor(const char* path, const size_t entity_count)
+{
+	using clock = std::chrono::steady_clock;
+	const auto ms_since = [](const clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	auto start = clock::now();
+	{
+		blt::fs::mmap_reader_t reader{path};
+		blt::nbt::NBTReader nbt_reader{reader};
+		nbt_reader.read();
+		BLT_ASSERT(nbt_reader.getTag<blt::nbt::tag_list>("entities")->size() == entity_count);
+	}
+	const auto tree_ms = ms_since(start);
+
+	start = clock::now();
+	{
+		blt::fs::mmap_reader_t reader{path};
+		recording_visitor_t visitor;
+		BLT_ASSERT(blt::nbt::visit(reader, visitor));
+	}
+	const auto full_ms = ms_since(start);
+
+	start = clock::now();
+	size_t file_size;
+	{
+		blt::fs::mmap_reader_t reader{path};
+		file_size = reader.size();
+		health_visitor_t visitor;
+		BLT_ASSERT(blt::nbt::visit(reader, visitor));
+		BLT_ASSERT(visitor.count == entity_count);
+		BLT_ASSERT(visitor.total == 20.0 * entity_count);
+	}
+	const auto skip_ms = ms_since(start);
+
+	BLT_INFO("NBT ({} entities, {} bytes): tree reader {:.2f}ms, visitor recording every event {:.2f}ms, visitor reading one field {:.2f}ms",
+			entity_count, file_size, tree_ms, full_ms, skip_ms);
+}
+
+void benchmark_document(const char* path, const size_t entity_count)
+{
+	using clock = std::chrono::steady_clock;
+	const auto ms_since = [](const clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	};
+
+	blt::fs::mmap_reader_t tree_reader{path};
+	auto start = clock::now();
+	auto* nbt_reader = new blt::nbt::NBTReader{tree_reader};
+	nbt_reader->read();
+	const auto tree_read_ms = ms_since(start);
+	start = clock::now();
+	delete nbt_reader;
+	const auto tree_free_ms = ms_since(start);
+
+	blt::fs::mmap_reader_t document_reader{path};
+	start = clock::now();
+	auto document = blt::nbt::nbt_document_t::read(document_reader);
+	const auto document_read_ms = ms_since(start);
+	BLT_ASSERT(document.root().find("entities")->size() == entity_count);
+	BLT_ASSERT(document.root().find("entities")->at(entity_count - 1).find("health")->as_float() == 20.0f);
+	const auto tags = document.tag_count();
+	start = clock::now();
+	document.clear();
+	const auto document_free_ms = ms_since(start);
+
+	BLT_INFO("NBT ({} tags): tag tree read {:.2f}ms free {:.2f}ms, flat document read {:.2f}ms free {:.2f}ms", tags, tree_read_ms,
+			tree_free_ms, document_read_ms, document_free_ms);
+}
+
+int main()
+{
+	test_visitor_events();
+	test_document();
+	test_bulk_arrays();
+	test_region();
+	benchmark_arrays();
+
+	constexpr size_t entity_count = 20000;
+	const auto path = "nbt_bench.nbt";
+	{
+		std::ofstream file{path, std::ios::binary};
+		blt::fs::fstream_writer_t writer{file};
+		blt::nbt::NBTWriter nbt_writer{writer};
+		nbt_writer.write(make_entities(entity_count));
+	}
+	benchmark_visitor(path, entity_count);
+	benchmark_document(path, entity_count);
+	std::remove(path);
+}
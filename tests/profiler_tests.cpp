@@ -0,0 +1,522 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <blt/logging/logging.h>
+#include <blt/profiling/profiler_v2.h>
+#include <blt/std/assert.h>
+#include <blt/std/system.h>
+#include <blt/std/tsc.h>
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr size_t THREAD_COUNT = 4;
+constexpr size_t ITERATIONS = 10000;
+
+void work(const size_t iterations)
+{
+	for (size_t i = 0; i < iterations; i++)
+	{
+		BLT_PROFILE_SCOPE("Fast", "scope");
+		BLT_START_FAST_INTERVAL("Fast", "pair");
+		BLT_END_FAST_INTERVAL("Fast", "pair");
+	}
+}
+
+void test_interning()
+{
+	const auto first = blt::_internal::intern_interval("Interning", "a");
+	const auto second = blt::_internal::intern_interval("Interning", "b");
+	BLT_ASSERT(first != second);
+	BLT_ASSERT(blt::_internal::intern_interval("Interning", "a") == first);
+	BLT_ASSERT(blt::_internal::intern_interval("Other", "a") != first);
+	BLT_INFO("Interning passed");
+}
+
+void test_thread_merge()
+{
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < THREAD_COUNT; i++)
+		threads.emplace_back(work, ITERATIONS);
+	for (auto& thread : threads)
+		thread.join();
+	// threads which exited hand their slots on, the totals must survive that
+	threads.clear();
+	threads.emplace_back(work, ITERATIONS);
+	threads.back().join();
+
+	std::stringstream stream;
+	BLT_WRITE_PROFILE(stream, "Fast");
+	const auto table = stream.str();
+	const auto expected = std::to_string((THREAD_COUNT + 1) * ITERATIONS);
+	BLT_ASSERT(table.find("scope") != std::string::npos);
+	BLT_ASSERT(table.find("pair") != std::string::npos);
+	BLT_ASSERT(table.find(expected) != std::string::npos);
+	BLT_ASSERT(table.find("CPU Time") == std::string::npos);
+
+	// printing resets the profile
+	std::stringstream empty;
+	BLT_WRITE_PROFILE(empty, "Fast");
+	BLT_ASSERT(empty.str().empty());
+
+	work(10);
+	std::stringstream again;
+	BLT_WRITE_PROFILE(again, "Fast");
+	BLT_ASSERT(again.str().find(" 10 ") != std::string::npos);
+	BLT_INFO("Thread merge passed");
+}
+
+void test_mixed_profile()
+{
+	BLT_START_INTERVAL("Mixed", "legacy");
+	BLT_END_INTERVAL("Mixed", "legacy");
+	BLT_START_FAST_INTERVAL("Mixed", "fast");
+	BLT_END_FAST_INTERVAL("Mixed", "fast");
+
+	std::stringstream stream;
+	BLT_WRITE_PROFILE(stream, "Mixed");
+	const auto table = stream.str();
+	BLT_ASSERT(table.find("legacy") != std::string::npos);
+	BLT_ASSERT(table.find("fast") != std::string::npos);
+	BLT_ASSERT(table.find("CPU Time") != std::string::npos);
+	BLT_INFO("Mixed profile passed");
+}
+
+size_t count_occurrences(const std::string& str, const std::string& needle)
+{
+	size_t count = 0;
+	for (auto pos = str.find(needle); pos != std::string::npos; pos = str.find(needle, pos + needle.size()))
+		count++;
+	return count;
+}
+
+void test_histogram()
+{
+	using histogram_t = blt::latency_histogram_t;
+	// buckets cover every value exactly once
+	for (size_t bucket = 0; bucket + 1 < histogram_t::BUCKET_COUNT; bucket++)
+	{
+		const auto highest = histogram_t::highest_value_of(bucket);
+		BLT_ASSERT(histogram_t::bucket_of(highest) == bucket);
+		BLT_ASSERT(histogram_t::bucket_of(highest + 1) == bucket + 1);
+	}
+	BLT_ASSERT(histogram_t::bucket_of(std::numeric_limits<blt::u64>::max()) == histogram_t::BUCKET_COUNT - 1);
+
+	histogram_t first;
+	histogram_t second;
+	for (blt::u64 i = 1; i <= 100000; i++)
+		(i % 2 ? first : second).record(i);
+	first.merge(second);
+	BLT_ASSERT(first.count() == 100000);
+	BLT_ASSERT(first.max() == 100000);
+	for (const double percentile : {50.0, 90.0, 99.0, 99.9})
+	{
+		const auto exact = static_cast<double>(percentile * 1000);
+		const auto value = static_cast<double>(first.value_at_percentile(percentile));
+		BLT_ASSERT(value >= exact && value <= exact * (1 + 1.0 / histogram_t::HALF_SUB_BUCKETS));
+	}
+	BLT_ASSERT(first.value_at_percentile(100) == 100000);
+
+	auto later = first;
+	later.record(5);
+	later.subtract(first);
+	BLT_ASSERT(later.count() == 1);
+	BLT_ASSERT(later.max() == 5);
+	BLT_ASSERT(later.value_at_percentile(50) == 5);
+
+	// the slow tail of an interval shows in its percentiles even though it barely moves the average
+	BLT_RECORD_PERCENTILES("Percentiles");
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < 2; t++)
+	{
+		threads.emplace_back([]() {
+			for (size_t i = 0; i < 1000; i++)
+			{
+				BLT_PROFILE_SCOPE("Percentiles", "tail");
+				if (i % 100 == 99)
+					std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	blt::profile_t profile{"Histogram"};
+	blt::recordPercentiles(profile);
+	for (size_t i = 0; i < 10; i++)
+		blt::auto_interval interval{profile.intervals.empty() ? blt::createInterval(profile, "legacy") : profile.intervals.front()};
+
+	std::stringstream stream;
+	BLT_WRITE_PROFILE(stream, "Percentiles", blt::PRINT_WALL | blt::PRINT_PERCENTILES);
+	const auto table = stream.str();
+	BLT_ASSERT(table.find("p99.9") != std::string::npos);
+	// columns: order, interval, wall, p50, p90, p99, p99.9, max
+	const auto row_start = table.rfind('\n', table.find("tail"));
+	std::vector<std::string> columns;
+	std::stringstream row{table.substr(row_start + 1, table.find('\n', row_start + 1) - row_start - 1)};
+	for (std::string column; std::getline(row, column, '|');)
+		columns.push_back(column);
+	BLT_ASSERT(columns.size() >= 9);
+	BLT_ASSERT(std::stod(columns[7]) > 100 * std::stod(columns[4]));
+	BLT_ASSERT(std::stod(columns[8]) >= std::stod(columns[7]));
+
+	std::stringstream profile_stream;
+	blt::writeProfile(profile_stream, profile, blt::AVERAGE_HISTORY | blt::PRINT_PERCENTILES);
+	BLT_ASSERT(profile_stream.str().find("p50") != std::string::npos);
+	BLT_ASSERT(profile.intervals.front()->wall_histogram->count() == 10);
+
+	// without asking for percentiles no histogram is allocated, the columns show "-"
+	blt::profile_t plain{"Plain"};
+	for (size_t i = 0; i < 10; i++)
+		blt::auto_interval interval{plain.intervals.empty() ? blt::createInterval(plain, "plain") : plain.intervals.front()};
+	BLT_ASSERT(plain.intervals.front()->count == 10 && !plain.intervals.front()->wall_histogram);
+	for (size_t i = 0; i < 10; i++)
+		BLT_PROFILE_SCOPE("Plain", "fast");
+	std::stringstream plain_stream;
+	BLT_WRITE_PROFILE(plain_stream, "Plain", blt::PRINT_WALL | blt::PRINT_PERCENTILES);
+	const auto plain_table = plain_stream.str();
+	const auto fast_row = plain_table.substr(plain_table.find("fast"));
+	BLT_ASSERT(count_occurrences(fast_row.substr(0, fast_row.find('\n')), " - ") == 5);
+	BLT_INFO("Histogram passed");
+}
+
+void test_trace()
+{
+	BLT_RECORD_EVENTS("Trace", 64);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < 2; i++)
+	{
+		threads.emplace_back([i]() {
+			blt::logging::set_thread_name("worker \"" + std::to_string(i) + "\"");
+			for (size_t j = 0; j < 10; j++)
+			{
+				BLT_PROFILE_SCOPE("Trace", "outer");
+				BLT_START_INTERVAL("Trace", "inner");
+				BLT_END_INTERVAL("Trace", "inner");
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	// only the newest 64 events of a thread are kept
+	for (size_t i = 0; i < 100; i++)
+	{
+		BLT_START_FAST_INTERVAL("Trace", "wrapped");
+		BLT_END_FAST_INTERVAL("Trace", "wrapped");
+	}
+	BLT_START_FAST_INTERVAL("Untraced", "hidden");
+	BLT_END_FAST_INTERVAL("Untraced", "hidden");
+
+	std::stringstream stream;
+	BLT_WRITE_TRACE(stream, "Trace");
+	const auto trace = stream.str();
+	BLT_ASSERT(trace.find(R"("traceEvents":[)") != std::string::npos);
+	BLT_ASSERT(trace.find(R"(worker \"0\")") != std::string::npos);
+	BLT_ASSERT(trace.find(R"(worker \"1\")") != std::string::npos);
+	BLT_ASSERT(count_occurrences(trace, R"("name":"outer")") == 20);
+	BLT_ASSERT(count_occurrences(trace, R"("name":"wrapped")") == 64);
+	BLT_ASSERT(trace.find("hidden") == std::string::npos);
+
+	blt::profile_t profile{"Profile Trace"};
+	blt::recordEvents(profile);
+	for (size_t i = 0; i < 5; i++)
+		blt::auto_interval interval{"recorded", profile};
+	std::stringstream profile_stream;
+	blt::writeTrace(profile_stream, profile);
+	BLT_ASSERT(count_occurrences(profile_stream.str(), R"("ph":"X")") == 5);
+	BLT_ASSERT(profile_stream.str().find("Profile Trace") != std::string::npos);
+	BLT_INFO("Trace passed");
+}
+
+void spin_for(const std::chrono::microseconds duration)
+{
+	const auto end = clock_type::now() + duration;
+	while (clock_type::now() < end)
+	{
+	}
+}
+
+void scoped_child()
+{
+	BLT_PROFILE_SCOPE("Scopes", "child");
+	spin_for(std::chrono::microseconds(200));
+}
+
+void scoped_parent()
+{
+	BLT_PROFILE_SCOPE("Scopes", "parent");
+	spin_for(std::chrono::microseconds(100));
+	scoped_child();
+	// intervals of other profiles are transparent, their time stays with the parent
+	BLT_PROFILE_SCOPE("Unscoped", "hidden");
+	spin_for(std::chrono::microseconds(50));
+}
+
+std::vector<std::pair<std::string, blt::u64>> parse_collapsed(const std::string& collapsed)
+{
+	std::vector<std::pair<std::string, blt::u64>> stacks;
+	std::stringstream stream{collapsed};
+	for (std::string line; std::getline(stream, line);)
+	{
+		const auto space = line.rfind(' ');
+		stacks.emplace_back(line.substr(0, space), std::stoull(line.substr(space + 1)));
+	}
+	std::sort(stacks.begin(), stacks.end());
+	return stacks;
+}
+
+void test_scopes()
+{
+	BLT_RECORD_SCOPES("Scopes");
+	std::thread thread([]() {
+		for (size_t i = 0; i < 5; i++)
+			scoped_parent();
+	});
+	for (size_t i = 0; i < 5; i++)
+	{
+		scoped_parent();
+		scoped_child();
+	}
+	thread.join();
+	// ending a scope ends the scopes started inside it
+	BLT_START_FAST_INTERVAL("Scopes", "unbalanced");
+	BLT_START_INTERVAL("Scopes", "left open");
+	BLT_END_FAST_INTERVAL("Scopes", "unbalanced");
+	scoped_child();
+
+	std::stringstream collapsed_stream;
+	BLT_WRITE_COLLAPSED_STACKS(collapsed_stream, "Scopes");
+	const auto stacks = parse_collapsed(collapsed_stream.str());
+	std::vector<std::string> paths;
+	for (const auto& [path, weight] : stacks)
+		paths.push_back(path);
+	const std::vector<std::string> expected{"child", "parent", "parent;child", "unbalanced", "unbalanced;left open"};
+	BLT_ASSERT(paths == expected);
+	const auto weight_of = [&stacks](const std::string& path) {
+		return std::find_if(stacks.begin(), stacks.end(), [&path](const auto& stack) {
+			return stack.first == path;
+		})->second;
+	};
+	// 10 * 150us of its own against 10 * 200us in the child
+	BLT_ASSERT(weight_of("parent") >= 10 * 150000);
+	BLT_ASSERT(weight_of("parent;child") >= 10 * 200000);
+	BLT_ASSERT(weight_of("child") >= 6 * 200000);
+
+	std::stringstream table_stream;
+	BLT_WRITE_SCOPES(table_stream, "Scopes");
+	const auto table = table_stream.str();
+	BLT_ASSERT(table.find("Wall Excl") != std::string::npos);
+	BLT_ASSERT(table.find("..child") != std::string::npos);
+	BLT_ASSERT(table.find("hidden") == std::string::npos);
+
+	blt::profile_t profile{"Profile Scopes"};
+	blt::recordScopes(profile);
+	auto* outer = blt::createInterval(profile, "outer");
+	auto* inner = blt::createInterval(profile, "inner");
+	for (size_t i = 0; i < 3; i++)
+	{
+		blt::auto_interval outer_scope{outer};
+		blt::auto_interval inner_scope{inner};
+	}
+	std::stringstream profile_stream;
+	blt::writeCollapsedStacks(profile_stream, profile, blt::sort_by::CYCLES);
+	std::vector<std::string> profile_paths;
+	for (const auto& [path, weight] : parse_collapsed(profile_stream.str()))
+		profile_paths.push_back(path);
+	BLT_ASSERT((profile_paths == std::vector<std::string>{"outer", "outer;inner"}));
+	BLT_INFO("Scopes passed");
+}
+
+void test_counters()
+{
+	using blt::profiling::perf_counter_t;
+	namespace detail = blt::profiling::detail;
+	// a 48 bit register, the kernel's offset is negative while the register counts up towards it
+	static_assert(detail::sign_extend_pmc(0x7FFFFFFFFFFF, 48) == 0x7FFFFFFFFFFF);
+	static_assert(detail::sign_extend_pmc(0xFFFFFFFFFFFF, 48) == -1);
+	static_assert(detail::sign_extend_pmc(0x800000000000, 48) == -0x800000000000);
+	static_assert(detail::sign_extend_pmc(0xABCD000000000005, 48) == 5);
+	static_assert(detail::sign_extend_pmc(0xFFFFFFFFFFFFFFFF, 64) == -1);
+	// a 1GHz TSC is one ns per tick: mult 1 << shift, and the offset is taken as it is
+	static_assert(detail::perf_time_delta(1000, 0, 1u << 10, 10) == 1000);
+	static_assert(detail::perf_time_delta(1000, 500, 1u << 10, 10) == 1500);
+	// a 4GHz TSC is a quarter ns per tick, the remainder keeps the fraction below one shift step
+	static_assert(detail::perf_time_delta(4003, 0, 1u << 8, 10) == 1000);
+	static_assert(detail::perf_time_delta((1ull << 40) + 4, 0, 1u << 8, 10) == (1ull << 38) + 1);
+	// the offset is negative as often as not, time passes modulo 2^64
+	static_assert(detail::perf_time_delta(2000, static_cast<blt::u64>(-500), 1u << 10, 10) == 1500);
+	BLT_ASSERT(detail::scale_count(100, 1000, 1000) == 100);
+	BLT_ASSERT(detail::scale_count(100, 1000, 0) == 100);
+	BLT_ASSERT(detail::scale_count(100, 1000, 250) == 400);
+	// both ends of an interval scaled alike subtract to the scaled difference
+	blt::profiling::perf_values_t start, end;
+	start[perf_counter_t::INSTRUCTIONS] = detail::scale_count(1000, 2000, 1000);
+	end[perf_counter_t::INSTRUCTIONS] = detail::scale_count(1500, 3000, 1500);
+	BLT_ASSERT((end - start)[perf_counter_t::INSTRUCTIONS] == 1000);
+
+	// never throws, whatever the kernel allows
+	const blt::profiling::perf_counter_group_t group;
+	BLT_ASSERT(group.has(perf_counter_t::CONTEXT_SWITCHES));
+	BLT_ASSERT(group.has(perf_counter_t::INSTRUCTIONS) || !group.error().empty());
+	const auto before = group.read();
+	spin_for(std::chrono::microseconds(200));
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	const auto after = group.read();
+	for (size_t i = 0; i < blt::profiling::PERF_COUNTER_COUNT; i++)
+		BLT_ASSERT(after.values[i] >= before.values[i]);
+	if (group.has(perf_counter_t::INSTRUCTIONS))
+		BLT_ASSERT(after[perf_counter_t::INSTRUCTIONS] > before[perf_counter_t::INSTRUCTIONS]);
+
+	BLT_RECORD_COUNTERS("Counters");
+	for (size_t i = 0; i < 10; i++)
+	{
+		BLT_PROFILE_SCOPE("Counters", "fast");
+		BLT_START_INTERVAL("Counters", "legacy");
+		spin_for(std::chrono::microseconds(20));
+		BLT_END_INTERVAL("Counters", "legacy");
+	}
+	std::stringstream stream;
+	BLT_WRITE_PROFILE(stream, "Counters", blt::PRINT_COUNTERS);
+	const auto table = stream.str();
+	BLT_ASSERT(table.find("IPC") != std::string::npos);
+	BLT_ASSERT(table.find("LLC MPKI") != std::string::npos);
+	BLT_ASSERT(table.find("Ctx Switches") != std::string::npos);
+	// without a PMU the hardware columns stay empty and the table says why
+	if (!group.has(perf_counter_t::INSTRUCTIONS))
+		BLT_ASSERT(table.find("Hardware counters unavailable: " + group.error()) != std::string::npos);
+
+	// printing from a thread which never recorded counters does not open any for it
+	for (size_t i = 0; i < 10; i++)
+	{
+		BLT_START_INTERVAL("Counters", "legacy");
+		spin_for(std::chrono::microseconds(20));
+		BLT_END_INTERVAL("Counters", "legacy");
+	}
+	std::thread([&table]() {
+		const auto open_fds = []() {
+			return std::distance(std::filesystem::directory_iterator{"/proc/self/fd"}, std::filesystem::directory_iterator{});
+		};
+		const auto before = open_fds();
+		std::stringstream printed;
+		BLT_WRITE_PROFILE(printed, "Counters", blt::PRINT_COUNTERS);
+		BLT_ASSERT(open_fds() == before);
+		// the note is the same as on the threads which recorded
+		const auto note = table.find("Hardware counters unavailable");
+		BLT_ASSERT((note == std::string::npos) == (printed.str().find("Hardware counters unavailable") == std::string::npos));
+		if (note != std::string::npos)
+			BLT_ASSERT(printed.str().find(table.substr(note)) != std::string::npos);
+	}).join();
+
+	BLT_INFO("Counters passed, hardware counters {}", group.has(perf_counter_t::INSTRUCTIONS)
+														? (group.uses_rdpmc() ? "read with rdpmc" : "read with read()")
+														: "unavailable");
+}
+
+void test_tsc()
+{
+	const auto calibration = blt::system::tsc_calibration();
+	BLT_ASSERT(!calibration.used || (calibration.invariant && calibration.frequency_hz > 0));
+
+	blt::i64 last = blt::system::now_ns();
+	for (size_t i = 0; i < 100000; i++)
+	{
+		const auto now = blt::system::now_ns();
+		BLT_ASSERT(now >= last);
+		last = now;
+	}
+
+	// long enough to cross a few re-anchoring windows
+	const auto wall_start = clock_type::now();
+	const auto ns_start = blt::system::now_ns();
+	const auto cycles_start = blt::system::rdtsc();
+	spin_for(std::chrono::milliseconds(50));
+	const auto cycles_end = blt::system::rdtsc();
+	const auto ns_end = blt::system::now_ns();
+	const auto wall_end = clock_type::now();
+	const auto wall = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(wall_end - wall_start).count());
+	const auto measured = static_cast<double>(ns_end - ns_start);
+	BLT_ASSERT(measured <= wall && measured >= wall * 0.99);
+	if (calibration.frequency_hz > 0)
+	{
+		const auto converted = blt::system::tsc_to_ns(cycles_end - cycles_start);
+		BLT_ASSERT(converted <= wall * 1.01 && converted >= wall * 0.99);
+	}
+
+	const auto system_now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	BLT_ASSERT(std::abs(blt::system::unix_now_ns() - system_now) < 1000000);
+
+	const auto recalibrated = blt::system::recalibrate_tsc();
+	BLT_ASSERT(recalibrated.used == calibration.used);
+	BLT_ASSERT(blt::system::now_ns() >= last);
+
+	constexpr size_t iterations = 200000;
+	const auto tsc_start = clock_type::now();
+	for (size_t i = 0; i < iterations; i++)
+		last = std::max(last, blt::system::now_ns());
+	const auto chrono_start = clock_type::now();
+	for (size_t i = 0; i < iterations; i++)
+		last = std::max<blt::i64>(last, clock_type::now().time_since_epoch().count());
+	const auto chrono_end = clock_type::now();
+	const auto per_call = [](const auto duration) {
+		return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) / iterations;
+	};
+	BLT_INFO("TSC passed, {} at {:.1f} MHz, now_ns {:.1f}ns per call, steady_clock {:.1f}ns per call",
+			calibration.used ? "invariant TSC" : "system clock fallback", calibration.frequency_hz / 1e6, per_call(chrono_start - tsc_start),
+			per_call(chrono_end - chrono_start));
+}
+
+void benchmark_overhead()
+{
+	constexpr size_t iterations = 200000;
+	const auto fast = blt::_internal::measure_interval_overhead(iterations);
+
+	const auto wall_start = clock_type::now();
+	const auto cycles_start = blt::system::rdtsc();
+	for (size_t i = 0; i < iterations; i++)
+	{
+		BLT_START_INTERVAL("Overhead", "legacy");
+		BLT_END_INTERVAL("Overhead", "legacy");
+	}
+	const auto cycles_end = blt::system::rdtsc();
+	const auto wall_end = clock_type::now();
+	const auto legacy_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(wall_end - wall_start).count()) / iterations;
+	const auto legacy_cycles = static_cast<double>(cycles_end - cycles_start) / iterations;
+	std::stringstream discard;
+	BLT_WRITE_PROFILE(discard, "Overhead");
+
+	BLT_INFO("Overhead per start/end pair: fast {:.1f}ns ({:.1f} cycles), string keyed {:.1f}ns ({:.1f} cycles)", fast.wall_ns, fast.cycles,
+			legacy_ns, legacy_cycles);
+}
+
+int main()
+{
+	test_interning();
+	test_thread_merge();
+	test_mixed_profile();
+	test_trace();
+	test_histogram();
+	test_scopes();
+	test_counters();
+	test_tsc();
+	benchmark_overhead();
+}
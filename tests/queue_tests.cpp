@@ -0,0 +1,280 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <blt/logging/logging.h>
+#include <blt/std/assert.h>
+#include <blt/std/queue.h>
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr blt::size_t batch_size = 32;
+
+template <typename T>
+class mutex_queue_t
+{
+public:
+	explicit mutex_queue_t(blt::size_t)
+	{}
+
+	bool try_push(const T& t)
+	{
+		std::scoped_lock lock(m_mutex);
+		m_queue.push(t);
+		return true;
+	}
+
+	bool try_pop(T& out)
+	{
+		std::scoped_lock lock(m_mutex);
+		if (m_queue.empty())
+			return false;
+		out = m_queue.front();
+		m_queue.pop();
+		return true;
+	}
+
+	template <typename Iter>
+	blt::size_t try_push_n(Iter begin, const blt::size_t count)
+	{
+		std::scoped_lock lock(m_mutex);
+		for (blt::size_t i = 0; i < count; i++, ++begin)
+			m_queue.push(*begin);
+		return count;
+	}
+
+	template <typename Iter>
+	blt::size_t try_pop_n(Iter out, const blt::size_t count)
+	{
+		std::scoped_lock lock(m_mutex);
+		blt::size_t popped = 0;
+		for (; popped < count && !m_queue.empty(); ++popped, ++out)
+		{
+			*out = m_queue.front();
+			m_queue.pop();
+		}
+		return popped;
+	}
+
+private:
+	std::mutex m_mutex;
+	std::queue<T> m_queue;
+};
+
+/**
+ * Runs producers and consumers over the queue, each producer pushing the values [id * per_producer, (id + 1) * per_producer).
+ * @return sum of every value popped, used to check nothing was lost or duplicated
+ */
+template <typename Queue>
+blt::u64 run_queue(Queue& queue, const blt::size_t producers, const blt::size_t consumers, const blt::size_t per_producer, const bool batched)
+{
+	std::atomic<blt::u64> sum = 0;
+	std::atomic<blt::size_t> consumed = 0;
+	const auto total = producers * per_producer;
+	std::vector<std::thread> threads;
+	for (blt::size_t p = 0; p < producers; p++)
+	{
+		threads.emplace_back([&queue, p, per_producer, batched]() {
+			const auto begin = p * per_producer;
+			const auto end = begin + per_producer;
+			std::array<blt::u64, batch_size> values{};
+			for (auto i = begin; i < end;)
+			{
+				if (batched)
+				{
+					const auto count = std::min(batch_size, end - i);
+					for (blt::size_t j = 0; j < count; j++)
+						values[j] = i + j;
+					blt::size_t pushed = 0;
+					while (pushed < count)
+					{
+						const auto amount = queue.try_push_n(values.begin() + static_cast<blt::ptrdiff_t>(pushed), count - pushed);
+						if (amount == 0)
+							std::this_thread::yield();
+						pushed += amount;
+					}
+					i += count;
+				} else
+				{
+					while (!queue.try_push(static_cast<blt::u64>(i)))
+						std::this_thread::yield();
+					++i;
+				}
+			}
+		});
+	}
+	for (blt::size_t c = 0; c < consumers; c++)
+	{
+		threads.emplace_back([&queue, &sum, &consumed, total, batched]() {
+			std::array<blt::u64, batch_size> values{};
+			blt::u64 local = 0;
+			while (consumed.load(std::memory_order_relaxed) < total)
+			{
+				blt::size_t amount;
+				if (batched)
+					amount = queue.try_pop_n(values.begin(), batch_size);
+				else
+					amount = queue.try_pop(values[0]) ? 1 : 0;
+				if (amount == 0)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				for (blt::size_t j = 0; j < amount; j++)
+					local += values[j];
+				consumed.fetch_add(amount, std::memory_order_relaxed);
+			}
+			sum.fetch_add(local);
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	return sum.load();
+}
+
+void test_flat_queue()
+{
+	// move only elements, wrap around and growth while wrapped
+	blt::flat_queue<std::unique_ptr<int>> queue;
+	int next_push = 0, next_pop = 0;
+	for (int round = 0; round < 1000; round++)
+	{
+		for (int i = 0; i < 5; i++)
+			queue.push(std::make_unique<int>(next_push++));
+		for (int i = 0; i < 4; i++)
+		{
+			BLT_ASSERT(*queue.front() == next_pop++);
+			queue.pop();
+		}
+	}
+	BLT_ASSERT(queue.size() == 1000);
+	int expected = next_pop;
+	for (const auto& v : queue)
+		BLT_ASSERT(*v == expected++);
+
+	// a queue with a bounded number of live elements stops growing
+	blt::flat_queue<int> fifo;
+	for (int i = 0; i < 10; i++)
+		fifo.push(i);
+	const auto capacity = fifo.capacity();
+	for (int i = 10; i < 100000; i++)
+	{
+		BLT_ASSERT(fifo.front() == i - 10);
+		fifo.pop();
+		fifo.push(i);
+	}
+	BLT_ASSERT(fifo.capacity() == capacity && fifo.back() == 99999);
+
+	auto moved = std::move(queue);
+	BLT_ASSERT(moved.size() == 1000 && queue.empty());
+	blt::flat_queue<int> copy;
+	copy = fifo;
+	BLT_ASSERT(copy.size() == fifo.size() && copy.front() == fifo.front());
+	BLT_INFO("flat_queue tests passed");
+}
+
+template <typename Queue>
+void check_queue(const blt::size_t producers, const blt::size_t consumers)
+{
+	constexpr blt::size_t per_producer = 50000;
+	const auto total = producers * per_producer;
+	const auto expected = static_cast<blt::u64>(total) * (total - 1) / 2;
+	for (const bool batched : {false, true})
+	{
+		Queue queue{64};
+		BLT_ASSERT(run_queue(queue, producers, consumers, per_producer, batched) == expected);
+		BLT_ASSERT(queue.size_approx() == 0);
+	}
+}
+
+void test_queue_correctness()
+{
+	// single threaded behaviour, capacity rounding and partial batches
+	blt::mpmc_queue<int> queue{5};
+	BLT_ASSERT(queue.capacity() == 8);
+	std::array<int, 10> values{0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+	BLT_ASSERT(queue.try_push_n(values.begin(), values.size()) == 8);
+	BLT_ASSERT(!queue.try_push(10));
+	int value;
+	BLT_ASSERT(queue.try_pop(value) && value == 0);
+	std::array<int, 10> out{};
+	BLT_ASSERT(queue.try_pop_n(out.begin(), out.size()) == 7);
+	for (int i = 0; i < 7; i++)
+		BLT_ASSERT(out[i] == i + 1);
+	BLT_ASSERT(!queue.try_pop(value));
+
+	// elements left in the queue are destroyed with it
+	auto shared = std::make_shared<int>(0);
+	{
+		blt::spsc_queue<std::shared_ptr<int>> spsc{4};
+		blt::mpsc_queue<std::shared_ptr<int>> mpsc{4};
+		BLT_ASSERT(spsc.try_push(shared) && spsc.try_emplace(shared));
+		BLT_ASSERT(mpsc.try_push(shared));
+		BLT_ASSERT(shared.use_count() == 4);
+	}
+	BLT_ASSERT(shared.use_count() == 1);
+
+	check_queue<blt::spsc_queue<blt::u64>>(1, 1);
+	check_queue<blt::mpsc_queue<blt::u64>>(4, 1);
+	check_queue<blt::mpmc_queue<blt::u64>>(4, 4);
+	BLT_INFO("Queue correctness tests passed");
+}
+
+template <typename Queue>
+double bench_queue(const blt::size_t producers, const blt::size_t consumers, const bool batched)
+{
+	constexpr blt::size_t total = 1 << 20;
+	Queue queue{1024};
+	const auto start = clock_type::now();
+	run_queue(queue, producers, consumers, total / producers, batched);
+	const auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+	return static_cast<double>(total) / seconds;
+}
+
+int main()
+{
+	test_flat_queue();
+	test_queue_correctness();
+
+	BLT_INFO("Throughput in operations per second, threads are per side (producers = consumers)");
+	BLT_INFO("{:>8} {:>16} {:>16} {:>16} {:>16}", "threads", "mutex+std::queue", "mpmc", "mutex batch", "mpmc batch");
+	for (const blt::size_t threads : {1, 2, 4, 8, 16})
+	{
+		BLT_INFO("{:>8} {:>16} {:>16} {:>16} {:>16}", threads,
+				static_cast<blt::u64>(bench_queue<mutex_queue_t<blt::u64>>(threads, threads, false)),
+				static_cast<blt::u64>(bench_queue<blt::mpmc_queue<blt::u64>>(threads, threads, false)),
+				static_cast<blt::u64>(bench_queue<mutex_queue_t<blt::u64>>(threads, threads, true)),
+				static_cast<blt::u64>(bench_queue<blt::mpmc_queue<blt::u64>>(threads, threads, true)));
+	}
+	BLT_INFO("{:>8} {:>16} {:>16} {:>16} {:>16}", "1 -> 1", "mutex+std::queue", "spsc", "mutex batch", "spsc batch");
+	BLT_INFO("{:>8} {:>16} {:>16} {:>16} {:>16}", "", static_cast<blt::u64>(bench_queue<mutex_queue_t<blt::u64>>(1, 1, false)),
+			static_cast<blt::u64>(bench_queue<blt::spsc_queue<blt::u64>>(1, 1, false)),
+			static_cast<blt::u64>(bench_queue<mutex_queue_t<blt::u64>>(1, 1, true)),
+			static_cast<blt::u64>(bench_queue<blt::spsc_queue<blt::u64>>(1, 1, true)));
+	BLT_INFO("{:>8} {:>16} {:>16} {:>16} {:>16}", "4 -> 1", "mutex+std::queue", "mpsc", "mutex batch", "mpsc batch");
+	BLT_INFO("{:>8} {:>16} {:>16} {:>16} {:>16}", "", static_cast<blt::u64>(bench_queue<mutex_queue_t<blt::u64>>(4, 1, false)),
+			static_cast<blt::u64>(bench_queue<blt::mpsc_queue<blt::u64>>(4, 1, false)),
+			static_cast<blt::u64>(bench_queue<mutex_queue_t<blt::u64>>(4, 1, true)),
+			static_cast<blt::u64>(bench_queue<blt::mpsc_queue<blt::u64>>(4, 1, true)));
+}
@@ -0,0 +1,529 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <blt/fs/buffered_reader.h>
+#include <blt/fs/serializable.h>
+#include <blt/fs/stream_wrappers.h>
+#include <blt/logging/logging.h>
+#include <blt/std/assert.h>
+
+using clock_type = std::chrono::steady_clock;
+
+class string_writer_t final : public blt::fs::writer_t
+{
+public:
+	blt::i64 write(const char* buffer, const size_t bytes) override
+	{
+		str.append(buffer, bytes);
+		return static_cast<blt::i64>(bytes);
+	}
+
+	std::string str;
+};
+
+// hands out at most max_read bytes per call and counts the calls, like a slow backend would
+class string_reader_t final : public blt::fs::reader_t
+{
+public:
+	explicit string_reader_t(std::string data, const size_t max_read = std::numeric_limits<size_t>::max()):
+		m_data(std::move(data)), m_max_read(max_read)
+	{}
+
+	blt::i64 read(char* buffer, const size_t bytes) override
+	{
+		++calls;
+		const auto amount = std::min({bytes, m_max_read, m_data.size() - m_pos});
+		std::memcpy(buffer, m_data.data() + m_pos, amount);
+		m_pos += amount;
+		return static_cast<blt::i64>(amount);
+	}
+
+	size_t calls = 0;
+
+private:
+	std::string m_data;
+	size_t m_max_read;
+	size_t m_pos = 0;
+};
+
+std::string counting_bytes(const size_t count)
+{
+	std::string data(count, '\0');
+	for (size_t i = 0; i < count; i++)
+		data[i] = static_cast<char>(i);
+	return data;
+}
+
+void test_buffered_reader()
+{
+	const auto data = counting_bytes(1000);
+	// a tiny buffer and a backend which returns short reads puts every value across a refill
+	string_reader_t backend{data, 3};
+	blt::fs::buffered_reader_t reader{backend, 7};
+
+	blt::u32 value;
+	BLT_ASSERT(reader.read_value(value));
+	BLT_ASSERT(std::memcmp(&value, data.data(), sizeof(value)) == 0);
+
+	const auto peeked = reader.peek(6);
+	BLT_ASSERT(peeked == std::string_view(data).substr(4, 6));
+	// peek does not consume
+	BLT_ASSERT(reader.peek(2) == std::string_view(data).substr(4, 2));
+	// never more than the buffer holds
+	BLT_ASSERT(reader.peek(100).size() == reader.buffer_size());
+
+	BLT_ASSERT(reader.skip(20) == 20);
+	char byte;
+	BLT_ASSERT(reader.read(&byte, 1) == 1 && byte == data[24]);
+
+	// larger than the buffer, read straight from the backend
+	std::string large(500, '\0');
+	BLT_ASSERT(reader.read(large.data(), large.size()) == 500);
+	BLT_ASSERT(large == data.substr(25, 500));
+
+	BLT_ASSERT(reader.skip(1000) == 1000 - 525);
+	BLT_ASSERT(!reader.read_value(value));
+	BLT_ASSERT(reader.peek(4).empty());
+	BLT_ASSERT(reader.read(&byte, 1) == 0);
+}
+
+struct record_t
+{
+	blt::i32 id;
+	float weight;
+	double position[3];
+};
+
+template <typename T>
+std::string serialize_fixed(const T& value)
+{
+	string_writer_t writer;
+	blt::fs::writer_serializer_t out{writer};
+	out << value;
+	return writer.str;
+}
+
+void test_serializer()
+{
+	string_writer_t writer;
+	blt::fs::writer_serializer_t out{writer};
+	for (blt::i32 i = 0; i < 1000; i++)
+		out << i << static_cast<blt::u8>(i) << record_t{i, static_cast<float>(i) / 2, {1, 2, 3}};
+	out << std::string("buffered") << std::vector<blt::i64>{1, -2, 3};
+
+	string_reader_t backend{writer.str};
+	blt::fs::buffered_reader_t buffered{backend, 4096};
+	blt::fs::reader_serializer_t in{buffered};
+	for (blt::i32 i = 0; i < 1000; i++)
+	{
+		blt::i32 value;
+		blt::u8 small;
+		record_t record{};
+		in >> value >> small >> record;
+		BLT_ASSERT(value == i);
+		BLT_ASSERT(small == static_cast<blt::u8>(i));
+		BLT_ASSERT(record.id == i && record.weight == static_cast<float>(i) / 2 && record.position[2] == 3);
+	}
+	std::string str;
+	std::vector<blt::i64> values;
+	in >> str >> values;
+	BLT_ASSERT(str == "buffered");
+	BLT_ASSERT((values == std::vector<blt::i64>{1, -2, 3}));
+	// thousands of values, only a handful of reads made it to the backend
+	BLT_ASSERT(backend.calls <= writer.str.size() / 4096 + 2);
+
+	// a backend handing out a few bytes at a time is read until everything arrived, one running out of data throws
+	const auto reads = [](const std::string& data, auto value, const bool buffer) {
+		string_reader_t short_reads{data, 3};
+		blt::fs::buffered_reader_t buffered_short{short_reads, 4};
+		blt::fs::reader_serializer_t short_in{buffer ? static_cast<blt::fs::reader_t&>(buffered_short) : short_reads};
+		try
+		{
+			short_in >> value;
+		} catch (const std::runtime_error&)
+		{
+			return false;
+		}
+		return true;
+	};
+	for (const bool buffer : {false, true})
+	{
+		const auto full_string = serialize_fixed(std::string("ten chars!"));
+		const auto full_vector = serialize_fixed(std::vector<blt::i32>{1, 2, 3, 4});
+		BLT_ASSERT(reads(full_string, std::string{}, buffer));
+		BLT_ASSERT(reads(full_vector, std::vector<blt::i32>{}, buffer));
+		BLT_ASSERT(!reads(full_string.substr(0, full_string.size() - 7), std::string{}, buffer));
+		BLT_ASSERT(!reads(full_vector.substr(0, full_vector.size() - 6), std::vector<blt::i32>{}, buffer));
+	}
+}
+
+using blt::fs::serializer_encoding_t;
+
+template <typename... Values>
+std::string serialize(const serializer_encoding_t encoding, const Values&... values)
+{
+	string_writer_t writer;
+	blt::fs::writer_serializer_t out{writer, encoding};
+	((out << values), ...);
+	return writer.str;
+}
+
+template <typename T>
+void check_round_trip(const serializer_encoding_t encoding, const T& value)
+{
+	const auto data = serialize(encoding, value);
+	string_reader_t backend{data};
+	blt::fs::reader_serializer_t in{backend, encoding};
+	T result{};
+	in >> result;
+	BLT_ASSERT(result == value);
+	// everything written has to be consumed
+	char extra;
+	BLT_ASSERT(backend.read(&extra, 1) == 0);
+}
+
+template <typename T>
+void check_integer(const serializer_encoding_t encoding)
+{
+	using limits = std::numeric_limits<T>;
+	for (const auto value : {T{0}, T{1}, T{63}, T{64}, T{127}, T{128}, static_cast<T>(16383), static_cast<T>(16384), limits::max(),
+							 limits::min(), static_cast<T>(limits::max() - 1), static_cast<T>(limits::min() + 1)})
+		check_round_trip(encoding, value);
+	if constexpr (std::is_signed_v<T>)
+	{
+		for (const auto value : {T{-1}, T{-64}, T{-65}, static_cast<T>(-8192)})
+			check_round_trip(encoding, value);
+	}
+}
+
+void test_varint()
+{
+	for (const auto encoding : {serializer_encoding_t::FIXED, serializer_encoding_t::VARINT})
+	{
+		check_integer<blt::i16>(encoding);
+		check_integer<blt::u16>(encoding);
+		check_integer<blt::i32>(encoding);
+		check_integer<blt::u32>(encoding);
+		check_integer<blt::i64>(encoding);
+		check_integer<blt::u64>(encoding);
+		check_round_trip(encoding, true);
+		check_round_trip(encoding, static_cast<blt::i8>(-5));
+		check_round_trip(encoding, 2.5f);
+		check_round_trip(encoding, std::string("varint"));
+		check_round_trip(encoding, std::string(300, 'x'));
+		check_round_trip(encoding, std::vector<blt::i32>{0, -1, 1, 1000000, std::numeric_limits<blt::i32>::min()});
+		check_round_trip(encoding, std::vector<blt::u64>{0, 1ull << 63, 300});
+		check_round_trip(encoding, std::vector<double>{1.5, -2});
+		check_round_trip(encoding, std::vector<std::string>{"a", "", "ccc"});
+		check_round_trip(encoding, std::pair<blt::i16, blt::u64>{-300, 5});
+	}
+
+	// LEB128 as written by everyone else
+	BLT_ASSERT(serialize(serializer_encoding_t::VARINT, blt::u32{300}) == "\xAC\x02");
+	BLT_ASSERT(serialize(serializer_encoding_t::VARINT, blt::i32{-1}) == "\x01");
+	BLT_ASSERT(serialize(serializer_encoding_t::VARINT, blt::i32{1}) == "\x02");
+	BLT_ASSERT(serialize(serializer_encoding_t::VARINT, std::numeric_limits<blt::u64>::max()).size() == 10);
+	BLT_ASSERT(serialize(serializer_encoding_t::VARINT, std::string("abc")).size() == 4);
+	BLT_ASSERT(serialize(serializer_encoding_t::FIXED, std::string("abc")).size() == sizeof(size_t) + 3);
+	// the fixed encoding is unchanged, raw native integers
+	const blt::i32 raw = -7;
+	BLT_ASSERT(serialize(serializer_encoding_t::FIXED, raw) == std::string(reinterpret_cast<const char*>(&raw), sizeof(raw)));
+
+	const auto rejects = [](std::string data, auto value) {
+		string_reader_t backend{std::move(data)};
+		blt::fs::reader_serializer_t in{backend, serializer_encoding_t::VARINT};
+		try
+		{
+			in >> value;
+		} catch (const std::runtime_error&)
+		{
+			return true;
+		}
+		return false;
+	};
+	BLT_ASSERT(rejects(std::string(11, '\xFF'), blt::u64{}));
+	BLT_ASSERT(rejects(serialize(serializer_encoding_t::VARINT, blt::u32{70000}), blt::u16{}));
+	BLT_ASSERT(rejects(std::string("\x80"), blt::u32{}));
+}
+
+namespace reflected
+{
+	struct vec3_t
+	{
+		float x, y, z;
+	};
+
+	BLT_SERIALIZABLE(vec3_t, x, y, z)
+
+	struct entity_t
+	{
+		blt::u32 id;
+		blt::i32 health;
+		vec3_t position;
+		std::string name;
+		std::vector<blt::i32> tags;
+		blt::u8 flags;
+		double scale[2];
+	};
+
+	BLT_SERIALIZABLE(entity_t, id, health, position, name, tags, flags, scale)
+
+	// padding after a and b, so the run is packed through a buffer
+	struct padded_t
+	{
+		blt::u8 a;
+		blt::u32 b;
+		blt::u8 c;
+	};
+
+	BLT_SERIALIZABLE(padded_t, a, b, c)
+
+	// trivially copyable, but stores itself as a single byte
+	struct level_t
+	{
+		blt::u32 value;
+
+		template <typename Out>
+		void save(Out& out) const
+		{
+			out << static_cast<blt::u8>(value);
+		}
+
+		template <typename In>
+		void load(In& in)
+		{
+			blt::u8 stored;
+			in >> stored;
+			value = stored;
+		}
+	};
+
+	struct player_t
+	{
+		blt::u32 id;
+		level_t level;
+		blt::u32 score;
+	};
+
+	BLT_SERIALIZABLE(player_t, id, level, score)
+
+	bool operator==(const vec3_t& a, const vec3_t& b)
+	{
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+
+	bool operator==(const player_t& a, const player_t& b)
+	{
+		return a.id == b.id && a.level.value == b.level.value && a.score == b.score;
+	}
+
+	bool operator==(const entity_t& a, const entity_t& b)
+	{
+		return a.id == b.id && a.health == b.health && a.position == b.position && a.name == b.name && a.tags == b.tags &&
+			a.flags == b.flags && a.scale[0] == b.scale[0] && a.scale[1] == b.scale[1];
+	}
+
+	entity_t make_entity(const blt::u32 i)
+	{
+		return {i, static_cast<blt::i32>(i % 40) - 20, {static_cast<float>(i), 2, 3}, "entity " + std::to_string(i), {1, -2, static_cast<blt::i32>(i)},
+				static_cast<blt::u8>(i), {0.5, 2}};
+	}
+
+	namespace v2
+	{
+		// same names, one field changed width
+		struct entity_t
+		{
+			blt::u32 id;
+			blt::i64 health;
+			vec3_t position;
+			std::string name;
+			std::vector<blt::i32> tags;
+			blt::u8 flags;
+			double scale[2];
+		};
+
+		BLT_SERIALIZABLE(entity_t, id, health, position, name, tags, flags, scale)
+	}
+}
+
+class counting_writer_t final : public blt::fs::writer_t
+{
+public:
+	blt::i64 write(const char*, const size_t bytes) override
+	{
+		++calls;
+		total += bytes;
+		return static_cast<blt::i64>(bytes);
+	}
+
+	size_t calls = 0;
+	size_t total = 0;
+};
+
+void test_reflection()
+{
+	using namespace reflected;
+	static_assert(blt::fs::detail::is_serializable_v<entity_t>);
+	static_assert(!blt::fs::detail::is_serializable_v<record_t>);
+	static_assert(blt::fs::detail::schema_hash_v<entity_t> != blt::fs::detail::schema_hash_v<v2::entity_t>);
+
+	for (const auto encoding : {serializer_encoding_t::FIXED, serializer_encoding_t::VARINT})
+	{
+		check_round_trip(encoding, make_entity(7));
+		check_round_trip(encoding, vec3_t{1, -2, 3});
+		std::vector<entity_t> entities;
+		for (blt::u32 i = 0; i < 100; i++)
+			entities.push_back(make_entity(i));
+		check_round_trip(encoding, entities);
+		check_round_trip(encoding, std::list<vec3_t>{{1, 2, 3}, {4, 5, 6}});
+		check_round_trip(encoding, std::pair<vec3_t, std::string>{{1, 2, 3}, "pair"});
+		check_round_trip(encoding, player_t{1, {20}, 300});
+	}
+
+	// the schema hash and then three floats in a single write
+	counting_writer_t counter;
+	blt::fs::writer_serializer_t out{counter};
+	out << vec3_t{1, 2, 3};
+	BLT_ASSERT(counter.calls == 2 && counter.total == sizeof(blt::u64) + 3 * sizeof(float));
+	counter.calls = counter.total = 0;
+	out << padded_t{1, 2, 3};
+	BLT_ASSERT(counter.calls == 2 && counter.total == sizeof(blt::u64) + 6);
+	// a field with its own save() splits the run around it and is stored the way it asks to be
+	static_assert(!blt::fs::detail::is_packable_v<level_t, false>);
+	counter.calls = counter.total = 0;
+	out << player_t{1, {2}, 3};
+	BLT_ASSERT(counter.total == sizeof(blt::u64) + 2 * sizeof(blt::u32) + 1);
+	// the hash is only written once for a whole container
+	counter.calls = counter.total = 0;
+	out << std::vector<vec3_t>(10);
+	BLT_ASSERT(counter.total == sizeof(size_t) + sizeof(blt::u64) + 10 * 3 * sizeof(float));
+
+	const auto mismatch = [](const std::string& data, auto value) {
+		string_reader_t backend{data};
+		blt::fs::reader_serializer_t in{backend};
+		try
+		{
+			in >> value;
+		} catch (const std::runtime_error&)
+		{
+			return true;
+		}
+		return false;
+	};
+	BLT_ASSERT(mismatch(serialize(serializer_encoding_t::FIXED, make_entity(1)), v2::entity_t{}));
+	BLT_ASSERT(mismatch(serialize(serializer_encoding_t::FIXED, vec3_t{}), padded_t{}));
+	BLT_ASSERT(!mismatch(serialize(serializer_encoding_t::FIXED, make_entity(1)), entity_t{}));
+
+	// packed runs are read in full from a backend which hands out a few bytes at a time, and throw once it runs out
+	const auto entity = serialize(serializer_encoding_t::FIXED, make_entity(3));
+	string_reader_t short_reads{entity, 3};
+	blt::fs::reader_serializer_t short_in{short_reads};
+	entity_t read_entity{};
+	short_in >> read_entity;
+	BLT_ASSERT(read_entity == make_entity(3));
+	BLT_ASSERT(mismatch(serialize(serializer_encoding_t::FIXED, padded_t{1, 2, 3}).substr(0, sizeof(blt::u64) + 4), padded_t{}));
+}
+
+using message_t = std::tuple<blt::u32, blt::i32, std::vector<blt::u16>, std::string>;
+
+void benchmark_encodings()
+{
+	// shaped like our message logs, small ids and deltas with short payloads
+	std::vector<message_t> messages;
+	for (blt::u32 i = 0; i < 200000; i++)
+		messages.emplace_back(i % 1000, static_cast<blt::i32>(i % 41) - 20, std::vector<blt::u16>(i % 5, static_cast<blt::u16>(i % 300)),
+							  "event");
+
+	for (const auto encoding : {serializer_encoding_t::FIXED, serializer_encoding_t::VARINT})
+	{
+		auto start = clock_type::now();
+		string_writer_t writer;
+		blt::fs::writer_serializer_t out{writer, encoding};
+		for (const auto& message : messages)
+			out << message;
+		const auto write_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+
+		start = clock_type::now();
+		string_reader_t backend{writer.str};
+		blt::fs::buffered_reader_t buffered{backend};
+		blt::fs::reader_serializer_t in{buffered, encoding};
+		for (const auto& message : messages)
+		{
+			message_t read;
+			in >> read;
+			BLT_ASSERT(read == message);
+		}
+		const auto read_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+
+		BLT_INFO("{} messages {}: {} bytes, write {:.2f}ms, read {:.2f}ms", messages.size(),
+				encoding == serializer_encoding_t::FIXED ? "fixed" : "varint", writer.str.size(), write_ms, read_ms);
+	}
+}
+
+void benchmark_serializer()
+{
+	constexpr blt::i32 count = 1000000;
+	string_writer_t writer;
+	blt::fs::writer_serializer_t out{writer};
+	for (blt::i32 i = 0; i < count; i++)
+		out << i;
+
+	const auto run = [](blt::fs::reader_t& reader) {
+		const auto start = clock_type::now();
+		blt::fs::reader_serializer_t in{reader};
+		blt::i64 sum = 0;
+		for (blt::i32 i = 0; i < count; i++)
+		{
+			blt::i32 value;
+			in >> value;
+			sum += value;
+		}
+		BLT_ASSERT(sum == static_cast<blt::i64>(count) * (count - 1) / 2);
+		return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+	};
+
+	std::stringstream direct_stream{writer.str};
+	blt::fs::fstream_reader_t direct{direct_stream};
+	const auto direct_ms = run(direct);
+
+	std::stringstream buffered_stream{writer.str};
+	blt::fs::fstream_reader_t backend{buffered_stream};
+	blt::fs::buffered_reader_t buffered{backend};
+	const auto buffered_ms = run(buffered);
+
+	BLT_INFO("Reading {} ints: fstream_reader_t {:.2f}ms, buffered_reader_t {:.2f}ms", count, direct_ms, buffered_ms);
+}
+
+int main()
+{
+	test_buffered_reader();
+	test_serializer();
+	test_varint();
+	test_reflection();
+	benchmark_serializer();
+	benchmark_encodings();
+}
@@ -18,6 +18,7 @@
 #include <blt_tests.h>
 #include <blt/std/queue.h>
 #include <blt/std/binary_tree.h>
+#include <deque>
 #include <queue>
 #include <stack>
 #include <vector>
@@ -112,12 +113,71 @@ namespace blt
         BLT_PRINT_PROFILE(readProfile);
     }
     
+    void run_queue_size(size_t size)
+    {
+        auto fillProfile = "Queue Fill (" + std::to_string(size) += ')';
+        auto steadyProfile = "Queue Steady State (" + std::to_string(size) += ')';
+        
+        std::deque<int> std_deque;
+        BLT_START_INTERVAL(fillProfile, "std::deque");
+        for (size_t i = 0; i < size; i++)
+            std_deque.push_back(static_cast<int>(i));
+        while (!std_deque.empty())
+        {
+            blt::black_box(std_deque.front());
+            std_deque.pop_front();
+        }
+        BLT_END_INTERVAL(fillProfile, "std::deque");
+        
+        blt::flat_queue<int> blt_flat_queue;
+        BLT_START_INTERVAL(fillProfile, "blt::flat_queue");
+        for (size_t i = 0; i < size; i++)
+            blt_flat_queue.push(static_cast<int>(i));
+        while (!blt_flat_queue.empty())
+        {
+            blt::black_box(blt_flat_queue.front());
+            blt_flat_queue.pop();
+        }
+        BLT_END_INTERVAL(fillProfile, "blt::flat_queue");
+        
+        // a long running FIFO with a small window of live elements, the flat_queue should not allocate at all once warm
+        constexpr size_t window = 64;
+        for (size_t i = 0; i < window; i++)
+        {
+            std_deque.push_back(static_cast<int>(i));
+            blt_flat_queue.push(static_cast<int>(i));
+        }
+        
+        BLT_START_INTERVAL(steadyProfile, "std::deque");
+        for (size_t i = 0; i < size; i++)
+        {
+            blt::black_box(std_deque.front());
+            std_deque.pop_front();
+            std_deque.push_back(static_cast<int>(i));
+        }
+        BLT_END_INTERVAL(steadyProfile, "std::deque");
+        
+        BLT_START_INTERVAL(steadyProfile, "blt::flat_queue");
+        for (size_t i = 0; i < size; i++)
+        {
+            blt::black_box(blt_flat_queue.front());
+            blt_flat_queue.pop();
+            blt_flat_queue.push(static_cast<int>(i));
+        }
+        BLT_END_INTERVAL(steadyProfile, "blt::flat_queue");
+        
+        BLT_PRINT_PROFILE(fillProfile);
+        BLT_PRINT_PROFILE(steadyProfile);
+    }
+    
     void test::data::run()
     {
 //        auto max = static_cast<size_t>(std::log10(max_size));
 //        auto min = static_cast<size_t>(std::log10(min_size));
 //        for (size_t i = min; i <= max; i++)
 //            run_size(exp(10, i));
+        for (size_t i = 4; i <= 7; i++)
+            run_queue_size(exp(10, i));
         
         double d = -1;
         char data[sizeof(d)]{};
@@ -0,0 +1,288 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <blt/logging/logging.h>
+#include <blt/std/assert.h>
+#include <blt/std/executor.h>
+#include <blt/std/thread.h>
+
+using clock_type = std::chrono::steady_clock;
+
+std::atomic<blt::size_t> global_allocations = 0;
+
+void* operator new(const std::size_t size)
+{
+	global_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (auto* ptr = std::malloc(size))
+		return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+struct bench_result_t
+{
+	double tasks_per_second;
+	double p50_latency_us;
+	double p99_latency_us;
+};
+
+void wait_for(const std::atomic<blt::size_t>& counter, const blt::size_t value)
+{
+	while (counter.load(std::memory_order_acquire) < value)
+		std::this_thread::yield();
+}
+
+double percentile(std::vector<blt::i64>& values, const double p)
+{
+	std::sort(values.begin(), values.end());
+	const auto index = static_cast<blt::size_t>(p * static_cast<double>(values.size() - 1));
+	return static_cast<double>(values[index]) / 1000.0;
+}
+
+template <typename Submit>
+bench_result_t run_bench(Submit&& submit, const blt::size_t throughput_tasks, const blt::size_t latency_tasks)
+{
+	bench_result_t result{};
+
+	std::atomic<blt::size_t> done = 0;
+	const auto start = clock_type::now();
+	for (blt::size_t i = 0; i < throughput_tasks; i++)
+		submit([&done]() {
+			done.fetch_add(1, std::memory_order_release);
+		});
+	wait_for(done, throughput_tasks);
+	const auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+	result.tasks_per_second = static_cast<double>(throughput_tasks) / seconds;
+
+	// latency is measured with sparse submissions so the workers have a chance to go idle between tasks
+	std::vector<blt::i64> latencies(latency_tasks);
+	done = 0;
+	for (blt::size_t i = 0; i < latency_tasks; i++)
+	{
+		auto submitted = clock_type::now();
+		submit([&latencies, &done, submitted, i]() {
+			latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - submitted).count();
+			done.fetch_add(1, std::memory_order_release);
+		});
+		wait_for(done, i + 1);
+		std::this_thread::sleep_for(std::chrono::microseconds(500));
+	}
+	result.p50_latency_us = percentile(latencies, 0.5);
+	result.p99_latency_us = percentile(latencies, 0.99);
+	return result;
+}
+
+void print_result(const char* name, const bench_result_t& result)
+{
+	BLT_INFO("{:<28} {:>12} tasks/s  p50 {:>10.2f}us  p99 {:>10.2f}us", name, static_cast<blt::u64>(result.tasks_per_second),
+			result.p50_latency_us, result.p99_latency_us);
+}
+
+void test_executor_correctness()
+{
+	blt::work_stealing_executor executor{4};
+
+	constexpr blt::size_t count = 100000;
+	std::atomic<blt::size_t> done = 0;
+	std::vector<std::atomic<int>> ran(count);
+	for (blt::size_t i = 0; i < count; i++)
+		executor.execute([&ran, &done, i]() {
+			ran[i].fetch_add(1, std::memory_order_relaxed);
+			done.fetch_add(1, std::memory_order_release);
+		});
+	wait_for(done, count);
+	for (const auto& v : ran)
+		BLT_ASSERT(v.load() == 1 && "Every task must run exactly once");
+
+	// tasks spawning tasks exercise the worker local deques and stealing
+	done = 0;
+	constexpr blt::size_t fan_out = 64;
+	for (blt::size_t i = 0; i < fan_out; i++)
+		executor.execute([&executor, &done]() {
+			BLT_ASSERT(executor.in_worker());
+			for (blt::size_t j = 0; j < fan_out; j++)
+				executor.execute([&done]() {
+					done.fetch_add(1, std::memory_order_release);
+				});
+		});
+	wait_for(done, fan_out * fan_out);
+
+	// workers park when idle, make sure they wake back up
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	done = 0;
+	executor.execute([&done]() {
+		done.fetch_add(1, std::memory_order_release);
+	});
+	wait_for(done, 1);
+	BLT_INFO("Executor correctness tests passed");
+}
+
+void test_task_handles()
+{
+	blt::work_stealing_executor executor{4};
+
+	auto value = executor.submit([]() {
+		return 21;
+	});
+	auto doubled = value.then([](const int v) {
+		return v * 2;
+	});
+	BLT_ASSERT(doubled.get() == 42);
+	BLT_ASSERT(value.ready() && value.get() == 21);
+
+	auto chained = executor.submit([]() {}).then([]() {
+		return std::string("chained");
+	});
+	BLT_ASSERT(chained.get() == "chained");
+
+	// failures are carried through the handle and skip dependent continuations
+	bool continuation_ran = false;
+	auto failing = executor.submit([]() -> int {
+		throw std::runtime_error("task failure");
+	}).then([&continuation_ran](int) {
+		continuation_ran = true;
+	});
+	bool caught = false;
+	try
+	{
+		failing.get();
+	} catch (const std::runtime_error&)
+	{
+		caught = true;
+	}
+	BLT_ASSERT(caught && !continuation_ran);
+
+	std::atomic<blt::size_t> done = 0;
+	auto a = executor.submit([&done]() {
+		done.fetch_add(1);
+	});
+	auto b = executor.submit([&done]() {
+		done.fetch_add(1);
+		return 1.0f;
+	});
+	blt::when_all(a, b).wait();
+	BLT_ASSERT(done == 2);
+
+	// workers waiting on nested tasks run other work instead of blocking the pool
+	std::vector<blt::task_handle<blt::size_t>> batch;
+	for (blt::size_t i = 0; i < 64; i++)
+		batch.push_back(executor.submit([&executor, i]() {
+			blt::size_t sum = 0;
+			std::vector<blt::task_handle<blt::size_t>> inner;
+			for (blt::size_t j = 0; j < 16; j++)
+				inner.push_back(executor.submit([i, j]() {
+					return i * j;
+				}));
+			for (auto& handle : inner)
+				sum += handle.get();
+			return sum;
+		}));
+	blt::when_all(batch).wait();
+	for (blt::size_t i = 0; i < batch.size(); i++)
+		BLT_ASSERT(batch[i].get() == i * 120);
+
+	// once the per thread pools are warm, submitting and waiting should not touch the heap
+	std::vector<blt::task_handle<int>> handles(1024);
+	for (int round = 0; round < 4; round++)
+	{
+		const auto before = global_allocations.load();
+		for (auto& handle : handles)
+			handle = executor.submit([]() {
+				return 1;
+			});
+		for (auto& handle : handles)
+			handle.wait();
+		if (round == 3)
+		{
+			const auto allocated = global_allocations.load() - before;
+			BLT_INFO("Steady state heap allocations for {} submits: {}", handles.size(), allocated);
+			BLT_ASSERT(allocated < handles.size() / 16);
+		}
+	}
+	BLT_INFO("Task handle tests passed");
+}
+
+void test_remote_free_on_exit()
+{
+	using allocator = blt::detail::task_allocator_t;
+	// the owning thread exits while another thread is still freeing its blocks, the pool has to outlive both
+	for (int round = 0; round < 200; round++)
+	{
+		std::vector<void*> blocks;
+		std::atomic_bool allocated = false;
+		std::thread owner([&]() {
+			for (int i = 0; i < 64; i++)
+				blocks.push_back(allocator::allocate(static_cast<blt::size_t>(16 + i * 4)));
+			allocated.store(true, std::memory_order_release);
+		});
+		std::thread freer([&]() {
+			while (!allocated.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			for (auto* block : blocks)
+				allocator::deallocate(block);
+		});
+		owner.join();
+		freer.join();
+	}
+	BLT_INFO("Remote free on exit passed");
+}
+
+int main()
+{
+	test_executor_correctness();
+	test_task_handles();
+	test_remote_free_on_exit();
+
+	const auto threads = std::max(2u, std::thread::hardware_concurrency());
+	{
+		blt::thread_pool<true> pool{threads};
+		print_result("blt::thread_pool<true>", run_bench([&pool](auto&& func) {
+			pool.execute(func);
+		}, 100000, 100));
+		pool.stop();
+	}
+	{
+		blt::work_stealing_executor executor{threads};
+		print_result("blt::work_stealing_executor", run_bench([&executor](auto&& func) {
+			executor.execute(func);
+		}, 1000000, 100));
+	}
+	{
+		blt::work_stealing_executor executor{threads};
+		print_result("work_stealing_executor::submit", run_bench([&executor](auto&& func) {
+			executor.submit(func);
+		}, 1000000, 100));
+	}
+}